@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "matrix.h"
+#include "matrix-io.h"
+#include "simd.h"
+#include "thread-pool.h"
+
+#define MAX_REPETITIONS 1000
+
+typedef struct BenchmarkOptions {
+    int warmups;
+    int repetitions;
+    int quick;
+    int json;
+} BenchmarkOptions;
+
+typedef struct BenchmarkCase {
+    const char *operation;
+    int m, k, n;
+    Matrix *a;
+    Matrix *b;
+    char *filename;
+} BenchmarkCase;
+
+typedef struct BenchmarkResult {
+    int failed;
+    double median;
+    double p95;
+    double min;
+    double flops;
+    double bytes;
+} BenchmarkResult;
+
+int printed_results = 0;
+
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return x < y ? -1 : x > y;
+}
+
+Matrix* random_matrix(int rows, int cols, unsigned seed) {
+    Matrix *m = new_matrix(rows, cols).value;
+
+    srand(seed);
+
+    for (int i = 1; i <= rows; i++) {
+        for (int j = 1; j <= cols; j++) {
+            matrix_set(m, i, j, (rand() % 2001 - 1000) / 100.0);
+        }
+    }
+
+    return m;
+}
+
+// Runs the case once and returns its wall time in seconds, or a negative
+// value if the operation failed.
+double run_once(BenchmarkCase *c) {
+    Matrix loaded;
+    MatrixResult result = { 0 };
+    int success = 0;
+    double begin = now_seconds();
+
+    if (strcmp(c->operation, "sum") == 0) {
+        result = matrix_sum(c->a, c->b);
+    } else if (strcmp(c->operation, "subtract") == 0) {
+        result = matrix_subtract(c->a, c->b);
+    } else if (strcmp(c->operation, "multiply") == 0) {
+        result = matrix_multiply(c->a, c->b);
+    } else if (strcmp(c->operation, "transpose") == 0) {
+        result = matrix_transpose(c->a);
+    } else if (strcmp(c->operation, "transpose-ip") == 0) {
+        success = matrix_transpose_in_place(c->a).success;
+    } else if (strcmp(c->operation, "det-lu-dec") == 0) {
+        success = matrix_determinant_lu_decomposition(c->a).success;
+    } else if (strcmp(c->operation, "det-laplace") == 0) {
+        success = matrix_determinant_laplace(c->a).success;
+    } else if (strcmp(c->operation, "write") == 0) {
+        success = write_matrix_to_file(c->a, c->filename);
+    } else if (strcmp(c->operation, "read") == 0) {
+        success = read_matrix_from_file(&loaded, c->filename);
+    }
+
+    double elapsed = now_seconds() - begin;
+
+    if (result.success) {
+        success = 1;
+        delete_matrix(result.value);
+    } else if (success && strcmp(c->operation, "read") == 0) {
+        Matrix *copy = malloc(sizeof(Matrix));
+
+        if (copy == NULL) return -1;
+
+        *copy = loaded;
+        delete_matrix(copy);
+    }
+
+    return success ? elapsed : -1;
+}
+
+long file_size(char *filename) {
+    FILE *file = fopen(filename, "rb");
+
+    if (file == NULL) return 0;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+
+    return size;
+}
+
+// Floating point operations and bytes moved by one run of the case; the
+// byte count is the minimum traffic: every operand read once, the result
+// written once.
+void count_work(BenchmarkCase *c, BenchmarkResult *r) {
+    double m = c->m, k = c->k, n = c->n;
+
+    r->flops = 0;
+    r->bytes = 0;
+
+    if (strcmp(c->operation, "sum") == 0 || strcmp(c->operation, "subtract") == 0) {
+        r->flops = m * n;
+        r->bytes = 3 * m * n * sizeof(double);
+    } else if (strcmp(c->operation, "multiply") == 0) {
+        r->flops = 2 * m * n * k;
+        r->bytes = (m * k + k * n + m * n) * sizeof(double);
+    } else if (strcmp(c->operation, "transpose") == 0 || strcmp(c->operation, "transpose-ip") == 0) {
+        r->bytes = 2 * m * n * sizeof(double);
+    } else if (strcmp(c->operation, "det-lu-dec") == 0) {
+        r->flops = 2.0 / 3.0 * n * n * n;
+        r->bytes = 2 * n * n * sizeof(double);
+    } else if (strcmp(c->operation, "read") == 0 || strcmp(c->operation, "write") == 0) {
+        r->bytes = file_size(c->filename);
+    }
+}
+
+// A case whose operation fails is reported as failed, without timings.
+BenchmarkResult run_case(BenchmarkCase *c, BenchmarkOptions *options) {
+    double samples[MAX_REPETITIONS];
+    BenchmarkResult r = { .failed = 1 };
+
+    for (int i = 0; i < options->warmups; i++) {
+        if (run_once(c) < 0) return r;
+    }
+
+    for (int i = 0; i < options->repetitions; i++) {
+        samples[i] = run_once(c);
+
+        if (samples[i] < 0) return r;
+    }
+
+    qsort(samples, options->repetitions, sizeof(double), compare_doubles);
+
+    int p95 = (int) (0.95 * (options->repetitions - 1) + 0.5);
+
+    r.failed = 0;
+    r.median = options->repetitions % 2 == 1
+        ? samples[options->repetitions / 2]
+        : (samples[options->repetitions / 2 - 1] + samples[options->repetitions / 2]) / 2;
+    r.p95 = samples[p95];
+    r.min = samples[0];
+    count_work(c, &r);
+
+    return r;
+}
+
+void print_result(BenchmarkCase *c, BenchmarkResult *r, BenchmarkOptions *options) {
+    double gflops = r->flops > 0 ? r->flops / r->median / 1e9 : 0;
+    double gbytes = r->bytes > 0 ? r->bytes / r->median / 1e9 : 0;
+    const char *format = c->filename == NULL ? "" : strrchr(c->filename, '.') + 1;
+
+    if (r->failed) {
+        if (options->json) {
+            printf(
+                "%s\n    {\"operation\": \"%s\", \"format\": \"%s\", \"m\": %d, \"k\": %d, \"n\": %d, \"failed\": true}",
+                printed_results > 0 ? "," : "", c->operation, format, c->m, c->k, c->n
+            );
+        } else {
+            printf("%-12s %-5s %6d x %6d x %6d  failed\n", c->operation, format, c->m, c->k, c->n);
+        }
+    } else if (options->json) {
+        printf(
+            "%s\n    {\"operation\": \"%s\", \"format\": \"%s\", \"m\": %d, \"k\": %d, \"n\": %d, "
+            "\"median_s\": %.9f, \"p95_s\": %.9f, \"min_s\": %.9f, \"gflops\": %.3f, \"gbytes_per_s\": %.3f}",
+            printed_results > 0 ? "," : "",
+            c->operation, format, c->m, c->k, c->n, r->median, r->p95, r->min, gflops, gbytes
+        );
+    } else {
+        printf(
+            "%-12s %-5s %6d x %6d x %6d  median %10.6fs  p95 %10.6fs  %8.2f GFLOP/s  %8.2f GB/s\n",
+            c->operation, format, c->m, c->k, c->n, r->median, r->p95, gflops, gbytes
+        );
+    }
+
+    printed_results++;
+}
+
+void bench(BenchmarkCase c, BenchmarkOptions *options) {
+    BenchmarkResult r = run_case(&c, options);
+    print_result(&c, &r, options);
+}
+
+void bench_shapes(BenchmarkOptions *options) {
+    int squares[] = { 64, 256, 1024, 2048 };
+    int square_count = options->quick ? 2 : 4;
+
+    for (int s = 0; s < square_count; s++) {
+        int n = squares[s];
+        Matrix *a = random_matrix(n, n, 1);
+        Matrix *b = random_matrix(n, n, 2);
+
+        bench((BenchmarkCase) { .operation = "sum", .m = n, .k = 1, .n = n, .a = a, .b = b }, options);
+        bench((BenchmarkCase) { .operation = "subtract", .m = n, .k = 1, .n = n, .a = a, .b = b }, options);
+        bench((BenchmarkCase) { .operation = "transpose", .m = n, .k = 1, .n = n, .a = a }, options);
+        bench((BenchmarkCase) { .operation = "transpose-ip", .m = n, .k = 1, .n = n, .a = a }, options);
+        bench((BenchmarkCase) { .operation = "multiply", .m = n, .k = n, .n = n, .a = a, .b = b }, options);
+        bench((BenchmarkCase) { .operation = "det-lu-dec", .m = n, .k = n, .n = n, .a = a }, options);
+
+        delete_matrix(a);
+        delete_matrix(b);
+    }
+
+    // Tall and skinny, short and wide, and a rank-k update shaped product.
+    int shapes[][3] = { { 4096, 64, 64 }, { 64, 64, 4096 }, { 1024, 16, 1024 } };
+
+    for (int s = 0; s < 3; s++) {
+        int m = shapes[s][0], k = shapes[s][1], n = shapes[s][2];
+        Matrix *a = random_matrix(m, k, 3);
+        Matrix *b = random_matrix(k, n, 4);
+
+        bench((BenchmarkCase) { .operation = "multiply", .m = m, .k = k, .n = n, .a = a, .b = b }, options);
+        bench((BenchmarkCase) { .operation = "transpose", .m = m, .k = 1, .n = k, .a = a }, options);
+        bench((BenchmarkCase) { .operation = "transpose-ip", .m = m, .k = 1, .n = k, .a = a }, options);
+
+        delete_matrix(a);
+        delete_matrix(b);
+    }
+
+    int laplace_sizes[] = { 6, 8, 10 };
+
+    for (int s = 0; s < (options->quick ? 2 : 3); s++) {
+        int n = laplace_sizes[s];
+        Matrix *a = random_matrix(n, n, 5);
+
+        bench((BenchmarkCase) { .operation = "det-laplace", .m = n, .k = n, .n = n, .a = a }, options);
+
+        delete_matrix(a);
+    }
+}
+
+void bench_files(BenchmarkOptions *options) {
+    int n = options->quick ? 256 : 1024;
+    char *filenames[] = { "benchmark-matrix.mat", "benchmark-matrix.matb" };
+    Matrix *a = random_matrix(n, n, 6);
+
+    for (int f = 0; f < 2; f++) {
+        bench((BenchmarkCase) { .operation = "write", .m = n, .k = 1, .n = n, .a = a, .filename = filenames[f] }, options);
+        bench((BenchmarkCase) { .operation = "read", .m = n, .k = 1, .n = n, .filename = filenames[f] }, options);
+        unlink(filenames[f]);
+    }
+
+    delete_matrix(a);
+}
+
+void main(int argc, char* argv[]) {
+    BenchmarkOptions options = { .warmups = 1, .repetitions = 5, .quick = 0, .json = 0 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            options.json = 1;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            options.quick = 1;
+        } else if (strcmp(argv[i], "--warmups") == 0 && i + 1 < argc) {
+            options.warmups = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            options.repetitions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_pool_set_size(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--strassen") == 0) {
+            matrix_set_multiply_mode(MATRIX_MULTIPLY_STRASSEN);
+        } else {
+            printf("Usage: %s [--json] [--quick] [--warmups N] [--repetitions N] [--threads N] [--strassen]\n", argv[0]);
+            return;
+        }
+    }
+
+    if (options.warmups < 0) options.warmups = 0;
+    if (options.repetitions < 1) options.repetitions = 1;
+    if (options.repetitions > MAX_REPETITIONS) options.repetitions = MAX_REPETITIONS;
+
+    if (options.json) {
+        printf(
+            "{\n  \"simd\": \"%s\",\n  \"threads\": %d,\n  \"warmups\": %d,\n  \"repetitions\": %d,\n  \"results\": [",
+            simd_kernels()->name, thread_pool_size(), options.warmups, options.repetitions
+        );
+    } else {
+        printf("simd: %s, threads: %d\n", simd_kernels()->name, thread_pool_size());
+    }
+
+    bench_shapes(&options);
+    bench_files(&options);
+
+    if (options.json) {
+        printf("\n  ]\n}\n");
+    }
+}
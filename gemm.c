@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include "gemm.h"
+#include "matrix.h"
+#include "simd.h"
+#include "thread-pool.h"
+
+// Cache blocking: a KC x NC panel of B stays in L3, an MC x KC block of A
+// stays in L2 and a KC x NR sliver of B streams through L1 while the
+// micro-kernel keeps an MR x NR tile of C in registers.
+#define GEMM_MC 96
+#define GEMM_KC 256
+#define GEMM_NC 4096
+
+int _gemm_min(int a, int b) {
+    return a < b ? a : b;
+}
+
+// Packs an mc x kc block of A into MR-row micro-panels, each stored
+// column by column and padded with zeros up to MR rows.
+void _gemm_pack_a(int mr, int mc, int kc, const double *a, int lda, double *packed) {
+    for (int i = 0; i < mc; i += mr) {
+        int rows = _gemm_min(mr, mc - i);
+
+        for (int p = 0; p < kc; p++) {
+            for (int r = 0; r < mr; r++) {
+                *packed++ = r < rows ? a[(size_t) (i + r) * lda + p] : 0;
+            }
+        }
+    }
+}
+
+// Packs NR-column micro-panels [begin, end) of a kc x nc panel of B, each
+// stored row by row and padded with zeros up to NR columns.
+void _gemm_pack_b(int nr, int kc, int nc, const double *b, int ldb, double *packed, int begin, int end) {
+    packed += (size_t) begin * nr * kc;
+
+    for (int j = begin * nr; j < end * nr && j < nc; j += nr) {
+        int cols = _gemm_min(nr, nc - j);
+
+        for (int p = 0; p < kc; p++) {
+            const double *b_row = b + (size_t) p * ldb + j;
+
+            for (int c = 0; c < nr; c++) {
+                *packed++ = c < cols ? b_row[c] : 0;
+            }
+        }
+    }
+}
+
+void _gemm_macro_kernel(
+    const MatrixKernels *kernels,
+    int mc, int nc, int kc,
+    double alpha,
+    const double *packed_a,
+    const double *packed_b,
+    double *c, int ldc
+) {
+    int mr = kernels->gemm_mr;
+    int nr = kernels->gemm_nr;
+    double edge[SIMD_GEMM_MAX_MR * SIMD_GEMM_MAX_NR];
+
+    for (int j = 0; j < nc; j += nr) {
+        int cols = _gemm_min(nr, nc - j);
+
+        for (int i = 0; i < mc; i += mr) {
+            int rows = _gemm_min(mr, mc - i);
+            const double *a_panel = packed_a + (size_t) i * kc;
+            const double *b_panel = packed_b + (size_t) j * kc;
+            double *c_tile = c + (size_t) i * ldc + j;
+
+            if (rows == mr && cols == nr) {
+                kernels->gemm_kernel(kc, a_panel, b_panel, c_tile, ldc, alpha);
+                continue;
+            }
+
+            memset(edge, 0, sizeof(double) * mr * nr);
+            kernels->gemm_kernel(kc, a_panel, b_panel, edge, nr, alpha);
+
+            for (int r = 0; r < rows; r++) {
+                for (int s = 0; s < cols; s++) {
+                    c_tile[(size_t) r * ldc + s] += edge[r * nr + s];
+                }
+            }
+        }
+    }
+}
+
+typedef struct GemmContext {
+    const MatrixKernels *kernels;
+    int m, nc, kc;
+    double alpha;
+    const double *a;
+    int lda;
+    const double *b;
+    int ldb;
+    double *packed_b;
+    double *packed_a;
+    double *c;
+    int ldc;
+    int column_groups;
+    int group_width;
+} GemmContext;
+
+void _gemm_pack_b_task(int begin, int end, void *context) {
+    GemmContext *g = context;
+    _gemm_pack_b(g->kernels->gemm_nr, g->kc, g->nc, g->b, g->ldb, g->packed_b, begin, end);
+}
+
+// Each work item is one MC-row block of C restricted to one group of
+// NR-column micro-panels. The A block is packed per item into the calling
+// thread's buffer, which costs little next to the multiply that follows.
+void _gemm_block_task(int begin, int end, void *context) {
+    GemmContext *g = context;
+    int mr = g->kernels->gemm_mr;
+    double *packed_a = g->packed_a + (size_t) thread_pool_thread_index() * GEMM_MC * GEMM_KC;
+
+    for (int item = begin; item < end; item++) {
+        int ic = item / g->column_groups * GEMM_MC;
+        int jr = item % g->column_groups * g->group_width;
+
+        if (jr >= g->nc) continue;
+
+        int mc = _gemm_min(GEMM_MC, g->m - ic);
+        int width = _gemm_min(g->group_width, g->nc - jr);
+
+        _gemm_pack_a(mr, mc, g->kc, g->a + (size_t) ic * g->lda, g->lda, packed_a);
+        _gemm_macro_kernel(
+            g->kernels, mc, width, g->kc, g->alpha,
+            packed_a, g->packed_b + (size_t) jr * g->kc,
+            g->c + (size_t) ic * g->ldc + jr, g->ldc
+        );
+    }
+}
+
+int gemm(
+    int m, int n, int k,
+    double alpha,
+    const double *a, int lda,
+    const double *b, int ldb,
+    double *c, int ldc
+) {
+    if (m <= 0 || n <= 0 || k <= 0) return 1;
+
+    const MatrixKernels *kernels = simd_kernels();
+    int nr = kernels->gemm_nr;
+
+    int nc_max = _gemm_min(GEMM_NC, (n + nr - 1) / nr * nr);
+    int kc_max = _gemm_min(GEMM_KC, k);
+
+    int threads = thread_pool_size();
+    MatrixAllocator *allocator = matrix_current_allocator();
+    size_t packed_a_size = (size_t) threads * GEMM_MC * GEMM_KC * sizeof(double);
+    size_t packed_b_size = (size_t) nc_max * kc_max * sizeof(double);
+    void *packed_a = matrix_allocate_scratch(allocator, packed_a_size);
+    void *packed_b = matrix_allocate_scratch(allocator, packed_b_size);
+
+    if (packed_a == NULL || packed_b == NULL) {
+        matrix_release(allocator, packed_b, packed_b_size);
+        matrix_release(allocator, packed_a, packed_a_size);
+        return 0;
+    }
+
+    GemmContext g = { 0 };
+    g.kernels = kernels;
+    g.m = m;
+    g.alpha = alpha;
+    g.lda = lda;
+    g.ldb = ldb;
+    g.ldc = ldc;
+    g.packed_a = packed_a;
+    g.packed_b = packed_b;
+
+    int row_blocks = (m + GEMM_MC - 1) / GEMM_MC;
+
+    for (int jc = 0; jc < n; jc += GEMM_NC) {
+        g.nc = _gemm_min(GEMM_NC, n - jc);
+
+        int panels = (g.nc + nr - 1) / nr;
+
+        // Split the columns too when there are too few row blocks to keep
+        // every thread busy (short and wide products).
+        g.column_groups = row_blocks >= threads * 2 ? 1 : (threads * 2 + row_blocks - 1) / row_blocks;
+        if (g.column_groups > panels) g.column_groups = panels;
+        g.group_width = (panels + g.column_groups - 1) / g.column_groups * nr;
+
+        for (int pc = 0; pc < k; pc += GEMM_KC) {
+            g.kc = _gemm_min(GEMM_KC, k - pc);
+            g.a = a + pc;
+            g.b = b + (size_t) pc * ldb + jc;
+            g.c = c + jc;
+
+            long flops_per_item = 2L * GEMM_MC * g.group_width * g.kc;
+
+            thread_pool_parallel_for(0, panels, thread_pool_grain((long) nr * g.kc, 1 << 16), _gemm_pack_b_task, &g);
+            thread_pool_parallel_for(
+                0, row_blocks * g.column_groups,
+                thread_pool_grain(flops_per_item, 1 << 22),
+                _gemm_block_task, &g
+            );
+        }
+    }
+
+    matrix_release(allocator, packed_b, packed_b_size);
+    matrix_release(allocator, packed_a, packed_a_size);
+
+    return 1;
+}
@@ -0,0 +1,15 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+// Row-major C += alpha * A * B, where A is m x k, B is k x n and C is m x n.
+// lda, ldb and ldc are the row strides (in elements) of each operand.
+// Returns 0 if the packing buffers could not be allocated.
+int gemm(
+    int m, int n, int k,
+    double alpha,
+    const double *a, int lda,
+    const double *b, int ldb,
+    double *c, int ldc
+);
+
+#endif // GEMM_H
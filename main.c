@@ -1,13 +1,23 @@
 #include <stdio.h>
 #include <string.h>
 #include "matrix.h"
+#include "matrix-cache.h"
+#include "matrix-io.h"
+#include "matrix-expression.h"
+#include "matrix-ooc.h"
+#include "matrix-server.h"
+#include "matrix-stats.h"
+#include "simd.h"
+#include "sparse-matrix.h"
+#include "strassen.h"
+#include "thread-pool.h"
 #include <stdlib.h>
-#include <ctype.h>
+#include <limits.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-#define FILE_READER_BUFFER_SIZE 1000
-
-#define OPERATIONS_SIZE 7
+#define OPERATIONS_SIZE 16
 
 typedef enum MatrixOperationType {
   SUM,
@@ -17,9 +27,24 @@ typedef enum MatrixOperationType {
   DET_LAPLACE,
   DET_LU_DEC,
   TRANSPOSE,
+  CONVERT,
+  SOLVE,
+  INVERSE,
+  EXPRESSION,
+  BATCH_MULTIPLY,
+  BATCH_DET,
+  BATCH_INVERSE,
+  BATCH_TRANSPOSE,
+  SERVE,
   INVALID_OPERATION
 } MatrixOperationType;
 
+// An input matrix, held in compressed form when it is sparse enough.
+typedef struct MatrixOperand {
+  Matrix dense;
+  SparseMatrix *sparse;
+} MatrixOperand;
+
 typedef struct MatrixOperation {
   Matrix *a;
   Matrix *b;
@@ -33,196 +58,843 @@ char OPERATIONS[OPERATIONS_SIZE][20] = {
   "--det",
   "--det-laplace",
   "--det-lu-dec",
-  "--transpose"
+  "--transpose",
+  "--convert",
+  "--solve",
+  "--inverse",
+  "--expr",
+  "--batch-multiply",
+  "--batch-det",
+  "--batch-inverse",
+  "--batch-transpose",
+  "--serve"
 };
 
-void print_matrix_error(MatrixResultCode code) {
-  switch (code) {
-    case MATRIX_DIMENSIONS_MUST_BE_POSITIVE:
-      printf("Validation failed: Matrix dimensions must be greater than 0.");
-      break;
-    case MATRIX_INDEX_ARGUMENT_OUT_OF_BOUNDS:
-      printf("Error: Index out of bounds.");
-      break;
-    case MATRIX_ARGUMENTS_MUST_NOT_BE_NULL:
-      printf("Error: Matrix should not be null.");
-      break;
-    case MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM:
-      printf("Validation failed: Matrices must have the same dimensions to calculate the sum.");
-      break;
-    case MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT:
-      printf("Validation failed: Matrices must have the same dimensions to calculate the subtract.");
-      break;
-    case MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY:
-      printf("Validation failed: Invalid dimensions for calculating multiplication.");
-      break;
-    case MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT:
-      printf("Validation failed: Matrix should be square to calculate the determinant.");
-      break;
-    case MATRIX_INTERNAL_ERROR:
-      printf("Error: Unexpected error occurred.");
-      break;
-    default:
-      printf("Error: Unexpected error occurred.");
-      break;
+MatrixOperationType parse_operation_type(char* operation) {
+  for (int i = 0; i < OPERATIONS_SIZE; i++) {
+    if (strcmp(OPERATIONS[i], operation) == 0) {
+      return i;
+    }
   }
+
+  return INVALID_OPERATION;
+}
+
+// Cache entry the result of the current operation is saved as, empty when
+// it is not cached.
+char result_cache_name[MATRIX_CACHE_NAME_MAX_LENGTH] = "";
+
+// Set by --stats json; the report is text otherwise.
+int stats_json = 0;
+
+void report_stats() {
+  fflush(stdout);
+  matrix_stats_report(stderr, stats_json);
 }
 
-int read_matrix_row(
-  char* buffer,
-  Matrix *matrix,
-  int row
+uint64_t file_size(char *filename) {
+  struct stat info;
+  return filename != NULL && stat(filename, &info) == 0 ? (uint64_t) info.st_size : 0;
+}
+
+// Inputs read so far: the first is timed as the read A phase, the rest as
+// read B.
+int inputs_read = 0;
+
+void add_read_phase(char *filename, double begin) {
+  matrix_stats_add_phase(inputs_read++ == 0 ? MATRIX_STATS_READ_A : MATRIX_STATS_READ_B, begin, file_size(filename));
+}
+
+void add_write_phase(char *filename, double begin) {
+  matrix_stats_add_phase(MATRIX_STATS_WRITE, begin, file_size(filename));
+}
+
+// Wall-clock start of the compute phase.
+double compute_started = 0;
+
+// Starts the compute phase. Returns the CPU clock the "Calculation time"
+// line is measured with.
+clock_t begin_compute() {
+  compute_started = matrix_stats_now();
+  return clock();
+}
+
+clock_t end_compute() {
+  matrix_stats_add_phase(MATRIX_STATS_COMPUTE, compute_started, 0);
+  return clock();
+}
+
+int output_matrix_result(
+  MatrixResult result,
+  char *output_filename,
+  double execution_time
 ) {
-  char *unused_ptr;
-  int col = 0;
-  char current_number[25];
-  int current_number_idx = 0;
-
-  for (int i = 0; i < strlen(buffer); i++) {
-    if (buffer[i] == ',' || buffer[i] == '\n' || buffer[i] == EOF) {
-      current_number[current_number_idx] = '\0';
-      double number = strtod(current_number, &unused_ptr);
-      matrix_set(matrix, row + 1, col + 1, number);
-      strcpy(current_number, "");
-      current_number_idx = 0;
-      col++;
-
-      if (col > matrix->cols) {
-        printf("Invalid file format: Invalid number of columns in matrix row %d. Expected: %d\n", row, matrix->cols);
-        return 0;
+    if (result.success) {
+      if (result_cache_name[0] != '\0') matrix_cache_store(result_cache_name, result.value);
+
+      double begin = matrix_stats_now();
+
+      if (output_filename != NULL) {
+        int written = write_matrix_to_file(result.value, output_filename);
+
+        add_write_phase(output_filename, begin);
+
+        if (written) printf("Success: Resulting matrix was saved to file '%s'.", output_filename);
+      } else {
+        print_matrix(result.value);
+        add_write_phase(NULL, begin);
       }
-    } else if (isdigit(buffer[i]) || buffer[i] == '.' || buffer[i] == '-') {
-      current_number[current_number_idx] = buffer[i];
-      current_number_idx++;
+    } else {
+      print_matrix_error(result.code);
     }
-  }
 
-  if (strlen(current_number) > 0) {
-      current_number[current_number_idx] = '\0';
-      double number = strtod(current_number, &unused_ptr);
+    printf("\nCalculation time: %lfs", execution_time);
+}
+
+// Element type given with --dtype. Without it, binary inputs keep the type
+// they were written with and text inputs read as float64.
+int element_type_requested = 0;
+MatrixElementType requested_element_type = MATRIX_FLOAT64;
+
+// Bytes out-of-core operations may use, given with --memory-limit. Without
+// it operations run in memory, unless an operand is a tiled file.
+size_t memory_limit = 0;
+
+// Set by --stream: sum and subtract read their inputs and write the result
+// a row at a time.
+int streaming = 0;
 
-      matrix_set(matrix, row + 1, col + 1, number);
+// Parses a size in bytes with an optional K, M, G or T suffix.
+int parse_memory_size(const char *text, size_t *size) {
+  char *end = NULL;
+  unsigned long long value = strtoull(text, &end, 10);
+  int shift = 0;
+
+  if (end == text) return 0;
+
+  switch (*end) {
+    case 'K': case 'k': shift = 10; end++; break;
+    case 'M': case 'm': shift = 20; end++; break;
+    case 'G': case 'g': shift = 30; end++; break;
+    case 'T': case 't': shift = 40; end++; break;
   }
 
+  if (*end != '\0' || value == 0 || value > (SIZE_MAX >> shift)) return 0;
+
+  *size = (size_t) value << shift;
   return 1;
 }
 
-int read_matrix_from_file(Matrix *m, char* filename) {
-  int buffer_length = FILE_READER_BUFFER_SIZE;
-  char buffer[FILE_READER_BUFFER_SIZE];
+// Consumes the global options (--threads N, --strassen, --dtype NAME,
+// --precision N, --no-cache, --memory-limit SIZE, --stream and
+// --stats [text|json]) wherever they appear and compacts the remaining arguments in place.
+// Returns the new argument count, or -1 if an option is malformed.
+int parse_options(int argc, char* argv[]) {
+  int positional = 1;
 
-  FILE *file = fopen(filename, "r");
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0) {
+      if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+        printf("Option '--threads' expects a positive number of threads.");
+        return -1;
+      }
 
-  if (file == NULL) {
-    printf("Error: Failed to open file %s", filename);
-    return 0;
-  } 
+      thread_pool_set_size(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--memory-limit") == 0) {
+      if (i + 1 >= argc || !parse_memory_size(argv[i + 1], &memory_limit)) {
+        printf("Option '--memory-limit' expects a size in bytes, such as 512M or 4G.");
+        return -1;
+      }
+
+      i++;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      matrix_stats_set_enabled(1);
+
+      if (i + 1 < argc && (strcmp(argv[i + 1], "json") == 0 || strcmp(argv[i + 1], "text") == 0)) {
+        stats_json = strcmp(argv[++i], "json") == 0;
+      }
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      streaming = 1;
+    } else if (strcmp(argv[i], "--no-cache") == 0) {
+      matrix_cache_set_enabled(0);
+    } else if (strcmp(argv[i], "--strassen") == 0) {
+      matrix_set_multiply_mode(MATRIX_MULTIPLY_STRASSEN);
+    } else if (strcmp(argv[i], "--dtype") == 0) {
+      if (i + 1 >= argc || !matrix_element_type_from_name(argv[i + 1], &requested_element_type)) {
+        printf("Option '--dtype' expects one of float64, float32, int32 or int64.");
+        return -1;
+      }
+
+      element_type_requested = 1;
+      i++;
+    } else if (strcmp(argv[i], "--precision") == 0) {
+      char *end = NULL;
+      long precision = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+
+      if (end == NULL || *end != '\0' || end == argv[i + 1] || precision < 0 || precision > MATRIX_OUTPUT_PRECISION_MAX) {
+        printf("Option '--precision' expects a number of decimals from 0 to %d.", MATRIX_OUTPUT_PRECISION_MAX);
+        return -1;
+      }
+
+      matrix_set_output_precision((int) precision);
+      i++;
+    } else {
+      argv[positional++] = argv[i];
+    }
+  }
+
+  argv[positional] = NULL;
+
+  return positional;
+}
+
+// Saves a determinant as a 1x1 matrix under result_cache_name.
+void cache_determinant(MatrixElementType element_type, double det, int64_t integer_det) {
+  if (result_cache_name[0] == '\0') return;
+
+  MatrixResult cached = new_typed_matrix(1, 1, element_type);
+
+  if (!cached.success) return;
+
+  if (element_type == MATRIX_INT64) {
+    cached.value->int64_values[0] = integer_det;
+  } else {
+    cached.value->values[0] = det;
+  }
+
+  matrix_cache_store(result_cache_name, cached.value);
+  delete_matrix(cached.value);
+}
+
+void print_determinant(double det) {
+  char text[MATRIX_TEXT_ELEMENT_MAX_LENGTH];
+  int length = format_matrix_number(text, det);
+
+  cache_determinant(MATRIX_FLOAT64, det, 0);
+  printf("det = %.*s\n", length, text);
+}
+
+double calc_execution_time(clock_t begin, clock_t end) {
+  return (double)(end - begin) / CLOCKS_PER_SEC;
+}
+
+void output_sparse_matrix_result(
+  SparseMatrixResult result,
+  char *output_filename,
+  double execution_time
+) {
+  if (result.success && output_filename != NULL && has_sparse_matrix_extension(output_filename)) {
+    double begin = matrix_stats_now();
+    int written = write_sparse_matrix_to_file(result.value, output_filename);
+
+    add_write_phase(output_filename, begin);
+
+    if (written) {
+      printf("Success: Resulting matrix was saved to file '%s'.", output_filename);
+    }
+
+    printf("\nCalculation time: %lfs", execution_time);
+    delete_sparse_matrix(result.value);
+    return;
+  }
+
+  MatrixResult dense = { 0, result.code, NULL };
+
+  if (result.success) {
+    dense = sparse_matrix_to_dense(result.value);
+    delete_sparse_matrix(result.value);
+  }
+
+  output_matrix_result(dense, output_filename, execution_time);
+}
+
+// Reads a dense matrix in the --dtype element type, if one was given. Sparse
+// files are expanded.
+int load_input_matrix(Matrix *m, char *filename) {
+  if (has_sparse_matrix_extension(filename)) {
+    SparseMatrix *s;
+
+    if (!read_sparse_matrix_from_file(&s, filename)) return 0;
+
+    MatrixResult dense = sparse_matrix_to_dense(s);
+    delete_sparse_matrix(s);
+
+    if (dense.success && requested_element_type != MATRIX_FLOAT64) {
+      MatrixResult converted = matrix_convert(dense.value, requested_element_type);
+      delete_matrix(dense.value);
+      dense = converted;
+    }
+
+    if (!dense.success) {
+      print_matrix_error(dense.code);
+      return 0;
+    }
+
+    *m = *dense.value;
+    free(dense.value);
 
-  char *row_line = fgets(buffer, FILE_READER_BUFFER_SIZE, file);
-  int rows = atoi(row_line);
+    return 1;
+  }
+
+  // Text files are parsed once; afterwards their binary form is mapped from
+  // the cache.
+  char key[MATRIX_CACHE_KEY_LENGTH + 1];
+  char cache_name[MATRIX_CACHE_NAME_MAX_LENGTH];
+  int cached = !has_binary_matrix_extension(filename) && matrix_cache_file_key(filename, key);
+
+  if (cached) {
+    snprintf(cache_name, sizeof(cache_name), "input-%s-%s", key, matrix_element_type_name(requested_element_type));
+
+    if (matrix_cache_load(cache_name, m)) return 1;
+  }
+
+  int read = element_type_requested ?
+    read_typed_matrix_from_file(m, filename, requested_element_type) : read_matrix_from_file(m, filename);
 
-  char *col_line = fgets(buffer, FILE_READER_BUFFER_SIZE, file);
-  int cols = atoi(col_line);
+  if (read && cached) matrix_cache_store(cache_name, m);
+
+  return read;
+}
+
+int read_input_matrix(Matrix *m, char *filename) {
+  double begin = matrix_stats_now();
+  int read = load_input_matrix(m, filename);
+
+  add_read_phase(filename, begin);
+
+  return read;
+}
 
-  MatrixResult matrix_result = new_matrix(rows, cols);
+// Names the cache entry of an operation's result after the operation, the
+// content keys of its input files and the options that change how it is
+// computed. Returns 0 if the result cannot be cached.
+int name_result_cache_entry(MatrixOperationType type, char *a_filename, char *b_filename) {
+  char a_key[MATRIX_CACHE_KEY_LENGTH + 1], b_key[MATRIX_CACHE_KEY_LENGTH + 1] = "";
+  char multiply_mode[32] = "classical";
 
-  if (!matrix_result.success) {
-    print_matrix_error(matrix_result.code);
+  if (!matrix_cache_file_key(a_filename, a_key)) return 0;
+  if (b_filename != NULL && !matrix_cache_file_key(b_filename, b_key)) return 0;
+
+  // Where Strassen stops recursing changes the bits of the product.
+  if (matrix_multiply_mode() == MATRIX_MULTIPLY_STRASSEN) {
+    snprintf(multiply_mode, sizeof(multiply_mode), "strassen%d", strassen_crossover());
+  }
+
+  int length = snprintf(result_cache_name, sizeof(result_cache_name), "%s-%s%s%s-%s-%s-%s",
+    OPERATIONS[type] + 2, a_key, b_filename != NULL ? "-" : "", b_key,
+    element_type_requested ? matrix_element_type_name(requested_element_type) : "any",
+    multiply_mode, simd_kernels()->name);
+
+  if (length <= 0 || length >= (int) sizeof(result_cache_name)) {
+    result_cache_name[0] = '\0';
     return 0;
   }
-  
-  Matrix *matrix = matrix_result.value;
 
-  int row = 0;
+  return 1;
+}
 
-  while (fgets(buffer, FILE_READER_BUFFER_SIZE, file) != NULL) {
-    if (!read_matrix_row(buffer, matrix, row)) {
-      printf("Error: Failed to parse matrix row %d of file %s", row, filename);
+// Prints or saves the cached result of a dense operation or determinant,
+// if there is one, without reading its inputs. Otherwise leaves
+// result_cache_name set for the result to be saved under.
+int output_cached_result(MatrixOperationType type, char* argv[]) {
+  char *b_filename = NULL, *output_filename = NULL;
+
+  if (argv[2] == NULL) return 0;
+
+  switch (type) {
+    case SUM:
+    case SUBTRACT:
+    case MULTIPLY:
+    case SOLVE:
+      if (argv[3] == NULL) return 0;
+
+      b_filename = argv[3];
+      output_filename = argv[4];
+
+      break;
+    case TRANSPOSE:
+    case INVERSE:
+      output_filename = argv[3];
+
+      break;
+    case DET:
+    case DET_LAPLACE:
+    case DET_LU_DEC:
+      break;
+    default:
       return 0;
-    };
-    row++;
   }
 
-  if (row != rows) {
-    printf("Invalid file format: Matrix should have %d rows.", rows);
+  if (!name_result_cache_entry(type, argv[2], b_filename)) return 0;
+
+  clock_t begin = clock();
+  Matrix *cached = malloc(sizeof(Matrix));
+
+  if (cached == NULL || !matrix_cache_load(result_cache_name, cached)) {
+    free(cached);
     return 0;
   }
 
-  fclose(file);
-  *m = *matrix;
+  // Already saved.
+  result_cache_name[0] = '\0';
+
+  double execution_time = calc_execution_time(begin, clock());
+
+  if (type == DET || type == DET_LAPLACE || type == DET_LU_DEC) {
+    if (cached->element_type == MATRIX_INT64) {
+      printf("det = %lld\n", (long long) cached->int64_values[0]);
+    } else {
+      print_determinant(cached->values[0]);
+    }
+
+    printf("Calculation time: %lf", execution_time);
+  } else {
+    output_matrix_result((MatrixResult) { 1, MATRIX_SUCCESS_CODE, cached }, output_filename, execution_time);
+  }
+
+  delete_matrix(cached);
 
   return 1;
 }
 
-void write_matrix_to_file(Matrix *m, char *filename) {
-  FILE *file = fopen(filename, "w");
+// Loads a .coo file in compressed form, and any other matrix file densely,
+// compressing it afterwards if few enough of its elements are nonzero.
+// Sparse matrices are float64, so other element types stay dense.
+int read_matrix_operand(MatrixOperand *operand, char *filename) {
+  operand->sparse = NULL;
 
-  fprintf(file, "%d\n", m->rows);
-  fprintf(file, "%d\n", m->cols);
+  if (has_sparse_matrix_extension(filename) && requested_element_type == MATRIX_FLOAT64) {
+    double begin = matrix_stats_now();
+    int read = read_sparse_matrix_from_file(&operand->sparse, filename);
 
-  for (int i = 0; i < m->rows; i++) {
-    for (int j = 0; j < m->cols; j++) {
-      fprintf(file, "%.2lf", matrix_get(m, i + 1, j + 1).value);
+    add_read_phase(filename, begin);
 
-      if (j < m->cols - 1) {
-        fprintf(file, ",");
-      }
+    return read;
+  }
+
+  if (!read_input_matrix(&operand->dense, filename)) return 0;
+
+  if (operand->dense.element_type == MATRIX_FLOAT64 &&
+      matrix_density(&operand->dense) <= SPARSE_MATRIX_DENSITY_THRESHOLD) {
+    SparseMatrixResult sparse = sparse_matrix_from_dense(&operand->dense, SPARSE_MATRIX_CSR);
+
+    // delete_matrix also frees the header, so the dense storage is handed
+    // to a heap copy of it; without one, the operand just stays dense.
+    Matrix *dense = sparse.success ? malloc(sizeof(Matrix)) : NULL;
+
+    if (dense != NULL) {
+      *dense = operand->dense;
+      delete_matrix(dense);
+      operand->sparse = sparse.value;
+    } else if (sparse.success) {
+      delete_sparse_matrix(sparse.value);
     }
-    fprintf(file, "\n");
   }
 
-  fclose(file);
+  return 1;
 }
 
-void print_matrix(Matrix *m) {
-  printf("\n");
+// Sum, subtract or multiply where at least one operand is sparse.
+void run_sparse_operation(MatrixOperationType type, MatrixOperand *a, MatrixOperand *b, char *output_filename) {
+  clock_t begin = begin_compute();
 
-  for (int i = 0; i < m->rows; i++) {
-    for (int j = 0; j < m->cols; j++) {
-      printf("%.2lf", matrix_get(m, i + 1, j + 1).value);
+  if (a->sparse != NULL && b->sparse != NULL) {
+    SparseMatrixResult r = type == SUM ? sparse_matrix_sum(a->sparse, b->sparse)
+      : type == SUBTRACT ? sparse_matrix_subtract(a->sparse, b->sparse)
+      : sparse_matrix_multiply(a->sparse, b->sparse);
 
-      if (j < m->cols - 1) {
-        printf(", ");
-      }
+    output_sparse_matrix_result(r, output_filename, calc_execution_time(begin, end_compute()));
+    return;
+  }
+
+  MatrixResult r;
+
+  if (a->sparse != NULL) {
+    r = type == SUM ? sparse_matrix_sum_dense(a->sparse, &b->dense)
+      : type == SUBTRACT ? sparse_matrix_subtract_dense(a->sparse, &b->dense)
+      : sparse_matrix_multiply_dense(a->sparse, &b->dense);
+  } else {
+    r = type == SUM ? sparse_matrix_sum_dense(b->sparse, &a->dense)
+      : type == SUBTRACT ? dense_matrix_subtract_sparse(&a->dense, b->sparse)
+      : dense_matrix_multiply_sparse(&a->dense, b->sparse);
+  }
+
+  output_matrix_result(r, output_filename, calc_execution_time(begin, end_compute()));
+}
+
+// Integer determinants are computed exactly by Bareiss elimination.
+void print_integer_determinant(Matrix *m) {
+  clock_t begin = begin_compute();
+  MatrixIntegerResult result = matrix_determinant_bareiss(m);
+  double execution_time = calc_execution_time(begin, end_compute());
+
+  if (result.success) {
+    cache_determinant(MATRIX_INT64, 0, result.value);
+    printf("det = %lld\n", (long long) result.value);
+    printf("Calculation time: %lf", execution_time);
+  } else {
+    print_matrix_error(result.code);
+  }
+}
+
+// Sum or subtract between .mat and .matb files with only a row of each
+// matrix in memory.
+void run_streaming(MatrixOperationType type, char* argv[]) {
+  if (argv[2] == NULL || argv[3] == NULL) {
+    printf("Missing input file.");
+    return;
+  }
+
+  for (int i = 2; i <= 4 && argv[i] != NULL; i++) {
+    if (has_sparse_matrix_extension(argv[i])) {
+      printf("Option '--stream' works on .mat and .matb files only.");
+      return;
     }
-    printf("\n");
   }
+
+  if (element_type_requested) {
+    printf("Option '--stream' keeps the element type of its inputs and cannot be used with '--dtype'.");
+    return;
+  }
+
+  clock_t begin = begin_compute();
+  int streamed = type == SUM ? stream_matrix_sum_files(argv[2], argv[3], argv[4]) :
+    stream_matrix_subtract_files(argv[2], argv[3], argv[4]);
+  double execution_time = calc_execution_time(begin, end_compute());
+
+  if (!streamed) return;
+
+  if (argv[4] != NULL) printf("Success: Resulting matrix was saved to file '%s'.", argv[4]);
+
+  printf("\nCalculation time: %lfs", execution_time);
 }
 
-MatrixOperationType parse_operation_type(char* operation) {
-  for (int i = 0; i < OPERATIONS_SIZE; i++) {
-    if (strcmp(OPERATIONS[i], operation) == 0) {
-      return i;
+// A new empty file for an intermediate tiled matrix, in $TMPDIR or /tmp.
+char* temporary_tiled_file() {
+  const char *directory = getenv("TMPDIR");
+  char *path = malloc(PATH_MAX);
+
+  if (path == NULL) return NULL;
+  if (directory == NULL || *directory == '\0') directory = "/tmp";
+
+  snprintf(path, PATH_MAX, "%s/matrix-ooc-XXXXXX%s", directory, MATRIX_TILED_EXTENSION);
+
+  // The extension tells the conversions that it is a tiled file.
+  int fd = mkstemps(path, strlen(MATRIX_TILED_EXTENSION));
+
+  if (fd < 0) {
+    printf("Error: Failed to create a temporary file in %s", directory);
+    free(path);
+    return NULL;
+  }
+
+  close(fd);
+  return path;
+}
+
+// Opens an operand as a tiled matrix with the given tile size, going
+// through a temporary copy unless it already is one that may be used as
+// it is. *temporary is set to the copy, to be removed afterwards.
+TiledMatrix* load_tiled_operand(char *filename, int tile_size, int copy, char **temporary) {
+  *temporary = NULL;
+
+  if (!copy && has_tiled_matrix_extension(filename)) {
+    TiledMatrixResult opened = open_tiled_matrix(filename);
+
+    if (opened.success && opened.value->tile_size == tile_size) return opened.value;
+    if (opened.success) close_tiled_matrix(opened.value);
+  }
+
+  *temporary = temporary_tiled_file();
+
+  if (*temporary == NULL || !convert_to_tiled_matrix_file(filename, *temporary, tile_size, memory_limit)) return NULL;
+
+  TiledMatrixResult opened = open_tiled_matrix(*temporary);
+
+  if (!opened.success) print_matrix_error(opened.code);
+
+  return opened.value;
+}
+
+TiledMatrix* open_tiled_operand(char *filename, int tile_size, int copy, char **temporary) {
+  double begin = matrix_stats_now();
+  TiledMatrix *m = load_tiled_operand(filename, tile_size, copy, temporary);
+
+  add_read_phase(filename, begin);
+
+  return m;
+}
+
+void remove_temporary_file(char *temporary) {
+  if (temporary == NULL) return;
+
+  unlink(temporary);
+  free(temporary);
+}
+
+// The determinant through a tiled LU factorization of a temporary copy.
+void run_out_of_core_determinant(char *filename) {
+  int rows, cols;
+
+  if (!read_matrix_file_dimensions(filename, &rows, &cols)) return;
+
+  if (rows != cols) {
+    print_matrix_error(MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT);
+    return;
+  }
+
+  int tile_size = lu_tile_size_for_memory_limit(memory_limit, rows);
+  int *pivots = malloc(rows * sizeof(int));
+
+  if (tile_size == 0 || pivots == NULL) {
+    print_matrix_error(tile_size == 0 ? MATRIX_MEMORY_LIMIT_TOO_SMALL : MATRIX_INTERNAL_ERROR);
+    free(pivots);
+    return;
+  }
+
+  char *temporary;
+  TiledMatrix *m = open_tiled_operand(filename, tile_size, 1, &temporary);
+
+  if (m != NULL) {
+    clock_t begin = begin_compute();
+    MatrixNumericResult det = tiled_matrix_lu_factor(m, pivots, memory_limit);
+    double execution_time = calc_execution_time(begin, end_compute());
+
+    if (det.success) {
+      print_determinant(det.value);
+      printf("Calculation time: %lf", execution_time);
+    } else {
+      print_matrix_error(det.code);
     }
+
+    close_tiled_matrix(m);
   }
 
-  return INVALID_OPERATION;
+  remove_temporary_file(temporary);
+  free(pivots);
 }
 
-int output_matrix_result(
-  MatrixResult result,
-  char *output_filename,
-  double execution_time
-) {
-    if (result.success) {
-      if (output_filename != NULL) {
-        write_matrix_to_file(result.value, output_filename);
+// Sum, subtract, multiply, transpose or determinant on tiled files, with
+// at most memory_limit bytes of matrix data in memory. Operands that are
+// not tiled files are converted to temporary ones, and the result is
+// converted to the format of the output file.
+void run_out_of_core(MatrixOperationType type, char* argv[]) {
+  int binary = type == SUM || type == SUBTRACT || type == MULTIPLY;
+  char *output_filename = argv[2] == NULL ? NULL : binary ? (argv[3] != NULL ? argv[4] : NULL) : argv[3];
+
+  if (memory_limit == 0) memory_limit = MATRIX_OOC_DEFAULT_MEMORY_LIMIT;
+
+  if (argv[2] == NULL || (binary && argv[3] == NULL)) {
+    printf("Missing input file.");
+    return;
+  }
+
+  if (type == DET || type == DET_LU_DEC) {
+    run_out_of_core_determinant(argv[2]);
+    return;
+  }
+
+  if (output_filename == NULL) {
+    printf("Out-of-core results must be saved to a file.");
+    return;
+  }
+
+  int tile_size = tile_size_for_memory_limit(memory_limit);
+
+  if (tile_size == 0) {
+    print_matrix_error(MATRIX_MEMORY_LIMIT_TOO_SMALL);
+    return;
+  }
+
+  char *a_temporary = NULL, *b_temporary = NULL, *result_temporary = NULL;
+  TiledMatrix *a = open_tiled_operand(argv[2], tile_size, 0, &a_temporary);
+  TiledMatrix *b = binary && a != NULL ? open_tiled_operand(argv[3], tile_size, 0, &b_temporary) : NULL;
+  int direct = has_tiled_matrix_extension(output_filename);
+  char *result_filename = direct ? output_filename : (result_temporary = temporary_tiled_file());
+
+  if (a != NULL && (b != NULL || !binary) && result_filename != NULL) {
+    clock_t begin = begin_compute();
+    TiledMatrixResult r = type == SUM ? tiled_matrix_sum(a, b, result_filename, memory_limit)
+      : type == SUBTRACT ? tiled_matrix_subtract(a, b, result_filename, memory_limit)
+      : type == MULTIPLY ? tiled_matrix_multiply(a, b, result_filename, memory_limit)
+      : tiled_matrix_transpose(a, result_filename, memory_limit);
+    double execution_time = calc_execution_time(begin, end_compute());
+
+    if (!r.success) {
+      print_matrix_error(r.code);
+    } else {
+      close_tiled_matrix(r.value);
+
+      double begin_write = matrix_stats_now();
+      int written = direct || convert_from_tiled_matrix_file(result_filename, output_filename, memory_limit);
+
+      add_write_phase(output_filename, begin_write);
+
+      if (written) {
         printf("Success: Resulting matrix was saved to file '%s'.", output_filename);
-      } else {
-        print_matrix(result.value);
+        printf("\nCalculation time: %lfs", execution_time);
       }
-    } else {
-      print_matrix_error(result.code);
     }
+  }
 
-    printf("\nCalculation time: %lfs", execution_time);
+  close_tiled_matrix(a);
+  close_tiled_matrix(b);
+  remove_temporary_file(a_temporary);
+  remove_temporary_file(b_temporary);
+  remove_temporary_file(result_temporary);
 }
 
-double calc_execution_time(clock_t begin, clock_t end) {
-  return (double)(end - begin) / CLOCKS_PER_SEC;
+// --serve [socket path]: answers requests on the socket, or on stdin and
+// stdout without one. Replies then go to the original stdout and anything
+// the library prints goes to stderr, so it cannot break up a reply.
+void serve(char *socket_path) {
+  MatrixRegistry *registry = new_matrix_registry();
+
+  if (registry == NULL) {
+    print_matrix_error(MATRIX_INTERNAL_ERROR);
+    return;
+  }
+
+  if (socket_path != NULL) {
+    matrix_server_listen(registry, socket_path);
+  } else {
+    int replies_fd = dup(STDOUT_FILENO);
+    FILE *replies = replies_fd >= 0 ? fdopen(replies_fd, "w") : NULL;
+
+    if (replies != NULL) {
+      fflush(stdout);
+      dup2(STDERR_FILENO, STDOUT_FILENO);
+      matrix_server_serve(registry, stdin, replies);
+      fclose(replies);
+    }
+  }
+
+  delete_matrix_registry(registry);
+}
+
+// --batch-multiply a.batch b.batch [output], and the single-operand batch
+// operations with input file and optional output.
+void run_batch_operation(MatrixOperationType type, char* argv[]) {
+  MatrixBatch *a, *b = NULL;
+  char *output_filename = type == BATCH_MULTIPLY ? argv[4] : argv[3];
+
+  double begin_read = matrix_stats_now();
+  int read = read_matrix_batch_from_file(&a, argv[2]);
+
+  add_read_phase(argv[2], begin_read);
+
+  if (!read) return;
+
+  if (type == BATCH_MULTIPLY) {
+    begin_read = matrix_stats_now();
+    read = read_matrix_batch_from_file(&b, argv[3]);
+    add_read_phase(argv[3], begin_read);
+
+    if (!read) {
+      delete_matrix_batch(a);
+      return;
+    }
+  }
+
+  clock_t begin = begin_compute();
+  MatrixBatchResult r = type == BATCH_MULTIPLY ? matrix_batch_multiply(a, b)
+    : type == BATCH_DET ? matrix_batch_determinant(a)
+    : type == BATCH_INVERSE ? matrix_batch_inverse(a)
+    : matrix_batch_transpose(a);
+  double execution_time = calc_execution_time(begin, end_compute());
+
+  if (!r.success) {
+    print_matrix_error(r.code);
+  } else if (output_filename != NULL) {
+    double begin_write = matrix_stats_now();
+    int written = write_matrix_batch_to_file(r.value, output_filename);
+
+    add_write_phase(output_filename, begin_write);
+
+    if (written) printf("Success: Resulting matrices were saved to file '%s'.", output_filename);
+  } else {
+    double begin_write = matrix_stats_now();
+
+    print_matrix_batch(r.value);
+    add_write_phase(NULL, begin_write);
+  }
+
+  printf("\nCalculation time: %lfs", execution_time);
+
+  if (r.success) delete_matrix_batch(r.value);
+  if (b != NULL) delete_matrix_batch(b);
+  delete_matrix_batch(a);
+}
+
+// --expr "<expression>" NAME=file... [output file]: loads every named
+// matrix, binds it and evaluates the whole expression in one go.
+void evaluate_expression(int argc, char* argv[]) {
+  if (argv[2] == NULL) {
+    printf("Usage: --expr \"<expression>\" NAME=file... [output file]");
+    return;
+  }
+
+  MatrixExpression *e = parse_matrix_expression(argv[2]);
+
+  if (e == NULL) return;
+
+  Matrix operands[MATRIX_EXPRESSION_MAX_VARIABLES];
+  int loaded = 0;
+  char *output_filename = NULL;
+  int ok = 1;
+
+  for (int i = 3; i < argc && ok; i++) {
+    char *separator = strchr(argv[i], '=');
+
+    if (separator == NULL) {
+      if (i == argc - 1) {
+        output_filename = argv[i];
+      } else {
+        printf("Invalid binding '%s': expected NAME=file.", argv[i]);
+        ok = 0;
+      }
+      continue;
+    }
+
+    *separator = '\0';
+
+    if (loaded == MATRIX_EXPRESSION_MAX_VARIABLES) {
+      printf("Matrix '%s' is not used in the expression.", argv[i]);
+      ok = 0;
+    } else if (!read_input_matrix(&operands[loaded], separator + 1)) {
+      ok = 0;
+    } else if (!matrix_expression_bind(e, argv[i], &operands[loaded++])) {
+      printf("Matrix '%s' is not used in the expression.", argv[i]);
+      ok = 0;
+    }
+  }
+
+  for (int v = 0; v < e->variable_count && ok; v++) {
+    if (e->variables[v] == NULL) {
+      printf("Matrix '%s' has no file; pass it as %s=<file>.", e->variable_names[v], e->variable_names[v]);
+      ok = 0;
+    }
+  }
+
+  if (ok) {
+    clock_t begin = begin_compute();
+    MatrixResult r = matrix_expression_evaluate(e);
+    clock_t end = end_compute();
+
+    output_matrix_result(r, output_filename, calc_execution_time(begin, end));
+  }
+
+  delete_matrix_expression(e);
 }
 
 void main(int argc, char* argv[]) {
+  argc = parse_options(argc, argv);
+
+  if (argc < 0) return;
+
+  // Reported on every way out of main.
+  if (matrix_stats_enabled()) atexit(report_stats);
+
   if (argv[1] == NULL) {
     printf("No operation was requested.");
     return;
@@ -235,7 +907,27 @@ void main(int argc, char* argv[]) {
     return;
   }
 
+  int tiled_operand = argv[2] != NULL && (has_tiled_matrix_extension(argv[2]) ||
+    (argv[3] != NULL && has_tiled_matrix_extension(argv[3])));
+
+  // Tiled files are left to the out-of-core path.
+  if (streaming && (operation_type == SUM || operation_type == SUBTRACT) &&
+      !tiled_operand && !(argv[3] != NULL && argv[4] != NULL && has_tiled_matrix_extension(argv[4]))) {
+    run_streaming(operation_type, argv);
+    return;
+  }
+
+  if ((memory_limit > 0 || tiled_operand) && (operation_type == SUM || operation_type == SUBTRACT ||
+      operation_type == MULTIPLY || operation_type == TRANSPOSE || operation_type == DET ||
+      operation_type == DET_LU_DEC)) {
+    run_out_of_core(operation_type, argv);
+    return;
+  }
+
+  if (output_cached_result(operation_type, argv)) return;
+
   Matrix a, b;
+  MatrixOperand a_operand, b_operand;
   int read_a_file_result, read_b_file_result;
   MatrixNumericResult numeric_result;
   MatrixResult r;
@@ -245,47 +937,71 @@ void main(int argc, char* argv[]) {
 
   switch (operation_type) {
     case SUM:
-      if (!read_matrix_from_file(&a, argv[2])) return;
-      if (!read_matrix_from_file(&b, argv[3])) return;
+      if (!read_matrix_operand(&a_operand, argv[2])) return;
+      if (!read_matrix_operand(&b_operand, argv[3])) return;
+
+      if (a_operand.sparse != NULL || b_operand.sparse != NULL) {
+        run_sparse_operation(operation_type, &a_operand, &b_operand, argv[4]);
+        break;
+      }
+
+      a = a_operand.dense;
+      b = b_operand.dense;
 
-      begin = clock();
+      begin = begin_compute();
       r = matrix_sum(&a, &b);
-      end = clock();
+      end = end_compute();
       execution_time = calc_execution_time(begin, end);
 
       output_matrix_result(r, argv[4], execution_time);
 
       break;
     case SUBTRACT:
-      if (!read_matrix_from_file(&a, argv[2])) return;
-      if (!read_matrix_from_file(&b, argv[3])) return;
+      if (!read_matrix_operand(&a_operand, argv[2])) return;
+      if (!read_matrix_operand(&b_operand, argv[3])) return;
 
-      begin = clock();
+      if (a_operand.sparse != NULL || b_operand.sparse != NULL) {
+        run_sparse_operation(operation_type, &a_operand, &b_operand, argv[4]);
+        break;
+      }
+
+      a = a_operand.dense;
+      b = b_operand.dense;
+
+      begin = begin_compute();
       r = matrix_subtract(&a, &b);
-      end = clock();
+      end = end_compute();
       execution_time = calc_execution_time(begin, end);
 
       output_matrix_result(r, argv[4], execution_time);
 
       break;
     case MULTIPLY:
-      if (!read_matrix_from_file(&a, argv[2])) return;
-      if (!read_matrix_from_file(&b, argv[3])) return;
+      if (!read_matrix_operand(&a_operand, argv[2])) return;
+      if (!read_matrix_operand(&b_operand, argv[3])) return;
+
+      if (a_operand.sparse != NULL || b_operand.sparse != NULL) {
+        run_sparse_operation(operation_type, &a_operand, &b_operand, argv[4]);
+        break;
+      }
+
+      a = a_operand.dense;
+      b = b_operand.dense;
       
-      begin = clock();
+      begin = begin_compute();
       r = matrix_multiply(&a, &b);
-      end = clock();
+      end = end_compute();
       execution_time = calc_execution_time(begin, end);
 
       output_matrix_result(r, argv[4], execution_time);
 
       break;
     case TRANSPOSE:
-      if (!read_matrix_from_file(&a, argv[2])) return;
+      if (!read_input_matrix(&a, argv[2])) return;
 
-      begin = clock();
+      begin = begin_compute();
       r = matrix_transpose(&a);
-      end = clock();
+      end = end_compute();
       execution_time = calc_execution_time(begin, end);
 
       output_matrix_result(r, argv[3], execution_time);
@@ -293,15 +1009,20 @@ void main(int argc, char* argv[]) {
       break;
     case DET_LU_DEC:
     case DET:
-      if (!read_matrix_from_file(&a, argv[2])) return;
+      if (!read_input_matrix(&a, argv[2])) return;
 
-      begin = clock();
+      if (a.element_type == MATRIX_INT32 || a.element_type == MATRIX_INT64) {
+        print_integer_determinant(&a);
+        break;
+      }
+
+      begin = begin_compute();
       numeric_result = matrix_determinant_lu_decomposition(&a);
-      end = clock();
+      end = end_compute();
       execution_time = calc_execution_time(begin, end);
 
       if (numeric_result.success) {
-        printf("det = %lf\n", numeric_result.value);
+        print_determinant(numeric_result.value);
         printf("Calculation time: %lf", execution_time);
       } else {
         print_matrix_error(numeric_result.code);
@@ -309,20 +1030,85 @@ void main(int argc, char* argv[]) {
 
       break;
     case DET_LAPLACE:
-      if (!read_matrix_from_file(&a, argv[2])) return;
+      if (!read_input_matrix(&a, argv[2])) return;
 
-      begin = clock();
+      begin = begin_compute();
       numeric_result = matrix_determinant_laplace(&a);
-      end = clock();
+      end = end_compute();
       execution_time = calc_execution_time(begin, end);
 
       if (numeric_result.success) {
-        printf("det = %lf\n", numeric_result.value);
+        print_determinant(numeric_result.value);
         printf("Calculation time: %lf", execution_time);
       } else {
         print_matrix_error(numeric_result.code);
       }
 
+      break;
+    case SOLVE:
+      if (!read_input_matrix(&a, argv[2])) return;
+      if (!read_input_matrix(&b, argv[3])) return;
+
+      begin = begin_compute();
+      MatrixLUResult lu = matrix_lu_factor(&a);
+      r = lu.success ? matrix_lu_solve(lu.value, &b) : (MatrixResult) { 0, lu.code, NULL };
+      end = end_compute();
+      execution_time = calc_execution_time(begin, end);
+
+      if (lu.success) delete_matrix_lu(lu.value);
+
+      output_matrix_result(r, argv[4], execution_time);
+
+      break;
+    case INVERSE:
+      if (!read_input_matrix(&a, argv[2])) return;
+
+      begin = begin_compute();
+      r = matrix_inverse(&a);
+      end = end_compute();
+      execution_time = calc_execution_time(begin, end);
+
+      output_matrix_result(r, argv[3], execution_time);
+
+      break;
+    case EXPRESSION:
+      evaluate_expression(argc, argv);
+
+      break;
+    case BATCH_MULTIPLY:
+    case BATCH_DET:
+    case BATCH_INVERSE:
+    case BATCH_TRANSPOSE:
+      run_batch_operation(operation_type, argv);
+
+      break;
+    case SERVE:
+      serve(argv[2]);
+
+      break;
+    case CONVERT:
+      if (argv[2] == NULL || argv[3] == NULL) {
+        printf("Usage: --convert <input file> <output file>");
+        return;
+      }
+
+      if (has_tiled_matrix_extension(argv[2]) || has_tiled_matrix_extension(argv[3])) {
+        size_t limit = memory_limit > 0 ? memory_limit : MATRIX_OOC_DEFAULT_MEMORY_LIMIT;
+        int converted = has_tiled_matrix_extension(argv[2]) ?
+          convert_from_tiled_matrix_file(argv[2], argv[3], limit) :
+          convert_to_tiled_matrix_file(argv[2], argv[3], tile_size_for_memory_limit(limit), limit);
+
+        if (converted) printf("Success: Matrix from '%s' was saved to file '%s'.", argv[2], argv[3]);
+      } else if (element_type_requested) {
+        if (!read_input_matrix(&a, argv[2])) return;
+
+        if (write_matrix_to_file(&a, argv[3])) {
+          printf("Success: Matrix from '%s' was saved to file '%s'.", argv[2], argv[3]);
+        }
+      } else if (convert_matrix_file(argv[2], argv[3])) {
+        printf("Success: Matrix from '%s' was saved to file '%s'.", argv[2], argv[3]);
+      }
+
       break;
     default:
       break;
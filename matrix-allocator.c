@@ -0,0 +1,325 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "matrix.h"
+#include "matrix-allocator.h"
+#include "matrix-stats.h"
+
+// Heap buffers of at least this size come straight from mmap: the kernel
+// hands out zeroed pages lazily, so there is nothing to clear.
+#define MATRIX_MMAP_THRESHOLD (1 << 20)
+
+// Pool size classes are the powers of two from MATRIX_ALIGNMENT bytes up to
+// 2^(POOL_MIN_SHIFT + POOL_CLASSES - 1); larger buffers bypass the pool.
+#define POOL_MIN_SHIFT 6
+#define POOL_CLASSES 30
+
+void* _heap_allocate(MatrixAllocator *allocator, size_t size, int zeroed) {
+    (void) allocator;
+
+    if (size >= MATRIX_MMAP_THRESHOLD) {
+        void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return memory == MAP_FAILED ? NULL : memory;
+    }
+
+    void *memory = NULL;
+
+    if (posix_memalign(&memory, MATRIX_ALIGNMENT, size > 0 ? size : 1) != 0) return NULL;
+
+    if (zeroed) memset(memory, 0, size);
+    return memory;
+}
+
+void _heap_release(MatrixAllocator *allocator, void *memory, size_t size) {
+    (void) allocator;
+
+    if (size >= MATRIX_MMAP_THRESHOLD) {
+        munmap(memory, size);
+    } else {
+        free(memory);
+    }
+}
+
+void _heap_destroy(MatrixAllocator *allocator) {
+    (void) allocator;
+}
+
+MatrixAllocator HEAP_ALLOCATOR = { _heap_allocate, _heap_release, _heap_destroy };
+
+MatrixAllocator* matrix_heap_allocator() {
+    return &HEAP_ALLOCATOR;
+}
+
+size_t _aligned_size(size_t size) {
+    return (size + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+}
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    char *memory;
+} ArenaBlock;
+
+typedef struct MatrixArena {
+    MatrixAllocator allocator;
+    pthread_mutex_t lock;
+    size_t block_size;
+    // Blocks being filled come first; current is the one allocations go to.
+    ArenaBlock *blocks;
+    ArenaBlock *current;
+} MatrixArena;
+
+ArenaBlock* _new_arena_block(size_t size) {
+    ArenaBlock *block = malloc(sizeof(ArenaBlock));
+
+    if (block == NULL) return NULL;
+
+    block->memory = _heap_allocate(NULL, size, 0);
+
+    if (block->memory == NULL) {
+        free(block);
+        return NULL;
+    }
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+void* _arena_allocate(MatrixAllocator *allocator, size_t size, int zeroed) {
+    MatrixArena *arena = (MatrixArena*) allocator;
+    size_t needed = _aligned_size(size > 0 ? size : 1);
+    void *memory = NULL;
+
+    pthread_mutex_lock(&arena->lock);
+
+    // Move on to the next kept block that is large enough, or append one.
+    ArenaBlock *block = arena->current;
+
+    while (block != NULL && block->size - block->used < needed) block = block->next;
+
+    if (block == NULL) {
+        block = _new_arena_block(needed > arena->block_size ? needed : arena->block_size);
+
+        if (block != NULL) {
+            ArenaBlock **last = &arena->blocks;
+            while (*last != NULL) last = &(*last)->next;
+            *last = block;
+        }
+    }
+
+    if (block != NULL) {
+        arena->current = block;
+        memory = block->memory + block->used;
+        block->used += needed;
+    }
+
+    pthread_mutex_unlock(&arena->lock);
+
+    if (memory != NULL && zeroed) memset(memory, 0, size);
+    return memory;
+}
+
+void _arena_release(MatrixAllocator *allocator, void *memory, size_t size) {
+    MatrixArena *arena = (MatrixArena*) allocator;
+    size_t needed = _aligned_size(size > 0 ? size : 1);
+
+    pthread_mutex_lock(&arena->lock);
+
+    ArenaBlock *block = arena->current;
+
+    if (block != NULL && (char*) memory + needed == block->memory + block->used) {
+        block->used -= needed;
+    }
+
+    pthread_mutex_unlock(&arena->lock);
+}
+
+void _arena_destroy(MatrixAllocator *allocator) {
+    MatrixArena *arena = (MatrixArena*) allocator;
+
+    while (arena->blocks != NULL) {
+        ArenaBlock *next = arena->blocks->next;
+        _heap_release(NULL, arena->blocks->memory, arena->blocks->size);
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+
+    pthread_mutex_destroy(&arena->lock);
+    free(arena);
+}
+
+MatrixAllocator* new_matrix_arena(size_t block_size) {
+    MatrixArena *arena = malloc(sizeof(MatrixArena));
+
+    if (arena == NULL) return NULL;
+
+    arena->allocator = (MatrixAllocator) { _arena_allocate, _arena_release, _arena_destroy };
+    pthread_mutex_init(&arena->lock, NULL);
+    arena->block_size = _aligned_size(block_size > 0 ? block_size : 1);
+    arena->blocks = NULL;
+    arena->current = NULL;
+
+    return &arena->allocator;
+}
+
+void matrix_arena_reset(MatrixAllocator *allocator) {
+    if (allocator == NULL || allocator->allocate != _arena_allocate) return;
+
+    MatrixArena *arena = (MatrixArena*) allocator;
+
+    pthread_mutex_lock(&arena->lock);
+
+    for (ArenaBlock *block = arena->blocks; block != NULL; block = block->next) block->used = 0;
+    arena->current = arena->blocks;
+
+    pthread_mutex_unlock(&arena->lock);
+}
+
+typedef struct PoolBuffer {
+    struct PoolBuffer *next;
+} PoolBuffer;
+
+typedef struct MatrixPool {
+    MatrixAllocator allocator;
+    pthread_mutex_t lock;
+    size_t max_cached;
+    size_t cached;
+    PoolBuffer *free_lists[POOL_CLASSES];
+} MatrixPool;
+
+// Size class of a request, or -1 if it is too large for the pool.
+int _pool_class(size_t size) {
+    int size_class = 0;
+
+    while (size_class < POOL_CLASSES && ((size_t) 1 << (POOL_MIN_SHIFT + size_class)) < size) size_class++;
+
+    return size_class < POOL_CLASSES ? size_class : -1;
+}
+
+size_t _pool_class_size(int size_class) {
+    return (size_t) 1 << (POOL_MIN_SHIFT + size_class);
+}
+
+void* _pool_allocate(MatrixAllocator *allocator, size_t size, int zeroed) {
+    MatrixPool *pool = (MatrixPool*) allocator;
+    int size_class = _pool_class(size);
+
+    if (size_class < 0) return _heap_allocate(NULL, size, zeroed);
+
+    pthread_mutex_lock(&pool->lock);
+
+    PoolBuffer *buffer = pool->free_lists[size_class];
+
+    if (buffer != NULL) {
+        pool->free_lists[size_class] = buffer->next;
+        pool->cached -= _pool_class_size(size_class);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (buffer == NULL) return _heap_allocate(NULL, _pool_class_size(size_class), zeroed);
+
+    if (zeroed) memset(buffer, 0, size);
+    return buffer;
+}
+
+void _pool_release(MatrixAllocator *allocator, void *memory, size_t size) {
+    MatrixPool *pool = (MatrixPool*) allocator;
+    int size_class = _pool_class(size);
+
+    if (size_class < 0) {
+        _heap_release(NULL, memory, size);
+        return;
+    }
+
+    size_t class_size = _pool_class_size(size_class);
+    int kept = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->cached + class_size <= pool->max_cached) {
+        PoolBuffer *buffer = memory;
+        buffer->next = pool->free_lists[size_class];
+        pool->free_lists[size_class] = buffer;
+        pool->cached += class_size;
+        kept = 1;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!kept) _heap_release(NULL, memory, class_size);
+}
+
+void _pool_destroy(MatrixAllocator *allocator) {
+    MatrixPool *pool = (MatrixPool*) allocator;
+
+    for (int size_class = 0; size_class < POOL_CLASSES; size_class++) {
+        while (pool->free_lists[size_class] != NULL) {
+            PoolBuffer *next = pool->free_lists[size_class]->next;
+            _heap_release(NULL, pool->free_lists[size_class], _pool_class_size(size_class));
+            pool->free_lists[size_class] = next;
+        }
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+MatrixAllocator* new_matrix_pool(size_t max_cached) {
+    MatrixPool *pool = calloc(1, sizeof(MatrixPool));
+
+    if (pool == NULL) return NULL;
+
+    pool->allocator = (MatrixAllocator) { _pool_allocate, _pool_release, _pool_destroy };
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->max_cached = max_cached;
+
+    return &pool->allocator;
+}
+
+void delete_matrix_allocator(MatrixAllocator *allocator) {
+    if (allocator != NULL) allocator->destroy(allocator);
+}
+
+_Thread_local MatrixAllocator *current_allocator = NULL;
+
+MatrixAllocator* matrix_use_allocator(MatrixAllocator *allocator) {
+    MatrixAllocator *previous = matrix_current_allocator();
+    current_allocator = allocator;
+    return previous;
+}
+
+MatrixAllocator* matrix_current_allocator() {
+    return current_allocator != NULL ? current_allocator : &HEAP_ALLOCATOR;
+}
+
+void* matrix_allocate(MatrixAllocator *allocator, size_t size) {
+    if (allocator == NULL) allocator = &HEAP_ALLOCATOR;
+
+    void *memory = allocator->allocate(allocator, size, 1);
+
+    if (memory != NULL) matrix_stats_count_allocation(size);
+    return memory;
+}
+
+void* matrix_allocate_scratch(MatrixAllocator *allocator, size_t size) {
+    if (allocator == NULL) allocator = &HEAP_ALLOCATOR;
+
+    void *memory = allocator->allocate(allocator, size, 0);
+
+    if (memory != NULL) matrix_stats_count_allocation(size);
+    return memory;
+}
+
+void matrix_release(MatrixAllocator *allocator, void *memory, size_t size) {
+    if (memory == NULL) return;
+    if (allocator == NULL) allocator = &HEAP_ALLOCATOR;
+
+    matrix_stats_count_release(size);
+    allocator->release(allocator, memory, size);
+}
@@ -0,0 +1,58 @@
+#ifndef MATRIX_ALLOCATOR_H
+#define MATRIX_ALLOCATOR_H
+
+#include <stddef.h>
+
+// Source of matrix storage and of the scratch buffers operations use
+// internally. Memory comes back aligned to MATRIX_ALIGNMENT, and zeroed if
+// asked to be; it is given back with the size it was requested with. Every
+// allocator may be used from several threads at once.
+typedef struct MatrixAllocator MatrixAllocator;
+
+struct MatrixAllocator {
+    void* (*allocate)(MatrixAllocator *allocator, size_t size, int zeroed);
+    void (*release)(MatrixAllocator *allocator, void *memory, size_t size);
+    void (*destroy)(MatrixAllocator *allocator);
+};
+
+// malloc, or mmap for large buffers. The default, and never destroyed.
+MatrixAllocator* matrix_heap_allocator();
+
+// Bump allocator over blocks of at least block_size bytes. Releasing only
+// gives memory back if it was the last allocation, so scratch buffers used
+// in LIFO order are reused at once; everything else stays until
+// matrix_arena_reset, which frees a whole computation in one go and keeps
+// the blocks for the next one.
+MatrixAllocator* new_matrix_arena(size_t block_size);
+
+// Makes all memory of the arena available again. Matrices allocated from it
+// should be deleted first, which then only frees their headers, and must
+// not be used afterwards.
+void matrix_arena_reset(MatrixAllocator *arena);
+
+// Keeps released buffers on free lists by power-of-two size class and hands
+// them out again for requests of the same class, so that repeating an
+// operation on same-shaped matrices stops going to the system. At most
+// max_cached bytes are kept; releases beyond that go back to the heap.
+MatrixAllocator* new_matrix_pool(size_t max_cached);
+
+// Frees an arena or a pool and all memory it holds.
+void delete_matrix_allocator(MatrixAllocator *allocator);
+
+// The allocator new matrices and scratch buffers of the calling thread come
+// from. Each thread starts with the heap allocator; NULL restores it.
+// Returns the previous one.
+MatrixAllocator* matrix_use_allocator(MatrixAllocator *allocator);
+
+MatrixAllocator* matrix_current_allocator();
+
+// Zeroed memory.
+void* matrix_allocate(MatrixAllocator *allocator, size_t size);
+
+// Memory whose contents are left as they are, for buffers that are written
+// before they are read.
+void* matrix_allocate_scratch(MatrixAllocator *allocator, size_t size);
+
+void matrix_release(MatrixAllocator *allocator, void *memory, size_t size);
+
+#endif // MATRIX_ALLOCATOR_H
@@ -0,0 +1,523 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix-batch.h"
+#include "simd.h"
+#include "thread-pool.h"
+
+#define BATCH_DOUBLES_PER_ALIGNMENT (MATRIX_ALIGNMENT / sizeof(double))
+
+// Matrices per thread pool item. A kernel goes over every element of a
+// block before moving on, so the block's slice of each lane array should
+// stay in cache meanwhile.
+#define BATCH_BLOCK 256
+
+// Minimum number of element operations a thread pool chunk should carry.
+#define BATCH_PARALLEL_MIN_WORK (1 << 16)
+
+MatrixBatchResult _batch_result(MatrixResultCode code, MatrixBatch *value) {
+    MatrixBatchResult result;
+    result.success = code == MATRIX_SUCCESS_CODE ? 1 : 0;
+    result.code = code;
+    result.value = value;
+    return result;
+}
+
+size_t _batch_size(MatrixBatch *batch) {
+    return (size_t) batch->rows * batch->cols * batch->stride * sizeof(double);
+}
+
+MatrixBatchResult new_matrix_batch(int count, int rows, int cols) {
+    if (count <= 0 || rows <= 0 || cols <= 0) return _batch_result(MATRIX_DIMENSIONS_MUST_BE_POSITIVE, NULL);
+
+    MatrixBatch *batch = malloc(sizeof(MatrixBatch));
+
+    if (batch == NULL) return _batch_result(MATRIX_INTERNAL_ERROR, NULL);
+
+    batch->count = count;
+    batch->rows = rows;
+    batch->cols = cols;
+    batch->stride = (count + BATCH_DOUBLES_PER_ALIGNMENT - 1) / BATCH_DOUBLES_PER_ALIGNMENT * BATCH_DOUBLES_PER_ALIGNMENT;
+
+    batch->allocator = matrix_current_allocator();
+    batch->values = matrix_allocate(batch->allocator, _batch_size(batch));
+
+    if (batch->values == NULL) {
+        free(batch);
+        return _batch_result(MATRIX_INTERNAL_ERROR, NULL);
+    }
+
+    return _batch_result(MATRIX_SUCCESS_CODE, batch);
+}
+
+double* matrix_batch_lanes(MatrixBatch *batch, int row, int col) {
+    return batch->values + ((size_t) row * batch->cols + col) * batch->stride;
+}
+
+MatrixResultCode matrix_batch_set(MatrixBatch *batch, int index, Matrix *m) {
+    if (batch == NULL || m == NULL) return MATRIX_ARGUMENTS_MUST_NOT_BE_NULL;
+    if (index < 0 || index >= batch->count) return MATRIX_INDEX_ARGUMENT_OUT_OF_BOUNDS;
+    if (m->rows != batch->rows || m->cols != batch->cols) return MATRIX_INVALID_DESTINATION_DIMENSIONS;
+
+    for (int i = 0; i < m->rows; i++) {
+        for (int j = 0; j < m->cols; j++) {
+            matrix_batch_lanes(batch, i, j)[index] = matrix_get(m, i + 1, j + 1).value;
+        }
+    }
+
+    return MATRIX_SUCCESS_CODE;
+}
+
+MatrixResult matrix_batch_get(MatrixBatch *batch, int index) {
+    MatrixResult result = { 0, MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL };
+
+    if (batch == NULL) return result;
+
+    if (index < 0 || index >= batch->count) {
+        result.code = MATRIX_INDEX_ARGUMENT_OUT_OF_BOUNDS;
+        return result;
+    }
+
+    result = new_matrix(batch->rows, batch->cols);
+
+    if (!result.success) return result;
+
+    for (int i = 0; i < batch->rows; i++) {
+        for (int j = 0; j < batch->cols; j++) {
+            matrix_set(result.value, i + 1, j + 1, matrix_batch_lanes(batch, i, j)[index]);
+        }
+    }
+
+    return result;
+}
+
+typedef struct BatchContext BatchContext;
+
+// Runs over matrices [begin, end) of the batch.
+typedef void (*BatchKernel)(BatchContext *c, int begin, int end);
+
+struct BatchContext {
+    BatchKernel kernel;
+    MatrixBatch *a;
+    MatrixBatch *b;
+    MatrixBatch *out;
+    int failed;
+};
+
+void _batch_blocks(int begin, int end, void *context) {
+    BatchContext *c = context;
+    int last = end * BATCH_BLOCK < c->a->count ? end * BATCH_BLOCK : c->a->count;
+
+    c->kernel(c, begin * BATCH_BLOCK, last);
+}
+
+// Kernels that need scratch memory set failed when they cannot get it.
+MatrixResultCode _batch_run(BatchKernel kernel, MatrixBatch *a, MatrixBatch *b, MatrixBatch *out, long work_per_matrix) {
+    BatchContext context = { .kernel = kernel, .a = a, .b = b, .out = out, .failed = 0 };
+    int blocks = (a->count + BATCH_BLOCK - 1) / BATCH_BLOCK;
+
+    thread_pool_parallel_for(
+        0, blocks,
+        thread_pool_grain(work_per_matrix * BATCH_BLOCK, BATCH_PARALLEL_MIN_WORK),
+        _batch_blocks, &context
+    );
+
+    return __atomic_load_n(&context.failed, __ATOMIC_RELAXED) ? MATRIX_INTERNAL_ERROR : MATRIX_SUCCESS_CODE;
+}
+
+#pragma GCC push_options
+#pragma GCC optimize ("tree-vectorize", "vect-cost-model=dynamic")
+
+MATRIX_VECTORIZE_CLONES
+void _batch_multiply_lanes(BatchContext *c, int begin, int end) {
+    MatrixBatch *a = c->a, *b = c->b, *out = c->out;
+
+    for (int i = 0; i < out->rows; i++) {
+        for (int j = 0; j < out->cols; j++) {
+            double *restrict dst = matrix_batch_lanes(out, i, j);
+
+            for (int k = begin; k < end; k++) dst[k] = 0;
+
+            for (int p = 0; p < a->cols; p++) {
+                const double *restrict x = matrix_batch_lanes(a, i, p);
+                const double *restrict y = matrix_batch_lanes(b, p, j);
+
+                for (int k = begin; k < end; k++) dst[k] += x[k] * y[k];
+            }
+        }
+    }
+}
+
+// Fills lanes[i * n + j] with the lane array of element (i, j).
+void _batch_lane_table(MatrixBatch *batch, double **lanes) {
+    for (int i = 0; i < batch->rows; i++) {
+        for (int j = 0; j < batch->cols; j++) {
+            lanes[i * batch->cols + j] = matrix_batch_lanes(batch, i, j);
+        }
+    }
+}
+
+// In the closed forms below, lanes of one element never depend on another
+// matrix's lanes, which is what ivdep tells the vectorizer.
+#define M(i, j) m[(i) * N + (j)][k]
+#define R(i, j) r[(i) * N + (j)][k]
+
+#define N 2
+MATRIX_VECTORIZE_CLONES
+void _batch_determinant_2x2_lanes(BatchContext *c, int begin, int end) {
+    double *m[4], *restrict det = c->out->values;
+
+    _batch_lane_table(c->a, m);
+
+    #pragma GCC ivdep
+    for (int k = begin; k < end; k++) {
+        det[k] = M(0, 0) * M(1, 1) - M(0, 1) * M(1, 0);
+    }
+}
+
+MATRIX_VECTORIZE_CLONES
+void _batch_inverse_2x2_lanes(BatchContext *c, int begin, int end) {
+    double *m[4], *r[4];
+
+    _batch_lane_table(c->a, m);
+    _batch_lane_table(c->out, r);
+
+    #pragma GCC ivdep
+    for (int k = begin; k < end; k++) {
+        double m00 = M(0, 0), m01 = M(0, 1), m10 = M(1, 0), m11 = M(1, 1);
+        double det = m00 * m11 - m01 * m10;
+        double inverse_det = det != 0 ? 1 / det : NAN;
+
+        R(0, 0) = m11 * inverse_det;
+        R(0, 1) = -m01 * inverse_det;
+        R(1, 0) = -m10 * inverse_det;
+        R(1, 1) = m00 * inverse_det;
+    }
+}
+#undef N
+
+#define N 3
+MATRIX_VECTORIZE_CLONES
+void _batch_determinant_3x3_lanes(BatchContext *c, int begin, int end) {
+    double *m[9], *restrict det = c->out->values;
+
+    _batch_lane_table(c->a, m);
+
+    #pragma GCC ivdep
+    for (int k = begin; k < end; k++) {
+        det[k] = M(0, 0) * (M(1, 1) * M(2, 2) - M(1, 2) * M(2, 1))
+            - M(0, 1) * (M(1, 0) * M(2, 2) - M(1, 2) * M(2, 0))
+            + M(0, 2) * (M(1, 0) * M(2, 1) - M(1, 1) * M(2, 0));
+    }
+}
+
+// The inverse is the adjugate (transposed cofactors) over the determinant.
+MATRIX_VECTORIZE_CLONES
+void _batch_inverse_3x3_lanes(BatchContext *c, int begin, int end) {
+    double *m[9], *r[9];
+
+    _batch_lane_table(c->a, m);
+    _batch_lane_table(c->out, r);
+
+    #pragma GCC ivdep
+    for (int k = begin; k < end; k++) {
+        double c00 = M(1, 1) * M(2, 2) - M(1, 2) * M(2, 1);
+        double c01 = M(1, 2) * M(2, 0) - M(1, 0) * M(2, 2);
+        double c02 = M(1, 0) * M(2, 1) - M(1, 1) * M(2, 0);
+        double det = M(0, 0) * c00 + M(0, 1) * c01 + M(0, 2) * c02;
+        double inverse_det = det != 0 ? 1 / det : NAN;
+
+        double r01 = (M(0, 2) * M(2, 1) - M(0, 1) * M(2, 2)) * inverse_det;
+        double r02 = (M(0, 1) * M(1, 2) - M(0, 2) * M(1, 1)) * inverse_det;
+        double r11 = (M(0, 0) * M(2, 2) - M(0, 2) * M(2, 0)) * inverse_det;
+        double r12 = (M(0, 2) * M(1, 0) - M(0, 0) * M(1, 2)) * inverse_det;
+        double r21 = (M(0, 1) * M(2, 0) - M(0, 0) * M(2, 1)) * inverse_det;
+        double r22 = (M(0, 0) * M(1, 1) - M(0, 1) * M(1, 0)) * inverse_det;
+
+        R(0, 0) = c00 * inverse_det;
+        R(1, 0) = c01 * inverse_det;
+        R(2, 0) = c02 * inverse_det;
+        R(0, 1) = r01;
+        R(0, 2) = r02;
+        R(1, 1) = r11;
+        R(1, 2) = r12;
+        R(2, 1) = r21;
+        R(2, 2) = r22;
+    }
+}
+#undef N
+
+#define N 4
+// 2x2 minors of the bottom two rows: low_ab is built from columns a and b
+// of rows 2 and 3.
+#define BATCH_LOW_MINORS                                            \
+    double low_01 = M(2, 0) * M(3, 1) - M(2, 1) * M(3, 0);          \
+    double low_02 = M(2, 0) * M(3, 2) - M(2, 2) * M(3, 0);          \
+    double low_03 = M(2, 0) * M(3, 3) - M(2, 3) * M(3, 0);          \
+    double low_12 = M(2, 1) * M(3, 2) - M(2, 2) * M(3, 1);          \
+    double low_13 = M(2, 1) * M(3, 3) - M(2, 3) * M(3, 1);          \
+    double low_23 = M(2, 2) * M(3, 3) - M(2, 3) * M(3, 2);          \
+    double c00 = M(1, 1) * low_23 - M(1, 2) * low_13 + M(1, 3) * low_12; \
+    double c01 = M(1, 0) * low_23 - M(1, 2) * low_03 + M(1, 3) * low_02; \
+    double c02 = M(1, 0) * low_13 - M(1, 1) * low_03 + M(1, 3) * low_01; \
+    double c03 = M(1, 0) * low_12 - M(1, 1) * low_02 + M(1, 2) * low_01; \
+    double det = M(0, 0) * c00 - M(0, 1) * c01 + M(0, 2) * c02 - M(0, 3) * c03;
+
+MATRIX_VECTORIZE_CLONES
+void _batch_determinant_4x4_lanes(BatchContext *c, int begin, int end) {
+    double *m[16], *restrict out = c->out->values;
+
+    _batch_lane_table(c->a, m);
+
+    #pragma GCC ivdep
+    for (int k = begin; k < end; k++) {
+        BATCH_LOW_MINORS
+        out[k] = det;
+    }
+}
+
+// Cofactors from the 2x2 minors of the bottom two rows (for the first two
+// rows of the adjugate) and of the top two rows (for the last two).
+MATRIX_VECTORIZE_CLONES
+void _batch_inverse_4x4_lanes(BatchContext *c, int begin, int end) {
+    double *m[16], *r[16];
+
+    _batch_lane_table(c->a, m);
+    _batch_lane_table(c->out, r);
+
+    #pragma GCC ivdep
+    for (int k = begin; k < end; k++) {
+        BATCH_LOW_MINORS
+
+        double high_01 = M(0, 0) * M(1, 1) - M(0, 1) * M(1, 0);
+        double high_02 = M(0, 0) * M(1, 2) - M(0, 2) * M(1, 0);
+        double high_03 = M(0, 0) * M(1, 3) - M(0, 3) * M(1, 0);
+        double high_12 = M(0, 1) * M(1, 2) - M(0, 2) * M(1, 1);
+        double high_13 = M(0, 1) * M(1, 3) - M(0, 3) * M(1, 1);
+        double high_23 = M(0, 2) * M(1, 3) - M(0, 3) * M(1, 2);
+        double inverse_det = det != 0 ? 1 / det : NAN;
+
+        double r01 = -(M(0, 1) * low_23 - M(0, 2) * low_13 + M(0, 3) * low_12) * inverse_det;
+        double r11 = (M(0, 0) * low_23 - M(0, 2) * low_03 + M(0, 3) * low_02) * inverse_det;
+        double r21 = -(M(0, 0) * low_13 - M(0, 1) * low_03 + M(0, 3) * low_01) * inverse_det;
+        double r31 = (M(0, 0) * low_12 - M(0, 1) * low_02 + M(0, 2) * low_01) * inverse_det;
+
+        double r02 = (M(3, 1) * high_23 - M(3, 2) * high_13 + M(3, 3) * high_12) * inverse_det;
+        double r12 = -(M(3, 0) * high_23 - M(3, 2) * high_03 + M(3, 3) * high_02) * inverse_det;
+        double r22 = (M(3, 0) * high_13 - M(3, 1) * high_03 + M(3, 3) * high_01) * inverse_det;
+        double r32 = -(M(3, 0) * high_12 - M(3, 1) * high_02 + M(3, 2) * high_01) * inverse_det;
+
+        double r03 = -(M(2, 1) * high_23 - M(2, 2) * high_13 + M(2, 3) * high_12) * inverse_det;
+        double r13 = (M(2, 0) * high_23 - M(2, 2) * high_03 + M(2, 3) * high_02) * inverse_det;
+        double r23 = -(M(2, 0) * high_13 - M(2, 1) * high_03 + M(2, 3) * high_01) * inverse_det;
+        double r33 = (M(2, 0) * high_12 - M(2, 1) * high_02 + M(2, 2) * high_01) * inverse_det;
+
+        R(0, 0) = c00 * inverse_det;
+        R(1, 0) = -c01 * inverse_det;
+        R(2, 0) = c02 * inverse_det;
+        R(3, 0) = -c03 * inverse_det;
+        R(0, 1) = r01;
+        R(1, 1) = r11;
+        R(2, 1) = r21;
+        R(3, 1) = r31;
+        R(0, 2) = r02;
+        R(1, 2) = r12;
+        R(2, 2) = r22;
+        R(3, 2) = r32;
+        R(0, 3) = r03;
+        R(1, 3) = r13;
+        R(2, 3) = r23;
+        R(3, 3) = r33;
+    }
+}
+#undef BATCH_LOW_MINORS
+#undef N
+#undef M
+#undef R
+
+#pragma GCC pop_options
+
+// Larger matrices are gathered one at a time into [A | I] and reduced by
+// Gauss-Jordan elimination with partial pivoting. With inverse unset only
+// the forward elimination runs, for the determinant.
+double _batch_reduce(MatrixBatch *batch, int index, int inverse, double *work) {
+    int n = batch->rows;
+    size_t width = inverse ? 2 * (size_t) n : (size_t) n;
+    double det = 1;
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            work[i * width + j] = matrix_batch_lanes(batch, i, j)[index];
+        }
+        for (size_t j = n; j < width; j++) {
+            work[i * width + j] = j - n == (size_t) i;
+        }
+    }
+
+    for (int k = 0; k < n; k++) {
+        int pivot = k;
+
+        for (int i = k + 1; i < n; i++) {
+            if (fabs(work[i * width + k]) > fabs(work[pivot * width + k])) pivot = i;
+        }
+
+        if (work[pivot * width + k] == 0) return 0;
+
+        if (pivot != k) {
+            for (size_t j = 0; j < width; j++) {
+                double temp = work[k * width + j];
+                work[k * width + j] = work[pivot * width + j];
+                work[pivot * width + j] = temp;
+            }
+            det = -det;
+        }
+
+        double *pivot_row = work + k * width;
+        det *= pivot_row[k];
+
+        for (int i = inverse ? 0 : k + 1; i < n; i++) {
+            double *row = work + i * width;
+            double f = row[k] / pivot_row[k];
+
+            if (i == k || f == 0) continue;
+
+            for (size_t j = k; j < width; j++) row[j] -= f * pivot_row[j];
+        }
+    }
+
+    return det;
+}
+
+// The work matrix of a chunk, whose size comes from the input, is taken
+// from the allocator rather than the stack.
+double* _batch_work(BatchContext *c, size_t size) {
+    double *work = matrix_allocate_scratch(c->out->allocator, size);
+
+    if (work == NULL) __atomic_store_n(&c->failed, 1, __ATOMIC_RELAXED);
+
+    return work;
+}
+
+void _batch_determinant_lanes(BatchContext *c, int begin, int end) {
+    int n = c->a->rows;
+    size_t size = (size_t) n * n * sizeof(double);
+    double *work = _batch_work(c, size);
+
+    if (work == NULL) return;
+
+    for (int k = begin; k < end; k++) {
+        c->out->values[k] = _batch_reduce(c->a, k, 0, work);
+    }
+
+    matrix_release(c->out->allocator, work, size);
+}
+
+void _batch_inverse_lanes(BatchContext *c, int begin, int end) {
+    int n = c->a->rows;
+    size_t size = (size_t) n * 2 * n * sizeof(double);
+    double *work = _batch_work(c, size);
+
+    if (work == NULL) return;
+
+    for (int k = begin; k < end; k++) {
+        int singular = _batch_reduce(c->a, k, 1, work) == 0;
+
+        for (int i = 0; i < n; i++) {
+            double *row = work + (size_t) i * 2 * n;
+
+            for (int j = 0; j < n; j++) {
+                matrix_batch_lanes(c->out, i, j)[k] = singular ? NAN : row[n + j] / row[i];
+            }
+        }
+    }
+
+    matrix_release(c->out->allocator, work, size);
+}
+
+MatrixBatchResult matrix_batch_multiply(MatrixBatch *a, MatrixBatch *b) {
+    if (a == NULL || b == NULL) return _batch_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (a->cols != b->rows) return _batch_result(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY, NULL);
+    if (a->count != b->count) return _batch_result(MATRIX_BATCH_SIZES_MUST_MATCH, NULL);
+
+    MatrixBatchResult result = new_matrix_batch(a->count, a->rows, b->cols);
+
+    if (!result.success) return result;
+
+    _batch_run(_batch_multiply_lanes, a, b, result.value, (long) a->rows * a->cols * b->cols);
+
+    return result;
+}
+
+MatrixBatchResult matrix_batch_transpose(MatrixBatch *batch) {
+    if (batch == NULL) return _batch_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+
+    MatrixBatchResult result = new_matrix_batch(batch->count, batch->cols, batch->rows);
+
+    if (!result.success) return result;
+
+    // Transposing only moves whole lane arrays around.
+    for (int i = 0; i < batch->rows; i++) {
+        for (int j = 0; j < batch->cols; j++) {
+            memcpy(matrix_batch_lanes(result.value, j, i), matrix_batch_lanes(batch, i, j), batch->count * sizeof(double));
+        }
+    }
+
+    return result;
+}
+
+MatrixBatchResult matrix_batch_determinant(MatrixBatch *batch) {
+    if (batch == NULL) return _batch_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (batch->rows != batch->cols) return _batch_result(MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT, NULL);
+
+    MatrixBatchResult result = new_matrix_batch(batch->count, 1, 1);
+
+    if (!result.success) return result;
+
+    int n = batch->rows;
+
+    if (n == 1) {
+        memcpy(result.value->values, batch->values, batch->count * sizeof(double));
+        return result;
+    }
+
+    BatchKernel kernels[] = { _batch_determinant_2x2_lanes, _batch_determinant_3x3_lanes, _batch_determinant_4x4_lanes };
+
+    MatrixResultCode code = _batch_run(
+        n <= 4 ? kernels[n - 2] : _batch_determinant_lanes, batch, NULL, result.value, (long) n * n * n
+    );
+
+    if (code != MATRIX_SUCCESS_CODE) {
+        delete_matrix_batch(result.value);
+        return _batch_result(code, NULL);
+    }
+
+    return result;
+}
+
+MatrixBatchResult matrix_batch_inverse(MatrixBatch *batch) {
+    if (batch == NULL) return _batch_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (batch->rows != batch->cols) return _batch_result(MATRIX_SHOULD_BE_SQUARE_TO_FACTOR, NULL);
+
+    MatrixBatchResult result = new_matrix_batch(batch->count, batch->rows, batch->cols);
+
+    if (!result.success) return result;
+
+    int n = batch->rows;
+    BatchKernel kernels[] = { _batch_inverse_2x2_lanes, _batch_inverse_3x3_lanes, _batch_inverse_4x4_lanes };
+
+    MatrixResultCode code = _batch_run(
+        n >= 2 && n <= 4 ? kernels[n - 2] : _batch_inverse_lanes, batch, NULL, result.value, (long) n * n * n
+    );
+
+    if (code != MATRIX_SUCCESS_CODE) {
+        delete_matrix_batch(result.value);
+        return _batch_result(code, NULL);
+    }
+
+    return result;
+}
+
+void delete_matrix_batch(MatrixBatch *batch) {
+    matrix_release(batch->allocator, batch->values, _batch_size(batch));
+    free(batch);
+}
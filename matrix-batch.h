@@ -0,0 +1,56 @@
+#ifndef MATRIX_BATCH_H
+#define MATRIX_BATCH_H
+
+#include "matrix.h"
+
+// count matrices of the same rows x cols shape in structure-of-arrays
+// layout: element (i, j) of every matrix sits in one contiguous lane array,
+// so a kernel written for a single matrix runs across count matrices at
+// once with each SIMD lane holding a different matrix. Element (i, j) of
+// matrix k is values[(i * cols + j) * stride + k]; stride is count rounded
+// up to a multiple of MATRIX_ALIGNMENT bytes, and the padding lanes are
+// zero.
+typedef struct MatrixBatch {
+    int count;
+    int rows;
+    int cols;
+    int stride;
+    double *values;
+    MatrixAllocator *allocator;
+} MatrixBatch;
+
+typedef struct MatrixBatchResult {
+    int success;
+    MatrixResultCode code;
+    MatrixBatch *value;
+} MatrixBatchResult;
+
+MatrixBatchResult new_matrix_batch(int count, int rows, int cols);
+
+// The lane array of element (row, col), 0-based.
+double* matrix_batch_lanes(MatrixBatch *batch, int row, int col);
+
+// Copies m into matrix index (0-based) of the batch.
+MatrixResultCode matrix_batch_set(MatrixBatch *batch, int index, Matrix *m);
+
+// Copies matrix index (0-based) of the batch out into a new matrix.
+MatrixResult matrix_batch_get(MatrixBatch *batch, int index);
+
+// All operations work matrix by matrix, in parallel over blocks of
+// matrices. 2x2, 3x3 and 4x4 determinants and inverses use closed forms;
+// larger ones are factored with partial pivoting one matrix at a time.
+
+MatrixBatchResult matrix_batch_multiply(MatrixBatch *a, MatrixBatch *b);
+
+MatrixBatchResult matrix_batch_transpose(MatrixBatch *batch);
+
+// The determinants, as a batch of 1x1 matrices.
+MatrixBatchResult matrix_batch_determinant(MatrixBatch *batch);
+
+// Singular matrices come out with NaN in every element, so that one of
+// them does not fail the whole batch.
+MatrixBatchResult matrix_batch_inverse(MatrixBatch *batch);
+
+void delete_matrix_batch(MatrixBatch *batch);
+
+#endif // MATRIX_BATCH_H
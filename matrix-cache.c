@@ -0,0 +1,307 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "matrix-cache.h"
+#include "matrix-io.h"
+
+#define CACHE_HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define CACHE_HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+
+int cache_enabled = 1;
+pthread_once_t cache_directory_once = PTHREAD_ONCE_INIT;
+// Empty when there is no usable cache directory.
+char cache_directory[PATH_MAX];
+
+void matrix_cache_set_enabled(int enabled) {
+    cache_enabled = enabled;
+}
+
+// Creates the directory and any missing parents.
+int _make_directories(char *path) {
+    for (char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        int made = mkdir(path, 0755) == 0 || errno == EEXIST;
+        *slash = '/';
+
+        if (!made) return 0;
+    }
+
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+void _resolve_cache_directory() {
+    const char *configured = getenv("MATRIX_CACHE_DIR");
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char path[PATH_MAX];
+    int length;
+
+    if (configured != NULL && *configured != '\0') {
+        length = snprintf(path, sizeof(path), "%s", configured);
+    } else if (xdg != NULL && *xdg != '\0') {
+        length = snprintf(path, sizeof(path), "%s/matrix-calculator", xdg);
+    } else if (home != NULL && *home != '\0') {
+        length = snprintf(path, sizeof(path), "%s/.cache/matrix-calculator", home);
+    } else {
+        return;
+    }
+
+    if (length <= 0 || length >= (int) sizeof(path)) return;
+
+    if (_make_directories(path) && access(path, W_OK | X_OK) == 0) strcpy(cache_directory, path);
+}
+
+int matrix_cache_enabled() {
+    if (!cache_enabled) return 0;
+
+    pthread_once(&cache_directory_once, _resolve_cache_directory);
+
+    return cache_directory[0] != '\0';
+}
+
+uint64_t _cache_rotate(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+uint64_t _cache_finish(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Two independent multiply-rotate lanes over 8-byte words, so the hash
+// runs at memory speed rather than a byte at a time.
+void _cache_hash(const unsigned char *data, size_t size, char key[MATRIX_CACHE_KEY_LENGTH + 1]) {
+    uint64_t h1 = CACHE_HASH_PRIME_1 ^ size;
+    uint64_t h2 = CACHE_HASH_PRIME_2 + size;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h1 = _cache_rotate(h1 ^ word * CACHE_HASH_PRIME_2, 31) * CACHE_HASH_PRIME_1;
+        h2 = _cache_rotate(h2 + word * CACHE_HASH_PRIME_1, 29) * CACHE_HASH_PRIME_2;
+    }
+
+    uint64_t tail = 0;
+    if (size > i) memcpy(&tail, data + i, size - i);
+
+    h1 = _cache_finish(h1 ^ tail * CACHE_HASH_PRIME_2);
+    h2 = _cache_finish(h2 + tail * CACHE_HASH_PRIME_1 + h1);
+
+    snprintf(key, MATRIX_CACHE_KEY_LENGTH + 1, "%016llx%016llx", (unsigned long long) h1, (unsigned long long) h2);
+}
+
+int _hash_file(const char *filename, char key[MATRIX_CACHE_KEY_LENGTH + 1]) {
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+
+    if (fd < 0) return 0;
+
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    size_t size = info.st_size;
+    void *data = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+
+    close(fd);
+
+    if (data == MAP_FAILED) return 0;
+
+    if (data != NULL) madvise(data, size, MADV_SEQUENTIAL);
+    _cache_hash(data, size, key);
+    if (data != NULL) munmap(data, size);
+
+    return 1;
+}
+
+int _cache_path(char path[PATH_MAX], const char *prefix, const char *name, const char *suffix) {
+    int length = snprintf(path, PATH_MAX, "%s/%s%s%s", cache_directory, prefix, name, suffix);
+    return length > 0 && length < PATH_MAX;
+}
+
+// Remembers which key a file had at a given inode, size and modification
+// time. Written to a temporary file and renamed, so that another process
+// never sees half a record.
+void _write_stat_record(const char *record_path, const char *record_name, struct stat *info, const char *key) {
+    char temporary[PATH_MAX];
+    char unique[64];
+
+    snprintf(unique, sizeof(unique), ".%d", (int) getpid());
+
+    if (!_cache_path(temporary, ".", record_name, unique)) return;
+
+    FILE *record = fopen(temporary, "w");
+
+    if (record == NULL) return;
+
+    int written = fprintf(record, "%llu %llu %lld %lld %ld %s\n",
+        (unsigned long long) info->st_dev, (unsigned long long) info->st_ino, (long long) info->st_size,
+        (long long) info->st_mtim.tv_sec, info->st_mtim.tv_nsec, key) > 0;
+
+    if (fclose(record) != 0 || !written || rename(temporary, record_path) != 0) unlink(temporary);
+}
+
+int matrix_cache_file_key(const char *filename, char key[MATRIX_CACHE_KEY_LENGTH + 1]) {
+    char resolved[PATH_MAX];
+    char record_name[MATRIX_CACHE_KEY_LENGTH + 1];
+    char record_path[PATH_MAX];
+    struct stat info;
+
+    if (!matrix_cache_enabled() || realpath(filename, resolved) == NULL || stat(resolved, &info) != 0) return 0;
+
+    _cache_hash((const unsigned char*) resolved, strlen(resolved), record_name);
+
+    if (!_cache_path(record_path, "stat-", record_name, "")) return 0;
+
+    FILE *record = fopen(record_path, "r");
+
+    if (record != NULL) {
+        unsigned long long device, inode;
+        long long size, seconds;
+        long nanoseconds;
+        char remembered[MATRIX_CACHE_KEY_LENGTH + 1];
+
+        int matched = fscanf(record, "%llu %llu %lld %lld %ld %32s",
+            &device, &inode, &size, &seconds, &nanoseconds, remembered) == 6 &&
+            device == (unsigned long long) info.st_dev && inode == (unsigned long long) info.st_ino &&
+            size == (long long) info.st_size && seconds == (long long) info.st_mtim.tv_sec &&
+            nanoseconds == info.st_mtim.tv_nsec && strlen(remembered) == MATRIX_CACHE_KEY_LENGTH;
+
+        fclose(record);
+
+        if (matched) {
+            memcpy(key, remembered, MATRIX_CACHE_KEY_LENGTH + 1);
+            utimensat(AT_FDCWD, record_path, NULL, 0);
+            return 1;
+        }
+    }
+
+    if (!_hash_file(resolved, key)) return 0;
+
+    _write_stat_record(record_path, record_name, &info, key);
+
+    return 1;
+}
+
+int matrix_cache_load(const char *name, Matrix *m) {
+    char path[PATH_MAX];
+
+    if (!matrix_cache_enabled() || !_cache_path(path, "", name, MATRIX_BINARY_EXTENSION)) return 0;
+
+    if (access(path, R_OK) != 0 || !read_matrix_from_file(m, path)) return 0;
+
+    // Modification times order the entries for eviction.
+    utimensat(AT_FDCWD, path, NULL, 0);
+
+    return 1;
+}
+
+typedef struct CacheEntry {
+    char *name;
+    off_t size;
+    struct timespec used;
+} CacheEntry;
+
+int _compare_cache_entries(const void *a, const void *b) {
+    const struct timespec *x = &((const CacheEntry*) a)->used;
+    const struct timespec *y = &((const CacheEntry*) b)->used;
+
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    if (x->tv_nsec != y->tv_nsec) return x->tv_nsec < y->tv_nsec ? -1 : 1;
+    return 0;
+}
+
+long long _cache_size_limit() {
+    const char *configured = getenv("MATRIX_CACHE_SIZE");
+    long long megabytes = configured != NULL ? atoll(configured) : 0;
+
+    return (megabytes > 0 ? megabytes : MATRIX_CACHE_DEFAULT_SIZE) << 20;
+}
+
+// Removes the least recently used entries until the cache fits its size.
+// Temporary files, whose names start with a dot, are left alone.
+void _cache_evict() {
+    DIR *directory = opendir(cache_directory);
+
+    if (directory == NULL) return;
+
+    CacheEntry *entries = NULL;
+    int count = 0, capacity = 0;
+    long long total = 0;
+    struct dirent *item;
+
+    while ((item = readdir(directory)) != NULL) {
+        char path[PATH_MAX];
+        struct stat info;
+
+        if (item->d_name[0] == '.' || !_cache_path(path, "", item->d_name, "")) continue;
+        if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) continue;
+
+        if (count == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 64;
+            CacheEntry *grown = realloc(entries, capacity * sizeof(CacheEntry));
+
+            if (grown == NULL) break;
+            entries = grown;
+        }
+
+        entries[count] = (CacheEntry) { strdup(item->d_name), info.st_size, info.st_mtim };
+
+        if (entries[count].name == NULL) break;
+
+        total += info.st_size;
+        count++;
+    }
+
+    closedir(directory);
+
+    long long limit = _cache_size_limit();
+
+    if (total > limit) {
+        qsort(entries, count, sizeof(CacheEntry), _compare_cache_entries);
+
+        for (int i = 0; i < count && total > limit; i++) {
+            char path[PATH_MAX];
+
+            if (_cache_path(path, "", entries[i].name, "") && unlink(path) == 0) total -= entries[i].size;
+        }
+    }
+
+    for (int i = 0; i < count; i++) free(entries[i].name);
+    free(entries);
+}
+
+void matrix_cache_store(const char *name, Matrix *m) {
+    char path[PATH_MAX];
+    char temporary[PATH_MAX];
+    char unique[64];
+
+    if (!matrix_cache_enabled() || !_cache_path(path, "", name, MATRIX_BINARY_EXTENSION)) return;
+
+    // The temporary keeps the extension, which selects the binary format.
+    snprintf(unique, sizeof(unique), ".%d%s", (int) getpid(), MATRIX_BINARY_EXTENSION);
+
+    if (!_cache_path(temporary, ".", name, unique)) return;
+
+    if (!write_matrix_to_file(m, temporary) || rename(temporary, path) != 0) {
+        unlink(temporary);
+        return;
+    }
+
+    _cache_evict();
+}
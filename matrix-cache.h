@@ -0,0 +1,41 @@
+#ifndef MATRIX_CACHE_H
+#define MATRIX_CACHE_H
+
+#include "matrix.h"
+
+// Hex digits of a content key: a 128-bit hash of the file's bytes. It is
+// not cryptographic, only meant to tell apart the files one user works on.
+#define MATRIX_CACHE_KEY_LENGTH 32
+
+#define MATRIX_CACHE_NAME_MAX_LENGTH 256
+
+// Total size of the entries kept, in MiB, unless MATRIX_CACHE_SIZE says
+// otherwise. Past it, the least recently used entries are removed.
+#define MATRIX_CACHE_DEFAULT_SIZE 1024
+
+// The cache lives in $MATRIX_CACHE_DIR, or in matrix-calculator under
+// $XDG_CACHE_HOME or ~/.cache, and is off if that cannot be created or
+// written to. Entries are .matb files, so reading one maps it instead of
+// parsing anything.
+void matrix_cache_set_enabled(int enabled);
+
+int matrix_cache_enabled();
+
+// Writes the content key of the file into key. The key is remembered along
+// with the file's inode, size and modification time, so a file that has not
+// changed since is not read again. Returns 0 if the cache is off or the
+// file cannot be read.
+int matrix_cache_file_key(const char *filename, char key[MATRIX_CACHE_KEY_LENGTH + 1]);
+
+// Reads the entry with the name into m, marking it as recently used.
+// Returns 0, printing nothing, if there is no such entry. An entry that
+// cannot be read, such as a corrupt one, also returns 0, but after
+// read_matrix_from_file has printed why; the result is then computed and
+// saved over it.
+int matrix_cache_load(const char *name, Matrix *m);
+
+// Saves m as the entry with the name, then evicts entries while the cache
+// is over its size. The cache only saves work, so failures are silent.
+void matrix_cache_store(const char *name, Matrix *m);
+
+#endif // MATRIX_CACHE_H
@@ -0,0 +1,543 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix-expression.h"
+#include "gemm.h"
+#include "simd.h"
+#include "thread-pool.h"
+
+// Columns handled per step of a fused pass: the destination chunk stays in
+// L1 while every operand of the sum is streamed into it.
+#define EXPRESSION_FUSION_CHUNK 1024
+
+#define EXPRESSION_PARALLEL_MIN_WORK (1 << 16)
+
+typedef struct ExpressionParser {
+    const char *text;
+    const char *at;
+    MatrixExpression *e;
+    int capacity;
+    int failed;
+} ExpressionParser;
+
+int _expression_parse_sum(ExpressionParser *p);
+
+void _expression_fail(ExpressionParser *p, const char *message) {
+    if (!p->failed) {
+        printf("Invalid expression: %s at position %d.", message, (int) (p->at - p->text) + 1);
+    }
+    p->failed = 1;
+}
+
+void _expression_skip_spaces(ExpressionParser *p) {
+    while (isspace((unsigned char) *p->at)) p->at++;
+}
+
+int _expression_add_node(ExpressionParser *p, MatrixExpressionNode node) {
+    MatrixExpression *e = p->e;
+
+    if (e->node_count == p->capacity) {
+        int capacity = p->capacity == 0 ? 16 : p->capacity * 2;
+        MatrixExpressionNode *nodes = realloc(e->nodes, capacity * sizeof(MatrixExpressionNode));
+
+        if (nodes == NULL) {
+            _expression_fail(p, "out of memory");
+            return -1;
+        }
+
+        e->nodes = nodes;
+        p->capacity = capacity;
+    }
+
+    e->nodes[e->node_count] = node;
+
+    return e->node_count++;
+}
+
+int _expression_binary_node(ExpressionParser *p, MatrixExpressionNodeType type, int left, int right) {
+    return _expression_add_node(p, (MatrixExpressionNode) { type, left, right, -1, 0, 0, 0 });
+}
+
+int _expression_variable(ExpressionParser *p, const char *name, int length) {
+    MatrixExpression *e = p->e;
+
+    for (int v = 0; v < e->variable_count; v++) {
+        if ((int) strlen(e->variable_names[v]) == length && strncmp(e->variable_names[v], name, length) == 0) {
+            return v;
+        }
+    }
+
+    if (length >= MATRIX_EXPRESSION_NAME_SIZE) {
+        _expression_fail(p, "matrix name is too long");
+        return -1;
+    }
+
+    if (e->variable_count == MATRIX_EXPRESSION_MAX_VARIABLES) {
+        _expression_fail(p, "too many matrices");
+        return -1;
+    }
+
+    memcpy(e->variable_names[e->variable_count], name, length);
+    e->variable_names[e->variable_count][length] = '\0';
+    e->variables[e->variable_count] = NULL;
+
+    return e->variable_count++;
+}
+
+int _expression_parse_primary(ExpressionParser *p) {
+    _expression_skip_spaces(p);
+
+    if (*p->at == '(') {
+        p->at++;
+
+        int inner = _expression_parse_sum(p);
+
+        _expression_skip_spaces(p);
+
+        if (*p->at != ')') {
+            _expression_fail(p, "expected ')'");
+            return -1;
+        }
+
+        p->at++;
+
+        return inner;
+    }
+
+    if (isdigit((unsigned char) *p->at) || *p->at == '.') {
+        char *end;
+        double constant = strtod(p->at, &end);
+
+        if (end == p->at) {
+            _expression_fail(p, "invalid number");
+            return -1;
+        }
+
+        p->at = end;
+
+        return _expression_add_node(p, (MatrixExpressionNode) { MATRIX_EXPRESSION_CONSTANT, -1, -1, -1, constant, 0, 0 });
+    }
+
+    if (isalpha((unsigned char) *p->at) || *p->at == '_') {
+        const char *name = p->at;
+
+        while (isalnum((unsigned char) *p->at) || *p->at == '_') p->at++;
+
+        int variable = _expression_variable(p, name, p->at - name);
+
+        if (variable < 0) return -1;
+
+        return _expression_add_node(p, (MatrixExpressionNode) { MATRIX_EXPRESSION_VARIABLE, -1, -1, variable, 0, 0, 0 });
+    }
+
+    _expression_fail(p, *p->at == '\0' ? "unexpected end" : "unexpected character");
+
+    return -1;
+}
+
+int _expression_parse_unary(ExpressionParser *p) {
+    _expression_skip_spaces(p);
+
+    if (*p->at == '-' || *p->at == '+') {
+        int negate = *p->at++ == '-';
+        int operand = _expression_parse_unary(p);
+
+        if (operand < 0 || !negate) return operand;
+
+        return _expression_binary_node(p, MATRIX_EXPRESSION_NEGATE, operand, -1);
+    }
+
+    return _expression_parse_primary(p);
+}
+
+int _expression_parse_product(ExpressionParser *p) {
+    int left = _expression_parse_unary(p);
+
+    while (left >= 0) {
+        _expression_skip_spaces(p);
+
+        if (*p->at != '*') break;
+
+        p->at++;
+
+        int right = _expression_parse_unary(p);
+
+        if (right < 0) return -1;
+
+        left = _expression_binary_node(p, MATRIX_EXPRESSION_MULTIPLY, left, right);
+    }
+
+    return left;
+}
+
+int _expression_parse_sum(ExpressionParser *p) {
+    int left = _expression_parse_product(p);
+
+    while (left >= 0) {
+        _expression_skip_spaces(p);
+
+        if (*p->at != '+' && *p->at != '-') break;
+
+        MatrixExpressionNodeType type = *p->at++ == '+' ? MATRIX_EXPRESSION_ADD : MATRIX_EXPRESSION_SUBTRACT;
+        int right = _expression_parse_product(p);
+
+        if (right < 0) return -1;
+
+        left = _expression_binary_node(p, type, left, right);
+    }
+
+    return left;
+}
+
+MatrixExpression* parse_matrix_expression(const char *text) {
+    MatrixExpression *e = calloc(1, sizeof(MatrixExpression));
+
+    if (e == NULL) {
+        printf("Error: Unexpected error occurred.");
+        return NULL;
+    }
+
+    ExpressionParser p = { text, text, e, 0, 0 };
+
+    e->root = _expression_parse_sum(&p);
+
+    _expression_skip_spaces(&p);
+
+    if (e->root >= 0 && *p.at != '\0') {
+        _expression_fail(&p, "unexpected character");
+    }
+
+    if (p.failed || e->root < 0) {
+        delete_matrix_expression(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+int matrix_expression_bind(MatrixExpression *e, const char *name, Matrix *m) {
+    for (int v = 0; v < e->variable_count; v++) {
+        if (strcmp(e->variable_names[v], name) == 0) {
+            e->variables[v] = m;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int _expression_is_scalar(MatrixExpressionNode *node) {
+    return node->rows == 0;
+}
+
+// Fills in the shape of every node under index, checking that the operands
+// of each operation agree.
+MatrixResultCode _expression_shape(MatrixExpression *e, int index) {
+    MatrixExpressionNode *node = &e->nodes[index];
+    MatrixExpressionNode *left = node->left >= 0 ? &e->nodes[node->left] : NULL;
+    MatrixExpressionNode *right = node->right >= 0 ? &e->nodes[node->right] : NULL;
+    MatrixResultCode code;
+
+    if (left != NULL && (code = _expression_shape(e, node->left)) != MATRIX_SUCCESS_CODE) return code;
+    if (right != NULL && (code = _expression_shape(e, node->right)) != MATRIX_SUCCESS_CODE) return code;
+
+    switch (node->type) {
+        case MATRIX_EXPRESSION_VARIABLE:
+            if (e->variables[node->variable] == NULL) return MATRIX_ARGUMENTS_MUST_NOT_BE_NULL;
+            if (e->variables[node->variable]->element_type != MATRIX_FLOAT64) return MATRIX_UNSUPPORTED_ELEMENT_TYPE;
+            node->rows = e->variables[node->variable]->rows;
+            node->cols = e->variables[node->variable]->cols;
+            break;
+        case MATRIX_EXPRESSION_CONSTANT:
+            node->rows = node->cols = 0;
+            break;
+        case MATRIX_EXPRESSION_NEGATE:
+            node->rows = left->rows;
+            node->cols = left->cols;
+            break;
+        case MATRIX_EXPRESSION_ADD:
+        case MATRIX_EXPRESSION_SUBTRACT:
+            if (left->rows != right->rows || left->cols != right->cols) {
+                return node->type == MATRIX_EXPRESSION_ADD
+                    ? MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM
+                    : MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT;
+            }
+            node->rows = left->rows;
+            node->cols = left->cols;
+            break;
+        case MATRIX_EXPRESSION_MULTIPLY:
+            if (_expression_is_scalar(left) || _expression_is_scalar(right)) {
+                node->rows = _expression_is_scalar(left) ? right->rows : left->rows;
+                node->cols = _expression_is_scalar(left) ? right->cols : left->cols;
+            } else if (left->cols != right->rows) {
+                return MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY;
+            } else {
+                node->rows = left->rows;
+                node->cols = right->cols;
+            }
+            break;
+    }
+
+    return MATRIX_SUCCESS_CODE;
+}
+
+double _expression_scalar(MatrixExpression *e, int index) {
+    MatrixExpressionNode *node = &e->nodes[index];
+
+    switch (node->type) {
+        case MATRIX_EXPRESSION_CONSTANT:
+            return node->constant;
+        case MATRIX_EXPRESSION_NEGATE:
+            return -_expression_scalar(e, node->left);
+        case MATRIX_EXPRESSION_ADD:
+            return _expression_scalar(e, node->left) + _expression_scalar(e, node->right);
+        case MATRIX_EXPRESSION_SUBTRACT:
+            return _expression_scalar(e, node->left) - _expression_scalar(e, node->right);
+        case MATRIX_EXPRESSION_MULTIPLY:
+            return _expression_scalar(e, node->left) * _expression_scalar(e, node->right);
+        default:
+            return 0;
+    }
+}
+
+// Strips negations and scalar factors off a matrix-valued node, folding
+// them into *coefficient, and returns the node that remains.
+int _expression_unwrap(MatrixExpression *e, int index, double *coefficient) {
+    for (;;) {
+        MatrixExpressionNode *node = &e->nodes[index];
+
+        if (node->type == MATRIX_EXPRESSION_NEGATE) {
+            *coefficient = -*coefficient;
+            index = node->left;
+        } else if (node->type == MATRIX_EXPRESSION_MULTIPLY && _expression_is_scalar(&e->nodes[node->left])) {
+            *coefficient *= _expression_scalar(e, node->left);
+            index = node->right;
+        } else if (node->type == MATRIX_EXPRESSION_MULTIPLY && _expression_is_scalar(&e->nodes[node->right])) {
+            *coefficient *= _expression_scalar(e, node->right);
+            index = node->left;
+        } else {
+            return index;
+        }
+    }
+}
+
+typedef struct ExpressionTerm {
+    double coefficient;
+    int node;
+} ExpressionTerm;
+
+// Flattens a matrix-valued node into a signed, scaled sum of terms, each
+// either a variable or a matrix product.
+void _expression_collect(MatrixExpression *e, int index, double coefficient, ExpressionTerm *terms, int *count) {
+    index = _expression_unwrap(e, index, &coefficient);
+
+    MatrixExpressionNode *node = &e->nodes[index];
+
+    if (node->type == MATRIX_EXPRESSION_ADD || node->type == MATRIX_EXPRESSION_SUBTRACT) {
+        _expression_collect(e, node->left, coefficient, terms, count);
+        _expression_collect(
+            e, node->right, node->type == MATRIX_EXPRESSION_ADD ? coefficient : -coefficient, terms, count
+        );
+    } else {
+        terms[(*count)++] = (ExpressionTerm) { coefficient, index };
+    }
+}
+
+typedef struct ExpressionFusionContext {
+    const MatrixKernels *kernels;
+    Matrix *dst;
+    Matrix **operands;
+    double *coefficients;
+    int count;
+} ExpressionFusionContext;
+
+double* _expression_row(Matrix *m, int row) {
+    return m->values + (size_t) row * m->stride;
+}
+
+// dst = sum of coefficients[k] * operands[k], one chunk of a row at a time.
+void _expression_fused_rows(int begin, int end, void *context) {
+    ExpressionFusionContext *c = context;
+    int cols = c->dst->cols;
+
+    for (int i = begin; i < end; i++) {
+        double *dst = _expression_row(c->dst, i);
+
+        for (int j = 0; j < cols; j += EXPRESSION_FUSION_CHUNK) {
+            int n = cols - j < EXPRESSION_FUSION_CHUNK ? cols - j : EXPRESSION_FUSION_CHUNK;
+
+            if (c->count == 0) {
+                memset(dst + j, 0, n * sizeof(double));
+                continue;
+            }
+
+            c->kernels->scale(dst + j, _expression_row(c->operands[0], i) + j, c->coefficients[0], n);
+
+            for (int k = 1; k < c->count; k++) {
+                c->kernels->axpy(dst + j, c->coefficients[k], _expression_row(c->operands[k], i) + j, n);
+            }
+        }
+    }
+}
+
+MatrixResultCode _expression_evaluate(MatrixExpression *e, int index, Matrix *dst);
+
+// Returns the matrix a product operand stands for: the bound matrix for a
+// variable, a freshly evaluated one (also stored in *temporary) otherwise.
+Matrix* _expression_operand(MatrixExpression *e, int index, Matrix **temporary, MatrixResultCode *code) {
+    MatrixExpressionNode *node = &e->nodes[index];
+
+    *temporary = NULL;
+
+    if (node->type == MATRIX_EXPRESSION_VARIABLE) return e->variables[node->variable];
+
+    MatrixResult result = new_matrix(node->rows, node->cols);
+
+    if (!result.success) {
+        *code = result.code;
+        return NULL;
+    }
+
+    *code = _expression_evaluate(e, index, result.value);
+
+    if (*code != MATRIX_SUCCESS_CODE) {
+        delete_matrix(result.value);
+        return NULL;
+    }
+
+    return *temporary = result.value;
+}
+
+MatrixResultCode _expression_evaluate(MatrixExpression *e, int index, Matrix *dst) {
+    MatrixAllocator *allocator = matrix_current_allocator();
+    ExpressionTerm *terms = matrix_allocate_scratch(allocator, e->node_count * sizeof(ExpressionTerm));
+    Matrix **operands = matrix_allocate_scratch(allocator, e->node_count * sizeof(Matrix*));
+    double *coefficients = matrix_allocate_scratch(allocator, e->node_count * sizeof(double));
+    MatrixResultCode code = MATRIX_SUCCESS_CODE;
+    int count = 0, fused = 0;
+
+    if (terms == NULL || operands == NULL || coefficients == NULL) {
+        matrix_release(allocator, coefficients, e->node_count * sizeof(double));
+        matrix_release(allocator, operands, e->node_count * sizeof(Matrix*));
+        matrix_release(allocator, terms, e->node_count * sizeof(ExpressionTerm));
+        return MATRIX_INTERNAL_ERROR;
+    }
+
+    _expression_collect(e, index, 1, terms, &count);
+
+    for (int t = 0; t < count; t++) {
+        MatrixExpressionNode *node = &e->nodes[terms[t].node];
+
+        if (node->type == MATRIX_EXPRESSION_VARIABLE) {
+            operands[fused] = e->variables[node->variable];
+            coefficients[fused++] = terms[t].coefficient;
+        }
+    }
+
+    ExpressionFusionContext context = { simd_kernels(), dst, operands, coefficients, fused };
+
+    thread_pool_parallel_for(
+        0, dst->rows,
+        thread_pool_grain((long) dst->cols * (fused > 0 ? fused : 1), EXPRESSION_PARALLEL_MIN_WORK),
+        _expression_fused_rows, &context
+    );
+
+    for (int t = 0; t < count && code == MATRIX_SUCCESS_CODE; t++) {
+        MatrixExpressionNode *node = &e->nodes[terms[t].node];
+
+        if (node->type != MATRIX_EXPRESSION_MULTIPLY) continue;
+
+        double coefficient = terms[t].coefficient;
+        int left = _expression_unwrap(e, node->left, &coefficient);
+        int right = _expression_unwrap(e, node->right, &coefficient);
+        Matrix *left_temporary, *right_temporary = NULL;
+        Matrix *a = _expression_operand(e, left, &left_temporary, &code);
+        Matrix *b = a == NULL ? NULL : _expression_operand(e, right, &right_temporary, &code);
+
+        if (a != NULL && b != NULL &&
+            !gemm(a->rows, b->cols, a->cols, coefficient, a->values, a->stride, b->values, b->stride, dst->values, dst->stride)) {
+            code = MATRIX_INTERNAL_ERROR;
+        }
+
+        if (left_temporary != NULL) delete_matrix(left_temporary);
+        if (right_temporary != NULL) delete_matrix(right_temporary);
+    }
+
+    matrix_release(allocator, coefficients, e->node_count * sizeof(double));
+    matrix_release(allocator, operands, e->node_count * sizeof(Matrix*));
+    matrix_release(allocator, terms, e->node_count * sizeof(ExpressionTerm));
+
+    return code;
+}
+
+int _expression_overlaps(Matrix *a, Matrix *b) {
+    char *a_begin = (char*) a->values, *a_end = (char*) (a->values + (size_t) a->rows * a->stride);
+    char *b_begin = (char*) b->values, *b_end = (char*) (b->values + (size_t) b->rows * b->stride);
+
+    return a_begin < b_end && b_begin < a_end;
+}
+
+MatrixResult matrix_expression_evaluate_into(Matrix *dst, MatrixExpression *e) {
+    MatrixResult result = { 0, MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL };
+
+    if (dst == NULL || e == NULL) return result;
+
+    result.code = _expression_shape(e, e->root);
+
+    if (result.code != MATRIX_SUCCESS_CODE) return result;
+
+    if (_expression_is_scalar(&e->nodes[e->root]) ||
+        dst->rows != e->nodes[e->root].rows || dst->cols != e->nodes[e->root].cols) {
+        result.code = MATRIX_INVALID_DESTINATION_DIMENSIONS;
+        return result;
+    }
+
+    if (dst->element_type != MATRIX_FLOAT64) {
+        result.code = MATRIX_UNSUPPORTED_ELEMENT_TYPE;
+        return result;
+    }
+
+    for (int v = 0; v < e->variable_count; v++) {
+        if (_expression_overlaps(dst, e->variables[v])) {
+            result.code = MATRIX_DESTINATION_OVERLAPS_ARGUMENTS;
+            return result;
+        }
+    }
+
+    result.code = _expression_evaluate(e, e->root, dst);
+    result.success = result.code == MATRIX_SUCCESS_CODE;
+    result.value = result.success ? dst : NULL;
+
+    return result;
+}
+
+MatrixResult matrix_expression_evaluate(MatrixExpression *e) {
+    MatrixResult result = { 0, MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL };
+
+    if (e == NULL) return result;
+
+    result.code = _expression_shape(e, e->root);
+
+    if (result.code != MATRIX_SUCCESS_CODE) return result;
+
+    if (_expression_is_scalar(&e->nodes[e->root])) {
+        result.code = MATRIX_DIMENSIONS_MUST_BE_POSITIVE;
+        return result;
+    }
+
+    result = new_matrix(e->nodes[e->root].rows, e->nodes[e->root].cols);
+
+    if (!result.success) return result;
+
+    MatrixResult outcome = matrix_expression_evaluate_into(result.value, e);
+
+    if (!outcome.success) delete_matrix(result.value);
+
+    return outcome;
+}
+
+void delete_matrix_expression(MatrixExpression *e) {
+    free(e->nodes);
+    free(e);
+}
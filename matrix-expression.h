@@ -0,0 +1,60 @@
+#ifndef MATRIX_EXPRESSION_H
+#define MATRIX_EXPRESSION_H
+
+#include "matrix.h"
+
+#define MATRIX_EXPRESSION_MAX_VARIABLES 32
+#define MATRIX_EXPRESSION_NAME_SIZE 32
+
+typedef enum MatrixExpressionNodeType {
+    MATRIX_EXPRESSION_VARIABLE,
+    MATRIX_EXPRESSION_CONSTANT,
+    MATRIX_EXPRESSION_ADD,
+    MATRIX_EXPRESSION_SUBTRACT,
+    MATRIX_EXPRESSION_MULTIPLY,
+    MATRIX_EXPRESSION_NEGATE
+} MatrixExpressionNodeType;
+
+// Nodes refer to their operands by index into MatrixExpression.nodes.
+// rows and cols are filled in by evaluation; 0 x 0 marks a scalar.
+typedef struct MatrixExpressionNode {
+    MatrixExpressionNodeType type;
+    int left;
+    int right;
+    int variable;
+    double constant;
+    int rows;
+    int cols;
+} MatrixExpressionNode;
+
+// An arithmetic expression over named matrices, such as "A*B + 2*C - D".
+// Each name is bound to a matrix before evaluation.
+typedef struct MatrixExpression {
+    MatrixExpressionNode *nodes;
+    int node_count;
+    int root;
+    int variable_count;
+    char variable_names[MATRIX_EXPRESSION_MAX_VARIABLES][MATRIX_EXPRESSION_NAME_SIZE];
+    Matrix *variables[MATRIX_EXPRESSION_MAX_VARIABLES];
+} MatrixExpression;
+
+// Parses +, -, * (matrix or scalar product), unary minus, parentheses,
+// numbers and names. Errors are printed and reported by returning NULL.
+MatrixExpression* parse_matrix_expression(const char *text);
+
+// Binds a name used in the expression to a float64 matrix. Returns 0 if
+// the expression does not use the name.
+int matrix_expression_bind(MatrixExpression *e, const char *name, Matrix *m);
+
+// Evaluates the expression without building intermediate matrices where
+// possible: every sum of plain matrices is computed in one pass over the
+// destination, and every product in the sum is accumulated straight into
+// it by the GEMM. Only product operands that are themselves expressions,
+// such as (A+B)*C, are materialized.
+MatrixResult matrix_expression_evaluate_into(Matrix *dst, MatrixExpression *e);
+
+MatrixResult matrix_expression_evaluate(MatrixExpression *e);
+
+void delete_matrix_expression(MatrixExpression *e);
+
+#endif // MATRIX_EXPRESSION_H
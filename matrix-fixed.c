@@ -0,0 +1,186 @@
+#include <stddef.h>
+#include <math.h>
+#include "matrix-fixed.h"
+
+// Every loop below runs a compile-time number of times; asking for it to be
+// unrolled completely leaves straight-line code with the elements in
+// registers. No target clones here: the determinant has to round the same
+// way as the generic LU path, which rules out contracting into FMAs.
+#define FIXED_UNROLL _Pragma("GCC unroll 8")
+
+#define MATRIX_FIXED_DEFINE(N)                                                     \
+    void matrix##N##_multiply(Matrix##N *dst, const Matrix##N *a, const Matrix##N *b) { \
+        Matrix##N result;                                                          \
+                                                                                   \
+        FIXED_UNROLL                                                               \
+        for (int i = 0; i < N; i++) {                                              \
+            FIXED_UNROLL                                                           \
+            for (int j = 0; j < N; j++) {                                          \
+                double sum = 0;                                                    \
+                FIXED_UNROLL                                                       \
+                for (int p = 0; p < N; p++) sum += a->values[i][p] * b->values[p][j]; \
+                result.values[i][j] = sum;                                         \
+            }                                                                      \
+        }                                                                          \
+                                                                                   \
+        *dst = result;                                                             \
+    }                                                                              \
+                                                                                   \
+    void matrix##N##_transpose(Matrix##N *dst, const Matrix##N *m) {               \
+        Matrix##N result;                                                          \
+                                                                                   \
+        FIXED_UNROLL                                                               \
+        for (int i = 0; i < N; i++) {                                              \
+            FIXED_UNROLL                                                           \
+            for (int j = 0; j < N; j++) result.values[j][i] = m->values[i][j];     \
+        }                                                                          \
+                                                                                   \
+        *dst = result;                                                             \
+    }                                                                              \
+                                                                                   \
+    /* Factors lu in place as matrix_lu_factor does: partial pivoting on the */    \
+    /* first largest magnitude, multipliers stored where they zeroed. Returns */   \
+    /* the sign of the permutation, or 0 if a pivot is zero. */                    \
+    int _fixed_lu_factor_##N(Matrix##N *lu, int pivots[N]) {                       \
+        int sign = 1;                                                              \
+                                                                                   \
+        FIXED_UNROLL                                                               \
+        for (int k = 0; k < N; k++) {                                              \
+            double max = fabs(lu->values[k][k]);                                   \
+            int max_idx = k;                                                       \
+                                                                                   \
+            FIXED_UNROLL                                                           \
+            for (int row = k + 1; row < N; row++) {                                \
+                if (fabs(lu->values[row][k]) > max) {                              \
+                    max = fabs(lu->values[row][k]);                                \
+                    max_idx = row;                                                 \
+                }                                                                  \
+            }                                                                      \
+                                                                                   \
+            pivots[k] = max_idx;                                                   \
+                                                                                   \
+            if (max_idx != k) {                                                    \
+                sign = -sign;                                                      \
+                FIXED_UNROLL                                                       \
+                for (int col = 0; col < N; col++) {                                \
+                    double temp = lu->values[k][col];                              \
+                    lu->values[k][col] = lu->values[max_idx][col];                 \
+                    lu->values[max_idx][col] = temp;                               \
+                }                                                                  \
+            }                                                                      \
+                                                                                   \
+            double ref = lu->values[k][k];                                         \
+                                                                                   \
+            if (ref == 0) return 0;                                                \
+                                                                                   \
+            FIXED_UNROLL                                                           \
+            for (int i = k + 1; i < N; i++) {                                      \
+                double value_to_set_zero = lu->values[i][k];                       \
+                                                                                   \
+                if (value_to_set_zero != 0) {                                      \
+                    double f = value_to_set_zero / ref * -1;                       \
+                    FIXED_UNROLL                                                   \
+                    for (int j = k + 1; j < N; j++) {                              \
+                        lu->values[i][j] = lu->values[i][j] + lu->values[k][j] * f; \
+                    }                                                              \
+                    lu->values[i][k] = -f;                                         \
+                }                                                                  \
+            }                                                                      \
+        }                                                                          \
+                                                                                   \
+        return sign;                                                               \
+    }                                                                              \
+                                                                                   \
+    double matrix##N##_determinant(const Matrix##N *m) {                           \
+        Matrix##N lu = *m;                                                         \
+        int pivots[N];                                                             \
+        int sign = _fixed_lu_factor_##N(&lu, pivots);                              \
+                                                                                   \
+        if (sign == 0) return 0;                                                   \
+                                                                                   \
+        double det = 1;                                                            \
+        FIXED_UNROLL                                                               \
+        for (int i = 0; i < N; i++) det *= lu.values[i][i];                        \
+                                                                                   \
+        return det * sign;                                                         \
+    }                                                                              \
+                                                                                   \
+    int matrix##N##_inverse(Matrix##N *dst, const Matrix##N *m) {                  \
+        Matrix##N lu = *m, x = { { { 0 } } };                                      \
+        int pivots[N];                                                             \
+                                                                                   \
+        if (_fixed_lu_factor_##N(&lu, pivots) == 0) return 0;                      \
+                                                                                   \
+        /* The identity with the pivoting's row swaps applied. */                  \
+        int order[N];                                                              \
+        FIXED_UNROLL                                                               \
+        for (int i = 0; i < N; i++) order[i] = i;                                  \
+        FIXED_UNROLL                                                               \
+        for (int k = 0; k < N; k++) {                                              \
+            int temp = order[k];                                                   \
+            order[k] = order[pivots[k]];                                           \
+            order[pivots[k]] = temp;                                               \
+        }                                                                          \
+        FIXED_UNROLL                                                               \
+        for (int i = 0; i < N; i++) x.values[i][order[i]] = 1;                     \
+                                                                                   \
+        FIXED_UNROLL                                                               \
+        for (int i = 1; i < N; i++) {                                              \
+            FIXED_UNROLL                                                           \
+            for (int j = 0; j < i; j++) {                                          \
+                FIXED_UNROLL                                                       \
+                for (int c = 0; c < N; c++) {                                      \
+                    x.values[i][c] -= lu.values[i][j] * x.values[j][c];            \
+                }                                                                  \
+            }                                                                      \
+        }                                                                          \
+                                                                                   \
+        FIXED_UNROLL                                                               \
+        for (int i = N - 1; i >= 0; i--) {                                         \
+            FIXED_UNROLL                                                           \
+            for (int j = i + 1; j < N; j++) {                                      \
+                FIXED_UNROLL                                                       \
+                for (int c = 0; c < N; c++) {                                      \
+                    x.values[i][c] -= lu.values[i][j] * x.values[j][c];            \
+                }                                                                  \
+            }                                                                      \
+                                                                                   \
+            double reciprocal = 1 / lu.values[i][i];                               \
+            FIXED_UNROLL                                                           \
+            for (int c = 0; c < N; c++) x.values[i][c] *= reciprocal;              \
+        }                                                                          \
+                                                                                   \
+        *dst = x;                                                                  \
+        return 1;                                                                  \
+    }                                                                              \
+                                                                                   \
+    void _fixed_multiply_##N(double *dst, const double *a, const double *b) {      \
+        matrix##N##_multiply((Matrix##N*) dst, (const Matrix##N*) a, (const Matrix##N*) b); \
+    }                                                                              \
+                                                                                   \
+    void _fixed_transpose_##N(double *dst, const double *m) {                      \
+        matrix##N##_transpose((Matrix##N*) dst, (const Matrix##N*) m);             \
+    }                                                                              \
+                                                                                   \
+    double _fixed_determinant_##N(const double *m) {                               \
+        return matrix##N##_determinant((const Matrix##N*) m);                      \
+    }                                                                              \
+                                                                                   \
+    int _fixed_inverse_##N(double *dst, const double *m) {                         \
+        return matrix##N##_inverse((Matrix##N*) dst, (const Matrix##N*) m);        \
+    }
+
+MATRIX_FIXED_SIZES(MATRIX_FIXED_DEFINE)
+
+#define MATRIX_FIXED_ENTRY(N) {                                                    \
+    N, _fixed_multiply_##N, _fixed_transpose_##N, _fixed_determinant_##N, _fixed_inverse_##N \
+},
+
+const MatrixFixedKernels MATRIX_FIXED_KERNELS[] = {
+    MATRIX_FIXED_SIZES(MATRIX_FIXED_ENTRY)
+};
+
+const MatrixFixedKernels* matrix_fixed_kernels(int n) {
+    if (n < MATRIX_FIXED_MIN || n > MATRIX_FIXED_MAX) return NULL;
+    return &MATRIX_FIXED_KERNELS[n - MATRIX_FIXED_MIN];
+}
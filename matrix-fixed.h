@@ -0,0 +1,49 @@
+#ifndef MATRIX_FIXED_H
+#define MATRIX_FIXED_H
+
+#define MATRIX_FIXED_MIN 2
+#define MATRIX_FIXED_MAX 8
+
+// Calls X(N) for every fixed size.
+#define MATRIX_FIXED_SIZES(X) X(2) X(3) X(4) X(5) X(6) X(7) X(8)
+
+// For each N from 2 to 8, a value type that lives on the stack and kernels
+// whose loops all have compile-time bounds, fully unrolled:
+//
+//   Matrix2 { double values[2][2]; }
+//   void matrix2_multiply(Matrix2 *dst, const Matrix2 *a, const Matrix2 *b);
+//   void matrix2_transpose(Matrix2 *dst, const Matrix2 *m);
+//   double matrix2_determinant(const Matrix2 *m);
+//   int matrix2_inverse(Matrix2 *dst, const Matrix2 *m);
+//
+// and so on up to Matrix8. dst may be one of the operands. The determinant
+// and inverse go through LU with partial pivoting, in the same order of
+// operations as matrix_determinant_lu_decomposition, so they give the same
+// results; the inverse returns 0, leaving dst alone, if m is singular.
+#define MATRIX_FIXED_DECLARE(N)                                                    \
+    typedef struct Matrix##N {                                                     \
+        double values[N][N];                                                       \
+    } Matrix##N;                                                                   \
+                                                                                   \
+    void matrix##N##_multiply(Matrix##N *dst, const Matrix##N *a, const Matrix##N *b); \
+    void matrix##N##_transpose(Matrix##N *dst, const Matrix##N *m);                \
+    double matrix##N##_determinant(const Matrix##N *m);                            \
+    int matrix##N##_inverse(Matrix##N *dst, const Matrix##N *m);
+
+MATRIX_FIXED_SIZES(MATRIX_FIXED_DECLARE)
+
+// The kernels of one size over packed row-major n x n arrays, which have
+// the layout of the MatrixN structs. matrix.c dispatches to them when the
+// dimensions of a square matrix match.
+typedef struct MatrixFixedKernels {
+    int n;
+    void (*multiply)(double *dst, const double *a, const double *b);
+    void (*transpose)(double *dst, const double *m);
+    double (*determinant)(const double *m);
+    int (*inverse)(double *dst, const double *m);
+} MatrixFixedKernels;
+
+// NULL if n is not a fixed size.
+const MatrixFixedKernels* matrix_fixed_kernels(int n);
+
+#endif // MATRIX_FIXED_H
@@ -0,0 +1,287 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "matrix-format.h"
+
+// A floating-point number f * 2^e with a 64-bit significand.
+typedef struct DiyFp {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+// 10^k for k = -348, -340, ..., 340, normalized and rounded to 64 bits.
+const DiyFp CACHED_POWERS_OF_TEN[] = {
+    { 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 }, { 0x8b16fb203055ac76ULL, -1166 },
+    { 0xcf42894a5dce35eaULL, -1140 }, { 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+    { 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 }, { 0xbe5691ef416bd60cULL, -1007 },
+    { 0x8dd01fad907ffc3cULL, -980 }, { 0xd3515c2831559a83ULL, -954 }, { 0x9d71ac8fada6c9b5ULL, -927 },
+    { 0xea9c227723ee8bcbULL, -901 }, { 0xaecc49914078536dULL, -874 }, { 0x823c12795db6ce57ULL, -847 },
+    { 0xc21094364dfb5637ULL, -821 }, { 0x9096ea6f3848984fULL, -794 }, { 0xd77485cb25823ac7ULL, -768 },
+    { 0xa086cfcd97bf97f4ULL, -741 }, { 0xef340a98172aace5ULL, -715 }, { 0xb23867fb2a35b28eULL, -688 },
+    { 0x84c8d4dfd2c63f3bULL, -661 }, { 0xc5dd44271ad3cdbaULL, -635 }, { 0x936b9fcebb25c996ULL, -608 },
+    { 0xdbac6c247d62a584ULL, -582 }, { 0xa3ab66580d5fdaf6ULL, -555 }, { 0xf3e2f893dec3f126ULL, -529 },
+    { 0xb5b5ada8aaff80b8ULL, -502 }, { 0x87625f056c7c4a8bULL, -475 }, { 0xc9bcff6034c13053ULL, -449 },
+    { 0x964e858c91ba2655ULL, -422 }, { 0xdff9772470297ebdULL, -396 }, { 0xa6dfbd9fb8e5b88fULL, -369 },
+    { 0xf8a95fcf88747d94ULL, -343 }, { 0xb94470938fa89bcfULL, -316 }, { 0x8a08f0f8bf0f156bULL, -289 },
+    { 0xcdb02555653131b6ULL, -263 }, { 0x993fe2c6d07b7facULL, -236 }, { 0xe45c10c42a2b3b06ULL, -210 },
+    { 0xaa242499697392d3ULL, -183 }, { 0xfd87b5f28300ca0eULL, -157 }, { 0xbce5086492111aebULL, -130 },
+    { 0x8cbccc096f5088ccULL, -103 }, { 0xd1b71758e219652cULL, -77 }, { 0x9c40000000000000ULL, -50 },
+    { 0xe8d4a51000000000ULL, -24 }, { 0xad78ebc5ac620000ULL, 3 }, { 0x813f3978f8940984ULL, 30 },
+    { 0xc097ce7bc90715b3ULL, 56 }, { 0x8f7e32ce7bea5c70ULL, 83 }, { 0xd5d238a4abe98068ULL, 109 },
+    { 0x9f4f2726179a2245ULL, 136 }, { 0xed63a231d4c4fb27ULL, 162 }, { 0xb0de65388cc8ada8ULL, 189 },
+    { 0x83c7088e1aab65dbULL, 216 }, { 0xc45d1df942711d9aULL, 242 }, { 0x924d692ca61be758ULL, 269 },
+    { 0xda01ee641a708deaULL, 295 }, { 0xa26da3999aef774aULL, 322 }, { 0xf209787bb47d6b85ULL, 348 },
+    { 0xb454e4a179dd1877ULL, 375 }, { 0x865b86925b9bc5c2ULL, 402 }, { 0xc83553c5c8965d3dULL, 428 },
+    { 0x952ab45cfa97a0b3ULL, 455 }, { 0xde469fbd99a05fe3ULL, 481 }, { 0xa59bc234db398c25ULL, 508 },
+    { 0xf6c69a72a3989f5cULL, 534 }, { 0xb7dcbf5354e9beceULL, 561 }, { 0x88fcf317f22241e2ULL, 588 },
+    { 0xcc20ce9bd35c78a5ULL, 614 }, { 0x98165af37b2153dfULL, 641 }, { 0xe2a0b5dc971f303aULL, 667 },
+    { 0xa8d9d1535ce3b396ULL, 694 }, { 0xfb9b7cd9a4a7443cULL, 720 }, { 0xbb764c4ca7a44410ULL, 747 },
+    { 0x8bab8eefb6409c1aULL, 774 }, { 0xd01fef10a657842cULL, 800 }, { 0x9b10a4e5e9913129ULL, 827 },
+    { 0xe7109bfba19c0c9dULL, 853 }, { 0xac2820d9623bf429ULL, 880 }, { 0x80444b5e7aa7cf85ULL, 907 },
+    { 0xbf21e44003acdd2dULL, 933 }, { 0x8e679c2f5e44ff8fULL, 960 }, { 0xd433179d9c8cb841ULL, 986 },
+    { 0x9e19db92b4e31ba9ULL, 1013 }, { 0xeb96bf6ebadf77d9ULL, 1039 }, { 0xaf87023b9bf0ee6bULL, 1066 }
+};
+
+const uint32_t POWERS_OF_TEN_32[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+DiyFp _diyfp_multiply(DiyFp a, DiyFp b) {
+    unsigned __int128 product = (unsigned __int128) a.f * b.f;
+
+    // Round the low half into the high one.
+    product += (unsigned __int128) 1 << 63;
+
+    return (DiyFp) { (uint64_t) (product >> 64), a.e + b.e + 64 };
+}
+
+DiyFp _diyfp_normalize(DiyFp x) {
+    int shift = __builtin_clzll(x.f);
+    return (DiyFp) { x.f << shift, x.e - shift };
+}
+
+// The cached power c = 10^-k that brings w * c's exponent into [-60, -32],
+// so its integer part fits in 32 bits.
+DiyFp _cached_power(int e, int *k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int rounded = (int) dk;
+
+    if (dk - rounded > 0.0) rounded++;
+
+    int index = (rounded >> 3) + 1;
+    *k = -(-348 + index * 8);
+
+    return CACHED_POWERS_OF_TEN[index];
+}
+
+int _decimal_digits(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= POWERS_OF_TEN_32[digits]) digits++;
+    return digits;
+}
+
+// Moves the last digit down while that brings the number closer to w and
+// keeps it inside the boundaries.
+void _grisu_round(char *digits, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        digits[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+// Generates the digits of the upper boundary mp until what is left is
+// within delta of it, which leaves the shortest digits in the interval.
+int _grisu_digits(DiyFp w, DiyFp mp, uint64_t delta, char *digits, int *k) {
+    DiyFp one = { (uint64_t) 1 << -mp.e, mp.e };
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t) (mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = _decimal_digits(p1);
+    int length = 0;
+
+    while (kappa > 0) {
+        uint32_t d = p1 / POWERS_OF_TEN_32[kappa - 1];
+        p1 %= POWERS_OF_TEN_32[kappa - 1];
+
+        if (d != 0 || length != 0) digits[length++] = (char) ('0' + d);
+
+        kappa--;
+        uint64_t rest = ((uint64_t) p1 << -one.e) + p2;
+
+        if (rest <= delta) {
+            *k += kappa;
+            _grisu_round(digits, length, delta, rest, (uint64_t) POWERS_OF_TEN_32[kappa] << -one.e, wp_w);
+            return length;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+
+        char d = (char) (p2 >> -one.e);
+
+        if (d != 0 || length != 0) digits[length++] = (char) ('0' + d);
+
+        p2 &= one.f - 1;
+        kappa--;
+
+        if (p2 < delta) {
+            *k += kappa;
+            _grisu_round(digits, length, delta, p2, one.f, -kappa < 10 ? wp_w * POWERS_OF_TEN_32[-kappa] : 0);
+            return length;
+        }
+    }
+}
+
+// Digits of a positive finite value, which is digits * 10^k.
+int _grisu2(double value, char *digits, int *k) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int biased_exponent = (int) (bits >> 52);
+    uint64_t significand = bits & (((uint64_t) 1 << 52) - 1);
+    DiyFp v = biased_exponent != 0 ?
+        (DiyFp) { significand | ((uint64_t) 1 << 52), biased_exponent - 1075 } :
+        (DiyFp) { significand, -1074 };
+
+    // The boundaries halfway to the neighbouring doubles; the lower one is
+    // closer when v is a power of two.
+    DiyFp plus = _diyfp_normalize((DiyFp) { (v.f << 1) + 1, v.e - 1 });
+    DiyFp minus = v.f == ((uint64_t) 1 << 52) ? (DiyFp) { (v.f << 2) - 1, v.e - 2 } : (DiyFp) { (v.f << 1) - 1, v.e - 1 };
+
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    DiyFp c = _cached_power(plus.e, k);
+    DiyFp w = _diyfp_multiply(_diyfp_normalize(v), c);
+    DiyFp wp = _diyfp_multiply(plus, c);
+    DiyFp wm = _diyfp_multiply(minus, c);
+
+    // Stay one unit inside the boundaries, which the products may be off by.
+    wm.f++;
+    wp.f--;
+
+    return _grisu_digits(w, wp, wp.f - wm.f, digits, k);
+}
+
+int _format_exponent(char *out, int exponent) {
+    int length = 0;
+
+    if (exponent < 0) {
+        out[length++] = '-';
+        exponent = -exponent;
+    }
+
+    if (exponent >= 100) out[length++] = (char) ('0' + exponent / 100);
+    if (exponent >= 10) out[length++] = (char) ('0' + exponent / 10 % 10);
+    out[length++] = (char) ('0' + exponent % 10);
+
+    return length;
+}
+
+// Lays out digits * 10^k as plain decimals when the number is not too far
+// from 1, and in exponent notation otherwise.
+int _format_decimal(char *out, int length, int k) {
+    int magnitude = length + k;
+
+    if (k >= 0 && magnitude <= 21) {
+        // 1234e7 -> 12340000000
+        memset(out + length, '0', k);
+        return magnitude;
+    }
+
+    if (magnitude > 0 && magnitude <= 21) {
+        // 1234e-2 -> 12.34
+        memmove(out + magnitude + 1, out + magnitude, length - magnitude);
+        out[magnitude] = '.';
+        return length + 1;
+    }
+
+    if (magnitude > -6 && magnitude <= 0) {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - magnitude;
+        memmove(out + offset, out, length);
+        out[0] = '0';
+        out[1] = '.';
+        memset(out + 2, '0', offset - 2);
+        return length + offset;
+    }
+
+    if (length == 1) {
+        // 1e30
+        out[1] = 'e';
+        return 2 + _format_exponent(out + 2, magnitude - 1);
+    }
+
+    // 1234e30 -> 1.234e33
+    memmove(out + 2, out + 1, length - 1);
+    out[1] = '.';
+    out[length + 1] = 'e';
+    return length + 2 + _format_exponent(out + length + 2, magnitude - 1);
+}
+
+int format_integer(char *out, int64_t value) {
+    char reversed[20];
+    uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+    int count = 0, length = 0;
+
+    do {
+        reversed[count++] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) out[length++] = '-';
+    while (count > 0) out[length++] = reversed[--count];
+
+    return length;
+}
+
+int format_double_shortest(char *out, double value) {
+    if (isnan(value)) {
+        memcpy(out, "nan", 3);
+        return 3;
+    }
+
+    int length = 0;
+
+    if (signbit(value)) {
+        out[length++] = '-';
+        value = -value;
+    }
+
+    if (isinf(value)) {
+        memcpy(out + length, "inf", 3);
+        return length + 3;
+    }
+
+    if (value == 0) {
+        out[length] = '0';
+        return length + 1;
+    }
+
+    if (value < 0x1p53 && value == (double) (int64_t) value) {
+        return length + format_integer(out + length, (int64_t) value);
+    }
+
+    int k;
+    int digits = _grisu2(value, out + length, &k);
+
+    return length + _format_decimal(out + length, digits, k);
+}
+
+int format_double_fixed(char *out, double value, int precision) {
+    if (fabs(value) < 0x1p53 && value == (double) (int64_t) value && !(value == 0 && signbit(value))) {
+        int length = format_integer(out, (int64_t) value);
+
+        if (precision > 0) {
+            out[length++] = '.';
+            memset(out + length, '0', precision);
+            length += precision;
+        }
+
+        out[length] = '\0';
+        return length;
+    }
+
+    return snprintf(out, 330 + precision, "%.*f", precision, value);
+}
@@ -0,0 +1,26 @@
+#ifndef MATRIX_FORMAT_H
+#define MATRIX_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Room format_double_shortest and format_integer need: a sign, 17 digits,
+// a point and an exponent, or the 20 characters of INT64_MIN.
+#define MATRIX_NUMBER_MAX_LENGTH 32
+
+// Writes the shortest decimal text that parses back as exactly value, by
+// Grisu2: the digits are generated from a 64-bit product with a cached
+// power of ten, so no big-integer arithmetic is needed, and in the rare
+// cases where that cannot find the shortest digits it still finds digits
+// that round-trip. Integral values below 2^53 take a plain integer path.
+// Returns the length; out is not NUL-terminated.
+int format_double_shortest(char *out, double value);
+
+int format_integer(char *out, int64_t value);
+
+// value with a fixed number of decimals, as printf's "%.*f" writes it
+// (integral values skip printf). out must have room for 330 + precision
+// bytes. Returns the length; out is NUL-terminated.
+int format_double_fixed(char *out, double value, int precision);
+
+#endif // MATRIX_FORMAT_H
@@ -0,0 +1,1653 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix-io.h"
+#include "matrix-format.h"
+#include "thread-pool.h"
+#include "typed-kernels.h"
+
+_Static_assert(sizeof(MatrixFileHeader) == 64, "MatrixFileHeader must stay 64 bytes");
+
+const char* matrix_error_message(MatrixResultCode code) {
+  switch (code) {
+    case MATRIX_DIMENSIONS_MUST_BE_POSITIVE:
+      return "Validation failed: Matrix dimensions must be greater than 0.";
+    case MATRIX_INDEX_ARGUMENT_OUT_OF_BOUNDS:
+      return "Error: Index out of bounds.";
+    case MATRIX_ARGUMENTS_MUST_NOT_BE_NULL:
+      return "Error: Matrix should not be null.";
+    case MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM:
+      return "Validation failed: Matrices must have the same dimensions to calculate the sum.";
+    case MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT:
+      return "Validation failed: Matrices must have the same dimensions to calculate the subtract.";
+    case MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY:
+      return "Validation failed: Invalid dimensions for calculating multiplication.";
+    case MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT:
+      return "Validation failed: Matrix should be square to calculate the determinant.";
+    case MATRIX_INVALID_DESTINATION_DIMENSIONS:
+      return "Validation failed: Destination matrix has the wrong dimensions for the result.";
+    case MATRIX_DESTINATION_OVERLAPS_ARGUMENTS:
+      return "Validation failed: Destination matrix must not overlap the operands.";
+    case MATRIX_SHOULD_BE_SQUARE_TO_FACTOR:
+      return "Validation failed: Matrix should be square to be factored.";
+    case MATRIX_INVALID_DIMENSIONS_TO_SOLVE:
+      return "Validation failed: Right-hand side must have as many rows as the matrix.";
+    case MATRIX_IS_SINGULAR:
+      return "Validation failed: Matrix is singular.";
+    case MATRIX_ELEMENT_TYPES_MUST_MATCH:
+      return "Validation failed: Matrices must have the same element type.";
+    case MATRIX_UNSUPPORTED_ELEMENT_TYPE:
+      return "Validation failed: Operation is not supported for this element type.";
+    case MATRIX_INTEGER_OVERFLOW:
+      return "Validation failed: Value does not fit the integer element type.";
+    case MATRIX_BATCH_SIZES_MUST_MATCH:
+      return "Validation failed: Batches must hold the same number of matrices.";
+    case MATRIX_TILE_SIZES_MUST_MATCH:
+      return "Validation failed: Tiled matrices must have the same tile size.";
+    case MATRIX_MEMORY_LIMIT_TOO_SMALL:
+      return "Validation failed: The memory limit is too small for the operation.";
+    case MATRIX_TILE_IO_FAILED:
+      return "Error: Failed to read or write a tiled matrix file.";
+    default:
+      return "Error: Unexpected error occurred.";
+  }
+}
+
+void print_matrix_error(MatrixResultCode code) {
+  printf("%s", matrix_error_message(code));
+}
+
+// Powers of ten that are exactly representable as doubles.
+const double EXACT_POWERS_OF_TEN[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parses a decimal number such as -12, 3.25 or 6.02e23 starting at text.
+// When the digits fit in 53 bits and the decimal exponent is at most 22 in
+// magnitude, both the mantissa and the power of ten are exact doubles, so
+// one multiplication or division gives the correctly rounded result
+// (Clinger's fast path). Anything else is handed to strtod. nan and
+// [-]inf, as non-finite values are written, are accepted too. Returns a
+// pointer past the number, or NULL if text does not start with one.
+const char* parse_matrix_number(const char *text, double *value) {
+  const char *p = text;
+  int negative = 0;
+
+  if (*p == '-' || *p == '+') {
+    negative = *p == '-';
+    p++;
+  }
+
+  if (strncmp(p, "nan", 3) == 0 || strncmp(p, "inf", 3) == 0) {
+    *value = copysign(*p == 'n' ? NAN : INFINITY, negative ? -1 : 1);
+    return p + 3;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  const char *digits_start = p;
+
+  while (*p >= '0' && *p <= '9') {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa != 0) digits++;
+    } else {
+      exponent++;
+    }
+    p++;
+  }
+
+  if (*p == '.') {
+    p++;
+
+    while (*p >= '0' && *p <= '9') {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa != 0) digits++;
+        exponent--;
+      }
+      p++;
+    }
+  }
+
+  if (p == digits_start || (p == digits_start + 1 && *digits_start == '.')) {
+    return NULL;
+  }
+
+  if (*p == 'e' || *p == 'E') {
+    const char *e = p + 1;
+    int exponent_negative = 0;
+    int explicit_exponent = 0;
+
+    if (*e == '-' || *e == '+') {
+      exponent_negative = *e == '-';
+      e++;
+    }
+
+    if (*e >= '0' && *e <= '9') {
+      while (*e >= '0' && *e <= '9') {
+        if (explicit_exponent < 100000) explicit_exponent = explicit_exponent * 10 + (*e - '0');
+        e++;
+      }
+
+      exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+      p = e;
+    }
+  }
+
+  if (digits >= 19 || mantissa > (1ULL << 53) || exponent < -22 || exponent > 22) {
+    char *strtod_end;
+    *value = strtod(text, &strtod_end);
+    return strtod_end;
+  }
+
+  double result = (double) mantissa;
+  result = exponent < 0 ? result / EXACT_POWERS_OF_TEN[-exponent] : result * EXACT_POWERS_OF_TEN[exponent];
+
+  *value = negative ? -result : result;
+  return p;
+}
+
+// Makes sure a whole line starting at reader->start is in the buffer,
+// sliding the unread bytes to the front and growing the buffer when a line
+// is longer than it. Returns the line length (without the newline), or -1
+// once the file is exhausted.
+long fill_reader_line(MatrixTextReader *reader) {
+  size_t scanned = 0;
+
+  for (;;) {
+    char *newline = memchr(reader->buffer + reader->start + scanned, '\n', reader->end - reader->start - scanned);
+
+    if (newline != NULL) {
+      return newline - (reader->buffer + reader->start);
+    }
+
+    scanned = reader->end - reader->start;
+
+    if (reader->eof) {
+      return scanned > 0 ? (long) scanned : -1;
+    }
+
+    if (reader->start > 0) {
+      memmove(reader->buffer, reader->buffer + reader->start, scanned);
+      reader->end = scanned;
+      reader->start = 0;
+    }
+
+    if (reader->end == reader->capacity) {
+      char *grown = realloc(reader->buffer, reader->capacity * 2 + 1);
+
+      if (grown == NULL) {
+        reader->eof = 1;
+        return -1;
+      }
+
+      reader->buffer = grown;
+      reader->capacity *= 2;
+    }
+
+    ssize_t bytes = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+
+    if (bytes <= 0) {
+      reader->eof = 1;
+    } else {
+      reader->end += bytes;
+    }
+
+    reader->buffer[reader->end] = '\0';
+  }
+}
+
+// Returns the next line, terminated in place, or NULL at the end of file.
+char* next_reader_line(MatrixTextReader *reader) {
+  long length = fill_reader_line(reader);
+
+  if (length < 0) return NULL;
+
+  char *line = reader->buffer + reader->start;
+  line[length] = '\0';
+  reader->start += length;
+
+  if (reader->start < reader->end) reader->start++;
+
+  return line;
+}
+
+int is_blank_line(char *line) {
+  while (*line == ' ' || *line == '\t' || *line == '\r') line++;
+  return *line == '\0';
+}
+
+MatrixTextReader* open_matrix_text_reader(char *filename) {
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0) {
+    printf("Error: Failed to open file %s", filename);
+    return NULL;
+  }
+
+  MatrixTextReader *reader = malloc(sizeof(MatrixTextReader));
+  char *buffer = malloc(MATRIX_TEXT_READER_BUFFER_SIZE + 1);
+
+  if (reader == NULL || buffer == NULL) {
+    free(reader);
+    free(buffer);
+    close(fd);
+    printf("Error: Unexpected error occurred.");
+    return NULL;
+  }
+
+  *reader = (MatrixTextReader) { fd, buffer, MATRIX_TEXT_READER_BUFFER_SIZE, 0, 0, 0, 0, 0, 0, filename };
+
+  char *row_line = next_reader_line(reader);
+  reader->rows = row_line != NULL ? atoi(row_line) : 0;
+
+  char *col_line = next_reader_line(reader);
+  reader->cols = col_line != NULL ? atoi(col_line) : 0;
+
+  if (reader->rows <= 0 || reader->cols <= 0) {
+    print_matrix_error(MATRIX_DIMENSIONS_MUST_BE_POSITIVE);
+    close_matrix_text_reader(reader);
+    return NULL;
+  }
+
+  return reader;
+}
+
+// Parses an integer entry exactly. Entries with a fraction or an exponent
+// are parsed as doubles and rounded. Returns a pointer past the number, or
+// NULL if text does not start with one or it does not fit in int64.
+const char* parse_matrix_integer(const char *text, int64_t *value) {
+  char *end;
+  errno = 0;
+  long long integer = strtoll(text, &end, 10);
+
+  if (end != text && *end != '.' && *end != 'e' && *end != 'E') {
+    *value = integer;
+    return errno == ERANGE ? NULL : end;
+  }
+
+  double number;
+  const char *number_end = parse_matrix_number(text, &number);
+
+  if (number_end == NULL) return NULL;
+
+  number = nearbyint(number);
+
+  if (!(number >= -0x1p63 && number < 0x1p63)) return NULL;
+
+  *value = (int64_t) number;
+  return number_end;
+}
+
+MatrixTextLineStatus parse_matrix_text_line(const char *line, int cols, double *values, int64_t *integers) {
+  const char *p = line;
+  int col = 0;
+
+  for (;;) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+
+    if (*p == '\0' && col == 0) break;
+
+    if (col >= cols) return MATRIX_TEXT_LINE_TOO_MANY_COLUMNS;
+
+    const char *end = integers != NULL ? parse_matrix_integer(p, &integers[col]) : parse_matrix_number(p, &values[col]);
+
+    if (end == NULL) return MATRIX_TEXT_LINE_MALFORMED;
+
+    col++;
+    p = end;
+
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+
+    if (*p == '\0') break;
+
+    if (*p != ',') return MATRIX_TEXT_LINE_MALFORMED;
+
+    p++;
+  }
+
+  for (; col < cols; col++) {
+    if (integers != NULL) {
+      integers[col] = 0;
+    } else {
+      values[col] = 0;
+    }
+  }
+
+  return MATRIX_TEXT_LINE_PARSED;
+}
+
+// Reads the next row into values, or into integers when that is not NULL.
+int read_matrix_text_row_as(MatrixTextReader *reader, double *values, int64_t *integers) {
+  int row = reader->row;
+  char *line = next_reader_line(reader);
+
+  if (line == NULL) {
+    printf("Invalid file format: Matrix should have %d rows.", reader->rows);
+    return 0;
+  }
+
+  MatrixTextLineStatus status = parse_matrix_text_line(line, reader->cols, values, integers);
+
+  if (status != MATRIX_TEXT_LINE_PARSED) {
+    if (status == MATRIX_TEXT_LINE_TOO_MANY_COLUMNS) {
+      printf("Invalid file format: Invalid number of columns in matrix row %d. Expected: %d\n", row, reader->cols);
+    }
+
+    printf("Error: Failed to parse matrix row %d of file %s", row, reader->filename);
+    return 0;
+  }
+
+  reader->row++;
+
+  return 1;
+}
+
+int read_matrix_text_row(MatrixTextReader *reader, double *values) {
+  return read_matrix_text_row_as(reader, values, NULL);
+}
+
+// Anything but blank lines after the last declared row is an error.
+int finish_matrix_text_reader(MatrixTextReader *reader) {
+  char *line;
+
+  while ((line = next_reader_line(reader)) != NULL) {
+    if (!is_blank_line(line)) {
+      printf("Invalid file format: Matrix should have %d rows.", reader->rows);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void close_matrix_text_reader(MatrixTextReader *reader) {
+  close(reader->fd);
+  free(reader->buffer);
+  free(reader);
+}
+
+// Stores a row parsed into scratch (doubles, or int64s for integer types)
+// into row of a matrix other than float64, with the element type's
+// conversion. Returns 0 if an integer does not fit.
+int store_typed_text_row(Matrix *matrix, int row, void *scratch) {
+  const TypedKernels *kernels = typed_kernels(matrix->element_type);
+  char *target = (char*) matrix->data + (size_t) row * matrix->stride * kernels->size;
+
+  for (int j = 0; j < matrix->cols; j++) {
+    if (!kernels->is_integer) {
+      kernels->set(target, j, ((double*) scratch)[j]);
+    } else if (!kernels->set_integer(target, j, ((int64_t*) scratch)[j])) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// Parses a row of a matrix other than float64 through a scratch row and
+// stores it with the element type's conversion.
+int read_typed_text_row(MatrixTextReader *reader, Matrix *matrix, int row, void *scratch) {
+  int is_integer = typed_kernels(matrix->element_type)->is_integer;
+
+  if (!read_matrix_text_row_as(reader, scratch, is_integer ? scratch : NULL)) return 0;
+
+  if (!store_typed_text_row(matrix, row, scratch)) {
+    printf("Error: Failed to parse matrix row %d of file %s: ", row, reader->filename);
+    print_matrix_error(MATRIX_INTEGER_OVERFLOW);
+    return 0;
+  }
+
+  return 1;
+}
+
+typedef struct TextParseContext {
+  const char *text;
+  size_t size;
+  // Chunk c covers [starts[c], starts[c + 1]), always whole lines; lines[c]
+  // is first its line count, then the index of its first line.
+  size_t *starts;
+  long *lines;
+  Matrix *matrix;
+  int failed;
+} TextParseContext;
+
+void count_text_lines(int begin, int end, void *context) {
+  TextParseContext *c = context;
+
+  for (int chunk = begin; chunk < end; chunk++) {
+    const char *p = c->text + c->starts[chunk], *stop = c->text + c->starts[chunk + 1];
+    long lines = 0;
+
+    while (p < stop && (p = memchr(p, '\n', stop - p)) != NULL) {
+      lines++;
+      p++;
+    }
+
+    // A last line without a newline.
+    if (c->starts[chunk + 1] == c->size && c->size > c->starts[chunk] && c->text[c->size - 1] != '\n') lines++;
+
+    c->lines[chunk] = lines;
+  }
+}
+
+// Parses the lines of each chunk straight into their rows. The first
+// problem marks the whole parse as failed, to be redone serially so that
+// the error is reported as the streaming reader reports it.
+void parse_text_chunks(int begin, int end, void *context) {
+  TextParseContext *c = context;
+  Matrix *matrix = c->matrix;
+  int typed = matrix->element_type != MATRIX_FLOAT64;
+  int is_integer = typed_kernels(matrix->element_type)->is_integer;
+  int64_t *scratch = typed ? malloc(matrix->cols * sizeof(int64_t)) : NULL;
+  size_t capacity = 256;
+  char *line = malloc(capacity);
+
+  if (line == NULL || (typed && scratch == NULL)) __atomic_store_n(&c->failed, 1, __ATOMIC_RELAXED);
+
+  for (int chunk = begin; chunk < end && !__atomic_load_n(&c->failed, __ATOMIC_RELAXED); chunk++) {
+    const char *p = c->text + c->starts[chunk], *stop = c->text + c->starts[chunk + 1];
+    long row = c->lines[chunk];
+
+    for (; p < stop; row++) {
+      const char *newline = memchr(p, '\n', stop - p);
+      size_t length = (newline != NULL ? newline : stop) - p;
+
+      if (length + 1 > capacity) {
+        char *grown = realloc(line, length + 1);
+
+        if (grown == NULL) {
+          __atomic_store_n(&c->failed, 1, __ATOMIC_RELAXED);
+          break;
+        }
+
+        line = grown;
+        capacity = length + 1;
+      }
+
+      memcpy(line, p, length);
+      line[length] = '\0';
+      p += length + 1;
+
+      int parsed;
+
+      if (row >= matrix->rows) {
+        parsed = is_blank_line(line);
+      } else if (!typed) {
+        parsed = parse_matrix_text_line(line, matrix->cols, matrix->values + (size_t) row * matrix->stride, NULL) ==
+          MATRIX_TEXT_LINE_PARSED;
+      } else {
+        parsed = parse_matrix_text_line(line, matrix->cols, (double*) scratch, is_integer ? scratch : NULL) ==
+            MATRIX_TEXT_LINE_PARSED &&
+          store_typed_text_row(matrix, row, scratch);
+      }
+
+      if (!parsed) {
+        __atomic_store_n(&c->failed, 1, __ATOMIC_RELAXED);
+        break;
+      }
+    }
+  }
+
+  free(line);
+  free(scratch);
+}
+
+// Reads the value of a header line, as atoi would from the streaming
+// reader. Returns the offset of the next line, or 0 if there is none.
+size_t parse_text_header_line(const char *text, size_t size, size_t offset, int *value) {
+  const char *newline = memchr(text + offset, '\n', size - offset);
+  char digits[32];
+
+  if (newline == NULL) return 0;
+
+  size_t length = newline - (text + offset);
+  if (length > sizeof(digits) - 1) length = sizeof(digits) - 1;
+
+  memcpy(digits, text + offset, length);
+  digits[length] = '\0';
+  *value = atoi(digits);
+
+  return newline - text + 1;
+}
+
+// Maps a large text file and parses it on the thread pool: the body is cut
+// into chunks at newlines, the lines of every chunk are counted to learn
+// which row each chunk starts at, and then every chunk is parsed into its
+// rows. Returns 0, printing nothing, when the file is too small for this to
+// pay off or anything is wrong with it.
+int read_text_matrix_in_parallel(Matrix *m, char *filename, MatrixElementType element_type) {
+  int fd = open(filename, O_RDONLY);
+  struct stat info;
+
+  if (fd < 0) return 0;
+
+  if (fstat(fd, &info) != 0 || info.st_size < MATRIX_PARALLEL_TEXT_MIN_SIZE) {
+    close(fd);
+    return 0;
+  }
+
+  size_t size = info.st_size;
+  const char *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (text == MAP_FAILED) return 0;
+
+  madvise((void*) text, size, MADV_SEQUENTIAL);
+
+  int rows = 0, cols = 0;
+  size_t body = parse_text_header_line(text, size, 0, &rows);
+  body = body != 0 ? parse_text_header_line(text, size, body, &cols) : 0;
+
+  int chunks = thread_pool_size() * 4;
+
+  if ((size - body) / chunks < MATRIX_TEXT_CHUNK_MIN_SIZE) chunks = (size - body) / MATRIX_TEXT_CHUNK_MIN_SIZE + 1;
+
+  size_t *starts = malloc((chunks + 1) * sizeof(size_t));
+  long *lines = malloc(chunks * sizeof(long));
+  MatrixResult result = body != 0 && rows > 0 && cols > 0 ?
+    new_typed_matrix(rows, cols, element_type) : (MatrixResult) { 0, MATRIX_DIMENSIONS_MUST_BE_POSITIVE, NULL };
+  int parsed = 0;
+
+  if (result.success && starts != NULL && lines != NULL) {
+    for (int chunk = 0; chunk <= chunks; chunk++) {
+      size_t start = body + (size - body) / chunks * chunk;
+      const char *newline = chunk == 0 ? NULL : memchr(text + start - 1, '\n', size - start + 1);
+
+      starts[chunk] = chunk == 0 ? body : chunk == chunks || newline == NULL ? size : (size_t) (newline - text) + 1;
+      if (chunk > 0 && starts[chunk] < starts[chunk - 1]) starts[chunk] = starts[chunk - 1];
+    }
+
+    TextParseContext context = { text, size, starts, lines, result.value, 0 };
+
+    thread_pool_parallel_for(0, chunks, 1, count_text_lines, &context);
+
+    long total = 0;
+
+    for (int chunk = 0; chunk < chunks; chunk++) {
+      long count = lines[chunk];
+      lines[chunk] = total;
+      total += count;
+    }
+
+    if (total >= rows) {
+      thread_pool_parallel_for(0, chunks, 1, parse_text_chunks, &context);
+      parsed = !context.failed;
+    }
+  }
+
+  munmap((void*) text, size);
+  free(starts);
+  free(lines);
+
+  if (!parsed) {
+    if (result.success) delete_matrix(result.value);
+    return 0;
+  }
+
+  *m = *result.value;
+  free(result.value);
+
+  return 1;
+}
+
+int read_text_matrix_from_file(Matrix *m, char* filename, MatrixElementType element_type) {
+  if (read_text_matrix_in_parallel(m, filename, element_type)) return 1;
+
+  MatrixTextReader *reader = open_matrix_text_reader(filename);
+
+  if (reader == NULL) return 0;
+
+  MatrixResult matrix_result = new_typed_matrix(reader->rows, reader->cols, element_type);
+  void *scratch = element_type != MATRIX_FLOAT64 ? malloc(reader->cols * sizeof(int64_t)) : NULL;
+
+  if (!matrix_result.success || (element_type != MATRIX_FLOAT64 && scratch == NULL)) {
+    print_matrix_error(matrix_result.success ? MATRIX_INTERNAL_ERROR : matrix_result.code);
+    if (matrix_result.success) delete_matrix(matrix_result.value);
+    close_matrix_text_reader(reader);
+    return 0;
+  }
+
+  Matrix *matrix = matrix_result.value;
+
+  for (int row = 0; row < matrix->rows; row++) {
+    int parsed = scratch != NULL ?
+      read_typed_text_row(reader, matrix, row, scratch) :
+      read_matrix_text_row(reader, matrix->values + (size_t) row * matrix->stride);
+
+    if (!parsed) {
+      free(scratch);
+      delete_matrix(matrix);
+      close_matrix_text_reader(reader);
+      return 0;
+    }
+  }
+
+  free(scratch);
+
+  int finished = finish_matrix_text_reader(reader);
+  close_matrix_text_reader(reader);
+
+  if (!finished) {
+    delete_matrix(matrix);
+    return 0;
+  }
+
+  *m = *matrix;
+  free(matrix);
+
+  return 1;
+}
+
+int output_precision = MATRIX_OUTPUT_SHORTEST;
+
+void matrix_set_output_precision(int precision) {
+  output_precision = precision;
+}
+
+int matrix_output_precision() {
+  return output_precision;
+}
+
+// out must have room for MATRIX_TEXT_ELEMENT_MAX_LENGTH bytes; returns the
+// length written, without a NUL.
+int format_matrix_number(char *out, double value) {
+  if (output_precision == MATRIX_OUTPUT_SHORTEST) return format_double_shortest(out, value);
+  return format_double_fixed(out, value, output_precision);
+}
+
+void write_matrix_number(FILE *file, double value) {
+  char text[MATRIX_TEXT_ELEMENT_MAX_LENGTH];
+  fwrite(text, 1, format_matrix_number(text, value), file);
+}
+
+// Integers go out exactly, whatever their magnitude.
+int format_matrix_element(char *out, Matrix *m, int row, int col) {
+  const TypedKernels *kernels = typed_kernels(m->element_type);
+  char *values = (char*) m->data + (size_t) row * m->stride * kernels->size;
+
+  if (kernels->is_integer) return format_integer(out, kernels->get_integer(values, col));
+
+  return format_matrix_number(out, kernels->get(values, col));
+}
+
+// Appends row of m to *buffer, growing it as needed, with separator between
+// the elements and a newline at the end. Returns the new length, or 0 if
+// the buffer could not grow.
+size_t format_matrix_row(char **buffer, size_t *capacity, size_t length, Matrix *m, int row, const char *separator) {
+  size_t separator_length = strlen(separator);
+
+  for (int j = 0; j < m->cols; j++) {
+    if (*capacity - length < MATRIX_TEXT_ELEMENT_MAX_LENGTH + separator_length + 1) {
+      size_t grown_capacity = *capacity * 2 + MATRIX_TEXT_ELEMENT_MAX_LENGTH + separator_length + 1;
+      char *grown = realloc(*buffer, grown_capacity);
+
+      if (grown == NULL) return 0;
+
+      *buffer = grown;
+      *capacity = grown_capacity;
+    }
+
+    length += format_matrix_element(*buffer + length, m, row, j);
+
+    if (j < m->cols - 1) {
+      memcpy(*buffer + length, separator, separator_length);
+      length += separator_length;
+    }
+  }
+
+  (*buffer)[length++] = '\n';
+
+  return length;
+}
+
+typedef struct TextWriteContext {
+  Matrix *m;
+  int fd;
+  int first_row;
+  int rows_per_block;
+  // One growing buffer per block of the current round, and the file offset
+  // each block goes to.
+  char **buffers;
+  size_t *capacities;
+  size_t *lengths;
+  off_t *offsets;
+  int failed;
+} TextWriteContext;
+
+void format_text_blocks(int begin, int end, void *context) {
+  TextWriteContext *c = context;
+
+  for (int block = begin; block < end; block++) {
+    int row0 = c->first_row + block * c->rows_per_block;
+    int row1 = row0 + c->rows_per_block < c->m->rows ? row0 + c->rows_per_block : c->m->rows;
+    size_t length = 0;
+
+    for (int i = row0; i < row1; i++) {
+      length = format_matrix_row(&c->buffers[block], &c->capacities[block], length, c->m, i, ",");
+
+      if (length == 0) {
+        __atomic_store_n(&c->failed, 1, __ATOMIC_RELAXED);
+        return;
+      }
+    }
+
+    c->lengths[block] = length;
+  }
+}
+
+void write_text_blocks(int begin, int end, void *context) {
+  TextWriteContext *c = context;
+
+  for (int block = begin; block < end; block++) {
+    size_t written = 0;
+
+    while (written < c->lengths[block]) {
+      ssize_t bytes = pwrite(c->fd, c->buffers[block] + written, c->lengths[block] - written, c->offsets[block] + written);
+
+      if (bytes <= 0) {
+        __atomic_store_n(&c->failed, 1, __ATOMIC_RELAXED);
+        return;
+      }
+
+      written += bytes;
+    }
+  }
+}
+
+// Formats rounds of row blocks into per-block buffers on the thread pool,
+// then writes each block at its offset with pwrite, so the file comes out
+// in order whichever thread finishes first.
+int write_text_matrix_to_file(Matrix *m, char *filename) {
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0) {
+    printf("Error: Failed to open file %s", filename);
+    return 0;
+  }
+
+  char header[32];
+  int header_length = snprintf(header, sizeof(header), "%d\n%d\n", m->rows, m->cols);
+  int blocks = thread_pool_size() * 2;
+  long row_size = (long) m->cols * 8;
+  int rows_per_block = row_size >= MATRIX_TEXT_WRITE_BLOCK_SIZE ? 1 : MATRIX_TEXT_WRITE_BLOCK_SIZE / row_size;
+
+  TextWriteContext context = {
+    m, fd, 0, rows_per_block,
+    calloc(blocks, sizeof(char*)), calloc(blocks, sizeof(size_t)),
+    calloc(blocks, sizeof(size_t)), calloc(blocks, sizeof(off_t)), 0
+  };
+
+  context.failed = context.buffers == NULL || context.capacities == NULL ||
+    context.lengths == NULL || context.offsets == NULL ||
+    pwrite(fd, header, header_length, 0) != header_length;
+
+  off_t offset = header_length;
+
+  while (!context.failed && context.first_row < m->rows) {
+    int remaining = (m->rows - context.first_row + rows_per_block - 1) / rows_per_block;
+    int round = remaining < blocks ? remaining : blocks;
+
+    thread_pool_parallel_for(0, round, 1, format_text_blocks, &context);
+
+    for (int block = 0; block < round; block++) {
+      context.offsets[block] = offset;
+      offset += context.lengths[block];
+    }
+
+    if (!context.failed) thread_pool_parallel_for(0, round, 1, write_text_blocks, &context);
+
+    context.first_row += round * rows_per_block;
+  }
+
+  for (int block = 0; context.buffers != NULL && block < blocks; block++) free(context.buffers[block]);
+  free(context.buffers);
+  free(context.capacities);
+  free(context.lengths);
+  free(context.offsets);
+
+  if (close(fd) != 0 || context.failed) {
+    printf("Error: Failed to write file %s", filename);
+    return 0;
+  }
+
+  return 1;
+}
+
+int write_matrix_text(FILE *file, Matrix *m) {
+  return fprintf(file, "%d\n%d\n", m->rows, m->cols) > 0 && write_matrix_text_rows(file, m);
+}
+
+int write_matrix_text_rows(FILE *file, Matrix *m) {
+  char *buffer = NULL;
+  size_t capacity = 0;
+  int written = 1;
+
+  for (int i = 0; written && i < m->rows; i++) {
+    size_t length = format_matrix_row(&buffer, &capacity, 0, m, i, ",");
+    written = length > 0 && fwrite(buffer, 1, length, file) == length;
+  }
+
+  free(buffer);
+
+  return written;
+}
+
+void print_matrix(Matrix *m) {
+  char *buffer = NULL;
+  size_t capacity = 0;
+
+  printf("\n");
+
+  for (int i = 0; i < m->rows; i++) {
+    size_t length = format_matrix_row(&buffer, &capacity, 0, m, i, ", ");
+    fwrite(buffer, 1, length, stdout);
+  }
+
+  free(buffer);
+}
+
+
+int has_binary_matrix_extension(char *filename) {
+  size_t length = strlen(filename);
+  size_t extension_length = strlen(MATRIX_BINARY_EXTENSION);
+
+  return length >= extension_length &&
+    strcmp(filename + length - extension_length, MATRIX_BINARY_EXTENSION) == 0;
+}
+
+uint8_t host_endianness() {
+  uint16_t probe = 1;
+  return *(uint8_t*) &probe == 1 ? MATRIX_FILE_LITTLE_ENDIAN : MATRIX_FILE_BIG_ENDIAN;
+}
+
+uint64_t swap_bytes_64(uint64_t value) {
+  return __builtin_bswap64(value);
+}
+
+// The file element type of each MatrixElementType, in its order.
+const uint8_t MATRIX_FILE_ELEMENT_TYPES[] = {
+  MATRIX_FILE_FLOAT64, MATRIX_FILE_FLOAT32, MATRIX_FILE_INT32, MATRIX_FILE_INT64
+};
+
+MatrixElementType matrix_element_type_of_file(uint8_t file_element_type) {
+  return (MatrixElementType) (file_element_type - MATRIX_FILE_FLOAT64);
+}
+
+// Reverses the byte order of count elements of the given size.
+void swap_element_bytes(void *target, const void *source, size_t size, int count) {
+  if (size == sizeof(uint32_t)) {
+    for (int j = 0; j < count; j++) {
+      ((uint32_t*) target)[j] = __builtin_bswap32(((const uint32_t*) source)[j]);
+    }
+  } else {
+    for (int j = 0; j < count; j++) {
+      ((uint64_t*) target)[j] = swap_bytes_64(((const uint64_t*) source)[j]);
+    }
+  }
+}
+
+int validate_binary_header(MatrixFileHeader *header, size_t file_size, char *filename) {
+  if (file_size < sizeof(MatrixFileHeader) || memcmp(header->magic, MATRIX_FILE_MAGIC, 4) != 0) {
+    printf("Invalid file format: %s is not a binary matrix file.", filename);
+    return 0;
+  }
+
+  if (header->endianness != MATRIX_FILE_LITTLE_ENDIAN && header->endianness != MATRIX_FILE_BIG_ENDIAN) {
+    printf("Invalid file format: Corrupted header in %s.", filename);
+    return 0;
+  }
+
+  if (header->endianness != host_endianness()) {
+    header->version = __builtin_bswap16(header->version);
+    header->rows = __builtin_bswap32(header->rows);
+    header->cols = __builtin_bswap32(header->cols);
+    header->stride = __builtin_bswap32(header->stride);
+    header->data_offset = swap_bytes_64(header->data_offset);
+  }
+
+  if (header->version != MATRIX_FILE_VERSION) {
+    printf("Invalid file format: Unsupported binary matrix version %d.", header->version);
+    return 0;
+  }
+
+  if (header->element_type < MATRIX_FILE_FLOAT64 || header->element_type > MATRIX_FILE_INT64) {
+    printf("Invalid file format: Unsupported element type %d.", header->element_type);
+    return 0;
+  }
+
+  // The data size is checked for overflow, so that no header can make the
+  // values seem to fit the file.
+  uint64_t elements, data_size;
+
+  if (header->rows == 0 || header->cols == 0 || header->rows > 0x7fffffff ||
+      header->stride < header->cols || header->stride > 0x7fffffff ||
+      header->data_offset % MATRIX_ALIGNMENT != 0 || header->data_offset > file_size ||
+      __builtin_mul_overflow((uint64_t) header->rows, (uint64_t) header->stride, &elements) ||
+      __builtin_mul_overflow(elements,
+        (uint64_t) matrix_element_size(matrix_element_type_of_file(header->element_type)), &data_size) ||
+      data_size > file_size - header->data_offset) {
+    printf("Invalid file format: Corrupted header in %s.", filename);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Maps the file copy-on-write and points the matrix straight at its data,
+// so loading costs no copy at all. Files written on a host with the other
+// byte order are the exception: they are swapped into a fresh matrix.
+int read_binary_matrix_from_file(Matrix *m, char *filename) {
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0) {
+    printf("Error: Failed to open file %s", filename);
+    return 0;
+  }
+
+  struct stat file_stat;
+
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t) sizeof(MatrixFileHeader)) {
+    printf("Invalid file format: %s is not a binary matrix file.", filename);
+    close(fd);
+    return 0;
+  }
+
+  size_t file_size = file_stat.st_size;
+  void *mapping = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    printf("Error: Failed to map file %s", filename);
+    return 0;
+  }
+
+  MatrixFileHeader header;
+  memcpy(&header, mapping, sizeof(header));
+
+  if (!validate_binary_header(&header, file_size, filename)) {
+    munmap(mapping, file_size);
+    return 0;
+  }
+
+  char *values = (char*) mapping + header.data_offset;
+  MatrixElementType element_type = matrix_element_type_of_file(header.element_type);
+  size_t size = matrix_element_size(element_type);
+  MatrixResult result;
+
+  if (header.endianness == host_endianness()) {
+    result = new_mapped_matrix(header.rows, header.cols, header.stride, element_type, values, mapping, file_size);
+  } else {
+    result = new_typed_matrix(header.rows, header.cols, element_type);
+
+    if (result.success) {
+      for (int i = 0; i < (int) header.rows; i++) {
+        swap_element_bytes(
+          (char*) result.value->data + (size_t) i * result.value->stride * size,
+          values + (size_t) i * header.stride * size,
+          size, header.cols
+        );
+      }
+    }
+
+    munmap(mapping, file_size);
+  }
+
+  if (!result.success) {
+    if (header.endianness == host_endianness()) munmap(mapping, file_size);
+    print_matrix_error(result.code);
+    return 0;
+  }
+
+  *m = *result.value;
+  free(result.value);
+
+  return 1;
+}
+
+// Writes the header followed by the rows exactly as they sit in memory,
+// stride padding included, so a later load can map them as they are.
+int write_binary_matrix_to_file(Matrix *m, char *filename) {
+  FILE *file = fopen(filename, "wb");
+
+  if (file == NULL) {
+    printf("Error: Failed to open file %s", filename);
+    return 0;
+  }
+
+  MatrixFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MATRIX_FILE_MAGIC, 4);
+  header.version = MATRIX_FILE_VERSION;
+  header.element_type = MATRIX_FILE_ELEMENT_TYPES[m->element_type];
+  header.endianness = host_endianness();
+  header.rows = m->rows;
+  header.cols = m->cols;
+  header.stride = m->stride;
+  header.data_offset = sizeof(MatrixFileHeader);
+
+  size_t values = (size_t) m->rows * m->stride;
+  int written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(m->data, matrix_element_size(m->element_type), values, file) == values;
+
+  if (fclose(file) != 0 || !written) {
+    printf("Error: Failed to write file %s", filename);
+    return 0;
+  }
+
+  return 1;
+}
+
+int read_matrix_from_file(Matrix *m, char *filename) {
+  if (has_binary_matrix_extension(filename)) {
+    return read_binary_matrix_from_file(m, filename);
+  }
+
+  return read_text_matrix_from_file(m, filename, MATRIX_FLOAT64);
+}
+
+int read_typed_matrix_from_file(Matrix *m, char *filename, MatrixElementType element_type) {
+  if (!has_binary_matrix_extension(filename)) {
+    return read_text_matrix_from_file(m, filename, element_type);
+  }
+
+  Matrix *loaded = malloc(sizeof(Matrix));
+
+  if (loaded == NULL || !read_binary_matrix_from_file(loaded, filename)) {
+    free(loaded);
+    return 0;
+  }
+
+  if (loaded->element_type == element_type) {
+    *m = *loaded;
+    free(loaded);
+    return 1;
+  }
+
+  MatrixResult converted = matrix_convert(loaded, element_type);
+
+  delete_matrix(loaded);
+
+  if (!converted.success) {
+    print_matrix_error(converted.code);
+    return 0;
+  }
+
+  *m = *converted.value;
+  free(converted.value);
+
+  return 1;
+}
+
+int write_dense_matrix_as_sparse(Matrix *m, char *filename);
+
+int write_matrix_to_file(Matrix *m, char *filename) {
+  if (has_binary_matrix_extension(filename)) {
+    return write_binary_matrix_to_file(m, filename);
+  } else if (has_sparse_matrix_extension(filename)) {
+    return write_dense_matrix_as_sparse(m, filename);
+  } else {
+    return write_text_matrix_to_file(m, filename);
+  }
+}
+
+int has_sparse_matrix_extension(char *filename) {
+  size_t length = strlen(filename);
+  size_t extension_length = strlen(MATRIX_SPARSE_EXTENSION);
+
+  return length >= extension_length &&
+    strcmp(filename + length - extension_length, MATRIX_SPARSE_EXTENSION) == 0;
+}
+
+// Parses "row,col,value" into 0-based indices.
+int parse_sparse_entry(const char *line, int *row, int *col, double *value) {
+  char *end;
+
+  *row = strtol(line, &end, 10) - 1;
+  if (end == line || *end != ',') return 0;
+
+  line = end + 1;
+  *col = strtol(line, &end, 10) - 1;
+  if (end == line || *end != ',') return 0;
+
+  const char *p = end + 1;
+  while (*p == ' ' || *p == '\t') p++;
+
+  p = parse_matrix_number(p, value);
+  if (p == NULL) return 0;
+
+  while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+
+  return *p == '\0';
+}
+
+int read_sparse_matrix_from_file(SparseMatrix **s, char *filename) {
+  MatrixTextReader *reader = open_matrix_text_reader(filename);
+
+  if (reader == NULL) return 0;
+
+  long count = 0, capacity = 1024;
+  int *rows = malloc(capacity * sizeof(int));
+  int *cols = malloc(capacity * sizeof(int));
+  double *values = malloc(capacity * sizeof(double));
+  int ok = rows != NULL && cols != NULL && values != NULL;
+  char *line;
+
+  if (!ok) printf("Error: Unexpected error occurred.");
+
+  while (ok && (line = next_reader_line(reader)) != NULL) {
+    if (is_blank_line(line)) continue;
+
+    if (count == capacity) {
+      capacity *= 2;
+
+      int *grown_rows = realloc(rows, capacity * sizeof(int));
+      if (grown_rows != NULL) rows = grown_rows;
+
+      int *grown_cols = realloc(cols, capacity * sizeof(int));
+      if (grown_cols != NULL) cols = grown_cols;
+
+      double *grown_values = realloc(values, capacity * sizeof(double));
+      if (grown_values != NULL) values = grown_values;
+
+      if (grown_rows == NULL || grown_cols == NULL || grown_values == NULL) {
+        printf("Error: Unexpected error occurred.");
+        ok = 0;
+        break;
+      }
+    }
+
+    if (!parse_sparse_entry(line, &rows[count], &cols[count], &values[count])) {
+      printf("Error: Failed to parse entry %ld of file %s", count + 1, filename);
+      ok = 0;
+      break;
+    }
+
+    count++;
+  }
+
+  if (ok) {
+    SparseMatrixResult result = new_sparse_matrix_from_triplets(reader->rows, reader->cols, count, rows, cols, values);
+
+    if (result.success) {
+      *s = result.value;
+    } else {
+      print_matrix_error(result.code);
+      ok = 0;
+    }
+  }
+
+  free(rows);
+  free(cols);
+  free(values);
+  close_matrix_text_reader(reader);
+
+  return ok;
+}
+
+int write_sparse_matrix_to_file(SparseMatrix *s, char *filename) {
+  SparseMatrix *csr = s;
+
+  if (s->format != SPARSE_MATRIX_CSR) {
+    SparseMatrixResult converted = sparse_matrix_convert(s, SPARSE_MATRIX_CSR);
+
+    if (!converted.success) {
+      print_matrix_error(converted.code);
+      return 0;
+    }
+
+    csr = converted.value;
+  }
+
+  FILE *file = fopen(filename, "w");
+
+  if (file == NULL) {
+    printf("Error: Failed to open file %s", filename);
+    if (csr != s) delete_sparse_matrix(csr);
+    return 0;
+  }
+
+  fprintf(file, "%d\n", csr->rows);
+  fprintf(file, "%d\n", csr->cols);
+
+  for (int i = 0; i < csr->rows; i++) {
+    for (long p = csr->pointers[i]; p < csr->pointers[i + 1]; p++) {
+      fprintf(file, "%d,%d,", i + 1, csr->indices[p] + 1);
+      write_matrix_number(file, csr->values[p]);
+      fputc('\n', file);
+    }
+  }
+
+  if (csr != s) delete_sparse_matrix(csr);
+
+  // A failed fprintf leaves the stream's error flag set.
+  int failed = ferror(file);
+
+  if (fclose(file) != 0 || failed) {
+    printf("Error: Failed to write file %s", filename);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Sparse files hold float64 values, so other element types are widened.
+int write_dense_matrix_as_sparse(Matrix *m, char *filename) {
+  if (m->element_type != MATRIX_FLOAT64) {
+    MatrixResult widened = matrix_convert(m, MATRIX_FLOAT64);
+
+    if (!widened.success) {
+      print_matrix_error(widened.code);
+      return 0;
+    }
+
+    int written = write_dense_matrix_as_sparse(widened.value, filename);
+    delete_matrix(widened.value);
+
+    return written;
+  }
+
+  SparseMatrixResult sparse = sparse_matrix_from_dense(m, SPARSE_MATRIX_CSR);
+
+  if (!sparse.success) {
+    print_matrix_error(sparse.code);
+    return 0;
+  }
+
+  int written = write_sparse_matrix_to_file(sparse.value, filename);
+  delete_sparse_matrix(sparse.value);
+
+  return written;
+}
+
+int read_matrix_batch_from_file(MatrixBatch **batch, char *filename) {
+  MatrixTextReader *reader = open_matrix_text_reader(filename);
+
+  if (reader == NULL) return 0;
+
+  char *count_line = next_reader_line(reader);
+  int count = count_line != NULL ? atoi(count_line) : 0;
+  MatrixBatchResult result = new_matrix_batch(count, reader->rows, reader->cols);
+  double *row = malloc(reader->cols * sizeof(double));
+
+  if (!result.success || row == NULL) {
+    print_matrix_error(result.success ? MATRIX_INTERNAL_ERROR : result.code);
+    if (result.success) delete_matrix_batch(result.value);
+    free(row);
+    close_matrix_text_reader(reader);
+    return 0;
+  }
+
+  MatrixBatch *b = result.value;
+  int ok = 1;
+
+  for (int k = 0; k < b->count && ok; k++) {
+    for (int i = 0; i < b->rows && ok; i++) {
+      ok = read_matrix_text_row(reader, row);
+
+      for (int j = 0; j < b->cols && ok; j++) {
+        matrix_batch_lanes(b, i, j)[k] = row[j];
+      }
+    }
+  }
+
+  ok = ok && finish_matrix_text_reader(reader);
+
+  free(row);
+  close_matrix_text_reader(reader);
+
+  if (!ok) {
+    delete_matrix_batch(b);
+    return 0;
+  }
+
+  *batch = b;
+
+  return 1;
+}
+
+void write_matrix_batch_rows(FILE *file, MatrixBatch *batch, int index, const char *separator) {
+  for (int i = 0; i < batch->rows; i++) {
+    for (int j = 0; j < batch->cols; j++) {
+      write_matrix_number(file, matrix_batch_lanes(batch, i, j)[index]);
+
+      if (j < batch->cols - 1) {
+        fprintf(file, "%s", separator);
+      }
+    }
+    fprintf(file, "\n");
+  }
+}
+
+int write_matrix_batch_to_file(MatrixBatch *batch, char *filename) {
+  FILE *file = fopen(filename, "w");
+
+  if (file == NULL) {
+    printf("Error: Failed to open file %s", filename);
+    return 0;
+  }
+
+  fprintf(file, "%d\n", batch->rows);
+  fprintf(file, "%d\n", batch->cols);
+  fprintf(file, "%d\n", batch->count);
+
+  for (int k = 0; k < batch->count; k++) {
+    write_matrix_batch_rows(file, batch, k, ",");
+  }
+
+  if (fclose(file) != 0) {
+    printf("Error: Failed to write file %s", filename);
+    return 0;
+  }
+
+  return 1;
+}
+
+void print_matrix_batch(MatrixBatch *batch) {
+  for (int k = 0; k < batch->count; k++) {
+    printf("\n");
+    write_matrix_batch_rows(stdout, batch, k, ", ");
+  }
+}
+
+int convert_matrix_file(char *input_filename, char *output_filename) {
+  if (has_sparse_matrix_extension(input_filename)) {
+    SparseMatrix *s;
+
+    if (!read_sparse_matrix_from_file(&s, input_filename)) return 0;
+
+    if (has_sparse_matrix_extension(output_filename)) {
+      int written = write_sparse_matrix_to_file(s, output_filename);
+      delete_sparse_matrix(s);
+      return written;
+    }
+
+    MatrixResult dense = sparse_matrix_to_dense(s);
+    delete_sparse_matrix(s);
+
+    if (!dense.success) {
+      print_matrix_error(dense.code);
+      return 0;
+    }
+
+    int written = write_matrix_to_file(dense.value, output_filename);
+    delete_matrix(dense.value);
+
+    return written;
+  }
+
+  Matrix *m = malloc(sizeof(Matrix));
+
+  if (m == NULL || !read_matrix_from_file(m, input_filename)) {
+    free(m);
+    return 0;
+  }
+
+  int written = write_matrix_to_file(m, output_filename);
+  delete_matrix(m);
+
+  return written;
+}
+
+MatrixRowReader* open_matrix_row_reader(char *filename) {
+  MatrixRowReader *reader = calloc(1, sizeof(MatrixRowReader));
+
+  if (reader == NULL) {
+    print_matrix_error(MATRIX_INTERNAL_ERROR);
+    return NULL;
+  }
+
+  if (!has_binary_matrix_extension(filename)) {
+    reader->text = open_matrix_text_reader(filename);
+
+    if (reader->text == NULL) {
+      free(reader);
+      return NULL;
+    }
+
+    reader->rows = reader->text->rows;
+    reader->cols = reader->text->cols;
+    reader->element_type = MATRIX_FLOAT64;
+
+    return reader;
+  }
+
+  reader->file = fopen(filename, "rb");
+
+  if (reader->file == NULL) {
+    printf("Error: Failed to open file %s", filename);
+    free(reader);
+    return NULL;
+  }
+
+  struct stat file_stat;
+  MatrixFileHeader header;
+  int valid = fstat(fileno(reader->file), &file_stat) == 0;
+
+  if (valid && fread(&header, sizeof(header), 1, reader->file) != 1) memset(&header, 0, sizeof(header));
+
+  valid = valid && validate_binary_header(&header, file_stat.st_size, filename);
+
+  if (!valid || fseeko(reader->file, header.data_offset, SEEK_SET) != 0) {
+    if (valid) printf("Error: Failed to read file %s", filename);
+    close_matrix_row_reader(reader);
+    return NULL;
+  }
+
+  reader->rows = header.rows;
+  reader->cols = header.cols;
+  reader->element_type = matrix_element_type_of_file(header.element_type);
+  reader->swap = header.endianness != host_endianness();
+  reader->padding = (size_t) (header.stride - header.cols) * matrix_element_size(reader->element_type);
+  reader->filename = filename;
+
+  return reader;
+}
+
+int read_matrix_row(MatrixRowReader *reader, Matrix *m) {
+  if (reader->text != NULL) return read_matrix_text_row(reader->text, m->values);
+
+  size_t size = matrix_element_size(reader->element_type);
+
+  if (fread(m->data, size, reader->cols, reader->file) != (size_t) reader->cols ||
+      (reader->padding > 0 && fseeko(reader->file, reader->padding, SEEK_CUR) != 0)) {
+    printf("Error: Failed to read file %s", reader->filename);
+    return 0;
+  }
+
+  if (reader->swap) swap_element_bytes(m->data, m->data, size, reader->cols);
+
+  return 1;
+}
+
+int finish_matrix_row_reader(MatrixRowReader *reader) {
+  return reader->text == NULL || finish_matrix_text_reader(reader->text);
+}
+
+void close_matrix_row_reader(MatrixRowReader *reader) {
+  if (reader->text != NULL) close_matrix_text_reader(reader->text);
+  if (reader->file != NULL) fclose(reader->file);
+  free(reader);
+}
+
+MatrixRowWriter* open_matrix_row_writer(char *filename, int rows, int cols, MatrixElementType element_type) {
+  MatrixRowWriter *writer = calloc(1, sizeof(MatrixRowWriter));
+
+  if (writer == NULL) {
+    print_matrix_error(MATRIX_INTERNAL_ERROR);
+    return NULL;
+  }
+
+  writer->filename = filename;
+
+  if (filename == NULL) {
+    writer->file = stdout;
+    writer->separator = ", ";
+    writer->written = printf("\n") > 0;
+    return writer;
+  }
+
+  size_t length = strlen(filename) + 32;
+  writer->temporary = malloc(length);
+
+  if (writer->temporary == NULL) {
+    print_matrix_error(MATRIX_INTERNAL_ERROR);
+    free(writer);
+    return NULL;
+  }
+
+  snprintf(writer->temporary, length, "%s.%d.tmp", filename, (int) getpid());
+
+  writer->file = fopen(writer->temporary, "wb");
+  writer->separator = ",";
+  writer->binary = has_binary_matrix_extension(filename);
+
+  if (writer->file == NULL) {
+    printf("Error: Failed to open file %s", filename);
+    free(writer->temporary);
+    free(writer);
+    return NULL;
+  }
+
+  if (writer->binary) {
+    // Rows start on MATRIX_ALIGNMENT boundaries, as in matrices in memory.
+    int per_alignment = MATRIX_ALIGNMENT / matrix_element_size(element_type);
+    writer->stride = (cols + per_alignment - 1) / per_alignment * per_alignment;
+
+    MatrixFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MATRIX_FILE_MAGIC, 4);
+    header.version = MATRIX_FILE_VERSION;
+    header.element_type = MATRIX_FILE_ELEMENT_TYPES[element_type];
+    header.endianness = host_endianness();
+    header.rows = rows;
+    header.cols = cols;
+    header.stride = writer->stride;
+    header.data_offset = sizeof(MatrixFileHeader);
+
+    writer->written = fwrite(&header, sizeof(header), 1, writer->file) == 1;
+  } else {
+    writer->written = fprintf(writer->file, "%d\n%d\n", rows, cols) > 0;
+  }
+
+  return writer;
+}
+
+int write_matrix_rows(MatrixRowWriter *writer, Matrix *m) {
+  if (!writer->written) return 0;
+
+  for (int i = 0; writer->written && i < m->rows; i++) {
+    if (writer->binary) {
+      static const char zeros[MATRIX_ALIGNMENT];
+      size_t size = matrix_element_size(m->element_type), padding = (size_t) (writer->stride - m->cols) * size;
+
+      writer->written = fwrite((char*) m->data + (size_t) i * m->stride * size, size, m->cols, writer->file) ==
+        (size_t) m->cols && fwrite(zeros, 1, padding, writer->file) == padding;
+    } else {
+      size_t length = format_matrix_row(&writer->buffer, &writer->capacity, 0, m, i, writer->separator);
+      writer->written = length > 0 && fwrite(writer->buffer, 1, length, writer->file) == length;
+    }
+  }
+
+  return writer->written;
+}
+
+int close_matrix_row_writer(MatrixRowWriter *writer, int keep) {
+  int written = writer->written;
+
+  if (writer->filename != NULL) {
+    written = fclose(writer->file) == 0 && written;
+
+    if (written && keep && rename(writer->temporary, writer->filename) != 0) written = 0;
+
+    if (!written) printf("Error: Failed to write file %s", writer->filename);
+    if (!written || !keep) unlink(writer->temporary);
+  }
+
+  free(writer->temporary);
+  free(writer->buffer);
+  free(writer);
+
+  return written && keep;
+}
+
+// Shared by the streaming sum and subtract: one row of each input and of
+// the result in memory at a time, combined with matrix_sum_into or
+// matrix_subtract_into so that the checks and kernels are the in-memory
+// ones.
+int stream_element_wise_files(char *a_filename, char *b_filename, char *output_filename, int subtract) {
+  MatrixResultCode mismatch = subtract ? MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT : MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM;
+  MatrixRowReader *a = open_matrix_row_reader(a_filename);
+  MatrixRowReader *b = a != NULL ? open_matrix_row_reader(b_filename) : NULL;
+
+  if (b == NULL) {
+    if (a != NULL) close_matrix_row_reader(a);
+    return 0;
+  }
+
+  MatrixResultCode code = a->rows != b->rows || a->cols != b->cols ? mismatch
+    : a->element_type != b->element_type ? MATRIX_ELEMENT_TYPES_MUST_MATCH : MATRIX_SUCCESS_CODE;
+  Matrix *a_row = NULL, *b_row = NULL, *result_row = NULL;
+  MatrixRowWriter *writer = NULL;
+
+  if (code == MATRIX_SUCCESS_CODE) {
+    a_row = new_typed_matrix(1, a->cols, a->element_type).value;
+    b_row = new_typed_matrix(1, a->cols, a->element_type).value;
+    result_row = new_typed_matrix(1, a->cols, a->element_type).value;
+
+    if (a_row == NULL || b_row == NULL || result_row == NULL) code = MATRIX_INTERNAL_ERROR;
+  }
+
+  if (code != MATRIX_SUCCESS_CODE) {
+    print_matrix_error(code);
+  } else {
+    writer = open_matrix_row_writer(output_filename, a->rows, a->cols, a->element_type);
+  }
+
+  int streamed = writer != NULL;
+
+  for (int i = 0; streamed && i < a->rows; i++) {
+    streamed = read_matrix_row(a, a_row) && read_matrix_row(b, b_row);
+
+    if (!streamed) break;
+
+    MatrixResult r = subtract ? matrix_subtract_into(result_row, a_row, b_row) : matrix_sum_into(result_row, a_row, b_row);
+
+    if (!r.success) {
+      print_matrix_error(r.code);
+      streamed = 0;
+    } else if (!write_matrix_rows(writer, result_row)) {
+      streamed = 0;
+    }
+  }
+
+  streamed = streamed && finish_matrix_row_reader(a) && finish_matrix_row_reader(b);
+
+  if (writer != NULL) streamed = close_matrix_row_writer(writer, streamed);
+
+  if (a_row != NULL) delete_matrix(a_row);
+  if (b_row != NULL) delete_matrix(b_row);
+  if (result_row != NULL) delete_matrix(result_row);
+  close_matrix_row_reader(a);
+  close_matrix_row_reader(b);
+
+  return streamed;
+}
+
+int stream_matrix_sum_files(char *a_filename, char *b_filename, char *output_filename) {
+  return stream_element_wise_files(a_filename, b_filename, output_filename, 0);
+}
+
+int stream_matrix_subtract_files(char *a_filename, char *b_filename, char *output_filename) {
+  return stream_element_wise_files(a_filename, b_filename, output_filename, 1);
+}
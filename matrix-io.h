@@ -0,0 +1,231 @@
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "matrix.h"
+#include "matrix-batch.h"
+#include "sparse-matrix.h"
+
+#define MATRIX_BINARY_EXTENSION ".matb"
+#define MATRIX_SPARSE_EXTENSION ".coo"
+#define MATRIX_BATCH_EXTENSION ".batch"
+
+#define MATRIX_FILE_MAGIC "MATB"
+#define MATRIX_FILE_VERSION 1
+
+#define MATRIX_FILE_LITTLE_ENDIAN 1
+#define MATRIX_FILE_BIG_ENDIAN 2
+
+typedef enum MatrixFileElementType {
+  MATRIX_FILE_FLOAT64 = 1,
+  MATRIX_FILE_FLOAT32 = 2,
+  MATRIX_FILE_INT32 = 3,
+  MATRIX_FILE_INT64 = 4
+} MatrixFileElementType;
+
+// Fixed 64-byte header of a .matb file. The values follow at data_offset
+// (a multiple of MATRIX_ALIGNMENT), row after row, stride elements apart.
+typedef struct MatrixFileHeader {
+  char magic[4];
+  uint16_t version;
+  uint8_t element_type;
+  uint8_t endianness;
+  uint32_t rows;
+  uint32_t cols;
+  uint32_t stride;
+  uint32_t reserved;
+  uint64_t data_offset;
+  uint8_t padding[32];
+} MatrixFileHeader;
+
+#define MATRIX_TEXT_READER_BUFFER_SIZE (4 << 20)
+
+// Text files at least this large are mapped and parsed on the thread pool,
+// in chunks of at least MATRIX_TEXT_CHUNK_MIN_SIZE bytes; smaller ones are
+// streamed through a MatrixTextReader.
+#define MATRIX_PARALLEL_TEXT_MIN_SIZE (1 << 20)
+#define MATRIX_TEXT_CHUNK_MIN_SIZE (256 << 10)
+
+// Text output is formatted in blocks of rows of about this many bytes,
+// several at a time on the thread pool.
+#define MATRIX_TEXT_WRITE_BLOCK_SIZE (1 << 20)
+
+// Output precision that writes every float the shortest way that reads
+// back as the same value; the default.
+#define MATRIX_OUTPUT_SHORTEST -1
+#define MATRIX_OUTPUT_PRECISION_MAX 20
+
+// Longest text of one element: a float64 near the top of its range written
+// with MATRIX_OUTPUT_PRECISION_MAX decimals has over 300 digits.
+#define MATRIX_TEXT_ELEMENT_MAX_LENGTH 352
+
+// Streams a text .mat file through a large read buffer, one row at a time.
+// The buffer grows as needed, so rows may be arbitrarily wide.
+typedef struct MatrixTextReader {
+  int fd;
+  char *buffer;
+  size_t capacity;
+  size_t start;
+  size_t end;
+  int eof;
+  int rows;
+  int cols;
+  int row;
+  char *filename;
+} MatrixTextReader;
+
+const char* matrix_error_message(MatrixResultCode code);
+
+void print_matrix_error(MatrixResultCode code);
+
+// Opens a .mat file and reads its rows/cols header. Errors are printed and
+// reported by returning NULL.
+MatrixTextReader* open_matrix_text_reader(char *filename);
+
+// Parses the next row into values[0..cols). Missing trailing columns read
+// as zero. Errors are printed and reported by returning 0.
+int read_matrix_text_row(MatrixTextReader *reader, double *values);
+
+// Checks that nothing but blank lines follows the last row.
+int finish_matrix_text_reader(MatrixTextReader *reader);
+
+void close_matrix_text_reader(MatrixTextReader *reader);
+
+const char* parse_matrix_number(const char *text, double *value);
+
+typedef enum MatrixTextLineStatus {
+  MATRIX_TEXT_LINE_PARSED,
+  MATRIX_TEXT_LINE_TOO_MANY_COLUMNS,
+  MATRIX_TEXT_LINE_MALFORMED
+} MatrixTextLineStatus;
+
+// Parses one NUL-terminated line of comma-separated entries into
+// values[0..cols), or into integers when that is not NULL. Missing trailing
+// entries read as zero. Prints nothing, so that it can run on any thread.
+MatrixTextLineStatus parse_matrix_text_line(const char *line, int cols, double *values, int64_t *integers);
+
+// Reads a .matb file when the name has that extension, the text .mat
+// format otherwise. Errors are printed and reported by returning 0.
+// Binary files keep the element type they were written with; text files
+// read as float64.
+int read_matrix_from_file(Matrix *m, char *filename);
+
+// Like read_matrix_from_file, converting to the given element type. Text
+// integers are parsed exactly; other numbers going to an integer type are
+// rounded, and values out of its range are an error.
+int read_typed_matrix_from_file(Matrix *m, char *filename, MatrixElementType element_type);
+
+// Number of decimals floats are written and printed with, from 0 to
+// MATRIX_OUTPUT_PRECISION_MAX, or MATRIX_OUTPUT_SHORTEST.
+void matrix_set_output_precision(int precision);
+
+int matrix_output_precision();
+
+// Writes a float with the output precision; out must have room for
+// MATRIX_TEXT_ELEMENT_MAX_LENGTH bytes. Returns the length, without a NUL.
+int format_matrix_number(char *out, double value);
+
+// Integer matrices are written exactly in text files, floating-point ones
+// with the output precision, so by default they read back unchanged.
+// Errors are printed and reported by returning 0.
+int write_matrix_to_file(Matrix *m, char *filename);
+
+// Writes m to an open stream in the text .mat format.
+int write_matrix_text(FILE *file, Matrix *m);
+
+// Only the rows, for writing a matrix a band of rows at a time.
+int write_matrix_text_rows(FILE *file, Matrix *m);
+
+uint8_t host_endianness();
+
+int has_binary_matrix_extension(char *filename);
+
+int has_sparse_matrix_extension(char *filename);
+
+// Reads a .coo file: the rows and cols lines of a .mat file followed by
+// one "row,col,value" line (1-based) per nonzero element, in any order.
+// Errors are printed and reported by returning 0.
+int read_sparse_matrix_from_file(SparseMatrix **s, char *filename);
+
+int write_sparse_matrix_to_file(SparseMatrix *s, char *filename);
+
+// Reads a .batch file: the rows and cols lines of a .mat file, a line with
+// the number of matrices, then the rows of every matrix, one matrix after
+// the other. Errors are printed and reported by returning 0.
+int read_matrix_batch_from_file(MatrixBatch **batch, char *filename);
+
+int write_matrix_batch_to_file(MatrixBatch *batch, char *filename);
+
+void print_matrix_batch(MatrixBatch *batch);
+
+// Reads a .mat or .matb file one row at a time. Text rows read as float64;
+// binary rows keep the file's element type and are read through a stdio
+// buffer, stride padding skipped.
+typedef struct MatrixRowReader {
+  MatrixTextReader *text;
+  FILE *file;
+  int swap;
+  size_t padding;
+  int rows;
+  int cols;
+  MatrixElementType element_type;
+  char *filename;
+} MatrixRowReader;
+
+// Writes a .mat or .matb file, chosen by the extension, one band of rows at
+// a time, or prints the rows as print_matrix does when there is no file.
+typedef struct MatrixRowWriter {
+  FILE *file;
+  int binary;
+  // Elements per row in a binary file, padded as write_matrix_to_file pads them.
+  int stride;
+  int written;
+  const char *separator;
+  char *buffer;
+  size_t capacity;
+  char *filename;
+  // The rows go to this file next to filename, which is only replaced once
+  // the writer is closed with keep set, so the output may also be an input.
+  char *temporary;
+} MatrixRowWriter;
+
+// Errors are printed and reported by returning NULL.
+MatrixRowReader* open_matrix_row_reader(char *filename);
+
+// Reads the next row into the first row of m, which must have the reader's
+// columns and element type. Errors are printed and reported by returning 0.
+int read_matrix_row(MatrixRowReader *reader, Matrix *m);
+
+int finish_matrix_row_reader(MatrixRowReader *reader);
+
+void close_matrix_row_reader(MatrixRowReader *reader);
+
+MatrixRowWriter* open_matrix_row_writer(char *filename, int rows, int cols, MatrixElementType element_type);
+
+// Appends every row of m. Errors are reported by returning 0 and printed
+// when the writer is closed.
+int write_matrix_rows(MatrixRowWriter *writer, Matrix *m);
+
+// With keep set, moves a fully written file over the output; otherwise,
+// or if writing failed, removes what was written and leaves the output as
+// it was.
+int close_matrix_row_writer(MatrixRowWriter *writer, int keep);
+
+// Sum and subtract straight between files, reading both inputs a row at a
+// time in step and writing each result row at once, so memory stays
+// proportional to the number of columns. The output is a .mat or .matb
+// file, or the matrix is printed when output_filename is NULL. Errors are
+// the ones matrix_sum and matrix_subtract report, printed, with 0
+// returned and a partial output file removed.
+int stream_matrix_sum_files(char *a_filename, char *b_filename, char *output_filename);
+
+int stream_matrix_subtract_files(char *a_filename, char *b_filename, char *output_filename);
+
+// Rewrites a matrix file in the format chosen by the output extension
+// (.mat, .matb or .coo).
+int convert_matrix_file(char *input_filename, char *output_filename);
+
+void print_matrix(Matrix *m);
+
+#endif // MATRIX_IO_H
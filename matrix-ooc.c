@@ -0,0 +1,1053 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "matrix-ooc.h"
+#include "matrix-io.h"
+#include "matrix-stats.h"
+#include "gemm.h"
+#include "simd.h"
+
+// Tiles in memory at once: the read-ahead ring of operand pairs and the
+// result tile.
+#define OOC_BINARY_TILES (2 * MATRIX_OOC_READ_AHEAD_DEPTH + 1)
+#define OOC_TRANSPOSE_TILES (MATRIX_OOC_READ_AHEAD_DEPTH + 1)
+
+// The panel being factored and the read-ahead ring of factored panels.
+#define OOC_LU_PANELS (MATRIX_OOC_READ_AHEAD_DEPTH + 1)
+
+TiledMatrixResult _tiled_result(MatrixResultCode code, TiledMatrix *value) {
+    return (TiledMatrixResult) { code == MATRIX_SUCCESS_CODE, code, value };
+}
+
+size_t _tile_elements(TiledMatrix *m) {
+    return (size_t) m->tile_size * m->tile_size;
+}
+
+off_t _tile_offset(TiledMatrix *m, int tile_row, int tile_col) {
+    return m->data_offset + ((off_t) tile_row * m->tile_cols + tile_col) * _tile_elements(m) * sizeof(double);
+}
+
+// Rows of tile_row, or columns of tile_col, that lie inside the matrix.
+int _tile_extent(int size, int tile_size, int tile) {
+    int rest = size - tile * tile_size;
+    return rest < tile_size ? rest : tile_size;
+}
+
+int _pread_all(int fd, void *buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t bytes = pread(fd, buffer, size, offset);
+
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) return 0;
+
+        buffer = (char*) buffer + bytes;
+        size -= bytes;
+        offset += bytes;
+    }
+
+    return 1;
+}
+
+int _pwrite_all(int fd, const void *buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t bytes = pwrite(fd, buffer, size, offset);
+
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) return 0;
+
+        buffer = (const char*) buffer + bytes;
+        size -= bytes;
+        offset += bytes;
+    }
+
+    return 1;
+}
+
+TiledMatrix* _new_tiled_matrix(int fd, int rows, int cols, int tile_size) {
+    TiledMatrix *m = malloc(sizeof(TiledMatrix));
+
+    if (m == NULL) return NULL;
+
+    *m = (TiledMatrix) {
+        fd, rows, cols, tile_size,
+        (rows + tile_size - 1) / tile_size, (cols + tile_size - 1) / tile_size,
+        sizeof(TiledMatrixFileHeader)
+    };
+
+    return m;
+}
+
+TiledMatrixResult create_tiled_matrix(const char *filename, int rows, int cols, int tile_size) {
+    if (rows <= 0 || cols <= 0 || tile_size <= 0) return _tiled_result(MATRIX_DIMENSIONS_MUST_BE_POSITIVE, NULL);
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) return _tiled_result(MATRIX_TILE_IO_FAILED, NULL);
+
+    TiledMatrix *m = _new_tiled_matrix(fd, rows, cols, tile_size);
+
+    if (m == NULL) {
+        close(fd);
+        return _tiled_result(MATRIX_INTERNAL_ERROR, NULL);
+    }
+
+    TiledMatrixFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MATRIX_TILED_FILE_MAGIC, 4);
+    header.version = MATRIX_TILED_FILE_VERSION;
+    header.element_type = MATRIX_FILE_FLOAT64;
+    header.endianness = host_endianness();
+    header.rows = rows;
+    header.cols = cols;
+    header.tile_size = tile_size;
+    header.data_offset = m->data_offset;
+
+    // Extending the file leaves a hole the tiles are written into.
+    if (!_pwrite_all(fd, &header, sizeof(header), 0) ||
+            ftruncate(fd, _tile_offset(m, m->tile_rows, 0)) != 0) {
+        close_tiled_matrix(m);
+        return _tiled_result(MATRIX_TILE_IO_FAILED, NULL);
+    }
+
+    return _tiled_result(MATRIX_SUCCESS_CODE, m);
+}
+
+TiledMatrixResult open_tiled_matrix(const char *filename) {
+    int fd = open(filename, O_RDWR);
+    TiledMatrixFileHeader header;
+    struct stat info;
+
+    if (fd < 0) fd = open(filename, O_RDONLY);
+    if (fd < 0) return _tiled_result(MATRIX_TILE_IO_FAILED, NULL);
+
+    if (fstat(fd, &info) != 0 || !_pread_all(fd, &header, sizeof(header), 0) ||
+            memcmp(header.magic, MATRIX_TILED_FILE_MAGIC, 4) != 0 ||
+            header.version != MATRIX_TILED_FILE_VERSION || header.element_type != MATRIX_FILE_FLOAT64 ||
+            header.endianness != host_endianness() ||
+            header.rows == 0 || header.rows > 0x7fffffff || header.cols == 0 || header.cols > 0x7fffffff ||
+            header.tile_size == 0 || header.tile_size > MATRIX_OOC_MAX_TILE_SIZE ||
+            header.data_offset < sizeof(header) || header.data_offset % MATRIX_ALIGNMENT != 0 ||
+            header.data_offset > (uint64_t) info.st_size) {
+        close(fd);
+        return _tiled_result(MATRIX_TILE_IO_FAILED, NULL);
+    }
+
+    TiledMatrix *m = _new_tiled_matrix(fd, header.rows, header.cols, header.tile_size);
+
+    if (m == NULL) {
+        close(fd);
+        return _tiled_result(MATRIX_INTERNAL_ERROR, NULL);
+    }
+
+    m->data_offset = header.data_offset;
+
+    // The whole tile grid has to fit in the file, so that no tile offset
+    // overflows or points past its end.
+    uint64_t tiles, tile_bytes = _tile_elements(m) * sizeof(double), grid_bytes;
+
+    if (__builtin_mul_overflow((uint64_t) m->tile_rows, (uint64_t) m->tile_cols, &tiles) ||
+            __builtin_mul_overflow(tiles, tile_bytes, &grid_bytes) ||
+            grid_bytes > (uint64_t) info.st_size - m->data_offset) {
+        close_tiled_matrix(m);
+        return _tiled_result(MATRIX_TILE_IO_FAILED, NULL);
+    }
+
+    return _tiled_result(MATRIX_SUCCESS_CODE, m);
+}
+
+void close_tiled_matrix(TiledMatrix *m) {
+    if (m == NULL) return;
+
+    close(m->fd);
+    free(m);
+}
+
+int read_tile(TiledMatrix *m, int tile_row, int tile_col, double *tile) {
+    return _pread_all(m->fd, tile, _tile_elements(m) * sizeof(double), _tile_offset(m, tile_row, tile_col));
+}
+
+int write_tile(TiledMatrix *m, int tile_row, int tile_col, const double *tile) {
+    return _pwrite_all(m->fd, tile, _tile_elements(m) * sizeof(double), _tile_offset(m, tile_row, tile_col));
+}
+
+int tile_size_for_memory_limit(size_t memory_limit) {
+    size_t tile_size = (size_t) sqrt((double) memory_limit / OOC_BINARY_TILES / sizeof(double));
+
+    if (tile_size > MATRIX_OOC_MAX_TILE_SIZE) tile_size = MATRIX_OOC_MAX_TILE_SIZE;
+    tile_size -= tile_size % MATRIX_OOC_MIN_TILE_SIZE;
+
+    return (int) tile_size;
+}
+
+size_t _panel_elements(int n, int tile_size) {
+    return (size_t) (n + tile_size - 1) / tile_size * tile_size * tile_size;
+}
+
+int lu_tile_size_for_memory_limit(size_t memory_limit, int n) {
+    int tile_size = (n + MATRIX_OOC_MIN_TILE_SIZE - 1) / MATRIX_OOC_MIN_TILE_SIZE * MATRIX_OOC_MIN_TILE_SIZE;
+
+    if (tile_size > MATRIX_OOC_MAX_TILE_SIZE) tile_size = MATRIX_OOC_MAX_TILE_SIZE;
+
+    while (tile_size >= MATRIX_OOC_MIN_TILE_SIZE &&
+            OOC_LU_PANELS * _panel_elements(n, tile_size) * sizeof(double) > memory_limit) {
+        tile_size -= MATRIX_OOC_MIN_TILE_SIZE;
+    }
+
+    return tile_size >= MATRIX_OOC_MIN_TILE_SIZE ? tile_size : 0;
+}
+
+// Loads request index of a sequence into buffer.
+typedef int (*ReadAheadLoader)(void *context, size_t index, double *buffer);
+
+// A thread that runs through a sequence of loads ahead of its consumer,
+// into a ring of buffers: the consumer takes them in order and releases
+// them in the same order, and the thread refills each released buffer with
+// the next load while the consumer computes on the others.
+typedef struct ReadAhead {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    ReadAheadLoader load;
+    void *context;
+    size_t count;
+    int depth;
+    size_t elements;
+    double **buffers;
+    size_t loaded;
+    size_t taken;
+    size_t released;
+    int failed;
+    int stopping;
+} ReadAhead;
+
+void* _read_ahead_thread(void *argument) {
+    ReadAhead *ahead = argument;
+
+    for (size_t index = 0; index < ahead->count; index++) {
+        pthread_mutex_lock(&ahead->lock);
+        while (index - ahead->released >= (size_t) ahead->depth && !ahead->stopping) {
+            pthread_cond_wait(&ahead->changed, &ahead->lock);
+        }
+        int stopping = ahead->stopping;
+        pthread_mutex_unlock(&ahead->lock);
+
+        if (stopping) break;
+
+        int loaded = ahead->load(ahead->context, index, ahead->buffers[index % ahead->depth]);
+
+        pthread_mutex_lock(&ahead->lock);
+        if (loaded) ahead->loaded = index + 1; else ahead->failed = 1;
+        pthread_cond_broadcast(&ahead->changed);
+        pthread_mutex_unlock(&ahead->lock);
+
+        if (!loaded) break;
+    }
+
+    return NULL;
+}
+
+void _free_read_ahead_buffers(ReadAhead *ahead) {
+    for (int i = 0; i < ahead->depth; i++) {
+        matrix_release(NULL, ahead->buffers[i], ahead->elements * sizeof(double));
+    }
+
+    free(ahead->buffers);
+}
+
+int _start_read_ahead(ReadAhead *ahead, ReadAheadLoader load, void *context, size_t count, int depth, size_t elements) {
+    *ahead = (ReadAhead) { .load = load, .context = context, .count = count, .depth = depth, .elements = elements };
+    ahead->buffers = calloc(depth, sizeof(double*));
+
+    for (int i = 0; ahead->buffers != NULL && i < depth; i++) {
+        ahead->buffers[i] = matrix_allocate_scratch(NULL, elements * sizeof(double));
+
+        if (ahead->buffers[i] == NULL) {
+            _free_read_ahead_buffers(ahead);
+            ahead->buffers = NULL;
+        }
+    }
+
+    if (ahead->buffers == NULL) return 0;
+
+    pthread_mutex_init(&ahead->lock, NULL);
+    pthread_cond_init(&ahead->changed, NULL);
+
+    if (pthread_create(&ahead->thread, NULL, _read_ahead_thread, ahead) != 0) {
+        pthread_cond_destroy(&ahead->changed);
+        pthread_mutex_destroy(&ahead->lock);
+        _free_read_ahead_buffers(ahead);
+        return 0;
+    }
+
+    return 1;
+}
+
+// The next loaded buffer, or NULL if its load failed.
+double* _read_ahead_next(ReadAhead *ahead) {
+    double *buffer = NULL;
+
+    pthread_mutex_lock(&ahead->lock);
+    while (ahead->loaded <= ahead->taken && !ahead->failed) pthread_cond_wait(&ahead->changed, &ahead->lock);
+
+    if (ahead->loaded > ahead->taken) buffer = ahead->buffers[ahead->taken++ % ahead->depth];
+    pthread_mutex_unlock(&ahead->lock);
+
+    return buffer;
+}
+
+// Hands back the oldest buffer taken.
+void _read_ahead_release(ReadAhead *ahead) {
+    pthread_mutex_lock(&ahead->lock);
+    ahead->released++;
+    pthread_cond_broadcast(&ahead->changed);
+    pthread_mutex_unlock(&ahead->lock);
+}
+
+void _stop_read_ahead(ReadAhead *ahead) {
+    pthread_mutex_lock(&ahead->lock);
+    ahead->stopping = 1;
+    pthread_cond_broadcast(&ahead->changed);
+    pthread_mutex_unlock(&ahead->lock);
+
+    pthread_join(ahead->thread, NULL);
+    pthread_cond_destroy(&ahead->changed);
+    pthread_mutex_destroy(&ahead->lock);
+    _free_read_ahead_buffers(ahead);
+}
+
+// Loads for element-wise operations: tile (i, j) of a, then of b, for
+// every tile in order.
+typedef struct TilePairs {
+    TiledMatrix *a;
+    TiledMatrix *b;
+} TilePairs;
+
+int _load_tile_pair(void *context, size_t index, double *buffer) {
+    TilePairs *pairs = context;
+    size_t tile = index / 2;
+    TiledMatrix *m = index % 2 == 0 ? pairs->a : pairs->b;
+
+    return read_tile(m, tile / m->tile_cols, tile % m->tile_cols, buffer);
+}
+
+// Creates the result file and the buffers every operation needs, or
+// explains why not.
+MatrixResultCode _begin_tiled_operation(
+    const char *filename, int rows, int cols, int tile_size, size_t memory_limit, int tiles,
+    TiledMatrix **result, double **tile
+) {
+    if ((size_t) tiles * tile_size * tile_size * sizeof(double) > memory_limit) return MATRIX_MEMORY_LIMIT_TOO_SMALL;
+
+    TiledMatrixResult created = create_tiled_matrix(filename, rows, cols, tile_size);
+
+    if (!created.success) return created.code;
+
+    *result = created.value;
+    *tile = matrix_allocate(NULL, (size_t) tile_size * tile_size * sizeof(double));
+
+    if (*tile == NULL) {
+        close_tiled_matrix(*result);
+        unlink(filename);
+        return MATRIX_INTERNAL_ERROR;
+    }
+
+    return MATRIX_SUCCESS_CODE;
+}
+
+TiledMatrixResult _end_tiled_operation(
+    const char *filename, TiledMatrix *result, double *tile, MatrixResultCode code
+) {
+    matrix_release(NULL, tile, _tile_elements(result) * sizeof(double));
+
+    if (code != MATRIX_SUCCESS_CODE) {
+        close_tiled_matrix(result);
+        unlink(filename);
+        return _tiled_result(code, NULL);
+    }
+
+    return _tiled_result(MATRIX_SUCCESS_CODE, result);
+}
+
+TiledMatrixResult _tiled_element_wise(
+    TiledMatrix *a, TiledMatrix *b, const char *filename, size_t memory_limit, int subtract
+) {
+    if (a == NULL || b == NULL) return _tiled_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+
+    if (a->rows != b->rows || a->cols != b->cols) {
+        return _tiled_result(subtract ? MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT : MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM, NULL);
+    }
+
+    if (a->tile_size != b->tile_size) return _tiled_result(MATRIX_TILE_SIZES_MUST_MATCH, NULL);
+
+    uint64_t elements = (uint64_t) a->rows * a->cols;
+
+    matrix_stats_count_kernel(subtract ? MATRIX_STATS_SUBTRACT : MATRIX_STATS_ADD, elements, 3 * elements * sizeof(double));
+
+    TiledMatrix *result;
+    double *out;
+    MatrixResultCode code = _begin_tiled_operation(
+        filename, a->rows, a->cols, a->tile_size, memory_limit, OOC_BINARY_TILES, &result, &out
+    );
+
+    if (code != MATRIX_SUCCESS_CODE) return _tiled_result(code, NULL);
+
+    const MatrixKernels *kernels = simd_kernels();
+    int tile_size = a->tile_size;
+    size_t tiles = (size_t) a->tile_rows * a->tile_cols;
+    TilePairs pairs = { a, b };
+    ReadAhead ahead;
+
+    if (!_start_read_ahead(&ahead, _load_tile_pair, &pairs, 2 * tiles, 2 * MATRIX_OOC_READ_AHEAD_DEPTH, _tile_elements(a))) {
+        return _end_tiled_operation(filename, result, out, MATRIX_INTERNAL_ERROR);
+    }
+
+    for (size_t tile = 0; tile < tiles && code == MATRIX_SUCCESS_CODE; tile++) {
+        int tile_row = tile / a->tile_cols, tile_col = tile % a->tile_cols;
+        int rows = _tile_extent(a->rows, tile_size, tile_row);
+        int cols = _tile_extent(a->cols, tile_size, tile_col);
+        double *x = _read_ahead_next(&ahead);
+        double *y = x != NULL ? _read_ahead_next(&ahead) : NULL;
+
+        if (y == NULL) {
+            code = MATRIX_TILE_IO_FAILED;
+            break;
+        }
+
+        for (int i = 0; i < rows; i++) {
+            size_t row = (size_t) i * tile_size;
+
+            if (subtract) {
+                kernels->subtract(out + row, x + row, y + row, cols);
+            } else {
+                kernels->add(out + row, x + row, y + row, cols);
+            }
+        }
+
+        _read_ahead_release(&ahead);
+        _read_ahead_release(&ahead);
+
+        if (!write_tile(result, tile_row, tile_col, out)) code = MATRIX_TILE_IO_FAILED;
+    }
+
+    _stop_read_ahead(&ahead);
+
+    return _end_tiled_operation(filename, result, out, code);
+}
+
+TiledMatrixResult tiled_matrix_sum(TiledMatrix *a, TiledMatrix *b, const char *filename, size_t memory_limit) {
+    return _tiled_element_wise(a, b, filename, memory_limit, 0);
+}
+
+TiledMatrixResult tiled_matrix_subtract(TiledMatrix *a, TiledMatrix *b, const char *filename, size_t memory_limit) {
+    return _tiled_element_wise(a, b, filename, memory_limit, 1);
+}
+
+// Loads for C = A B: for every tile (i, j) of C, tiles (i, k) of A and
+// (k, j) of B for each k in turn.
+int _load_product_tile(void *context, size_t index, double *buffer) {
+    TilePairs *pairs = context;
+    size_t pair = index / 2;
+    int inner = pairs->a->tile_cols;
+    int k = pair % inner;
+    size_t tile = pair / inner;
+    int tile_row = tile / pairs->b->tile_cols, tile_col = tile % pairs->b->tile_cols;
+
+    return index % 2 == 0 ? read_tile(pairs->a, tile_row, k, buffer) : read_tile(pairs->b, k, tile_col, buffer);
+}
+
+TiledMatrixResult tiled_matrix_multiply(TiledMatrix *a, TiledMatrix *b, const char *filename, size_t memory_limit) {
+    if (a == NULL || b == NULL) return _tiled_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (a->cols != b->rows) return _tiled_result(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY, NULL);
+    if (a->tile_size != b->tile_size) return _tiled_result(MATRIX_TILE_SIZES_MUST_MATCH, NULL);
+
+    matrix_stats_count_kernel(MATRIX_STATS_MULTIPLY, 2 * (uint64_t) a->rows * b->cols * a->cols,
+        ((uint64_t) a->rows * a->cols + (uint64_t) b->rows * b->cols + (uint64_t) a->rows * b->cols) * sizeof(double));
+
+    TiledMatrix *result;
+    double *out;
+    MatrixResultCode code = _begin_tiled_operation(
+        filename, a->rows, b->cols, a->tile_size, memory_limit, OOC_BINARY_TILES, &result, &out
+    );
+
+    if (code != MATRIX_SUCCESS_CODE) return _tiled_result(code, NULL);
+
+    int tile_size = a->tile_size;
+    size_t tiles = (size_t) result->tile_rows * result->tile_cols;
+    TilePairs pairs = { a, b };
+    ReadAhead ahead;
+
+    if (!_start_read_ahead(&ahead, _load_product_tile, &pairs, 2 * tiles * a->tile_cols,
+            2 * MATRIX_OOC_READ_AHEAD_DEPTH, _tile_elements(a))) {
+        return _end_tiled_operation(filename, result, out, MATRIX_INTERNAL_ERROR);
+    }
+
+    for (size_t tile = 0; tile < tiles && code == MATRIX_SUCCESS_CODE; tile++) {
+        int tile_row = tile / result->tile_cols, tile_col = tile % result->tile_cols;
+        int rows = _tile_extent(result->rows, tile_size, tile_row);
+        int cols = _tile_extent(result->cols, tile_size, tile_col);
+
+        memset(out, 0, _tile_elements(result) * sizeof(double));
+
+        for (int k = 0; k < a->tile_cols; k++) {
+            double *x = _read_ahead_next(&ahead);
+            double *y = x != NULL ? _read_ahead_next(&ahead) : NULL;
+
+            if (y == NULL) {
+                code = MATRIX_TILE_IO_FAILED;
+                break;
+            }
+
+            if (!gemm(rows, cols, _tile_extent(a->cols, tile_size, k), 1, x, tile_size, y, tile_size, out, tile_size)) {
+                code = MATRIX_INTERNAL_ERROR;
+            }
+
+            _read_ahead_release(&ahead);
+            _read_ahead_release(&ahead);
+
+            if (code != MATRIX_SUCCESS_CODE) break;
+        }
+
+        if (code == MATRIX_SUCCESS_CODE && !write_tile(result, tile_row, tile_col, out)) code = MATRIX_TILE_IO_FAILED;
+    }
+
+    _stop_read_ahead(&ahead);
+
+    return _end_tiled_operation(filename, result, out, code);
+}
+
+int _load_tile(void *context, size_t index, double *buffer) {
+    TiledMatrix *m = context;
+
+    return read_tile(m, index / m->tile_cols, index % m->tile_cols, buffer);
+}
+
+TiledMatrixResult tiled_matrix_transpose(TiledMatrix *m, const char *filename, size_t memory_limit) {
+    if (m == NULL) return _tiled_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+
+    TiledMatrix *result;
+    double *out;
+    MatrixResultCode code = _begin_tiled_operation(
+        filename, m->cols, m->rows, m->tile_size, memory_limit, OOC_TRANSPOSE_TILES, &result, &out
+    );
+
+    if (code != MATRIX_SUCCESS_CODE) return _tiled_result(code, NULL);
+
+    int tile_size = m->tile_size;
+    size_t tiles = (size_t) m->tile_rows * m->tile_cols;
+    ReadAhead ahead;
+
+    if (!_start_read_ahead(&ahead, _load_tile, m, tiles, MATRIX_OOC_READ_AHEAD_DEPTH, _tile_elements(m))) {
+        return _end_tiled_operation(filename, result, out, MATRIX_INTERNAL_ERROR);
+    }
+
+    for (size_t tile = 0; tile < tiles && code == MATRIX_SUCCESS_CODE; tile++) {
+        double *x = _read_ahead_next(&ahead);
+
+        if (x == NULL) {
+            code = MATRIX_TILE_IO_FAILED;
+            break;
+        }
+
+        // Whole tiles, so the zeroed padding lands where it belongs.
+        Matrix source = { .rows = tile_size, .cols = tile_size, .stride = tile_size, .values = x };
+        Matrix destination = { .rows = tile_size, .cols = tile_size, .stride = tile_size, .values = out };
+        MatrixResult transposed = matrix_transpose_into(&destination, &source);
+
+        _read_ahead_release(&ahead);
+
+        if (!transposed.success) {
+            code = transposed.code;
+        } else if (!write_tile(result, tile % m->tile_cols, tile / m->tile_cols, out)) {
+            code = MATRIX_TILE_IO_FAILED;
+        }
+    }
+
+    _stop_read_ahead(&ahead);
+
+    return _end_tiled_operation(filename, result, out, code);
+}
+
+// A column panel is the column of tiles tile_col stacked top to bottom,
+// which is a tile_rows * tile_size x tile_size row-major array.
+int _read_panel(TiledMatrix *m, int tile_col, double *panel) {
+    for (int tile_row = 0; tile_row < m->tile_rows; tile_row++) {
+        if (!read_tile(m, tile_row, tile_col, panel + tile_row * _tile_elements(m))) return 0;
+    }
+
+    return 1;
+}
+
+int _write_panel(TiledMatrix *m, int tile_col, const double *panel) {
+    for (int tile_row = 0; tile_row < m->tile_rows; tile_row++) {
+        if (!write_tile(m, tile_row, tile_col, panel + tile_row * _tile_elements(m))) return 0;
+    }
+
+    return 1;
+}
+
+// Applies the row exchanges pivots[first..last) to a panel.
+void _apply_pivots(double *panel, int tile_size, const int *pivots, int first, int last) {
+    for (int row = first; row < last; row++) {
+        if (pivots[row] == row) continue;
+
+        double *x = panel + (size_t) row * tile_size;
+        double *y = panel + (size_t) pivots[row] * tile_size;
+
+        for (int col = 0; col < tile_size; col++) {
+            double temp = x[col];
+            x[col] = y[col];
+            y[col] = temp;
+        }
+    }
+}
+
+int _load_panel(void *context, size_t index, double *buffer) {
+    return _read_panel(context, index, buffer);
+}
+
+MatrixNumericResult tiled_matrix_lu_factor(TiledMatrix *m, int *pivots, size_t memory_limit) {
+    if (m == NULL || pivots == NULL) return (MatrixNumericResult) { 0, MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, 0 };
+    if (m->rows != m->cols) return (MatrixNumericResult) { 0, MATRIX_SHOULD_BE_SQUARE_TO_FACTOR, 0 };
+
+    int n = m->rows, tile_size = m->tile_size;
+    size_t elements = _panel_elements(n, tile_size);
+
+    if (OOC_LU_PANELS * elements * sizeof(double) > memory_limit) {
+        return (MatrixNumericResult) { 0, MATRIX_MEMORY_LIMIT_TOO_SMALL, 0 };
+    }
+
+    double *panel = matrix_allocate_scratch(NULL, elements * sizeof(double));
+
+    if (panel == NULL) return (MatrixNumericResult) { 0, MATRIX_INTERNAL_ERROR, 0 };
+
+    matrix_stats_count_kernel(MATRIX_STATS_LU_FACTOR, 2 * (uint64_t) n * n * n / 3, 2 * (uint64_t) n * n * sizeof(double));
+
+    MatrixResultCode code = MATRIX_SUCCESS_CODE;
+    double det = 1;
+    int singular = 0;
+
+    for (int j = 0; j < m->tile_cols && code == MATRIX_SUCCESS_CODE && !singular; j++) {
+        int first = j * tile_size;
+        int width = _tile_extent(n, tile_size, j);
+
+        if (!_read_panel(m, j, panel)) {
+            code = MATRIX_TILE_IO_FAILED;
+            break;
+        }
+
+        _apply_pivots(panel, tile_size, pivots, 0, first);
+
+        // Brings the panel up to date with every factored panel k to its
+        // left, read back while the previous one is applied. A factored
+        // panel is stored with only the exchanges made up to its own
+        // factorization, so the later ones are applied to it here.
+        ReadAhead ahead;
+
+        if (j > 0 && !_start_read_ahead(&ahead, _load_panel, m, j, MATRIX_OOC_READ_AHEAD_DEPTH, elements)) {
+            code = MATRIX_INTERNAL_ERROR;
+            break;
+        }
+
+        for (int k = 0; k < j; k++) {
+            double *factored = _read_ahead_next(&ahead);
+
+            if (factored == NULL) {
+                code = MATRIX_TILE_IO_FAILED;
+                break;
+            }
+
+            int diagonal = k * tile_size;
+            int below = diagonal + tile_size;
+
+            _apply_pivots(factored, tile_size, pivots, below, first);
+
+            // U block of this panel: solve with the unit lower triangle.
+            for (int row = 1; row < tile_size; row++) {
+                double *target = panel + (size_t) (diagonal + row) * tile_size;
+                const double *multipliers = factored + (size_t) (diagonal + row) * tile_size;
+
+                for (int p = 0; p < row; p++) {
+                    double f = multipliers[p];
+                    const double *source = panel + (size_t) (diagonal + p) * tile_size;
+
+                    for (int col = 0; col < width; col++) target[col] -= f * source[col];
+                }
+            }
+
+            // The rows below take the product of the multipliers with it.
+            if (n > below && !gemm(
+                n - below, width, tile_size, -1,
+                factored + (size_t) below * tile_size, tile_size,
+                panel + (size_t) diagonal * tile_size, tile_size,
+                panel + (size_t) below * tile_size, tile_size
+            )) {
+                code = MATRIX_INTERNAL_ERROR;
+            }
+
+            _read_ahead_release(&ahead);
+
+            if (code != MATRIX_SUCCESS_CODE) break;
+        }
+
+        if (j > 0) _stop_read_ahead(&ahead);
+
+        if (code != MATRIX_SUCCESS_CODE) break;
+
+        // Factors the panel itself as matrix_lu_factor does: pivot on the
+        // first largest magnitude, store the multipliers where they zeroed.
+        for (int col = 0; col < width; col++) {
+            int row = first + col;
+            double *pivot_row = panel + (size_t) row * tile_size;
+            double max = fabs(pivot_row[col]);
+            int max_idx = row;
+
+            for (int i = row + 1; i < n; i++) {
+                if (fabs(panel[(size_t) i * tile_size + col]) > max) {
+                    max = fabs(panel[(size_t) i * tile_size + col]);
+                    max_idx = i;
+                }
+            }
+
+            pivots[row] = max_idx;
+
+            if (max_idx != row) {
+                _apply_pivots(panel, tile_size, pivots, row, row + 1);
+                det = -det;
+            }
+
+            double ref = pivot_row[col];
+
+            if (ref == 0) {
+                singular = 1;
+                break;
+            }
+
+            det *= ref;
+
+            for (int i = row + 1; i < n; i++) {
+                double *target = panel + (size_t) i * tile_size;
+
+                if (target[col] == 0) continue;
+
+                double f = target[col] / ref;
+
+                for (int c = col + 1; c < width; c++) target[c] -= f * pivot_row[c];
+                target[col] = f;
+            }
+        }
+
+        if (!_write_panel(m, j, panel)) code = MATRIX_TILE_IO_FAILED;
+    }
+
+    // Every panel but the last still lacks the exchanges made after it.
+    for (int k = 0; k + 1 < m->tile_cols && code == MATRIX_SUCCESS_CODE && !singular; k++) {
+        if (!_read_panel(m, k, panel)) {
+            code = MATRIX_TILE_IO_FAILED;
+            break;
+        }
+
+        _apply_pivots(panel, tile_size, pivots, (k + 1) * tile_size, n);
+
+        if (!_write_panel(m, k, panel)) code = MATRIX_TILE_IO_FAILED;
+    }
+
+    matrix_release(NULL, panel, elements * sizeof(double));
+
+    if (code != MATRIX_SUCCESS_CODE) return (MatrixNumericResult) { 0, code, 0 };
+
+    return (MatrixNumericResult) { 1, MATRIX_SUCCESS_CODE, singular ? 0 : det };
+}
+
+int has_tiled_matrix_extension(char *filename) {
+    size_t length = strlen(filename);
+    size_t extension_length = strlen(MATRIX_TILED_EXTENSION);
+
+    return length >= extension_length &&
+        strcmp(filename + length - extension_length, MATRIX_TILED_EXTENSION) == 0;
+}
+
+// Reads or writes count rows of a tiled matrix starting at first_row, all
+// within one row of tiles, from or to band (count x cols, packed). scratch
+// holds count rows of one tile, which are contiguous in the file.
+int _tiled_band(TiledMatrix *m, int first_row, int count, double *band, double *scratch, int writing) {
+    int tile_size = m->tile_size;
+    int tile_row = first_row / tile_size;
+    off_t within = (off_t) (first_row % tile_size) * tile_size * sizeof(double);
+    size_t bytes = (size_t) count * tile_size * sizeof(double);
+
+    for (int tile_col = 0; tile_col < m->tile_cols; tile_col++) {
+        int first_col = tile_col * tile_size;
+        int cols = _tile_extent(m->cols, tile_size, tile_col);
+        off_t offset = _tile_offset(m, tile_row, tile_col) + within;
+
+        if (writing) {
+            memset(scratch, 0, bytes);
+            for (int i = 0; i < count; i++) {
+                memcpy(scratch + (size_t) i * tile_size, band + (size_t) i * m->cols + first_col, cols * sizeof(double));
+            }
+
+            if (!_pwrite_all(m->fd, scratch, bytes, offset)) return 0;
+        } else {
+            if (!_pread_all(m->fd, scratch, bytes, offset)) return 0;
+
+            for (int i = 0; i < count; i++) {
+                memcpy(band + (size_t) i * m->cols + first_col, scratch + (size_t) i * tile_size, cols * sizeof(double));
+            }
+        }
+    }
+
+    return 1;
+}
+
+// Where rows come from when converting: a text reader, a mapped .matb
+// matrix or a tiled file.
+typedef struct RowSource {
+    int rows;
+    int cols;
+    MatrixTextReader *reader;
+    Matrix *mapped;
+    TiledMatrix *tiled;
+} RowSource;
+
+int _open_row_source(RowSource *source, char *filename) {
+    *source = (RowSource) { 0 };
+
+    if (has_tiled_matrix_extension(filename)) {
+        TiledMatrixResult opened = open_tiled_matrix(filename);
+
+        if (!opened.success) {
+            printf("Invalid file format: %s is not a tiled matrix file.", filename);
+            return 0;
+        }
+
+        source->tiled = opened.value;
+        source->rows = source->tiled->rows;
+        source->cols = source->tiled->cols;
+    } else if (has_binary_matrix_extension(filename)) {
+        source->mapped = malloc(sizeof(Matrix));
+
+        if (source->mapped == NULL || !read_matrix_from_file(source->mapped, filename)) {
+            free(source->mapped);
+            return 0;
+        }
+
+        if (source->mapped->element_type != MATRIX_FLOAT64) {
+            print_matrix_error(MATRIX_UNSUPPORTED_ELEMENT_TYPE);
+            delete_matrix(source->mapped);
+            return 0;
+        }
+
+        source->rows = source->mapped->rows;
+        source->cols = source->mapped->cols;
+    } else {
+        source->reader = open_matrix_text_reader(filename);
+
+        if (source->reader == NULL) return 0;
+
+        source->rows = source->reader->rows;
+        source->cols = source->reader->cols;
+    }
+
+    return 1;
+}
+
+int _read_source_rows(RowSource *source, int first_row, int count, double *band, double *scratch) {
+    if (source->tiled != NULL) return _tiled_band(source->tiled, first_row, count, band, scratch, 0);
+
+    for (int i = 0; i < count; i++) {
+        double *row = band + (size_t) i * source->cols;
+
+        if (source->reader != NULL) {
+            if (!read_matrix_text_row(source->reader, row)) return 0;
+        } else {
+            memcpy(row, source->mapped->values + (size_t) (first_row + i) * source->mapped->stride,
+                source->cols * sizeof(double));
+        }
+    }
+
+    return 1;
+}
+
+// With finish, checks that a text file has nothing after its last row.
+int _close_row_source(RowSource *source, int finish) {
+    int finished = 1;
+
+    if (source->reader != NULL) {
+        if (finish) finished = finish_matrix_text_reader(source->reader);
+        close_matrix_text_reader(source->reader);
+    }
+
+    if (source->mapped != NULL) delete_matrix(source->mapped);
+    close_tiled_matrix(source->tiled);
+
+    return finished;
+}
+
+int read_matrix_file_dimensions(char *filename, int *rows, int *cols) {
+    RowSource source;
+
+    if (!_open_row_source(&source, filename)) return 0;
+
+    *rows = source.rows;
+    *cols = source.cols;
+    _close_row_source(&source, 0);
+
+    return 1;
+}
+
+// Rows per band so that a band and a tile-wide scratch of as many rows fit
+// in memory_limit, never fewer than one.
+int _band_rows(size_t memory_limit, int cols, int tile_size) {
+    size_t rows = memory_limit / (((size_t) cols + tile_size) * sizeof(double));
+
+    return rows > 0 ? (rows < 0x7fffffff ? (int) rows : 0x7fffffff) : 1;
+}
+
+// Rows from first_row on that stay within one row of tiles of both sides.
+int _band_extent(int first_row, int rows, int band_rows, int tile_size, int source_tile_size) {
+    int count = rows - first_row;
+
+    if (count > band_rows) count = band_rows;
+    if (count > tile_size - first_row % tile_size) count = tile_size - first_row % tile_size;
+    if (source_tile_size > 0 && count > source_tile_size - first_row % source_tile_size) {
+        count = source_tile_size - first_row % source_tile_size;
+    }
+
+    return count;
+}
+
+int convert_to_tiled_matrix_file(char *input_filename, char *output_filename, int tile_size, size_t memory_limit) {
+    RowSource source;
+
+    if (!_open_row_source(&source, input_filename)) return 0;
+
+    TiledMatrixResult created = create_tiled_matrix(output_filename, source.rows, source.cols, tile_size);
+
+    if (!created.success) {
+        print_matrix_error(created.code);
+        _close_row_source(&source, 0);
+        return 0;
+    }
+
+    TiledMatrix *output = created.value;
+    int source_tile_size = source.tiled != NULL ? source.tiled->tile_size : 0;
+    int widest_tile = tile_size > source_tile_size ? tile_size : source_tile_size;
+    int band_rows = _band_rows(memory_limit, source.cols, widest_tile);
+    int capacity = band_rows < widest_tile ? band_rows : widest_tile;
+    double *band = malloc((size_t) capacity * source.cols * sizeof(double));
+    double *scratch = malloc((size_t) capacity * widest_tile * sizeof(double));
+    int converted = band != NULL && scratch != NULL;
+
+    for (int row = 0; converted && row < source.rows;) {
+        int count = _band_extent(row, source.rows, capacity, tile_size, source_tile_size);
+
+        converted = _read_source_rows(&source, row, count, band, scratch);
+
+        if (!converted) break;
+
+        if (!_tiled_band(output, row, count, band, scratch, 1)) {
+            print_matrix_error(MATRIX_TILE_IO_FAILED);
+            converted = 0;
+        }
+
+        row += count;
+    }
+
+    if (band == NULL || scratch == NULL) print_matrix_error(MATRIX_INTERNAL_ERROR);
+
+    free(band);
+    free(scratch);
+    converted = _close_row_source(&source, converted) && converted;
+    close_tiled_matrix(output);
+
+    if (!converted) unlink(output_filename);
+
+    return converted;
+}
+
+int convert_from_tiled_matrix_file(char *input_filename, char *output_filename, size_t memory_limit) {
+    if (has_tiled_matrix_extension(output_filename)) {
+        TiledMatrixResult opened = open_tiled_matrix(input_filename);
+
+        if (!opened.success) {
+            printf("Invalid file format: %s is not a tiled matrix file.", input_filename);
+            return 0;
+        }
+
+        int tile_size = opened.value->tile_size;
+        close_tiled_matrix(opened.value);
+
+        return convert_to_tiled_matrix_file(input_filename, output_filename, tile_size, memory_limit);
+    }
+
+    RowSource source;
+
+    if (!_open_row_source(&source, input_filename)) return 0;
+
+    if (source.tiled == NULL) {
+        printf("Invalid file format: %s is not a tiled matrix file.", input_filename);
+        _close_row_source(&source, 0);
+        return 0;
+    }
+
+    FILE *file = fopen(output_filename, "wb");
+
+    if (file == NULL) {
+        printf("Error: Failed to open file %s", output_filename);
+        _close_row_source(&source, 0);
+        return 0;
+    }
+
+    int binary = has_binary_matrix_extension(output_filename);
+    int tile_size = source.tiled->tile_size;
+    int capacity = _band_rows(memory_limit, source.cols, tile_size);
+    double *band = malloc((size_t) (capacity < tile_size ? capacity : tile_size) * source.cols * sizeof(double));
+    double *scratch = malloc((size_t) (capacity < tile_size ? capacity : tile_size) * tile_size * sizeof(double));
+    int written = band != NULL && scratch != NULL;
+
+    if (binary) {
+        // Rows packed, so the stride is the number of columns.
+        MatrixFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MATRIX_FILE_MAGIC, 4);
+        header.version = MATRIX_FILE_VERSION;
+        header.element_type = MATRIX_FILE_FLOAT64;
+        header.endianness = host_endianness();
+        header.rows = source.rows;
+        header.cols = source.cols;
+        header.stride = source.cols;
+        header.data_offset = sizeof(MatrixFileHeader);
+
+        written = written && fwrite(&header, sizeof(header), 1, file) == 1;
+    } else {
+        written = written && fprintf(file, "%d\n%d\n", source.rows, source.cols) > 0;
+    }
+
+    for (int row = 0; written && row < source.rows;) {
+        int count = _band_extent(row, source.rows, capacity, tile_size, 0);
+        Matrix rows = { .rows = count, .cols = source.cols, .stride = source.cols, .values = band };
+
+        written = _read_source_rows(&source, row, count, band, scratch) && (binary ?
+            fwrite(band, sizeof(double), (size_t) count * source.cols, file) == (size_t) count * source.cols :
+            write_matrix_text_rows(file, &rows));
+
+        row += count;
+    }
+
+    free(band);
+    free(scratch);
+    _close_row_source(&source, 0);
+
+    if (fclose(file) != 0 || !written) {
+        printf("Error: Failed to write file %s", output_filename);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,119 @@
+#ifndef MATRIX_OOC_H
+#define MATRIX_OOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "matrix.h"
+
+#define MATRIX_TILED_EXTENSION ".matt"
+
+#define MATRIX_TILED_FILE_MAGIC "MATT"
+#define MATRIX_TILED_FILE_VERSION 1
+
+// Tiles never grow past this, however much memory there is, so that the
+// first tile read and the last one written, which nothing overlaps, stay
+// short.
+#define MATRIX_OOC_MAX_TILE_SIZE 8192
+#define MATRIX_OOC_MIN_TILE_SIZE 8
+
+// Tiles or panels the read-ahead thread may load before they are used.
+#define MATRIX_OOC_READ_AHEAD_DEPTH 2
+
+// Fixed 64-byte header of a .matt file. tile_size x tile_size float64 tiles
+// follow at data_offset, row of tiles after row of tiles; every tile is
+// stored whole, the parts past the last row or column zeroed, so tile
+// (i, j) always sits at data_offset + (i * tile_cols + j) * tile bytes.
+typedef struct TiledMatrixFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t element_type;
+    uint8_t endianness;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t tile_size;
+    uint32_t reserved;
+    uint64_t data_offset;
+    uint8_t padding[32];
+} TiledMatrixFileHeader;
+
+// A float64 matrix kept in a .matt file and read and written a tile at a
+// time, for matrices that do not fit in memory.
+typedef struct TiledMatrix {
+    int fd;
+    int rows;
+    int cols;
+    int tile_size;
+    int tile_rows;
+    int tile_cols;
+    uint64_t data_offset;
+} TiledMatrix;
+
+typedef struct TiledMatrixResult {
+    int success;
+    MatrixResultCode code;
+    TiledMatrix *value;
+} TiledMatrixResult;
+
+// Creates the file with every element zero; its tiles take no disk space
+// until they are written.
+TiledMatrixResult create_tiled_matrix(const char *filename, int rows, int cols, int tile_size);
+
+TiledMatrixResult open_tiled_matrix(const char *filename);
+
+void close_tiled_matrix(TiledMatrix *m);
+
+int read_tile(TiledMatrix *m, int tile_row, int tile_col, double *tile);
+
+int write_tile(TiledMatrix *m, int tile_row, int tile_col, const double *tile);
+
+// Budget used for converting to and from tiled files when no memory limit
+// is given.
+#define MATRIX_OOC_DEFAULT_MEMORY_LIMIT ((size_t) 256 << 20)
+
+// Largest tile size the sum, subtract, multiply and transpose below can
+// work with in memory_limit bytes, or 0 if not even the smallest fits.
+int tile_size_for_memory_limit(size_t memory_limit);
+
+// The operations below stream tiles through at most memory_limit bytes
+// while a read-ahead thread loads the next ones, and write their result to
+// a new tiled file with the operands' tile size.
+
+TiledMatrixResult tiled_matrix_sum(TiledMatrix *a, TiledMatrix *b, const char *filename, size_t memory_limit);
+
+TiledMatrixResult tiled_matrix_subtract(TiledMatrix *a, TiledMatrix *b, const char *filename, size_t memory_limit);
+
+TiledMatrixResult tiled_matrix_multiply(TiledMatrix *a, TiledMatrix *b, const char *filename, size_t memory_limit);
+
+TiledMatrixResult tiled_matrix_transpose(TiledMatrix *m, const char *filename, size_t memory_limit);
+
+// Factors m in place as matrix_lu_factor does, P A = L U with partial
+// pivoting, leaving L (unit diagonal, not stored) and U in its tiles.
+// Left-looking: each column panel of tiles is loaded, brought up to date
+// with the factored panels to its left, read back one at a time, then
+// factored and written back, so at most three panels are ever in memory.
+// pivots must have room for m->rows entries.
+// The value is the determinant, which is 0 for a singular matrix; the
+// factors are then incomplete.
+MatrixNumericResult tiled_matrix_lu_factor(TiledMatrix *m, int *pivots, size_t memory_limit);
+
+// Tile size a matrix of that order must be stored with for
+// tiled_matrix_lu_factor to fit in memory_limit, or 0 if none fits.
+int lu_tile_size_for_memory_limit(size_t memory_limit, int n);
+
+int has_tiled_matrix_extension(char *filename);
+
+// Reads the dimensions of a .mat, .matb or .matt file without its values.
+// Errors are printed and reported by returning 0.
+int read_matrix_file_dimensions(char *filename, int *rows, int *cols);
+
+// Rewrites a .mat, .matb or .matt file as a .matt file with the given tile
+// size, a band of rows at a time. Errors are printed and reported by
+// returning 0.
+int convert_to_tiled_matrix_file(char *input_filename, char *output_filename, int tile_size, size_t memory_limit);
+
+// Rewrites a .matt file as a .mat, .matb or .matt file, chosen by the
+// output extension, a band of rows at a time. Errors are printed and
+// reported by returning 0.
+int convert_from_tiled_matrix_file(char *input_filename, char *output_filename, size_t memory_limit);
+
+#endif // MATRIX_OOC_H
@@ -0,0 +1,545 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "matrix-server.h"
+#include "matrix-format.h"
+#include "matrix-io.h"
+
+// Words of the longest request, "sum RESULT A B", and one more to notice
+// extra ones.
+#define SERVER_MAX_WORDS 5
+
+typedef struct RegistryEntry {
+    char *name;
+    ResidentMatrix *resident;
+} RegistryEntry;
+
+struct MatrixRegistry {
+    pthread_mutex_t lock;
+    RegistryEntry *entries;
+    int count;
+    int capacity;
+    MatrixAllocator *pool;
+};
+
+MatrixRegistry* new_matrix_registry() {
+    MatrixRegistry *registry = calloc(1, sizeof(MatrixRegistry));
+
+    if (registry == NULL) return NULL;
+
+    registry->pool = new_matrix_pool(MATRIX_SERVER_POOL_SIZE);
+
+    if (registry->pool == NULL) {
+        free(registry);
+        return NULL;
+    }
+
+    pthread_mutex_init(&registry->lock, NULL);
+
+    return registry;
+}
+
+void _delete_resident(ResidentMatrix *resident) {
+    delete_matrix(resident->matrix);
+    free(resident);
+}
+
+void delete_matrix_registry(MatrixRegistry *registry) {
+    if (registry == NULL) return;
+
+    for (int i = 0; i < registry->count; i++) {
+        free(registry->entries[i].name);
+        _delete_resident(registry->entries[i].resident);
+    }
+
+    free(registry->entries);
+    pthread_mutex_destroy(&registry->lock);
+    delete_matrix_allocator(registry->pool);
+    free(registry);
+}
+
+// Index of the entry with the name, or -1. Called with the lock held.
+int _registry_find(MatrixRegistry *registry, const char *name) {
+    for (int i = 0; i < registry->count; i++) {
+        if (strcmp(registry->entries[i].name, name) == 0) return i;
+    }
+
+    return -1;
+}
+
+// Drops one reference, returning the matrix to delete once the lock is
+// released if it was the last one. Called with the lock held.
+ResidentMatrix* _registry_unreference(ResidentMatrix *resident) {
+    return --resident->references == 0 ? resident : NULL;
+}
+
+int matrix_registry_store(MatrixRegistry *registry, const char *name, Matrix *m) {
+    ResidentMatrix *resident = malloc(sizeof(ResidentMatrix));
+    char *copy = strdup(name);
+    ResidentMatrix *replaced = NULL;
+    int stored = 0;
+
+    if (resident == NULL || copy == NULL) {
+        free(resident);
+        free(copy);
+        delete_matrix(m);
+        return 0;
+    }
+
+    resident->matrix = m;
+    resident->references = 1;
+
+    pthread_mutex_lock(&registry->lock);
+
+    int index = _registry_find(registry, name);
+
+    if (index >= 0) {
+        replaced = _registry_unreference(registry->entries[index].resident);
+        registry->entries[index].resident = resident;
+        free(copy);
+        stored = 1;
+    } else {
+        if (registry->count == registry->capacity) {
+            int capacity = registry->capacity > 0 ? registry->capacity * 2 : 16;
+            RegistryEntry *entries = realloc(registry->entries, capacity * sizeof(RegistryEntry));
+
+            if (entries != NULL) {
+                registry->entries = entries;
+                registry->capacity = capacity;
+            }
+        }
+
+        if (registry->count < registry->capacity) {
+            registry->entries[registry->count++] = (RegistryEntry) { copy, resident };
+            stored = 1;
+        }
+    }
+
+    pthread_mutex_unlock(&registry->lock);
+
+    if (replaced != NULL) _delete_resident(replaced);
+
+    if (!stored) {
+        free(copy);
+        _delete_resident(resident);
+    }
+
+    return stored;
+}
+
+ResidentMatrix* matrix_registry_acquire(MatrixRegistry *registry, const char *name) {
+    ResidentMatrix *resident = NULL;
+
+    pthread_mutex_lock(&registry->lock);
+
+    int index = _registry_find(registry, name);
+
+    if (index >= 0) {
+        resident = registry->entries[index].resident;
+        resident->references++;
+    }
+
+    pthread_mutex_unlock(&registry->lock);
+
+    return resident;
+}
+
+void matrix_registry_release(MatrixRegistry *registry, ResidentMatrix *resident) {
+    if (resident == NULL) return;
+
+    pthread_mutex_lock(&registry->lock);
+    ResidentMatrix *unused = _registry_unreference(resident);
+    pthread_mutex_unlock(&registry->lock);
+
+    if (unused != NULL) _delete_resident(unused);
+}
+
+int matrix_registry_remove(MatrixRegistry *registry, const char *name) {
+    ResidentMatrix *unused = NULL;
+    char *removed_name = NULL;
+
+    pthread_mutex_lock(&registry->lock);
+
+    int index = _registry_find(registry, name);
+
+    if (index >= 0) {
+        removed_name = registry->entries[index].name;
+        unused = _registry_unreference(registry->entries[index].resident);
+        registry->entries[index] = registry->entries[--registry->count];
+    }
+
+    pthread_mutex_unlock(&registry->lock);
+
+    free(removed_name);
+    if (unused != NULL) _delete_resident(unused);
+
+    return index >= 0;
+}
+
+MatrixResult _server_solve(Matrix *a, Matrix *b) {
+    MatrixLUResult lu = matrix_lu_factor(a);
+
+    if (!lu.success) return (MatrixResult) { 0, lu.code, NULL };
+
+    MatrixResult result = matrix_lu_solve(lu.value, b);
+    delete_matrix_lu(lu.value);
+
+    return result;
+}
+
+typedef struct ServerOperation {
+    const char *name;
+    MatrixResult (*unary)(Matrix *m);
+    MatrixResult (*binary)(Matrix *a, Matrix *b);
+} ServerOperation;
+
+const ServerOperation SERVER_OPERATIONS[] = {
+    { "sum", NULL, matrix_sum },
+    { "subtract", NULL, matrix_subtract },
+    { "multiply", NULL, matrix_multiply },
+    { "solve", NULL, _server_solve },
+    { "transpose", matrix_transpose, NULL },
+    { "inverse", matrix_inverse, NULL }
+};
+
+const ServerOperation* _server_operation(const char *name) {
+    for (size_t i = 0; i < sizeof(SERVER_OPERATIONS) / sizeof(SERVER_OPERATIONS[0]); i++) {
+        if (strcmp(SERVER_OPERATIONS[i].name, name) == 0) return &SERVER_OPERATIONS[i];
+    }
+
+    return NULL;
+}
+
+void _reply_stored(FILE *out, MatrixRegistry *registry, const char *name, Matrix *m) {
+    int rows = m->rows, cols = m->cols;
+
+    if (matrix_registry_store(registry, name, m)) {
+        fprintf(out, "ok %s %d %d\n", name, rows, cols);
+    } else {
+        fprintf(out, "error Out of memory.\n");
+    }
+}
+
+// Runs an operation on resident operands and names its result.
+void _serve_operation(MatrixRegistry *registry, const ServerOperation *operation, char **words, int count, FILE *out) {
+    int operands = operation->binary != NULL ? 2 : 1;
+
+    if (count != operands + 2) {
+        fprintf(out, "error Usage: %s RESULT %s\n", operation->name, operands == 2 ? "A B" : "A");
+        return;
+    }
+
+    ResidentMatrix *a = matrix_registry_acquire(registry, words[2]);
+    ResidentMatrix *b = operands == 2 ? matrix_registry_acquire(registry, words[3]) : NULL;
+
+    if (a == NULL || (operands == 2 && b == NULL)) {
+        fprintf(out, "error Unknown matrix '%s'.\n", a == NULL ? words[2] : words[3]);
+    } else {
+        MatrixResult result = operands == 2 ?
+            operation->binary(a->matrix, b->matrix) : operation->unary(a->matrix);
+
+        if (result.success) {
+            _reply_stored(out, registry, words[1], result.value);
+        } else {
+            fprintf(out, "error %s\n", matrix_error_message(result.code));
+        }
+    }
+
+    matrix_registry_release(registry, a);
+    matrix_registry_release(registry, b);
+}
+
+void _serve_determinant(MatrixRegistry *registry, const char *name, FILE *out) {
+    ResidentMatrix *resident = matrix_registry_acquire(registry, name);
+
+    if (resident == NULL) {
+        fprintf(out, "error Unknown matrix '%s'.\n", name);
+        return;
+    }
+
+    Matrix *m = resident->matrix;
+
+    if (m->element_type == MATRIX_INT32 || m->element_type == MATRIX_INT64) {
+        MatrixIntegerResult det = matrix_determinant_bareiss(m);
+        char text[MATRIX_NUMBER_MAX_LENGTH];
+
+        if (det.success) {
+            fprintf(out, "ok %.*s\n", format_integer(text, det.value), text);
+        } else {
+            fprintf(out, "error %s\n", matrix_error_message(det.code));
+        }
+    } else {
+        MatrixNumericResult det = matrix_determinant_lu_decomposition(m);
+        char text[MATRIX_TEXT_ELEMENT_MAX_LENGTH];
+
+        if (det.success) {
+            fprintf(out, "ok %.*s\n", format_matrix_number(text, det.value), text);
+        } else {
+            fprintf(out, "error %s\n", matrix_error_message(det.code));
+        }
+    }
+
+    matrix_registry_release(registry, resident);
+}
+
+// Parses a dimension line of a put request: a positive number and nothing
+// else.
+int _parse_request_dimension(const char *line, int *dimension) {
+    char *end;
+    errno = 0;
+    long value = strtol(line, &end, 10);
+
+    while (*end == '\r' || *end == '\n') end++;
+
+    if (end == line || *end != '\0' || errno == ERANGE || value <= 0 || value > INT_MAX) return 0;
+
+    *dimension = (int) value;
+    return 1;
+}
+
+// Reads the .mat text following a put request. Returns NULL if it is not
+// a valid matrix. Once the dimensions are read every row is consumed, even
+// after an invalid one, so that the next request starts where it should;
+// framed is cleared when the dimensions themselves are invalid and the
+// rows cannot be told from the requests that follow.
+Matrix* _read_request_matrix(FILE *in, char **line, size_t *capacity, int *framed) {
+    int dimensions[2];
+
+    *framed = 0;
+
+    for (int i = 0; i < 2; i++) {
+        if (getline(line, capacity, in) < 0 || !_parse_request_dimension(*line, &dimensions[i])) return NULL;
+    }
+
+    *framed = 1;
+
+    MatrixResult result = new_matrix(dimensions[0], dimensions[1]);
+    Matrix *m = result.value;
+
+    for (int i = 0; i < dimensions[0]; i++) {
+        ssize_t length = getline(line, capacity, in);
+
+        if (length < 0) {
+            *framed = 0;
+            break;
+        }
+
+        if (length > 0 && (*line)[length - 1] == '\n') (*line)[length - 1] = '\0';
+
+        if (m != NULL && parse_matrix_text_line(*line, m->cols, m->values + (size_t) i * m->stride, NULL) !=
+                MATRIX_TEXT_LINE_PARSED) {
+            delete_matrix(m);
+            m = NULL;
+        }
+    }
+
+    if (m != NULL && !*framed) {
+        delete_matrix(m);
+        m = NULL;
+    }
+
+    return m;
+}
+
+void _serve_list(MatrixRegistry *registry, FILE *out) {
+    char *listing = NULL;
+    size_t size = 0;
+    FILE *text = open_memstream(&listing, &size);
+
+    if (text == NULL) {
+        fprintf(out, "error Out of memory.\n");
+        return;
+    }
+
+    // Formatted under the lock, written after it, so a slow client does not
+    // hold up the others.
+    pthread_mutex_lock(&registry->lock);
+
+    fprintf(text, "ok %d\n", registry->count);
+
+    for (int i = 0; i < registry->count; i++) {
+        Matrix *m = registry->entries[i].resident->matrix;
+        fprintf(text, "%s %d %d\n", registry->entries[i].name, m->rows, m->cols);
+    }
+
+    pthread_mutex_unlock(&registry->lock);
+
+    fclose(text);
+    fwrite(listing, 1, size, out);
+    free(listing);
+}
+
+// Answers one request. Returns 0 when the client asked to quit.
+int _serve_request(MatrixRegistry *registry, char **line, size_t *capacity, FILE *in, FILE *out) {
+    char *words[SERVER_MAX_WORDS];
+    char *save = NULL;
+    int count = 0;
+
+    for (char *word = strtok_r(*line, " \t\r\n", &save); word != NULL && count < SERVER_MAX_WORDS;
+            word = strtok_r(NULL, " \t\r\n", &save)) {
+        words[count++] = word;
+    }
+
+    if (count == 0) return 1;
+
+    const char *command = words[0];
+    const ServerOperation *operation = _server_operation(command);
+
+    if (strcmp(command, "quit") == 0) {
+        return 0;
+    } else if (operation != NULL) {
+        _serve_operation(registry, operation, words, count, out);
+    } else if (strcmp(command, "load") == 0 && count == 3) {
+        Matrix *m = malloc(sizeof(Matrix));
+
+        if (m != NULL && read_matrix_from_file(m, words[2])) {
+            _reply_stored(out, registry, words[1], m);
+        } else {
+            free(m);
+            fprintf(out, "error Failed to read matrix file '%s'.\n", words[2]);
+        }
+    } else if (strcmp(command, "put") == 0 && count == 2) {
+        // The name lives in *line, which reading the matrix reuses.
+        char *name = strdup(words[1]);
+        int framed;
+        Matrix *m = _read_request_matrix(in, line, capacity, &framed);
+
+        if (m != NULL && name != NULL) {
+            _reply_stored(out, registry, name, m);
+        } else if (m != NULL) {
+            fprintf(out, "error Out of memory.\n");
+        } else if (!framed) {
+            // The rest of the matrix would be read as requests.
+            fprintf(out, "error Invalid matrix dimensions.\n");
+        } else {
+            fprintf(out, "error Invalid matrix.\n");
+        }
+
+        if (m != NULL && name == NULL) delete_matrix(m);
+        free(name);
+
+        if (!framed) return 0;
+    } else if ((strcmp(command, "get") == 0 && count == 2) || (strcmp(command, "save") == 0 && count == 3)) {
+        ResidentMatrix *resident = matrix_registry_acquire(registry, words[1]);
+
+        if (resident == NULL) {
+            fprintf(out, "error Unknown matrix '%s'.\n", words[1]);
+        } else if (count == 2) {
+            fprintf(out, "ok\n");
+            write_matrix_text(out, resident->matrix);
+        } else if (write_matrix_to_file(resident->matrix, words[2])) {
+            fprintf(out, "ok\n");
+        } else {
+            fprintf(out, "error Failed to write matrix file '%s'.\n", words[2]);
+        }
+
+        matrix_registry_release(registry, resident);
+    } else if (strcmp(command, "free") == 0 && count == 2) {
+        if (matrix_registry_remove(registry, words[1])) {
+            fprintf(out, "ok\n");
+        } else {
+            fprintf(out, "error Unknown matrix '%s'.\n", words[1]);
+        }
+    } else if (strcmp(command, "det") == 0 && count == 2) {
+        _serve_determinant(registry, words[1], out);
+    } else if (strcmp(command, "list") == 0 && count == 1) {
+        _serve_list(registry, out);
+    } else {
+        fprintf(out, "error Invalid request '%s'.\n", command);
+    }
+
+    return 1;
+}
+
+void matrix_server_serve(MatrixRegistry *registry, FILE *in, FILE *out) {
+    MatrixAllocator *previous = matrix_use_allocator(registry->pool);
+    char *line = NULL;
+    size_t capacity = 0;
+
+    while (getline(&line, &capacity, in) >= 0) {
+        int serving = _serve_request(registry, &line, &capacity, in, out);
+
+        if (fflush(out) != 0 || !serving) break;
+    }
+
+    free(line);
+    matrix_use_allocator(previous);
+}
+
+typedef struct ServerConnection {
+    MatrixRegistry *registry;
+    int fd;
+} ServerConnection;
+
+void* _serve_connection(void *argument) {
+    ServerConnection *connection = argument;
+    int out_fd = dup(connection->fd);
+    FILE *in = fdopen(connection->fd, "r");
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+
+    if (in != NULL && out != NULL) matrix_server_serve(connection->registry, in, out);
+
+    if (in != NULL) fclose(in); else close(connection->fd);
+    if (out != NULL) fclose(out); else if (out_fd >= 0) close(out_fd);
+
+    free(connection);
+    return NULL;
+}
+
+int matrix_server_listen(MatrixRegistry *registry, const char *socket_path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Error: Socket path '%s' is too long.", socket_path);
+        return 0;
+    }
+
+    strcpy(address.sun_path, socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    unlink(socket_path);
+
+    if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 ||
+            listen(listener, MATRIX_SERVER_BACKLOG) != 0) {
+        printf("Error: Failed to listen on socket '%s': %s", socket_path, strerror(errno));
+        if (listener >= 0) close(listener);
+        return 0;
+    }
+
+    // A client that goes away mid-reply must not take the server with it.
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+
+            printf("Error: Failed to accept a connection: %s", strerror(errno));
+            close(listener);
+            return 0;
+        }
+
+        ServerConnection *connection = malloc(sizeof(ServerConnection));
+        pthread_t thread;
+
+        if (connection != NULL) *connection = (ServerConnection) { registry, fd };
+
+        if (connection == NULL || pthread_create(&thread, NULL, _serve_connection, connection) != 0) {
+            free(connection);
+            close(fd);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+}
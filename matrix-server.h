@@ -0,0 +1,69 @@
+#ifndef MATRIX_SERVER_H
+#define MATRIX_SERVER_H
+
+#include <stdio.h>
+#include "matrix.h"
+
+// Bytes of released matrix storage the server's pool keeps for reuse, so
+// that repeating an operation on same-shaped matrices does not go back to
+// the system.
+#define MATRIX_SERVER_POOL_SIZE (256 << 20)
+
+#define MATRIX_SERVER_BACKLOG 16
+
+// Named matrices kept in memory across requests and connections. Requests
+// hold a reference to the matrices they work on, so a matrix that is freed
+// or replaced while another request uses it is deleted only when that
+// request is done.
+typedef struct MatrixRegistry MatrixRegistry;
+
+typedef struct ResidentMatrix {
+    Matrix *matrix;
+    int references;
+} ResidentMatrix;
+
+MatrixRegistry* new_matrix_registry();
+
+void delete_matrix_registry(MatrixRegistry *registry);
+
+// Names m, which the registry takes over, replacing any matrix that had the
+// name. Returns 0 if the registry could not grow; m is then deleted.
+int matrix_registry_store(MatrixRegistry *registry, const char *name, Matrix *m);
+
+// The matrix with the name, with a reference held for the caller, or NULL.
+ResidentMatrix* matrix_registry_acquire(MatrixRegistry *registry, const char *name);
+
+void matrix_registry_release(MatrixRegistry *registry, ResidentMatrix *resident);
+
+// Drops the name. Returns 0 if there was no matrix with it.
+int matrix_registry_remove(MatrixRegistry *registry, const char *name);
+
+// Answers the requests read from in on out, one line each, until quit or
+// the end of in:
+//
+//   load NAME FILE            ok NAME ROWS COLS
+//   put NAME                  the .mat text of the matrix follows the request
+//                             ok NAME ROWS COLS
+//   get NAME                  ok, then the .mat text of the matrix
+//   save NAME FILE            ok
+//   free NAME                 ok
+//   list                      ok COUNT, then a NAME ROWS COLS line each
+//   sum RESULT A B            ok RESULT ROWS COLS
+//   subtract RESULT A B       and multiply, solve likewise
+//   transpose RESULT A        and inverse likewise
+//   det A                     ok VALUE
+//   quit
+//
+// A failed request is answered with "error " and a message. A put whose
+// dimensions are not positive numbers also ends the session, since its rows
+// could not be told from requests. Files are read
+// and written with the server's paths; messages the library prints about
+// them go to stdout.
+void matrix_server_serve(MatrixRegistry *registry, FILE *in, FILE *out);
+
+// Listens on a Unix domain socket and serves every connection on a thread
+// of its own, so requests from different clients run at the same time.
+// Returns only if the socket cannot be set up, printing why.
+int matrix_server_listen(MatrixRegistry *registry, const char *socket_path);
+
+#endif // MATRIX_SERVER_H
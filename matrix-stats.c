@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "matrix-stats.h"
+
+typedef struct PhaseStats {
+    double seconds;
+    uint64_t bytes;
+    int runs;
+} PhaseStats;
+
+typedef struct KernelStats {
+    uint64_t calls;
+    uint64_t flops;
+    uint64_t bytes;
+} KernelStats;
+
+const char *STATS_PHASE_NAMES[] = { "read_a", "read_b", "compute", "write" };
+
+const char *STATS_KERNEL_NAMES[] = {
+    "add", "subtract", "scale", "axpy", "multiply", "transpose",
+    "lu_factor", "lu_solve", "determinant_laplace", "determinant_bareiss"
+};
+
+_Static_assert(sizeof(STATS_PHASE_NAMES) / sizeof(STATS_PHASE_NAMES[0]) == MATRIX_STATS_PHASE_COUNT,
+    "every phase needs a name");
+_Static_assert(sizeof(STATS_KERNEL_NAMES) / sizeof(STATS_KERNEL_NAMES[0]) == MATRIX_STATS_KERNEL_COUNT,
+    "every kernel needs a name");
+
+int stats_enabled = 0;
+double stats_start = 0;
+PhaseStats phase_stats[MATRIX_STATS_PHASE_COUNT];
+KernelStats kernel_stats[MATRIX_STATS_KERNEL_COUNT];
+uint64_t stats_allocations = 0;
+uint64_t stats_allocated_bytes = 0;
+uint64_t stats_releases = 0;
+int64_t stats_live_bytes = 0;
+int64_t stats_peak_live_bytes = 0;
+
+void matrix_stats_set_enabled(int enabled) {
+    if (enabled && !stats_enabled) stats_start = matrix_stats_now();
+
+    __atomic_store_n(&stats_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+int matrix_stats_enabled() {
+    return __atomic_load_n(&stats_enabled, __ATOMIC_RELAXED);
+}
+
+double matrix_stats_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void matrix_stats_add_phase(MatrixStatsPhase phase, double begin, uint64_t bytes) {
+    if (!matrix_stats_enabled()) return;
+
+    // Phases are timed by the main thread only.
+    phase_stats[phase].seconds += matrix_stats_now() - begin;
+    phase_stats[phase].bytes += bytes;
+    phase_stats[phase].runs++;
+}
+
+void matrix_stats_count_allocation(uint64_t bytes) {
+    if (!matrix_stats_enabled()) return;
+
+    __atomic_fetch_add(&stats_allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats_allocated_bytes, bytes, __ATOMIC_RELAXED);
+
+    int64_t live = __atomic_add_fetch(&stats_live_bytes, (int64_t) bytes, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&stats_peak_live_bytes, __ATOMIC_RELAXED);
+
+    while (live > peak && !__atomic_compare_exchange_n(&stats_peak_live_bytes, &peak, live, 1,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void matrix_stats_count_release(uint64_t bytes) {
+    if (!matrix_stats_enabled()) return;
+
+    __atomic_fetch_add(&stats_releases, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stats_live_bytes, (int64_t) bytes, __ATOMIC_RELAXED);
+}
+
+void matrix_stats_count_kernel(MatrixStatsKernel kernel, uint64_t flops, uint64_t bytes) {
+    if (!matrix_stats_enabled()) return;
+
+    __atomic_fetch_add(&kernel_stats[kernel].calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&kernel_stats[kernel].flops, flops, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&kernel_stats[kernel].bytes, bytes, __ATOMIC_RELAXED);
+}
+
+double _stats_rate(double amount, double seconds) {
+    return seconds > 0 ? amount / seconds : 0;
+}
+
+void matrix_stats_report(FILE *file, int json) {
+    double total = matrix_stats_now() - stats_start;
+    double compute = phase_stats[MATRIX_STATS_COMPUTE].seconds;
+    double flops = 0, bytes = 0;
+    struct rusage usage;
+
+    // Linux reports the peak resident set size in KiB.
+    long peak_rss_kib = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+
+    for (int k = 0; k < MATRIX_STATS_KERNEL_COUNT; k++) {
+        flops += kernel_stats[k].flops;
+        bytes += kernel_stats[k].bytes;
+    }
+
+    if (json) {
+        fprintf(file, "{\"phases\": {");
+
+        for (int p = 0; p < MATRIX_STATS_PHASE_COUNT; p++) {
+            fprintf(file, "%s\"%s\": {\"seconds\": %.9f, \"bytes\": %llu}", p > 0 ? ", " : "", STATS_PHASE_NAMES[p],
+                phase_stats[p].seconds, (unsigned long long) phase_stats[p].bytes);
+        }
+
+        fprintf(file, "}, \"total_seconds\": %.9f, \"peak_rss_bytes\": %lld, ", total, (long long) peak_rss_kib * 1024);
+        fprintf(file, "\"allocations\": {\"count\": %llu, \"bytes\": %llu, \"releases\": %llu, \"peak_live_bytes\": %lld}, ",
+            (unsigned long long) stats_allocations, (unsigned long long) stats_allocated_bytes,
+            (unsigned long long) stats_releases, (long long) stats_peak_live_bytes);
+        fprintf(file, "\"kernels\": {");
+
+        int printed = 0;
+
+        for (int k = 0; k < MATRIX_STATS_KERNEL_COUNT; k++) {
+            if (kernel_stats[k].calls == 0) continue;
+
+            fprintf(file, "%s\"%s\": {\"calls\": %llu, \"flops\": %llu, \"bytes\": %llu}", printed++ > 0 ? ", " : "",
+                STATS_KERNEL_NAMES[k], (unsigned long long) kernel_stats[k].calls,
+                (unsigned long long) kernel_stats[k].flops, (unsigned long long) kernel_stats[k].bytes);
+        }
+
+        fprintf(file, "}, \"gflops_per_s\": %.3f, \"gbytes_per_s\": %.3f}\n",
+            _stats_rate(flops, compute) / 1e9, _stats_rate(bytes, compute) / 1e9);
+        return;
+    }
+
+    fprintf(file, "\nStatistics:\n");
+
+    for (int p = 0; p < MATRIX_STATS_PHASE_COUNT; p++) {
+        if (phase_stats[p].runs == 0) continue;
+
+        fprintf(file, "  %-10s %12.6fs", STATS_PHASE_NAMES[p], phase_stats[p].seconds);
+
+        if (phase_stats[p].bytes > 0) {
+            fprintf(file, "  %10.2f MiB  %8.2f MiB/s", phase_stats[p].bytes / 1048576.0,
+                _stats_rate(phase_stats[p].bytes, phase_stats[p].seconds) / 1048576.0);
+        }
+
+        fprintf(file, "\n");
+    }
+
+    fprintf(file, "  %-10s %12.6fs\n", "total", total);
+    fprintf(file, "  peak RSS   %12.2f MiB\n", peak_rss_kib / 1024.0);
+    fprintf(file, "  allocations %11llu  (%.2f MiB, %llu released, peak live %.2f MiB)\n",
+        (unsigned long long) stats_allocations, stats_allocated_bytes / 1048576.0,
+        (unsigned long long) stats_releases, stats_peak_live_bytes / 1048576.0);
+
+    for (int k = 0; k < MATRIX_STATS_KERNEL_COUNT; k++) {
+        if (kernel_stats[k].calls == 0) continue;
+
+        fprintf(file, "  %-20s %8llu calls  %12.6f GFLOP  %12.6f GB\n", STATS_KERNEL_NAMES[k],
+            (unsigned long long) kernel_stats[k].calls, kernel_stats[k].flops / 1e9, kernel_stats[k].bytes / 1e9);
+    }
+
+    if (compute > 0 && flops + bytes > 0) {
+        fprintf(file, "  compute rate %.3f GFLOP/s, %.3f GB/s\n",
+            _stats_rate(flops, compute) / 1e9, _stats_rate(bytes, compute) / 1e9);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef MATRIX_STATS_H
+#define MATRIX_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Phases of a run, timed with the monotonic clock. Inputs after the second
+// one, such as the operands of an expression, count towards
+// MATRIX_STATS_READ_B.
+typedef enum MatrixStatsPhase {
+    MATRIX_STATS_READ_A,
+    MATRIX_STATS_READ_B,
+    MATRIX_STATS_COMPUTE,
+    MATRIX_STATS_WRITE,
+    MATRIX_STATS_PHASE_COUNT
+} MatrixStatsPhase;
+
+// Kernels whose work is counted. The counts are nominal, those of the
+// classical algorithm for the shape (2mnk FLOPs for a product, also when
+// Strassen or a fixed-size kernel computes it), and the bytes are the
+// elements read and written once each, so that runs can be compared.
+typedef enum MatrixStatsKernel {
+    MATRIX_STATS_ADD,
+    MATRIX_STATS_SUBTRACT,
+    MATRIX_STATS_SCALE,
+    MATRIX_STATS_AXPY,
+    MATRIX_STATS_MULTIPLY,
+    MATRIX_STATS_TRANSPOSE,
+    MATRIX_STATS_LU_FACTOR,
+    MATRIX_STATS_LU_SOLVE,
+    MATRIX_STATS_DETERMINANT_LAPLACE,
+    MATRIX_STATS_DETERMINANT_BAREISS,
+    MATRIX_STATS_KERNEL_COUNT
+} MatrixStatsKernel;
+
+// Counting is off until enabled; while off, every call below only reads a
+// flag. Counters are updated atomically, so kernels running on the thread
+// pool may count.
+void matrix_stats_set_enabled(int enabled);
+
+int matrix_stats_enabled();
+
+// Seconds on the monotonic clock, for timing phases.
+double matrix_stats_now();
+
+// Adds the time since begin (from matrix_stats_now) to the phase, along
+// with the bytes of the file it read or wrote, if any.
+void matrix_stats_add_phase(MatrixStatsPhase phase, double begin, uint64_t bytes);
+
+// Called by matrix_allocate, matrix_allocate_scratch and matrix_release.
+void matrix_stats_count_allocation(uint64_t bytes);
+
+void matrix_stats_count_release(uint64_t bytes);
+
+void matrix_stats_count_kernel(MatrixStatsKernel kernel, uint64_t flops, uint64_t bytes);
+
+// Writes the phases, the whole run since stats were enabled, peak RSS, the
+// allocations and the kernels' work, as aligned text or one JSON object.
+void matrix_stats_report(FILE *file, int json);
+
+#endif // MATRIX_STATS_H
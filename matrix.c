@@ -1,7 +1,27 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <sys/mman.h>
 #include "matrix.h"
+#include "gemm.h"
+#include "matrix-fixed.h"
+#include "matrix-stats.h"
+#include "simd.h"
+#include "strassen.h"
+#include "thread-pool.h"
+#include "typed-kernels.h"
+
+// Largest order whose Laplace sub-determinants are memoized: the table
+// holds 2^n doubles (256 MiB at 25).
+#define LAPLACE_MEMO_MAX_ORDER 25
+
+// Edge of the square tiles the recursive transpose stops splitting at.
+#define TRANSPOSE_LEAF 32
+
+// Minimum number of element operations a thread pool chunk should carry;
+// anything smaller runs on the calling thread.
+#define MATRIX_PARALLEL_MIN_WORK (1 << 16)
 
 MatrixNumericResult _build_numeric_result(MatrixResultCode code, double value) {
     MatrixNumericResult result;
@@ -35,34 +55,143 @@ MatrixResult _failed_matrix_result(MatrixResultCode error_code) {
     return _build_matrix_result(error_code, NULL);
 }
 
-MatrixResult new_matrix(int rows, int cols) {
+size_t matrix_element_size(MatrixElementType element_type) {
+    return typed_kernels(element_type)->size;
+}
+
+const char* MATRIX_ELEMENT_TYPE_NAMES[] = { "float64", "float32", "int32", "int64" };
+
+const char* matrix_element_type_name(MatrixElementType element_type) {
+    return MATRIX_ELEMENT_TYPE_NAMES[element_type];
+}
+
+int matrix_element_type_from_name(const char *name, MatrixElementType *element_type) {
+    for (int i = 0; i < (int) (sizeof(MATRIX_ELEMENT_TYPE_NAMES) / sizeof(MATRIX_ELEMENT_TYPE_NAMES[0])); i++) {
+        if (strcmp(name, MATRIX_ELEMENT_TYPE_NAMES[i]) == 0) {
+            *element_type = (MatrixElementType) i;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Rows start on MATRIX_ALIGNMENT boundaries whatever the element size.
+int _padded_stride(int cols, MatrixElementType element_type) {
+    int per_alignment = MATRIX_ALIGNMENT / matrix_element_size(element_type);
+
+    return (cols + per_alignment - 1) / per_alignment * per_alignment;
+}
+
+size_t _values_size(int rows, int stride, MatrixElementType element_type) {
+    return (size_t) rows * stride * matrix_element_size(element_type);
+}
+
+MatrixResult new_typed_matrix(int rows, int cols, MatrixElementType element_type) {
     if (rows <= 0 || cols <= 0) {
         return _failed_matrix_result(MATRIX_DIMENSIONS_MUST_BE_POSITIVE);
     }
 
     Matrix *m = (Matrix*) malloc(sizeof(Matrix));
 
+    if (m == NULL) return _failed_matrix_result(MATRIX_INTERNAL_ERROR);
+
     m->rows = rows;
     m->cols = cols;
-    m->values = (double**) malloc(rows * sizeof(double*));
+    m->stride = _padded_stride(cols, element_type);
+    m->capacity = _values_size(rows, m->stride, element_type);
+    m->allocator = matrix_current_allocator();
+    m->data = matrix_allocate(m->allocator, m->capacity);
+    m->mapping = NULL;
+    m->mapping_size = 0;
+    m->element_type = element_type;
+
+    if (m->values == NULL) {
+        free(m);
+        return _failed_matrix_result(MATRIX_INTERNAL_ERROR);
+    }
 
-    for (int i = 0; i < rows; i++) {
-        m->values[i] = (double*) malloc(cols * sizeof(double));
+    return _succeeded_matrix_result(m);
+}
 
-        for (int j = 0; j < cols; j++) {
-            m->values[i][j] = 0;
-        }
+MatrixResult new_matrix(int rows, int cols) {
+    return new_typed_matrix(rows, cols, MATRIX_FLOAT64);
+}
+
+MatrixResult new_mapped_matrix(
+    int rows, int cols, int stride, MatrixElementType element_type,
+    void *values, void *mapping, size_t mapping_size
+) {
+    if (rows <= 0 || cols <= 0 || stride < cols) {
+        return _failed_matrix_result(MATRIX_DIMENSIONS_MUST_BE_POSITIVE);
+    }
+
+    if (values == NULL || mapping == NULL) {
+        return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
     }
 
+    Matrix *m = (Matrix*) malloc(sizeof(Matrix));
+
+    if (m == NULL) return _failed_matrix_result(MATRIX_INTERNAL_ERROR);
+
+    m->rows = rows;
+    m->cols = cols;
+    m->stride = stride;
+    m->data = values;
+    m->capacity = _values_size(rows, stride, element_type);
+    m->allocator = NULL;
+    m->mapping = mapping;
+    m->mapping_size = mapping_size;
+    m->element_type = element_type;
+
     return _succeeded_matrix_result(m);
 }
 
+int _overlaps(Matrix *a, Matrix *b) {
+    char *a_begin = a->data, *a_end = a_begin + _values_size(a->rows, a->stride, a->element_type);
+    char *b_begin = b->data, *b_end = b_begin + _values_size(b->rows, b->stride, b->element_type);
+
+    return a_begin < b_end && b_begin < a_end;
+}
+
+// Returns the outcome of an *_into call made on a freshly allocated result,
+// releasing the result if the call failed.
+MatrixResult _keep_or_delete(Matrix *result, MatrixResult outcome) {
+    if (!outcome.success) delete_matrix(result);
+    return outcome;
+}
+
+double* _row(Matrix *m, int row) {
+    return m->values + (size_t) row * m->stride;
+}
+
+// Row of a matrix of any element type.
+void* _typed_row(Matrix *m, int row) {
+    return (char*) m->data + (size_t) row * m->stride * matrix_element_size(m->element_type);
+}
+
 double _get(Matrix *m, int row, int col) {
-    return m->values[row][col];
+    return _row(m, row)[col];
 }
 
 void _set(Matrix *m, int row, int col, double value) {
-    m->values[row][col] = value;
+    _row(m, row)[col] = value;
+}
+
+// The unrolled kernels for m's size if it is a square float64 matrix of one
+// of the fixed sizes, NULL otherwise.
+const MatrixFixedKernels* _fixed_kernels_of(Matrix *m) {
+    if (m->element_type != MATRIX_FLOAT64 || m->rows != m->cols) return NULL;
+    return matrix_fixed_kernels(m->rows);
+}
+
+// Copies m into, or out of, a packed n x n array laid out as a MatrixN.
+void _pack_fixed(Matrix *m, double *packed) {
+    for (int i = 0; i < m->rows; i++) memcpy(packed + i * m->cols, _row(m, i), m->cols * sizeof(double));
+}
+
+void _unpack_fixed(Matrix *m, const double *packed) {
+    for (int i = 0; i < m->rows; i++) memcpy(_row(m, i), packed + i * m->cols, m->cols * sizeof(double));
 }
 
 MatrixResult new_matrix_with_values(int rows, int cols, double values[rows][cols]) {
@@ -95,22 +224,241 @@ MatrixResult new_identity_matrix(int n) {
     return result;
 }
 
-MatrixResult matrix_transpose(Matrix *m) {
+typedef struct TransposeContext {
+    Matrix *m;
+    Matrix *t;
+    const MatrixKernels *kernels;
+} TransposeContext;
+
+// Transposes a tile of at most TRANSPOSE_LEAF x TRANSPOSE_LEAF elements with
+// the in-register kernel, finishing ragged edges element by element.
+void _transpose_leaf(TransposeContext *c, int row0, int rows, int col0, int cols) {
+    Matrix *m = c->m, *t = c->t;
+
+    if (m->element_type != MATRIX_FLOAT64) {
+        size_t size = matrix_element_size(m->element_type);
+
+        typed_kernels(m->element_type)->transpose(
+            (char*) _typed_row(m, row0) + col0 * size, m->stride,
+            (char*) _typed_row(t, col0) + row0 * size, t->stride,
+            rows, cols
+        );
+        return;
+    }
+
+    int block = c->kernels->transpose_block;
+    int full_rows = rows - rows % block;
+    int full_cols = cols - cols % block;
+
+    for (int i = row0; i < row0 + full_rows; i += block) {
+        for (int j = col0; j < col0 + full_cols; j += block) {
+            c->kernels->transpose(_row(m, i) + j, m->stride, _row(t, j) + i, t->stride);
+        }
+    }
+
+    for (int i = row0; i < row0 + rows; i++) {
+        for (int j = i < row0 + full_rows ? col0 + full_cols : col0; j < col0 + cols; j++) {
+            _set(t, j, i, _get(m, i, j));
+        }
+    }
+}
+
+// Cache-oblivious: halves the longer side until the tile fits a leaf, so
+// at some level of the recursion both the source and destination tiles sit
+// in cache, whatever its size.
+void _transpose_recursive(TransposeContext *c, int row0, int rows, int col0, int cols) {
+    if (rows <= TRANSPOSE_LEAF && cols <= TRANSPOSE_LEAF) {
+        _transpose_leaf(c, row0, rows, col0, cols);
+    } else if (rows >= cols) {
+        int half = rows / 2 / TRANSPOSE_LEAF * TRANSPOSE_LEAF;
+        if (half == 0) half = rows / 2;
+        _transpose_recursive(c, row0, half, col0, cols);
+        _transpose_recursive(c, row0 + half, rows - half, col0, cols);
+    } else {
+        int half = cols / 2 / TRANSPOSE_LEAF * TRANSPOSE_LEAF;
+        if (half == 0) half = cols / 2;
+        _transpose_recursive(c, row0, rows, col0, half);
+        _transpose_recursive(c, row0, rows, col0 + half, cols - half);
+    }
+}
+
+void _transpose_row_strips(int begin, int end, void *context) {
+    TransposeContext *c = context;
+    int row0 = begin * TRANSPOSE_LEAF;
+    int row1 = end * TRANSPOSE_LEAF < c->m->rows ? end * TRANSPOSE_LEAF : c->m->rows;
+
+    _transpose_recursive(c, row0, row1 - row0, 0, c->m->cols);
+}
+
+MatrixResult matrix_transpose_into(Matrix *dst, Matrix *m) {
+    if (dst == NULL || m == NULL) return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+    if (dst->rows != m->cols || dst->cols != m->rows) {
+        return _failed_matrix_result(MATRIX_INVALID_DESTINATION_DIMENSIONS);
+    }
+    if (dst->element_type != m->element_type) return _failed_matrix_result(MATRIX_ELEMENT_TYPES_MUST_MATCH);
+    if (_overlaps(dst, m)) return _failed_matrix_result(MATRIX_DESTINATION_OVERLAPS_ARGUMENTS);
+
+    matrix_stats_count_kernel(MATRIX_STATS_TRANSPOSE, 0, 2 * (uint64_t) m->rows * m->cols * matrix_element_size(m->element_type));
+
+    const MatrixFixedKernels *fixed = _fixed_kernels_of(m);
+
+    if (fixed != NULL) {
+        double packed[MATRIX_FIXED_MAX * MATRIX_FIXED_MAX], transposed[MATRIX_FIXED_MAX * MATRIX_FIXED_MAX];
+        _pack_fixed(m, packed);
+        fixed->transpose(transposed, packed);
+        _unpack_fixed(dst, transposed);
+        return _succeeded_matrix_result(dst);
+    }
+
+    TransposeContext context = { m, dst, simd_kernels() };
+    int strips = (m->rows + TRANSPOSE_LEAF - 1) / TRANSPOSE_LEAF;
+
+    thread_pool_parallel_for(
+        0, strips,
+        thread_pool_grain((long) TRANSPOSE_LEAF * m->cols, MATRIX_PARALLEL_MIN_WORK),
+        _transpose_row_strips, &context
+    );
+
+    return _succeeded_matrix_result(dst);
+}
+
+// Swaps the transposes of tiles (i, j) and (j, i) of a square matrix, or
+// transposes a diagonal tile, going through a small buffer per tile.
+void _transpose_square_tile_rows(int begin, int end, void *context) {
+    Matrix *m = ((TransposeContext*) context)->m;
+    const MatrixKernels *kernels = ((TransposeContext*) context)->kernels;
+    double upper[TRANSPOSE_LEAF * TRANSPOSE_LEAF], lower[TRANSPOSE_LEAF * TRANSPOSE_LEAF];
+    int n = m->rows;
+
+    for (int tile_row = begin; tile_row < end; tile_row++) {
+        int i0 = tile_row * TRANSPOSE_LEAF;
+        int rows = n - i0 < TRANSPOSE_LEAF ? n - i0 : TRANSPOSE_LEAF;
+
+        for (int j0 = i0; j0 < n; j0 += TRANSPOSE_LEAF) {
+            int cols = n - j0 < TRANSPOSE_LEAF ? n - j0 : TRANSPOSE_LEAF;
+            Matrix upper_tile = { .rows = cols, .cols = rows, .stride = TRANSPOSE_LEAF, .values = upper };
+            Matrix lower_tile = { .rows = rows, .cols = cols, .stride = TRANSPOSE_LEAF, .values = lower };
+            Matrix upper_view = *m, lower_view = *m;
+
+            upper_view.values = _row(m, i0) + j0;
+            lower_view.values = _row(m, j0) + i0;
+
+            TransposeContext to_upper = { &upper_view, &upper_tile, kernels };
+            _transpose_leaf(&to_upper, 0, rows, 0, cols);
+
+            if (j0 != i0) {
+                TransposeContext to_lower = { &lower_view, &lower_tile, kernels };
+                _transpose_leaf(&to_lower, 0, cols, 0, rows);
+
+                for (int r = 0; r < rows; r++) {
+                    memcpy(_row(&upper_view, r), _row(&lower_tile, r), cols * sizeof(double));
+                }
+            }
+
+            for (int r = 0; r < cols; r++) {
+                memcpy(_row(&lower_view, r), _row(&upper_tile, r), rows * sizeof(double));
+            }
+        }
+    }
+}
+
+// Moves element i * cols + j of a dense rows x cols array to j * rows + i.
+// That permutation sends index k to k * rows mod (n - 1), so each cycle is
+// followed with one element in hand, and a bitmap marks finished indices.
+int _transpose_cycles(double *values, size_t rows, size_t cols) {
+    size_t n = rows * cols;
+    MatrixAllocator *allocator = matrix_current_allocator();
+    unsigned char *visited = matrix_allocate(allocator, (n + 7) / 8);
+
+    if (visited == NULL) return 0;
+
+    for (size_t start = 1; start + 1 < n; start++) {
+        if (visited[start / 8] & (1 << (start % 8))) continue;
+
+        size_t current = start;
+        double carried = values[start];
+
+        do {
+            size_t next = (size_t) ((unsigned __int128) current * rows % (n - 1));
+            double displaced = values[next];
+
+            values[next] = carried;
+            carried = displaced;
+            visited[next / 8] |= 1 << (next % 8);
+            current = next;
+        } while (current != start);
+    }
+
+    matrix_release(allocator, visited, (n + 7) / 8);
+
+    return 1;
+}
+
+MatrixResult matrix_transpose_in_place(Matrix *m) {
     if (m == NULL) return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+    if (m->element_type != MATRIX_FLOAT64) return _failed_matrix_result(MATRIX_UNSUPPORTED_ELEMENT_TYPE);
 
-    Matrix *result = new_matrix(m->cols, m->rows).value;
+    matrix_stats_count_kernel(MATRIX_STATS_TRANSPOSE, 0, 2 * (uint64_t) m->rows * m->cols * sizeof(double));
 
-    for (int i = 0; i < m->rows; i++) {
-        for (int j = 0; j < m->cols; j++) {
-            _set(result, j, i, _get(m, i, j));
+    if (m->rows == m->cols) {
+        TransposeContext context = { m, m, simd_kernels() };
+        int tile_rows = (m->rows + TRANSPOSE_LEAF - 1) / TRANSPOSE_LEAF;
+
+        thread_pool_parallel_for(
+            0, tile_rows,
+            thread_pool_grain((long) TRANSPOSE_LEAF * m->cols, MATRIX_PARALLEL_MIN_WORK),
+            _transpose_square_tile_rows, &context
+        );
+
+        return _succeeded_matrix_result(m);
+    }
+
+    // Squeeze out the row padding, permute the dense array, then spread the
+    // rows back out with the padding the new shape wants, if it fits.
+    for (int i = 1; i < m->rows; i++) {
+        memmove(m->values + (size_t) i * m->cols, _row(m, i), m->cols * sizeof(double));
+    }
+
+    if (!_transpose_cycles(m->values, m->rows, m->cols)) {
+        for (int i = m->rows - 1; i > 0; i--) {
+            memmove(_row(m, i), m->values + (size_t) i * m->cols, m->cols * sizeof(double));
         }
+        return _failed_matrix_result(MATRIX_INTERNAL_ERROR);
     }
 
-    return _succeeded_matrix_result(result);
+    int rows = m->cols, cols = m->rows;
+    int stride = _padded_stride(cols, MATRIX_FLOAT64);
+
+    if (_values_size(rows, stride, MATRIX_FLOAT64) > m->capacity) stride = cols;
+
+    m->rows = rows;
+    m->cols = cols;
+    m->stride = stride;
+
+    for (int i = rows - 1; i >= 0; i--) {
+        memmove(_row(m, i), m->values + (size_t) i * cols, cols * sizeof(double));
+        memset(_row(m, i) + cols, 0, (stride - cols) * sizeof(double));
+    }
+
+    return _succeeded_matrix_result(m);
+}
+
+MatrixResult matrix_transpose(Matrix *m) {
+    if (m == NULL) return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+
+    MatrixResult result = new_typed_matrix(m->cols, m->rows, m->element_type);
+
+    if (!result.success) return result;
+
+    return _keep_or_delete(result.value, matrix_transpose_into(result.value, m));
 }
 
 MatrixNumericResult matrix_get(Matrix *m, int row, int col) {
     if (row > 0 && row <= m->rows && col > 0 && col <= m->cols) {
+        if (m->element_type != MATRIX_FLOAT64) {
+            return _succeeded_numeric_result(typed_kernels(m->element_type)->get(_typed_row(m, row - 1), col - 1));
+        }
+
         return _succeeded_numeric_result(_get(m, row - 1, col - 1));
     } 
 
@@ -119,6 +467,13 @@ MatrixNumericResult matrix_get(Matrix *m, int row, int col) {
 
 MatrixNumericResult matrix_set(Matrix *m, int row, int col, double value) {
     if (row > 0 && row <= m->rows && col > 0 && col <= m->cols) {
+        if (m->element_type != MATRIX_FLOAT64) {
+            const TypedKernels *kernels = typed_kernels(m->element_type);
+
+            kernels->set(_typed_row(m, row - 1), col - 1, value);
+            return _succeeded_numeric_result(kernels->get(_typed_row(m, row - 1), col - 1));
+        }
+
         _set(m, row - 1, col - 1, value);
         return _succeeded_numeric_result(value);
     } 
@@ -130,18 +485,189 @@ int matrix_equals(Matrix *a, Matrix *b) {
     if (a == NULL && b == NULL) return 1;
     if (a == NULL || b == NULL) return 0;
     if (a->rows != b->rows || a->cols != b->cols) return 0;
+    if (a->element_type != b->element_type) return 0;
+
+    if (a->element_type != MATRIX_FLOAT64) {
+        const TypedKernels *typed = typed_kernels(a->element_type);
+
+        for (int i = 0; i < a->rows; i++) {
+            if (!typed->equals(_typed_row(a, i), _typed_row(b, i), a->cols)) return 0;
+        }
+
+        return 1;
+    }
+
+    const MatrixKernels *kernels = simd_kernels();
 
     for (int i = 0; i < a->rows; i++) {
-        for (int j = 0; j < a->cols; j++) {
-            if (_get(a, i, j) != _get(b, i, j)) {
-                return 0;
-            }
+        if (!kernels->equals(_row(a, i), _row(b, i), a->cols)) {
+            return 0;
         }
     }
 
     return 1;
 }
 
+typedef enum ElementWiseOperation {
+    ELEMENT_WISE_ADD,
+    ELEMENT_WISE_SUBTRACT,
+    ELEMENT_WISE_SCALE,
+    ELEMENT_WISE_AXPY
+} ElementWiseOperation;
+
+typedef struct ElementWiseContext {
+    ElementWiseOperation operation;
+    const MatrixKernels *kernels;
+    Matrix *dst;
+    Matrix *a;
+    Matrix *b;
+    double scalar;
+} ElementWiseContext;
+
+void _element_wise_span(ElementWiseContext *c, double *dst, double *a, double *b, int n) {
+    switch (c->operation) {
+        case ELEMENT_WISE_ADD:
+            c->kernels->add(dst, a, b, n);
+            break;
+        case ELEMENT_WISE_SUBTRACT:
+            c->kernels->subtract(dst, a, b, n);
+            break;
+        case ELEMENT_WISE_SCALE:
+            c->kernels->scale(dst, a, c->scalar, n);
+            break;
+        case ELEMENT_WISE_AXPY:
+            c->kernels->axpy(dst, c->scalar, b, n);
+            break;
+    }
+}
+
+// Sum and subtract of matrices other than float64, which have no scalar
+// operations.
+void _typed_element_wise_span(ElementWiseContext *c, void *dst, void *a, void *b, int n) {
+    const TypedKernels *typed = typed_kernels(c->dst->element_type);
+
+    if (c->operation == ELEMENT_WISE_ADD) {
+        typed->add(dst, a, b, n);
+    } else {
+        typed->subtract(dst, a, b, n);
+    }
+}
+
+// Applies the operation row by row, or over whole runs of rows at once when
+// the operands share a stride (the padding is zero-filled, so it stays so).
+void _element_wise_rows(int begin, int end, void *context) {
+    ElementWiseContext *c = context;
+    Matrix *dst = c->dst, *a = c->a, *b = c->b;
+
+    if (dst->element_type != MATRIX_FLOAT64) {
+        if (dst->stride == a->stride && dst->stride == b->stride && (size_t) (end - begin) * a->stride <= 0x7fffffff) {
+            _typed_element_wise_span(c, _typed_row(dst, begin), _typed_row(a, begin), _typed_row(b, begin), (end - begin) * a->stride);
+            return;
+        }
+
+        for (int i = begin; i < end; i++) {
+            _typed_element_wise_span(c, _typed_row(dst, i), _typed_row(a, i), _typed_row(b, i), a->cols);
+        }
+        return;
+    }
+
+    if (dst->stride == a->stride && (b == NULL || dst->stride == b->stride) &&
+        (size_t) (end - begin) * a->stride <= 0x7fffffff) {
+        _element_wise_span(c, _row(dst, begin), _row(a, begin), b == NULL ? NULL : _row(b, begin), (end - begin) * a->stride);
+        return;
+    }
+
+    for (int i = begin; i < end; i++) {
+        _element_wise_span(c, _row(dst, i), _row(a, i), b == NULL ? NULL : _row(b, i), a->cols);
+    }
+}
+
+// Stats kernel, FLOPs per element and operands read per element of each
+// operation.
+const struct {
+    MatrixStatsKernel kernel;
+    int flops;
+    int reads;
+} ELEMENT_WISE_STATS[] = {
+    { MATRIX_STATS_ADD, 1, 2 },
+    { MATRIX_STATS_SUBTRACT, 1, 2 },
+    { MATRIX_STATS_SCALE, 1, 1 },
+    { MATRIX_STATS_AXPY, 2, 2 }
+};
+
+void _apply_element_wise(ElementWiseOperation operation, Matrix *dst, Matrix *a, Matrix *b, double scalar) {
+    ElementWiseContext context = { operation, simd_kernels(), dst, a, b, scalar };
+    uint64_t elements = (uint64_t) a->rows * a->cols;
+
+    matrix_stats_count_kernel(ELEMENT_WISE_STATS[operation].kernel, elements * ELEMENT_WISE_STATS[operation].flops,
+        elements * (ELEMENT_WISE_STATS[operation].reads + 1) * matrix_element_size(a->element_type));
+
+    thread_pool_parallel_for(
+        0, a->rows,
+        thread_pool_grain(a->cols, MATRIX_PARALLEL_MIN_WORK),
+        _element_wise_rows, &context
+    );
+}
+
+MatrixResultCode _validate_element_wise(Matrix *dst, Matrix *a, Matrix *b, MatrixResultCode mismatch) {
+    if (dst == NULL || a == NULL || b == NULL) return MATRIX_ARGUMENTS_MUST_NOT_BE_NULL;
+    if (a->rows != b->rows || a->cols != b->cols) return mismatch;
+    if (dst->rows != a->rows || dst->cols != a->cols) return MATRIX_INVALID_DESTINATION_DIMENSIONS;
+    if (a->element_type != b->element_type || dst->element_type != a->element_type) {
+        return MATRIX_ELEMENT_TYPES_MUST_MATCH;
+    }
+
+    return MATRIX_SUCCESS_CODE;
+}
+
+MatrixResult matrix_sum_into(Matrix *dst, Matrix *a, Matrix *b) {
+    MatrixResultCode code = _validate_element_wise(dst, a, b, MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM);
+
+    if (code != MATRIX_SUCCESS_CODE) return _failed_matrix_result(code);
+
+    _apply_element_wise(ELEMENT_WISE_ADD, dst, a, b, 0);
+
+    return _succeeded_matrix_result(dst);
+}
+
+MatrixResult matrix_subtract_into(Matrix *dst, Matrix *a, Matrix *b) {
+    MatrixResultCode code = _validate_element_wise(dst, a, b, MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT);
+
+    if (code != MATRIX_SUCCESS_CODE) return _failed_matrix_result(code);
+
+    _apply_element_wise(ELEMENT_WISE_SUBTRACT, dst, a, b, 0);
+
+    return _succeeded_matrix_result(dst);
+}
+
+MatrixResult matrix_add_in_place(Matrix *a, Matrix *b) {
+    return matrix_sum_into(a, a, b);
+}
+
+MatrixResult matrix_subtract_in_place(Matrix *a, Matrix *b) {
+    return matrix_subtract_into(a, a, b);
+}
+
+MatrixResult matrix_scale(Matrix *m, double factor) {
+    if (m == NULL) return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+    if (m->element_type != MATRIX_FLOAT64) return _failed_matrix_result(MATRIX_UNSUPPORTED_ELEMENT_TYPE);
+
+    _apply_element_wise(ELEMENT_WISE_SCALE, m, m, NULL, factor);
+
+    return _succeeded_matrix_result(m);
+}
+
+MatrixResult matrix_axpy(Matrix *y, double alpha, Matrix *x) {
+    MatrixResultCode code = _validate_element_wise(y, y, x, MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM);
+
+    if (code != MATRIX_SUCCESS_CODE) return _failed_matrix_result(code);
+    if (y->element_type != MATRIX_FLOAT64) return _failed_matrix_result(MATRIX_UNSUPPORTED_ELEMENT_TYPE);
+
+    _apply_element_wise(ELEMENT_WISE_AXPY, y, y, x, alpha);
+
+    return _succeeded_matrix_result(y);
+}
+
 MatrixResult matrix_sum(Matrix *a, Matrix *b) {
     if (a == NULL || b == NULL) {
         return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
@@ -151,15 +677,11 @@ MatrixResult matrix_sum(Matrix *a, Matrix *b) {
         return _failed_matrix_result(MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM);
     }
 
-    Matrix *result = new_matrix(a->rows, a->cols).value;
+    MatrixResult result = new_typed_matrix(a->rows, a->cols, a->element_type);
 
-    for (int i = 0; i < a->rows; i++) {
-        for (int j = 0; j < a->cols; j++) {
-            _set(result, i, j, _get(a, i, j) + _get(b, i, j));
-        }
-    }
+    if (!result.success) return result;
 
-    return _succeeded_matrix_result(result);
+    return _keep_or_delete(result.value, matrix_sum_into(result.value, a, b));
 }
 
 MatrixResult matrix_subtract(Matrix *a, Matrix *b) {
@@ -171,41 +693,107 @@ MatrixResult matrix_subtract(Matrix *a, Matrix *b) {
         return _failed_matrix_result(MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT);
     }
 
-    Matrix *result = new_matrix(a->rows, a->cols).value;
+    MatrixResult result = new_typed_matrix(a->rows, a->cols, a->element_type);
 
-    for (int i = 0; i < a->rows; i++) {
-        for (int j = 0; j < a->cols; j++) {
-            _set(result, i, j, _get(a, i, j) - _get(b, i, j));
-        }
-    }
+    if (!result.success) return result;
 
-    return _succeeded_matrix_result(result);
+    return _keep_or_delete(result.value, matrix_subtract_into(result.value, a, b));
 }
 
-float _multiply_row_by_col(Matrix *a, int a_row, Matrix *b, int b_col) {
-    int size = a->cols;
-    double result = 0;
+MatrixMultiplyMode multiply_mode = MATRIX_MULTIPLY_CLASSICAL;
 
-    for (int i = 0; i < size; i++) {
-        result += _get(a, a_row, i) * _get(b, i, b_col);
+void matrix_set_multiply_mode(MatrixMultiplyMode mode) {
+    multiply_mode = mode;
+}
+
+MatrixMultiplyMode matrix_multiply_mode() {
+    return multiply_mode;
+}
+
+typedef struct TypedMultiplyContext {
+    const TypedKernels *kernels;
+    Matrix *dst;
+    Matrix *a;
+    Matrix *b;
+} TypedMultiplyContext;
+
+void _typed_multiply_rows(int begin, int end, void *context) {
+    TypedMultiplyContext *c = context;
+
+    c->kernels->multiply_rows(
+        begin, end, c->dst->cols, c->a->cols,
+        c->a->data, c->a->stride, c->b->data, c->b->stride, c->dst->data, c->dst->stride
+    );
+}
+
+MatrixResult matrix_multiply_into(Matrix *dst, Matrix *a, Matrix *b) {
+    if (dst == NULL || a == NULL || b == NULL) return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+    if (a->cols != b->rows) return _failed_matrix_result(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY);
+    if (dst->rows != a->rows || dst->cols != b->cols) {
+        return _failed_matrix_result(MATRIX_INVALID_DESTINATION_DIMENSIONS);
+    }
+    if (a->element_type != b->element_type || dst->element_type != a->element_type) {
+        return _failed_matrix_result(MATRIX_ELEMENT_TYPES_MUST_MATCH);
+    }
+    if (_overlaps(dst, a) || _overlaps(dst, b)) {
+        return _failed_matrix_result(MATRIX_DESTINATION_OVERLAPS_ARGUMENTS);
     }
 
-    return result;
+    matrix_stats_count_kernel(MATRIX_STATS_MULTIPLY, 2 * (uint64_t) a->rows * b->cols * a->cols,
+        ((uint64_t) a->rows * a->cols + (uint64_t) b->rows * b->cols + (uint64_t) dst->rows * dst->cols) *
+        matrix_element_size(a->element_type));
+
+    if (a->element_type != MATRIX_FLOAT64) {
+        TypedMultiplyContext context = { typed_kernels(a->element_type), dst, a, b };
+
+        thread_pool_parallel_for(
+            0, dst->rows,
+            thread_pool_grain((long) a->cols * b->cols, MATRIX_PARALLEL_MIN_WORK),
+            _typed_multiply_rows, &context
+        );
+
+        return _succeeded_matrix_result(dst);
+    }
+
+    const MatrixFixedKernels *fixed = _fixed_kernels_of(a);
+
+    if (fixed != NULL && b->cols == a->cols) {
+        double x[MATRIX_FIXED_MAX * MATRIX_FIXED_MAX], y[MATRIX_FIXED_MAX * MATRIX_FIXED_MAX];
+        _pack_fixed(a, x);
+        _pack_fixed(b, y);
+        fixed->multiply(x, x, y);
+        _unpack_fixed(dst, x);
+        return _succeeded_matrix_result(dst);
+    }
+
+    if (multiply_mode == MATRIX_MULTIPLY_STRASSEN && strassen_levels(a->rows, b->cols, a->cols) > 0) {
+        if (!strassen_gemm(a->rows, b->cols, a->cols, a->values, a->stride, b->values, b->stride, dst->values, dst->stride)) {
+            return _failed_matrix_result(MATRIX_INTERNAL_ERROR);
+        }
+
+        return _succeeded_matrix_result(dst);
+    }
+
+    for (int i = 0; i < dst->rows; i++) {
+        memset(_row(dst, i), 0, dst->cols * sizeof(double));
+    }
+
+    if (!gemm(a->rows, b->cols, a->cols, 1, a->values, a->stride, b->values, b->stride, dst->values, dst->stride)) {
+        return _failed_matrix_result(MATRIX_INTERNAL_ERROR);
+    }
+
+    return _succeeded_matrix_result(dst);
 }
 
 MatrixResult matrix_multiply(Matrix *a, Matrix *b) {
     if (a == NULL || b == NULL) return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
     if (a->cols != b->rows) return _failed_matrix_result(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY);
 
-    Matrix *result = new_matrix(a->rows, b->cols).value;
+    MatrixResult result = new_typed_matrix(a->rows, b->cols, a->element_type);
 
-    for (int i = 0; i < a->rows; i++) {
-        for (int j = 0; j < b->cols; j++) {
-            _set(result, i, j, _multiply_row_by_col(a, i, b, j));
-        }
-    }
+    if (!result.success) return result;
 
-    return _succeeded_matrix_result(result);
+    return _keep_or_delete(result.value, matrix_multiply_into(result.value, a, b));
 }
 
 MatrixNumericResult _determinant_2x2(Matrix *m) {
@@ -229,36 +817,81 @@ MatrixNumericResult _determinant_3x3(Matrix *m) {
     );
 }
 
-Matrix* _new_complementary_matrix(Matrix *m, int row_to_remove, int col_to_remove) {
-    Matrix *result = new_matrix(m->rows - 1, m->cols - 1).value;
+// Cofactor expansion along the first remaining row, over the columns still
+// in use, without copying minors. Only used past LAPLACE_MEMO_MAX_ORDER,
+// where the memo table would not fit in memory.
+double _laplace_expand(Matrix *m, int row, int *cols, int count) {
+    if (count == 1) return _get(m, row, cols[0]);
 
-    int row_to_skip = 0;
-    int col_to_skip = 0;
+    int remaining[count - 1];
+    double result = 0;
 
-    for (int i = 0; i < m->rows; i++) {
-        for (int j = 0; j < m->cols; j++) {
-            if (i == row_to_remove) {
-                row_to_skip = 1;
-            }
+    for (int i = 0; i < count; i++) {
+        double current_value = _get(m, row, cols[i]);
 
-            if (j == col_to_remove) {
-                col_to_skip = 1;
+        if (current_value != 0) {
+            for (int j = 0, r = 0; j < count; j++) {
+                if (j != i) remaining[r++] = cols[j];
             }
 
-            if (i != row_to_remove && j != col_to_remove) {
-                _set(result, i - row_to_skip, j - col_to_skip, _get(m, i, j));
-            }
+            result += (i % 2 == 0 ? 1 : -1) * current_value * _laplace_expand(m, row + 1, remaining, count - 1);
         }
-        col_to_skip = 0;
     }
 
     return result;
 }
 
+typedef struct LaplaceContext {
+    Matrix *m;
+    double *minors;
+    int size;
+} LaplaceContext;
+
+// minors[S] is the determinant of the last |S| rows restricted to the
+// columns in bitmask S. A level computes every S of one size from the
+// level below by expanding along the first of those rows.
+void _laplace_level(int begin, int end, void *context) {
+    LaplaceContext *c = context;
+    double *row = _row(c->m, c->m->rows - c->size);
+
+    for (int mask = begin; mask < end; mask++) {
+        if (__builtin_popcount(mask) != c->size) continue;
+
+        double result = 0;
+        int position = 0;
+
+        for (int remaining = mask; remaining != 0; remaining &= remaining - 1, position++) {
+            int col = __builtin_ctz(remaining);
+            double current_value = row[col];
+
+            if (current_value != 0) {
+                result += (position % 2 == 0 ? 1 : -1) * current_value * c->minors[mask & ~(1 << col)];
+            }
+        }
+
+        c->minors[mask] = result;
+    }
+}
+
+// Runs a float64 determinant on a float64 copy of m.
+MatrixNumericResult _determinant_of_float64_copy(Matrix *m, MatrixNumericResult (*determinant)(Matrix*)) {
+    MatrixResult copy = matrix_convert(m, MATRIX_FLOAT64);
+
+    if (!copy.success) return _failed_numeric_result(copy.code);
+
+    MatrixNumericResult det = determinant(copy.value);
+    delete_matrix(copy.value);
+
+    return det;
+}
 
 MatrixNumericResult matrix_determinant_laplace(Matrix *m) {
     if (m == NULL) return _failed_numeric_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
 
+    if (m->element_type != MATRIX_FLOAT64) {
+        return _determinant_of_float64_copy(m, matrix_determinant_laplace);
+    }
+
     if (m->rows != m->cols) {
         return _failed_numeric_result(MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT);
     }
@@ -275,57 +908,157 @@ MatrixNumericResult matrix_determinant_laplace(Matrix *m) {
         return _determinant_3x3(m);
     }
 
-    double result = 0;
+    int n = m->rows;
+    MatrixAllocator *allocator = matrix_current_allocator();
+    double *minors = n <= LAPLACE_MEMO_MAX_ORDER ? matrix_allocate_scratch(allocator, sizeof(double) << n) : NULL;
 
-    for (int i = 0; i < m->rows; i++) {
-        double current_value = _get(m, i, 0);
+    if (minors == NULL) {
+        int cols[n];
 
-        if (current_value != 0) {
-            Matrix *complement = _new_complementary_matrix(m, i, 0);
-            MatrixNumericResult complement_det = matrix_determinant_laplace(complement);
+        for (int j = 0; j < n; j++) cols[j] = j;
 
-            if (!complement_det.success) {
-                return _failed_numeric_result(MATRIX_INTERNAL_ERROR);
-            }
+        return _succeeded_numeric_result(_laplace_expand(m, 0, cols, n));
+    }
 
-            result += (i % 2 == 0 ? 1 : -1) * current_value * complement_det.value;
-            delete_matrix(complement);
-        } 
+    // Every subset of columns costs a multiply and an add per column in it.
+    matrix_stats_count_kernel(MATRIX_STATS_DETERMINANT_LAPLACE, (uint64_t) n << n, (sizeof(double) << n) * 2);
+
+    LaplaceContext context = { m, minors, 0 };
+    minors[0] = 1;
+
+    for (int size = 1; size <= n; size++) {
+        context.size = size;
+        thread_pool_parallel_for(
+            1, 1 << n,
+            thread_pool_grain(n, MATRIX_PARALLEL_MIN_WORK),
+            _laplace_level, &context
+        );
     }
 
-    return _succeeded_numeric_result(result);
+    double det = minors[(1 << n) - 1];
+    matrix_release(allocator, minors, sizeof(double) << n);
+
+    return _succeeded_numeric_result(det);
 }
 
 Matrix* matrix_copy(Matrix *m) {
     if (m == NULL) return NULL;
 
-    Matrix *copy = new_matrix(m->rows, m->cols).value;
+    Matrix *copy = new_typed_matrix(m->rows, m->cols, m->element_type).value;
+
+    if (copy == NULL) return NULL;
 
     for (int i = 0; i < m->rows; i++) {
-        for (int j = 0; j < m-> cols; j++) {
-            _set(copy, i, j, _get(m, i, j));
-        }
+        memcpy(_typed_row(copy, i), _typed_row(m, i), m->cols * matrix_element_size(m->element_type));
     }
 
     return copy;
 }
 
-MatrixNumericResult matrix_determinant_lu_decomposition(Matrix *m) {
-    if (m == NULL) return _failed_numeric_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+// Stores value, a float64 or an int64 element, into an integer element of
+// the target, failing if it is not finite or out of range.
+int _convert_to_integer(const TypedKernels *from, const void *src, const TypedKernels *to, void *dst, int col) {
+    if (from->is_integer) return to->set_integer(dst, col, from->get_integer(src, col));
 
-    if (m->rows != m->cols) {
-        return _failed_numeric_result(MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT);
+    double value = nearbyint(from->get(src, col));
+
+    if (!(value >= -0x1p63 && value < 0x1p63)) return 0;
+
+    return to->set_integer(dst, col, (int64_t) value);
+}
+
+MatrixResult matrix_convert(Matrix *m, MatrixElementType element_type) {
+    if (m == NULL) return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+
+    if (m->element_type == element_type) {
+        Matrix *copy = matrix_copy(m);
+
+        return copy == NULL ? _failed_matrix_result(MATRIX_INTERNAL_ERROR) : _succeeded_matrix_result(copy);
     }
 
-    if (m->rows == 1) {
-        return _succeeded_numeric_result(_get(m, 0, 0));
+    MatrixResult result = new_typed_matrix(m->rows, m->cols, element_type);
+
+    if (!result.success) return result;
+
+    const TypedKernels *from = typed_kernels(m->element_type), *to = typed_kernels(element_type);
+
+    for (int i = 0; i < m->rows; i++) {
+        void *src = _typed_row(m, i), *dst = _typed_row(result.value, i);
+
+        for (int j = 0; j < m->cols; j++) {
+            if (!to->is_integer) {
+                to->set(dst, j, from->get(src, j));
+            } else if (!_convert_to_integer(from, src, to, dst, j)) {
+                delete_matrix(result.value);
+                return _failed_matrix_result(MATRIX_INTEGER_OVERFLOW);
+            }
+        }
+    }
+
+    return result;
+}
+
+typedef struct EliminationContext {
+    Matrix *m;
+    int pivot;
+} EliminationContext;
+
+// Subtracts multiples of the pivot row from rows [begin, end) so that their
+// entries below the pivot become zero, and stores each multiplier in the
+// slot it zeroed: that is where the packed L factor lives.
+void _eliminate_rows(int begin, int end, void *context) {
+    EliminationContext *c = context;
+    int k = c->pivot;
+    double *pivot_row = _row(c->m, k);
+    double ref = pivot_row[k];
+
+    for (int i = begin; i < end; i++) {
+        double *row = _row(c->m, i);
+        double value_to_set_zero = row[k];
+
+        if (value_to_set_zero != 0) {
+            double f = value_to_set_zero / ref * -1;
+            for (int j = k + 1; j < c->m->cols; j++) {
+                row[j] = row[j] + pivot_row[j] * f;
+            }
+            row[k] = -f;
+        }
     }
+}
+
+MatrixLUResult _build_lu_result(MatrixResultCode code, MatrixLU *value) {
+    MatrixLUResult result;
+    result.success = code == MATRIX_SUCCESS_CODE ? 1 : 0;
+    result.code = code;
+    result.value = value;
+    return result;
+}
+
+MatrixLUResult matrix_lu_factor(Matrix *m) {
+    if (m == NULL) return _build_lu_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+
+    if (m->rows != m->cols) {
+        return _build_lu_result(MATRIX_SHOULD_BE_SQUARE_TO_FACTOR, NULL);
+    }
+
+    MatrixLU *lu = malloc(sizeof(MatrixLU));
+    Matrix *copy = matrix_convert(m, MATRIX_FLOAT64).value;
+    int *pivots = malloc(m->rows * sizeof(int));
 
-    Matrix *copy = matrix_copy(m);
+    if (lu == NULL || copy == NULL || pivots == NULL) {
+        free(lu);
+        free(pivots);
+        if (copy != NULL) delete_matrix(copy);
+        return _build_lu_result(MATRIX_INTERNAL_ERROR, NULL);
+    }
 
     int p = 1;
+    int singular = 0;
+    uint64_t n = copy->rows;
+
+    matrix_stats_count_kernel(MATRIX_STATS_LU_FACTOR, 2 * n * n * n / 3, 2 * n * n * sizeof(double));
 
-    for (int k = 0; k < m->rows - 1; k++) {
+    for (int k = 0; k < copy->rows; k++) {
         double max = fabs(_get(copy, k, k));
         int max_idx = k;
 
@@ -337,45 +1070,331 @@ MatrixNumericResult matrix_determinant_lu_decomposition(Matrix *m) {
             }
         }
 
+        pivots[k] = max_idx;
+
         if (k != max_idx) {
             p *= -1;
+            double *a = _row(copy, k), *b = _row(copy, max_idx);
             for (int col = 0; col < copy->cols; col++) {
-                double temp = _get(copy, k, col);
-                _set(copy, k, col, _get(copy, max_idx, col));
-                _set(copy, max_idx, col, temp);
+                double temp = a[col];
+                a[col] = b[col];
+                b[col] = temp;
             }
         }
 
-        double ref = _get(copy, k, k);
+        if (_get(copy, k, k) == 0) {
+            singular = 1;
+            continue;
+        }
 
-        if (ref == 0) return _succeeded_numeric_result(0);
+        EliminationContext context = { copy, k };
 
-        for (int i = k + 1; i < m->rows; i++) {
-            double value_to_set_zero = _get(copy, i, k);
+        thread_pool_parallel_for(
+            k + 1, copy->rows,
+            thread_pool_grain(copy->cols - k, MATRIX_PARALLEL_MIN_WORK),
+            _eliminate_rows, &context
+        );
+    }
 
-            if (value_to_set_zero != 0) {
-                double f = value_to_set_zero / ref * -1;
-                for (int j = 0; j < m->cols; j++) {
-                    _set(copy, i, j, _get(copy, i, j) + _get(copy, k, j) * f);
-                }
+    lu->factors = copy;
+    lu->pivots = pivots;
+    lu->sign = p;
+    lu->singular = singular;
+
+    return _build_lu_result(MATRIX_SUCCESS_CODE, lu);
+}
+
+MatrixNumericResult matrix_lu_determinant(MatrixLU *lu) {
+    if (lu == NULL) return _failed_numeric_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+
+    if (lu->singular) return _succeeded_numeric_result(0);
+
+    double det = 1;
+
+    for (int i = 0; i < lu->factors->rows; i++) {
+        det *= _get(lu->factors, i, i);
+    }
+
+    return _succeeded_numeric_result(det * lu->sign);
+}
+
+typedef struct SolveContext {
+    MatrixLU *lu;
+    Matrix *x;
+} SolveContext;
+
+// Forward and back substitution on columns [begin, end) of x, which already
+// holds the right-hand sides in pivoted row order. Each step updates a
+// whole row segment, so the inner loop is an axpy across the columns.
+void _substitute_columns(int begin, int end, void *context) {
+    SolveContext *c = context;
+    Matrix *f = c->lu->factors, *x = c->x;
+    const MatrixKernels *kernels = simd_kernels();
+    int n = f->rows, width = end - begin;
+
+    for (int i = 1; i < n; i++) {
+        double *target = _row(x, i) + begin;
+        double *l = _row(f, i);
+
+        for (int j = 0; j < i; j++) {
+            if (l[j] != 0) kernels->axpy(target, -l[j], _row(x, j) + begin, width);
+        }
+    }
+
+    for (int i = n - 1; i >= 0; i--) {
+        double *target = _row(x, i) + begin;
+        double *u = _row(f, i);
+
+        for (int j = i + 1; j < n; j++) {
+            if (u[j] != 0) kernels->axpy(target, -u[j], _row(x, j) + begin, width);
+        }
+
+        kernels->scale(target, target, 1 / u[i], width);
+    }
+}
+
+MatrixResult matrix_lu_solve(MatrixLU *lu, Matrix *b) {
+    if (lu == NULL || b == NULL) return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+    if (b->rows != lu->factors->rows) return _failed_matrix_result(MATRIX_INVALID_DIMENSIONS_TO_SOLVE);
+    if (lu->singular) return _failed_matrix_result(MATRIX_IS_SINGULAR);
+
+    Matrix *x = matrix_convert(b, MATRIX_FLOAT64).value;
+
+    if (x == NULL) return _failed_matrix_result(MATRIX_INTERNAL_ERROR);
+
+    for (int k = 0; k < x->rows; k++) {
+        int p = lu->pivots[k];
+
+        if (p != k) {
+            double *a = _row(x, k), *c = _row(x, p);
+            for (int col = 0; col < x->cols; col++) {
+                double temp = a[col];
+                a[col] = c[col];
+                c[col] = temp;
             }
         }
     }
 
-    double det = 1;
+    uint64_t n = x->rows;
+
+    matrix_stats_count_kernel(MATRIX_STATS_LU_SOLVE, 2 * n * n * x->cols, (n * n + 2 * n * x->cols) * sizeof(double));
+
+    SolveContext context = { lu, x };
+
+    thread_pool_parallel_for(
+        0, x->cols,
+        thread_pool_grain((long) x->rows * x->rows, MATRIX_PARALLEL_MIN_WORK),
+        _substitute_columns, &context
+    );
+
+    return _succeeded_matrix_result(x);
+}
+
+MatrixResult matrix_lu_inverse(MatrixLU *lu) {
+    if (lu == NULL) return _failed_matrix_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+
+    MatrixResult identity = new_identity_matrix(lu->factors->rows);
+
+    if (!identity.success) return identity;
 
-    for (int i = 0; i < copy->rows; i++) {
-        det *= _get(copy, i, i );
+    MatrixResult inverse = matrix_lu_solve(lu, identity.value);
+    delete_matrix(identity.value);
+
+    return inverse;
+}
+
+void delete_matrix_lu(MatrixLU *lu) {
+    delete_matrix(lu->factors);
+    free(lu->pivots);
+    free(lu);
+}
+
+MatrixResult matrix_inverse(Matrix *m) {
+    const MatrixFixedKernels *fixed = m != NULL ? _fixed_kernels_of(m) : NULL;
+
+    if (fixed != NULL) {
+        double packed[MATRIX_FIXED_MAX * MATRIX_FIXED_MAX];
+        MatrixResult inverse = new_matrix(m->rows, m->cols);
+
+        if (!inverse.success) return inverse;
+
+        _pack_fixed(m, packed);
+
+        if (!fixed->inverse(packed, packed)) {
+            delete_matrix(inverse.value);
+            return _failed_matrix_result(MATRIX_IS_SINGULAR);
+        }
+
+        _unpack_fixed(inverse.value, packed);
+        return inverse;
     }
 
-    return _succeeded_numeric_result(det * p);
+    MatrixLUResult lu = matrix_lu_factor(m);
+
+    if (!lu.success) return _failed_matrix_result(lu.code);
+
+    MatrixResult inverse = matrix_lu_inverse(lu.value);
+    delete_matrix_lu(lu.value);
+
+    return inverse;
+}
+
+MatrixNumericResult matrix_determinant_lu_decomposition(Matrix *m) {
+    if (m == NULL) return _failed_numeric_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL);
+
+    if (m->element_type != MATRIX_FLOAT64) {
+        return _determinant_of_float64_copy(m, matrix_determinant_lu_decomposition);
+    }
+
+    if (m->rows != m->cols) {
+        return _failed_numeric_result(MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT);
+    }
+
+    if (m->rows == 1) {
+        return _succeeded_numeric_result(_get(m, 0, 0));
+    }
+
+    const MatrixFixedKernels *fixed = _fixed_kernels_of(m);
+
+    if (fixed != NULL) {
+        double packed[MATRIX_FIXED_MAX * MATRIX_FIXED_MAX];
+        uint64_t n = m->rows;
+
+        matrix_stats_count_kernel(MATRIX_STATS_LU_FACTOR, 2 * n * n * n / 3, n * n * sizeof(double));
+        _pack_fixed(m, packed);
+        return _succeeded_numeric_result(fixed->determinant(packed));
+    }
+
+    MatrixLUResult lu = matrix_lu_factor(m);
+
+    if (!lu.success) return _failed_numeric_result(lu.code);
+
+    MatrixNumericResult det = matrix_lu_determinant(lu.value);
+    delete_matrix_lu(lu.value);
+
+    return det;
+}
+
+MatrixIntegerResult _build_integer_result(MatrixResultCode code, int64_t value) {
+    MatrixIntegerResult result;
+    result.success = code == MATRIX_SUCCESS_CODE ? 1 : 0;
+    result.code = code;
+    result.value = value;
+    return result;
+}
+
+typedef struct BareissContext {
+    Matrix *m;
+    int pivot;
+    int64_t previous_pivot;
+    int overflow;
+} BareissContext;
+
+// One fraction-free step on rows [begin, end): every entry right of and
+// below the pivot becomes the 2x2 determinant it forms with the pivot row
+// and column, divided (exactly) by the previous pivot.
+void _bareiss_rows(int begin, int end, void *context) {
+    BareissContext *c = context;
+    int k = c->pivot, n = c->m->cols;
+    int64_t *pivot_row = _typed_row(c->m, k);
+
+    for (int i = begin; i < end; i++) {
+        int64_t *row = _typed_row(c->m, i);
+
+        for (int j = k + 1; j < n; j++) {
+            __int128 kept, removed, value;
+
+            if (__builtin_mul_overflow((__int128) row[j], (__int128) pivot_row[k], &kept) ||
+                __builtin_mul_overflow((__int128) row[k], (__int128) pivot_row[j], &removed) ||
+                __builtin_sub_overflow(kept, removed, &value)) {
+                __atomic_store_n(&c->overflow, 1, __ATOMIC_RELAXED);
+                return;
+            }
+
+            value /= c->previous_pivot;
+
+            if (value > INT64_MAX || value < INT64_MIN) {
+                __atomic_store_n(&c->overflow, 1, __ATOMIC_RELAXED);
+                return;
+            }
+
+            row[j] = (int64_t) value;
+        }
+    }
+}
+
+MatrixIntegerResult matrix_determinant_bareiss(Matrix *m) {
+    if (m == NULL) return _build_integer_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, 0);
+
+    if (m->rows != m->cols) {
+        return _build_integer_result(MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT, 0);
+    }
+
+    if (!typed_kernels(m->element_type)->is_integer) {
+        return _build_integer_result(MATRIX_UNSUPPORTED_ELEMENT_TYPE, 0);
+    }
+
+    MatrixResult copy = matrix_convert(m, MATRIX_INT64);
+
+    if (!copy.success) return _build_integer_result(copy.code, 0);
+
+    Matrix *a = copy.value;
+    int n = a->rows;
+    int sign = 1;
+    BareissContext context = { a, 0, 1, 0 };
+    uint64_t order = n;
+
+    // Two products, a difference and a division per updated entry.
+    matrix_stats_count_kernel(MATRIX_STATS_DETERMINANT_BAREISS, 4 * order * order * order / 3,
+        2 * order * order * sizeof(int64_t));
+
+    for (int k = 0; k < n - 1 && !context.overflow; k++) {
+        int pivot = k;
+
+        while (pivot < n && ((int64_t*) _typed_row(a, pivot))[k] == 0) pivot++;
+
+        if (pivot == n) {
+            delete_matrix(a);
+            return _build_integer_result(MATRIX_SUCCESS_CODE, 0);
+        }
+
+        if (pivot != k) {
+            int64_t *x = _typed_row(a, k), *y = _typed_row(a, pivot);
+            for (int col = k; col < n; col++) {
+                int64_t temp = x[col];
+                x[col] = y[col];
+                y[col] = temp;
+            }
+            sign = -sign;
+        }
+
+        context.pivot = k;
+
+        thread_pool_parallel_for(
+            k + 1, n,
+            thread_pool_grain(n - k, MATRIX_PARALLEL_MIN_WORK),
+            _bareiss_rows, &context
+        );
+
+        context.previous_pivot = ((int64_t*) _typed_row(a, k))[k];
+    }
+
+    int64_t det = ((int64_t*) _typed_row(a, n - 1))[n - 1];
+    int overflow = context.overflow || (sign < 0 && det == INT64_MIN);
+
+    delete_matrix(a);
+
+    if (overflow) return _build_integer_result(MATRIX_INTEGER_OVERFLOW, 0);
+
+    return _build_integer_result(MATRIX_SUCCESS_CODE, sign * det);
 }
 
 void delete_matrix(Matrix *m) {
-    for (int i = 0; i < m->rows; i++) {
-        free(m->values[i]);
+    if (m->mapping != NULL) {
+        munmap(m->mapping, m->mapping_size);
+    } else {
+        matrix_release(m->allocator, m->data, m->capacity);
     }
 
-    free(m->values);
     free(m);
 }
@@ -1,10 +1,39 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#define MATRIX_ALIGNMENT 64
+
+#include <stddef.h>
+#include <stdint.h>
+#include "matrix-allocator.h"
+
+// Element type of a matrix. float64 is the default, so a zero-initialized
+// Matrix is a float64 one.
+typedef enum MatrixElementType {
+    MATRIX_FLOAT64,
+    MATRIX_FLOAT32,
+    MATRIX_INT32,
+    MATRIX_INT64
+} MatrixElementType;
+
 typedef struct Matrix {
     int rows;
     int cols;
-    double **values;
+    int stride;
+    // The view of the storage that matches element_type.
+    union {
+        double *values;
+        float *float32_values;
+        int32_t *int32_values;
+        int64_t *int64_values;
+        void *data;
+    };
+    size_t capacity;
+    // Where the storage came from; NULL for mapped matrices.
+    MatrixAllocator *allocator;
+    void *mapping;
+    size_t mapping_size;
+    MatrixElementType element_type;
 } Matrix;
 
 typedef enum MatrixResultCode {
@@ -16,6 +45,18 @@ typedef enum MatrixResultCode {
     MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT,
     MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY,
     MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT,
+    MATRIX_INVALID_DESTINATION_DIMENSIONS,
+    MATRIX_DESTINATION_OVERLAPS_ARGUMENTS,
+    MATRIX_SHOULD_BE_SQUARE_TO_FACTOR,
+    MATRIX_INVALID_DIMENSIONS_TO_SOLVE,
+    MATRIX_IS_SINGULAR,
+    MATRIX_ELEMENT_TYPES_MUST_MATCH,
+    MATRIX_UNSUPPORTED_ELEMENT_TYPE,
+    MATRIX_INTEGER_OVERFLOW,
+    MATRIX_BATCH_SIZES_MUST_MATCH,
+    MATRIX_TILE_SIZES_MUST_MATCH,
+    MATRIX_MEMORY_LIMIT_TOO_SMALL,
+    MATRIX_TILE_IO_FAILED,
     MATRIX_INTERNAL_ERROR
 } MatrixResultCode;
 
@@ -31,8 +72,60 @@ typedef struct MatrixNumericResult {
     double value;
 } MatrixNumericResult;
 
+typedef struct MatrixIntegerResult {
+    int success;
+    MatrixResultCode code;
+    int64_t value;
+} MatrixIntegerResult;
+
+// LU factorization with partial pivoting, P A = L U. L (unit diagonal,
+// not stored) and U share one matrix; pivots[k] is the row exchanged with
+// row k at step k.
+typedef struct MatrixLU {
+    Matrix *factors;
+    int *pivots;
+    int sign;
+    int singular;
+} MatrixLU;
+
+typedef struct MatrixLUResult {
+    int success;
+    MatrixResultCode code;
+    MatrixLU *value;
+} MatrixLUResult;
+
+typedef enum MatrixMultiplyMode {
+    MATRIX_MULTIPLY_CLASSICAL,
+    MATRIX_MULTIPLY_STRASSEN
+} MatrixMultiplyMode;
+
+// New matrices take their storage from matrix_current_allocator() and give
+// it back to the same allocator in delete_matrix. The Matrix header itself
+// is always malloc'ed, since callers copy headers around by value.
 MatrixResult new_matrix(int rows, int cols);
 
+MatrixResult new_typed_matrix(int rows, int cols, MatrixElementType element_type);
+
+// Wraps values that live inside a memory mapping created by the caller
+// (for instance a mapped binary matrix file). The matrix takes ownership
+// of the mapping and unmaps it in delete_matrix.
+MatrixResult new_mapped_matrix(
+    int rows, int cols, int stride, MatrixElementType element_type,
+    void *values, void *mapping, size_t mapping_size
+);
+
+size_t matrix_element_size(MatrixElementType element_type);
+
+const char* matrix_element_type_name(MatrixElementType element_type);
+
+// Returns 0 and leaves element_type untouched if the name is unknown.
+int matrix_element_type_from_name(const char *name, MatrixElementType *element_type);
+
+// Copies m into a matrix of the given element type. Values going to an
+// integer type must be finite and are rounded to the nearest integer; a
+// value out of the target's range fails with MATRIX_INTEGER_OVERFLOW.
+MatrixResult matrix_convert(Matrix *m, MatrixElementType element_type);
+
 MatrixResult new_matrix_with_values(int rows, int cols, double values[rows][cols]);
 
 Matrix* matrix_copy(Matrix *m);
@@ -43,18 +136,80 @@ MatrixNumericResult matrix_set(Matrix *m, int row, int col, double value);
 
 MatrixNumericResult matrix_get(Matrix *m, int row, int col);
 
+// Sum, subtract, multiply and transpose work on every element type, and
+// their operands and result must share it. Integer arithmetic wraps around
+// on overflow. Scaling, axpy, in-place transposition and Strassen are
+// float64 only; determinants and factorizations of other types are
+// computed on a float64 copy. Square float64 matrices from 2x2 to 8x8 are
+// multiplied, transposed, inverted and have their LU determinant taken by
+// the unrolled kernels of matrix-fixed.h.
 MatrixResult matrix_sum(Matrix *a, Matrix *b);
 
 MatrixResult matrix_subtract(Matrix *a, Matrix *b);
 
 MatrixResult matrix_multiply(Matrix *a, Matrix *b);
 
+// Destination-passing variants: the result is written into dst, which must
+// already have the result's dimensions, and dst is returned on success.
+// Element-wise operations allow dst to be one of the operands; multiply and
+// transpose need a dst that does not overlap them.
+MatrixResult matrix_sum_into(Matrix *dst, Matrix *a, Matrix *b);
+
+MatrixResult matrix_subtract_into(Matrix *dst, Matrix *a, Matrix *b);
+
+MatrixResult matrix_multiply_into(Matrix *dst, Matrix *a, Matrix *b);
+
+// Selects the algorithm behind matrix_multiply and matrix_multiply_into.
+// Strassen only applies to products whose dimensions all reach
+// strassen_crossover(); its error bound is given in strassen.h.
+void matrix_set_multiply_mode(MatrixMultiplyMode mode);
+
+MatrixMultiplyMode matrix_multiply_mode();
+
+MatrixResult matrix_transpose_into(Matrix *dst, Matrix *m);
+
+// Transposes m within its own storage. Square matrices swap tiles pairwise;
+// rectangular ones are permuted by following cycles, which needs only a
+// bitmap of one bit per element on top of the matrix itself.
+MatrixResult matrix_transpose_in_place(Matrix *m);
+
+// a += b
+MatrixResult matrix_add_in_place(Matrix *a, Matrix *b);
+
+// a -= b
+MatrixResult matrix_subtract_in_place(Matrix *a, Matrix *b);
+
+// m *= factor
+MatrixResult matrix_scale(Matrix *m, double factor);
+
+// y += alpha * x
+MatrixResult matrix_axpy(Matrix *y, double alpha, Matrix *x);
+
 MatrixNumericResult matrix_determinant_laplace(Matrix *m);
 
 MatrixNumericResult matrix_determinant_lu_decomposition(Matrix *m);
 
+// Exact determinant of an integer matrix by fraction-free (Bareiss)
+// elimination, whose intermediate values are all minors of m. Fails with
+// MATRIX_INTEGER_OVERFLOW if one of them does not fit in int64.
+MatrixIntegerResult matrix_determinant_bareiss(Matrix *m);
+
 MatrixResult matrix_transpose(Matrix *m);
 
+// Factors m once so the determinant, solves and the inverse can reuse it.
+MatrixLUResult matrix_lu_factor(Matrix *m);
+
+MatrixNumericResult matrix_lu_determinant(MatrixLU *lu);
+
+// Solves A X = B for every column of B at once.
+MatrixResult matrix_lu_solve(MatrixLU *lu, Matrix *b);
+
+MatrixResult matrix_lu_inverse(MatrixLU *lu);
+
+void delete_matrix_lu(MatrixLU *lu);
+
+MatrixResult matrix_inverse(Matrix *m);
+
 int matrix_equals(Matrix *a, Matrix *b);
 
 void delete_matrix(Matrix *m);
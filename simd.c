@@ -0,0 +1,504 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+void _scalar_add(double *dst, const double *a, const double *b, int n) {
+    for (int i = 0; i < n; i++) dst[i] = a[i] + b[i];
+}
+
+void _scalar_subtract(double *dst, const double *a, const double *b, int n) {
+    for (int i = 0; i < n; i++) dst[i] = a[i] - b[i];
+}
+
+void _scalar_scale(double *dst, const double *a, double factor, int n) {
+    for (int i = 0; i < n; i++) dst[i] = a[i] * factor;
+}
+
+void _scalar_axpy(double *y, double alpha, const double *x, int n) {
+    for (int i = 0; i < n; i++) y[i] += alpha * x[i];
+}
+
+int _scalar_equals(const double *a, const double *b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i]) return 0;
+    }
+
+    return 1;
+}
+
+void _scalar_transpose(const double *src, int src_stride, double *dst, int dst_stride) {
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            dst[j * dst_stride + i] = src[i * src_stride + j];
+        }
+    }
+}
+
+void _scalar_gemm_kernel(int k, const double *a, const double *b, double *c, int ldc, double alpha) {
+    double ab[4][4] = { { 0 } };
+
+    for (int p = 0; p < k; p++) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                ab[i][j] += a[p * 4 + i] * b[p * 4 + j];
+            }
+        }
+    }
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            c[i * ldc + j] += alpha * ab[i][j];
+        }
+    }
+}
+
+const MatrixKernels SCALAR_KERNELS = {
+    "scalar",
+    _scalar_add, _scalar_subtract, _scalar_scale, _scalar_axpy, _scalar_equals,
+    4, _scalar_transpose,
+    4, 4, _scalar_gemm_kernel
+};
+
+#ifdef SIMD_X86
+
+__attribute__((target("sse2")))
+void _sse2_add(double *dst, const double *a, const double *b, int n) {
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+
+    for (; i < n; i++) dst[i] = a[i] + b[i];
+}
+
+__attribute__((target("sse2")))
+void _sse2_subtract(double *dst, const double *a, const double *b, int n) {
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+
+    for (; i < n; i++) dst[i] = a[i] - b[i];
+}
+
+__attribute__((target("sse2")))
+void _sse2_scale(double *dst, const double *a, double factor, int n) {
+    __m128d f = _mm_set1_pd(factor);
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(a + i), f));
+    }
+
+    for (; i < n; i++) dst[i] = a[i] * factor;
+}
+
+__attribute__((target("sse2")))
+void _sse2_axpy(double *y, double alpha, const double *x, int n) {
+    __m128d scale = _mm_set1_pd(alpha);
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(scale, _mm_loadu_pd(x + i))));
+    }
+
+    for (; i < n; i++) y[i] += alpha * x[i];
+}
+
+__attribute__((target("sse2")))
+int _sse2_equals(const double *a, const double *b, int n) {
+    int i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        if (_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i))) != 0x3) return 0;
+    }
+
+    for (; i < n; i++) {
+        if (a[i] != b[i]) return 0;
+    }
+
+    return 1;
+}
+
+__attribute__((target("sse2")))
+void _sse2_transpose(const double *src, int src_stride, double *dst, int dst_stride) {
+    __m128d r0 = _mm_loadu_pd(src);
+    __m128d r1 = _mm_loadu_pd(src + src_stride);
+
+    _mm_storeu_pd(dst, _mm_unpacklo_pd(r0, r1));
+    _mm_storeu_pd(dst + dst_stride, _mm_unpackhi_pd(r0, r1));
+}
+
+__attribute__((target("sse2")))
+void _sse2_gemm_kernel(int k, const double *a, const double *b, double *c, int ldc, double alpha) {
+    __m128d c00 = _mm_setzero_pd(), c01 = _mm_setzero_pd();
+    __m128d c10 = _mm_setzero_pd(), c11 = _mm_setzero_pd();
+    __m128d c20 = _mm_setzero_pd(), c21 = _mm_setzero_pd();
+    __m128d c30 = _mm_setzero_pd(), c31 = _mm_setzero_pd();
+
+    for (int p = 0; p < k; p++) {
+        __m128d b0 = _mm_loadu_pd(b + p * 4);
+        __m128d b1 = _mm_loadu_pd(b + p * 4 + 2);
+        __m128d a0 = _mm_set1_pd(a[p * 4]);
+        __m128d a1 = _mm_set1_pd(a[p * 4 + 1]);
+        __m128d a2 = _mm_set1_pd(a[p * 4 + 2]);
+        __m128d a3 = _mm_set1_pd(a[p * 4 + 3]);
+
+        c00 = _mm_add_pd(c00, _mm_mul_pd(a0, b0)); c01 = _mm_add_pd(c01, _mm_mul_pd(a0, b1));
+        c10 = _mm_add_pd(c10, _mm_mul_pd(a1, b0)); c11 = _mm_add_pd(c11, _mm_mul_pd(a1, b1));
+        c20 = _mm_add_pd(c20, _mm_mul_pd(a2, b0)); c21 = _mm_add_pd(c21, _mm_mul_pd(a2, b1));
+        c30 = _mm_add_pd(c30, _mm_mul_pd(a3, b0)); c31 = _mm_add_pd(c31, _mm_mul_pd(a3, b1));
+    }
+
+    __m128d scale = _mm_set1_pd(alpha);
+    __m128d acc[4][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 } };
+
+    for (int i = 0; i < 4; i++) {
+        double *row = c + i * ldc;
+        _mm_storeu_pd(row, _mm_add_pd(_mm_loadu_pd(row), _mm_mul_pd(scale, acc[i][0])));
+        _mm_storeu_pd(row + 2, _mm_add_pd(_mm_loadu_pd(row + 2), _mm_mul_pd(scale, acc[i][1])));
+    }
+}
+
+const MatrixKernels SSE2_KERNELS = {
+    "sse2",
+    _sse2_add, _sse2_subtract, _sse2_scale, _sse2_axpy, _sse2_equals,
+    2, _sse2_transpose,
+    4, 4, _sse2_gemm_kernel
+};
+
+__attribute__((target("avx2,fma")))
+void _avx2_add(double *dst, const double *a, const double *b, int n) {
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+
+    for (; i < n; i++) dst[i] = a[i] + b[i];
+}
+
+__attribute__((target("avx2,fma")))
+void _avx2_subtract(double *dst, const double *a, const double *b, int n) {
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+
+    for (; i < n; i++) dst[i] = a[i] - b[i];
+}
+
+__attribute__((target("avx2,fma")))
+void _avx2_scale(double *dst, const double *a, double factor, int n) {
+    __m256d f = _mm256_set1_pd(factor);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), f));
+    }
+
+    for (; i < n; i++) dst[i] = a[i] * factor;
+}
+
+__attribute__((target("avx2,fma")))
+void _avx2_axpy(double *y, double alpha, const double *x, int n) {
+    __m256d scale = _mm256_set1_pd(alpha);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(y + i, _mm256_fmadd_pd(scale, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    }
+
+    for (; i < n; i++) y[i] += alpha * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+int _avx2_equals(const double *a, const double *b, int n) {
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256d equal = _mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), _CMP_EQ_OQ);
+        if (_mm256_movemask_pd(equal) != 0xF) return 0;
+    }
+
+    for (; i < n; i++) {
+        if (a[i] != b[i]) return 0;
+    }
+
+    return 1;
+}
+
+__attribute__((target("avx2,fma")))
+void _avx2_transpose(const double *src, int src_stride, double *dst, int dst_stride) {
+    __m256d r0 = _mm256_loadu_pd(src);
+    __m256d r1 = _mm256_loadu_pd(src + src_stride);
+    __m256d r2 = _mm256_loadu_pd(src + 2 * src_stride);
+    __m256d r3 = _mm256_loadu_pd(src + 3 * src_stride);
+
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+    __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+    __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+
+    _mm256_storeu_pd(dst, _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd(dst + dst_stride, _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd(dst + 2 * dst_stride, _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd(dst + 3 * dst_stride, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+// 6 x 8 tile: twelve accumulators, two B vectors and one broadcast.
+__attribute__((target("avx2,fma")))
+void _avx2_gemm_kernel(int k, const double *a, const double *b, double *c, int ldc, double alpha) {
+    __m256d acc[6][2];
+
+    #pragma GCC unroll 8
+    for (int i = 0; i < 6; i++) {
+        acc[i][0] = _mm256_setzero_pd();
+        acc[i][1] = _mm256_setzero_pd();
+    }
+
+    for (int p = 0; p < k; p++) {
+        __m256d b0 = _mm256_loadu_pd(b + p * 8);
+        __m256d b1 = _mm256_loadu_pd(b + p * 8 + 4);
+
+        #pragma GCC unroll 8
+        for (int i = 0; i < 6; i++) {
+            __m256d ai = _mm256_broadcast_sd(a + p * 6 + i);
+            acc[i][0] = _mm256_fmadd_pd(ai, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_pd(ai, b1, acc[i][1]);
+        }
+    }
+
+    __m256d scale = _mm256_set1_pd(alpha);
+
+    #pragma GCC unroll 8
+    for (int i = 0; i < 6; i++) {
+        double *row = c + i * ldc;
+        _mm256_storeu_pd(row, _mm256_fmadd_pd(scale, acc[i][0], _mm256_loadu_pd(row)));
+        _mm256_storeu_pd(row + 4, _mm256_fmadd_pd(scale, acc[i][1], _mm256_loadu_pd(row + 4)));
+    }
+}
+
+const MatrixKernels AVX2_KERNELS = {
+    "avx2",
+    _avx2_add, _avx2_subtract, _avx2_scale, _avx2_axpy, _avx2_equals,
+    4, _avx2_transpose,
+    6, 8, _avx2_gemm_kernel
+};
+
+__attribute__((target("avx512f")))
+void _avx512_add(double *dst, const double *a, const double *b, int n) {
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(dst + i, _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+    }
+
+    if (i < n) {
+        __mmask8 tail = (__mmask8) ((1u << (n - i)) - 1);
+        __m512d sum = _mm512_add_pd(_mm512_maskz_loadu_pd(tail, a + i), _mm512_maskz_loadu_pd(tail, b + i));
+        _mm512_mask_storeu_pd(dst + i, tail, sum);
+    }
+}
+
+__attribute__((target("avx512f")))
+void _avx512_subtract(double *dst, const double *a, const double *b, int n) {
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(dst + i, _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+    }
+
+    if (i < n) {
+        __mmask8 tail = (__mmask8) ((1u << (n - i)) - 1);
+        __m512d difference = _mm512_sub_pd(_mm512_maskz_loadu_pd(tail, a + i), _mm512_maskz_loadu_pd(tail, b + i));
+        _mm512_mask_storeu_pd(dst + i, tail, difference);
+    }
+}
+
+__attribute__((target("avx512f")))
+void _avx512_scale(double *dst, const double *a, double factor, int n) {
+    __m512d f = _mm512_set1_pd(factor);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(dst + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), f));
+    }
+
+    if (i < n) {
+        __mmask8 tail = (__mmask8) ((1u << (n - i)) - 1);
+        _mm512_mask_storeu_pd(dst + i, tail, _mm512_mul_pd(_mm512_maskz_loadu_pd(tail, a + i), f));
+    }
+}
+
+__attribute__((target("avx512f")))
+void _avx512_axpy(double *y, double alpha, const double *x, int n) {
+    __m512d scale = _mm512_set1_pd(alpha);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(y + i, _mm512_fmadd_pd(scale, _mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+    }
+
+    if (i < n) {
+        __mmask8 tail = (__mmask8) ((1u << (n - i)) - 1);
+        __m512d sum = _mm512_fmadd_pd(scale, _mm512_maskz_loadu_pd(tail, x + i), _mm512_maskz_loadu_pd(tail, y + i));
+        _mm512_mask_storeu_pd(y + i, tail, sum);
+    }
+}
+
+__attribute__((target("avx512f")))
+int _avx512_equals(const double *a, const double *b, int n) {
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        if (_mm512_cmp_pd_mask(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), _CMP_EQ_OQ) != 0xFF) return 0;
+    }
+
+    for (; i < n; i++) {
+        if (a[i] != b[i]) return 0;
+    }
+
+    return 1;
+}
+
+// 8 x 8 tile transposed through three rounds of 2-, 4- and 8-lane shuffles.
+__attribute__((target("avx512f")))
+void _avx512_transpose(const double *src, int src_stride, double *dst, int dst_stride) {
+    __m512d r[8], t[8];
+
+    #pragma GCC unroll 8
+    for (int i = 0; i < 8; i++) r[i] = _mm512_loadu_pd(src + i * src_stride);
+
+    #pragma GCC unroll 8
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm512_unpacklo_pd(r[i], r[i + 1]);
+        t[i + 1] = _mm512_unpackhi_pd(r[i], r[i + 1]);
+    }
+
+    const __m512i low_pairs = _mm512_set_epi64(13, 12, 5, 4, 9, 8, 1, 0);
+    const __m512i high_pairs = _mm512_set_epi64(15, 14, 7, 6, 11, 10, 3, 2);
+
+    #pragma GCC unroll 8
+    for (int i = 0; i < 8; i += 4) {
+        #pragma GCC unroll 8
+        for (int j = 0; j < 2; j++) {
+            r[i + j] = _mm512_permutex2var_pd(t[i + j], low_pairs, t[i + j + 2]);
+            r[i + j + 2] = _mm512_permutex2var_pd(t[i + j], high_pairs, t[i + j + 2]);
+        }
+    }
+
+    const __m512i low_halves = _mm512_set_epi64(11, 10, 9, 8, 3, 2, 1, 0);
+    const __m512i high_halves = _mm512_set_epi64(15, 14, 13, 12, 7, 6, 5, 4);
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 4; j++) {
+        t[j] = _mm512_permutex2var_pd(r[j], low_halves, r[j + 4]);
+        t[j + 4] = _mm512_permutex2var_pd(r[j], high_halves, r[j + 4]);
+    }
+
+    #pragma GCC unroll 8
+    for (int i = 0; i < 8; i++) _mm512_storeu_pd(dst + i * dst_stride, t[i]);
+}
+
+// 8 x 16 tile: sixteen accumulators, two B vectors and one broadcast.
+__attribute__((target("avx512f")))
+void _avx512_gemm_kernel(int k, const double *a, const double *b, double *c, int ldc, double alpha) {
+    __m512d acc[8][2];
+
+    #pragma GCC unroll 8
+    for (int i = 0; i < 8; i++) {
+        acc[i][0] = _mm512_setzero_pd();
+        acc[i][1] = _mm512_setzero_pd();
+    }
+
+    for (int p = 0; p < k; p++) {
+        __m512d b0 = _mm512_loadu_pd(b + p * 16);
+        __m512d b1 = _mm512_loadu_pd(b + p * 16 + 8);
+
+        #pragma GCC unroll 8
+        for (int i = 0; i < 8; i++) {
+            __m512d ai = _mm512_set1_pd(a[p * 8 + i]);
+            acc[i][0] = _mm512_fmadd_pd(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_pd(ai, b1, acc[i][1]);
+        }
+    }
+
+    __m512d scale = _mm512_set1_pd(alpha);
+
+    #pragma GCC unroll 8
+    for (int i = 0; i < 8; i++) {
+        double *row = c + i * ldc;
+        _mm512_storeu_pd(row, _mm512_fmadd_pd(scale, acc[i][0], _mm512_loadu_pd(row)));
+        _mm512_storeu_pd(row + 8, _mm512_fmadd_pd(scale, acc[i][1], _mm512_loadu_pd(row + 8)));
+    }
+}
+
+const MatrixKernels AVX512_KERNELS = {
+    "avx512",
+    _avx512_add, _avx512_subtract, _avx512_scale, _avx512_axpy, _avx512_equals,
+    8, _avx512_transpose,
+    8, 16, _avx512_gemm_kernel
+};
+
+#endif // SIMD_X86
+
+const MatrixKernels* simd_kernels_named(const char *name) {
+    if (strcmp(name, "scalar") == 0) return &SCALAR_KERNELS;
+
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        return &SSE2_KERNELS;
+    }
+
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return &AVX2_KERNELS;
+    }
+
+    if (strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+        return &AVX512_KERNELS;
+    }
+#endif
+
+    return NULL;
+}
+
+const MatrixKernels *selected_kernels = &SCALAR_KERNELS;
+pthread_once_t kernels_selected = PTHREAD_ONCE_INIT;
+
+void _select_kernels() {
+    const char *order[] = { "avx512", "avx2", "sse2", "scalar" };
+    const char *limit = getenv("MATRIX_SIMD");
+    int first = 0;
+
+    if (limit != NULL) {
+        for (int i = 0; i < 4; i++) {
+            if (strcmp(order[i], limit) == 0) first = i;
+        }
+    }
+
+    for (int i = first; i < 4; i++) {
+        const MatrixKernels *kernels = simd_kernels_named(order[i]);
+
+        if (kernels != NULL) {
+            selected_kernels = kernels;
+            return;
+        }
+    }
+}
+
+const MatrixKernels* simd_kernels() {
+    pthread_once(&kernels_selected, _select_kernels);
+    return selected_kernels;
+}
@@ -0,0 +1,44 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#define SIMD_GEMM_MAX_MR 8
+#define SIMD_GEMM_MAX_NR 16
+
+typedef struct MatrixKernels {
+    const char *name;
+
+    void (*add)(double *dst, const double *a, const double *b, int n);
+    void (*subtract)(double *dst, const double *a, const double *b, int n);
+    void (*scale)(double *dst, const double *a, double factor, int n);
+    // y += alpha * x
+    void (*axpy)(double *y, double alpha, const double *x, int n);
+    int (*equals)(const double *a, const double *b, int n);
+
+    // Transposes a transpose_block x transpose_block tile held in registers.
+    int transpose_block;
+    void (*transpose)(const double *src, int src_stride, double *dst, int dst_stride);
+
+    // C[mr x nr] += alpha * A_panel * B_panel over k packed steps.
+    int gemm_mr;
+    int gemm_nr;
+    void (*gemm_kernel)(int k, const double *a, const double *b, double *c, int ldc, double alpha);
+} MatrixKernels;
+
+// Kernels for the widest vector unit of the running CPU. The choice is made
+// once, on first use, and can be narrowed with the MATRIX_SIMD environment
+// variable (scalar, sse2, avx2 or avx512).
+const MatrixKernels* simd_kernels();
+
+// Kernels for a specific instruction set, or NULL if the CPU lacks it.
+const MatrixKernels* simd_kernels_named(const char *name);
+
+// For loops left to the compiler's vectorizer rather than written per
+// instruction set: the function is built once per instruction set and the
+// version for the running CPU is picked at load time.
+#if defined(__x86_64__) || defined(__i386__)
+#define MATRIX_VECTORIZE_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define MATRIX_VECTORIZE_CLONES
+#endif
+
+#endif // SIMD_H
@@ -0,0 +1,763 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sparse-matrix.h"
+#include "simd.h"
+#include "thread-pool.h"
+#include "typed-kernels.h"
+
+// Minimum number of entries a thread pool chunk should touch.
+#define SPARSE_PARALLEL_MIN_WORK (1 << 14)
+
+SparseMatrixResult _sparse_result(MatrixResultCode code, SparseMatrix *value) {
+    SparseMatrixResult result;
+    result.success = code == MATRIX_SUCCESS_CODE ? 1 : 0;
+    result.code = code;
+    result.value = value;
+    return result;
+}
+
+MatrixResult _sparse_dense_result(MatrixResultCode code, Matrix *value) {
+    MatrixResult result;
+    result.success = code == MATRIX_SUCCESS_CODE ? 1 : 0;
+    result.code = code;
+    result.value = value;
+    return result;
+}
+
+double* _sparse_dense_row(Matrix *m, int row) {
+    return m->values + (size_t) row * m->stride;
+}
+
+int _sparse_major(SparseMatrix *s) {
+    return s->format == SPARSE_MATRIX_CSR ? s->rows : s->cols;
+}
+
+// Items per chunk for a loop over the rows of s whose cost grows with the
+// entries of each row times work_per_entry.
+int _sparse_grain(SparseMatrix *s, long work_per_entry) {
+    long per_row = s->nonzeros / (_sparse_major(s) > 0 ? _sparse_major(s) : 1) + 1;
+    return thread_pool_grain(per_row * work_per_entry, SPARSE_PARALLEL_MIN_WORK);
+}
+
+// Turns per-row counts stored at pointers[i + 1] into offsets.
+long _sparse_prefix_sum(long *pointers, int count) {
+    pointers[0] = 0;
+
+    for (int i = 0; i < count; i++) {
+        pointers[i + 1] += pointers[i];
+    }
+
+    return pointers[count];
+}
+
+SparseMatrixResult new_sparse_matrix(int rows, int cols, SparseMatrixFormat format, long nonzeros) {
+    if (rows <= 0 || cols <= 0 || nonzeros < 0) return _sparse_result(MATRIX_DIMENSIONS_MUST_BE_POSITIVE, NULL);
+
+    SparseMatrix *s = malloc(sizeof(SparseMatrix));
+
+    if (s == NULL) return _sparse_result(MATRIX_INTERNAL_ERROR, NULL);
+
+    s->rows = rows;
+    s->cols = cols;
+    s->format = format;
+    s->nonzeros = nonzeros;
+    s->pointers = calloc((size_t) _sparse_major(s) + 1, sizeof(long));
+    s->indices = malloc((nonzeros > 0 ? nonzeros : 1) * sizeof(int));
+    s->values = malloc((nonzeros > 0 ? nonzeros : 1) * sizeof(double));
+
+    if (s->pointers == NULL || s->indices == NULL || s->values == NULL) {
+        delete_sparse_matrix(s);
+        return _sparse_result(MATRIX_INTERNAL_ERROR, NULL);
+    }
+
+    return _sparse_result(MATRIX_SUCCESS_CODE, s);
+}
+
+void delete_sparse_matrix(SparseMatrix *s) {
+    free(s->pointers);
+    free(s->indices);
+    free(s->values);
+    free(s);
+}
+
+typedef struct SparseEntry {
+    int index;
+    double value;
+} SparseEntry;
+
+int _sparse_compare_entries(const void *a, const void *b) {
+    int x = ((const SparseEntry*) a)->index, y = ((const SparseEntry*) b)->index;
+    return x < y ? -1 : x > y;
+}
+
+int _sparse_compare_ints(const void *a, const void *b) {
+    int x = *(const int*) a, y = *(const int*) b;
+    return x < y ? -1 : x > y;
+}
+
+SparseMatrixResult new_sparse_matrix_from_triplets(
+    int rows, int cols, long count,
+    const int *row_indices, const int *col_indices, const double *values
+) {
+    if (rows <= 0 || cols <= 0 || count < 0) return _sparse_result(MATRIX_DIMENSIONS_MUST_BE_POSITIVE, NULL);
+    if (count > 0 && (row_indices == NULL || col_indices == NULL || values == NULL)) {
+        return _sparse_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    }
+
+    for (long t = 0; t < count; t++) {
+        if (row_indices[t] < 0 || row_indices[t] >= rows || col_indices[t] < 0 || col_indices[t] >= cols) {
+            return _sparse_result(MATRIX_INDEX_ARGUMENT_OUT_OF_BOUNDS, NULL);
+        }
+    }
+
+    MatrixAllocator *allocator = matrix_current_allocator();
+    size_t starts_size = ((size_t) rows + 1) * sizeof(long);
+    size_t entries_size = (count > 0 ? count : 1) * sizeof(SparseEntry);
+    long *starts = matrix_allocate(allocator, starts_size);
+    SparseEntry *entries = matrix_allocate_scratch(allocator, entries_size);
+
+    if (starts == NULL || entries == NULL) {
+        matrix_release(allocator, entries, entries_size);
+        matrix_release(allocator, starts, starts_size);
+        return _sparse_result(MATRIX_INTERNAL_ERROR, NULL);
+    }
+
+    // Bucket the triplets by row, then sort each row by column and fold
+    // repeated columns together.
+    for (long t = 0; t < count; t++) {
+        starts[row_indices[t] + 1]++;
+    }
+
+    _sparse_prefix_sum(starts, rows);
+
+    for (long t = 0; t < count; t++) {
+        entries[starts[row_indices[t]]++] = (SparseEntry) { col_indices[t], values[t] };
+    }
+
+    long unique = 0;
+
+    for (int i = rows; i > 0; i--) {
+        starts[i] = starts[i - 1];
+    }
+    starts[0] = 0;
+
+    for (int i = 0; i < rows; i++) {
+        long begin = starts[i], end = starts[i + 1];
+
+        qsort(entries + begin, end - begin, sizeof(SparseEntry), _sparse_compare_entries);
+
+        for (long p = begin; p < end; p++) {
+            if (p == begin || entries[p].index != entries[p - 1].index) unique++;
+        }
+    }
+
+    SparseMatrixResult result = new_sparse_matrix(rows, cols, SPARSE_MATRIX_CSR, unique);
+
+    if (!result.success) {
+        matrix_release(allocator, entries, entries_size);
+        matrix_release(allocator, starts, starts_size);
+        return result;
+    }
+
+    SparseMatrix *s = result.value;
+    long q = -1;
+
+    for (int i = 0; i < rows; i++) {
+        for (long p = starts[i]; p < starts[i + 1]; p++) {
+            if (p == starts[i] || entries[p].index != entries[p - 1].index) {
+                q++;
+                s->indices[q] = entries[p].index;
+                s->values[q] = entries[p].value;
+            } else {
+                s->values[q] += entries[p].value;
+            }
+        }
+
+        s->pointers[i + 1] = q + 1;
+    }
+
+    matrix_release(allocator, entries, entries_size);
+    matrix_release(allocator, starts, starts_size);
+
+    return result;
+}
+
+typedef struct SparseDenseContext {
+    Matrix *dense;
+    SparseMatrix *sparse;
+} SparseDenseContext;
+
+void _sparse_count_dense_rows(int begin, int end, void *context) {
+    SparseDenseContext *c = context;
+
+    for (int i = begin; i < end; i++) {
+        double *row = _sparse_dense_row(c->dense, i);
+        long count = 0;
+
+        for (int j = 0; j < c->dense->cols; j++) {
+            count += row[j] != 0;
+        }
+
+        c->sparse->pointers[i + 1] = count;
+    }
+}
+
+void _sparse_fill_dense_rows(int begin, int end, void *context) {
+    SparseDenseContext *c = context;
+
+    for (int i = begin; i < end; i++) {
+        double *row = _sparse_dense_row(c->dense, i);
+        long q = c->sparse->pointers[i];
+
+        for (int j = 0; j < c->dense->cols; j++) {
+            if (row[j] != 0) {
+                c->sparse->indices[q] = j;
+                c->sparse->values[q++] = row[j];
+            }
+        }
+    }
+}
+
+SparseMatrixResult sparse_matrix_from_dense(Matrix *m, SparseMatrixFormat format) {
+    if (m == NULL) return _sparse_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (m->element_type != MATRIX_FLOAT64) return _sparse_result(MATRIX_UNSUPPORTED_ELEMENT_TYPE, NULL);
+
+    SparseMatrixResult result = new_sparse_matrix(m->rows, m->cols, SPARSE_MATRIX_CSR, 0);
+
+    if (!result.success) return result;
+
+    SparseMatrix *s = result.value;
+    SparseDenseContext context = { m, s };
+    int grain = thread_pool_grain(m->cols, SPARSE_PARALLEL_MIN_WORK);
+
+    thread_pool_parallel_for(0, m->rows, grain, _sparse_count_dense_rows, &context);
+
+    s->nonzeros = _sparse_prefix_sum(s->pointers, m->rows);
+
+    int *indices = realloc(s->indices, (s->nonzeros > 0 ? s->nonzeros : 1) * sizeof(int));
+    if (indices != NULL) s->indices = indices;
+
+    double *values = realloc(s->values, (s->nonzeros > 0 ? s->nonzeros : 1) * sizeof(double));
+    if (values != NULL) s->values = values;
+
+    if (indices == NULL || values == NULL) {
+        delete_sparse_matrix(s);
+        return _sparse_result(MATRIX_INTERNAL_ERROR, NULL);
+    }
+
+    thread_pool_parallel_for(0, m->rows, grain, _sparse_fill_dense_rows, &context);
+
+    if (format == SPARSE_MATRIX_CSR) return result;
+
+    SparseMatrixResult converted = sparse_matrix_convert(s, format);
+
+    delete_sparse_matrix(s);
+
+    return converted;
+}
+
+SparseMatrixResult sparse_matrix_convert(SparseMatrix *s, SparseMatrixFormat format) {
+    if (s == NULL) return _sparse_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+
+    SparseMatrixResult result = new_sparse_matrix(s->rows, s->cols, format, s->nonzeros);
+
+    if (!result.success) return result;
+
+    SparseMatrix *t = result.value;
+
+    if (format == s->format) {
+        memcpy(t->pointers, s->pointers, ((size_t) _sparse_major(s) + 1) * sizeof(long));
+        memcpy(t->indices, s->indices, s->nonzeros * sizeof(int));
+        memcpy(t->values, s->values, s->nonzeros * sizeof(double));
+        return result;
+    }
+
+    // Counting sort on the minor index; walking the major index in order
+    // leaves every output run sorted.
+    MatrixAllocator *allocator = matrix_current_allocator();
+    size_t next_size = ((size_t) _sparse_major(t) + 1) * sizeof(long);
+    long *next = matrix_allocate_scratch(allocator, next_size);
+
+    if (next == NULL) {
+        delete_sparse_matrix(t);
+        return _sparse_result(MATRIX_INTERNAL_ERROR, NULL);
+    }
+
+    for (long p = 0; p < s->nonzeros; p++) {
+        t->pointers[s->indices[p] + 1]++;
+    }
+
+    _sparse_prefix_sum(t->pointers, _sparse_major(t));
+    memcpy(next, t->pointers, next_size);
+
+    for (int i = 0; i < _sparse_major(s); i++) {
+        for (long p = s->pointers[i]; p < s->pointers[i + 1]; p++) {
+            long q = next[s->indices[p]]++;
+            t->indices[q] = i;
+            t->values[q] = s->values[p];
+        }
+    }
+
+    matrix_release(allocator, next, next_size);
+
+    return result;
+}
+
+// Returns s if it is CSR, otherwise a CSR copy that is also stored in
+// *temporary for the caller to delete.
+SparseMatrix* _sparse_as_csr(SparseMatrix *s, SparseMatrix **temporary, MatrixResultCode *code) {
+    *temporary = NULL;
+
+    if (s->format == SPARSE_MATRIX_CSR) return s;
+
+    SparseMatrixResult converted = sparse_matrix_convert(s, SPARSE_MATRIX_CSR);
+
+    *code = converted.code;
+
+    return *temporary = converted.value;
+}
+
+void _sparse_scatter_rows(int begin, int end, void *context) {
+    SparseDenseContext *c = context;
+
+    for (int i = begin; i < end; i++) {
+        double *row = _sparse_dense_row(c->dense, i);
+
+        for (long p = c->sparse->pointers[i]; p < c->sparse->pointers[i + 1]; p++) {
+            row[c->sparse->indices[p]] = c->sparse->values[p];
+        }
+    }
+}
+
+MatrixResult sparse_matrix_to_dense(SparseMatrix *s) {
+    if (s == NULL) return _sparse_dense_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+
+    MatrixResultCode code = MATRIX_SUCCESS_CODE;
+    SparseMatrix *temporary;
+    SparseMatrix *csr = _sparse_as_csr(s, &temporary, &code);
+
+    if (csr == NULL) return _sparse_dense_result(code, NULL);
+
+    MatrixResult result = new_matrix(s->rows, s->cols);
+
+    if (result.success) {
+        SparseDenseContext context = { result.value, csr };
+        thread_pool_parallel_for(0, s->rows, _sparse_grain(csr, 1), _sparse_scatter_rows, &context);
+    }
+
+    if (temporary != NULL) delete_sparse_matrix(temporary);
+
+    return result;
+}
+
+double matrix_density(Matrix *m) {
+    const TypedKernels *kernels = typed_kernels(m->element_type);
+    size_t row_size = m->stride * kernels->size;
+    long count = 0;
+
+    for (int i = 0; i < m->rows; i++) {
+        char *row = (char*) m->data + i * row_size;
+
+        for (int j = 0; j < m->cols; j++) {
+            count += kernels->get(row, j) != 0;
+        }
+    }
+
+    return (double) count / ((double) m->rows * m->cols);
+}
+
+MatrixNumericResult sparse_matrix_get(SparseMatrix *s, int row, int col) {
+    MatrixNumericResult result = { 0, MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, -1 };
+
+    if (s == NULL) return result;
+
+    if (row < 1 || row > s->rows || col < 1 || col > s->cols) {
+        result.code = MATRIX_INDEX_ARGUMENT_OUT_OF_BOUNDS;
+        return result;
+    }
+
+    int major = s->format == SPARSE_MATRIX_CSR ? row - 1 : col - 1;
+    int minor = s->format == SPARSE_MATRIX_CSR ? col - 1 : row - 1;
+    long low = s->pointers[major], high = s->pointers[major + 1];
+
+    result.success = 1;
+    result.code = MATRIX_SUCCESS_CODE;
+    result.value = 0;
+
+    while (low < high) {
+        long middle = low + (high - low) / 2;
+
+        if (s->indices[middle] < minor) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < s->pointers[major + 1] && s->indices[low] == minor) result.value = s->values[low];
+
+    return result;
+}
+
+typedef struct SparseSumContext {
+    SparseMatrix *a;
+    SparseMatrix *b;
+    SparseMatrix *out;
+    double sign;
+    int fill;
+} SparseSumContext;
+
+// Merges row i of a and sign * b. The counting pass only sizes the rows.
+void _sparse_merge_rows(int begin, int end, void *context) {
+    SparseSumContext *c = context;
+    SparseMatrix *a = c->a, *b = c->b, *out = c->out;
+
+    for (int i = begin; i < end; i++) {
+        long p = a->pointers[i], p_end = a->pointers[i + 1];
+        long q = b->pointers[i], q_end = b->pointers[i + 1];
+        long r = c->fill ? out->pointers[i] : 0, count = 0;
+
+        while (p < p_end || q < q_end) {
+            int column;
+            double value;
+
+            if (q == q_end || (p < p_end && a->indices[p] < b->indices[q])) {
+                column = a->indices[p];
+                value = a->values[p++];
+            } else if (p == p_end || b->indices[q] < a->indices[p]) {
+                column = b->indices[q];
+                value = c->sign * b->values[q++];
+            } else {
+                column = a->indices[p];
+                value = a->values[p++] + c->sign * b->values[q++];
+            }
+
+            if (c->fill) {
+                out->indices[r] = column;
+                out->values[r++] = value;
+            } else {
+                count++;
+            }
+        }
+
+        if (!c->fill) out->pointers[i + 1] = count;
+    }
+}
+
+SparseMatrixResult _sparse_combine(SparseMatrix *a, SparseMatrix *b, double sign, MatrixResultCode mismatch) {
+    if (a == NULL || b == NULL) return _sparse_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (a->rows != b->rows || a->cols != b->cols) return _sparse_result(mismatch, NULL);
+
+    MatrixResultCode code = MATRIX_SUCCESS_CODE;
+    SparseMatrix *a_temporary, *b_temporary = NULL;
+    SparseMatrix *a_csr = _sparse_as_csr(a, &a_temporary, &code);
+    SparseMatrix *b_csr = a_csr == NULL ? NULL : _sparse_as_csr(b, &b_temporary, &code);
+    SparseMatrixResult result = _sparse_result(code, NULL);
+
+    if (b_csr != NULL) {
+        result = new_sparse_matrix(a->rows, a->cols, SPARSE_MATRIX_CSR, a_csr->nonzeros + b_csr->nonzeros);
+    }
+
+    if (result.success) {
+        SparseSumContext context = { a_csr, b_csr, result.value, sign, 0 };
+        int grain = _sparse_grain(a_csr, 2);
+
+        thread_pool_parallel_for(0, a->rows, grain, _sparse_merge_rows, &context);
+        result.value->nonzeros = _sparse_prefix_sum(result.value->pointers, a->rows);
+
+        context.fill = 1;
+        thread_pool_parallel_for(0, a->rows, grain, _sparse_merge_rows, &context);
+    }
+
+    if (a_temporary != NULL) delete_sparse_matrix(a_temporary);
+    if (b_temporary != NULL) delete_sparse_matrix(b_temporary);
+
+    return result;
+}
+
+SparseMatrixResult sparse_matrix_sum(SparseMatrix *a, SparseMatrix *b) {
+    return _sparse_combine(a, b, 1, MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM);
+}
+
+SparseMatrixResult sparse_matrix_subtract(SparseMatrix *a, SparseMatrix *b) {
+    return _sparse_combine(a, b, -1, MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT);
+}
+
+typedef struct SparseDenseSumContext {
+    const MatrixKernels *kernels;
+    SparseMatrix *sparse;
+    double sparse_sign;
+    Matrix *dense;
+    double dense_sign;
+    Matrix *out;
+} SparseDenseSumContext;
+
+void _sparse_dense_sum_rows(int begin, int end, void *context) {
+    SparseDenseSumContext *c = context;
+
+    for (int i = begin; i < end; i++) {
+        double *row = _sparse_dense_row(c->out, i);
+
+        c->kernels->scale(row, _sparse_dense_row(c->dense, i), c->dense_sign, c->out->cols);
+
+        for (long p = c->sparse->pointers[i]; p < c->sparse->pointers[i + 1]; p++) {
+            row[c->sparse->indices[p]] += c->sparse_sign * c->sparse->values[p];
+        }
+    }
+}
+
+MatrixResult _sparse_dense_combine(
+    SparseMatrix *sparse, double sparse_sign,
+    Matrix *dense, double dense_sign,
+    MatrixResultCode mismatch
+) {
+    if (sparse == NULL || dense == NULL) return _sparse_dense_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (sparse->rows != dense->rows || sparse->cols != dense->cols) return _sparse_dense_result(mismatch, NULL);
+    if (dense->element_type != MATRIX_FLOAT64) return _sparse_dense_result(MATRIX_ELEMENT_TYPES_MUST_MATCH, NULL);
+
+    MatrixResultCode code = MATRIX_SUCCESS_CODE;
+    SparseMatrix *temporary;
+    SparseMatrix *csr = _sparse_as_csr(sparse, &temporary, &code);
+
+    if (csr == NULL) return _sparse_dense_result(code, NULL);
+
+    MatrixResult result = new_matrix(dense->rows, dense->cols);
+
+    if (result.success) {
+        SparseDenseSumContext context = { simd_kernels(), csr, sparse_sign, dense, dense_sign, result.value };
+        int grain = thread_pool_grain(dense->cols, SPARSE_PARALLEL_MIN_WORK);
+
+        thread_pool_parallel_for(0, dense->rows, grain, _sparse_dense_sum_rows, &context);
+    }
+
+    if (temporary != NULL) delete_sparse_matrix(temporary);
+
+    return result;
+}
+
+MatrixResult sparse_matrix_sum_dense(SparseMatrix *a, Matrix *b) {
+    return _sparse_dense_combine(a, 1, b, 1, MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM);
+}
+
+MatrixResult sparse_matrix_subtract_dense(SparseMatrix *a, Matrix *b) {
+    return _sparse_dense_combine(a, 1, b, -1, MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT);
+}
+
+MatrixResult dense_matrix_subtract_sparse(Matrix *a, SparseMatrix *b) {
+    return _sparse_dense_combine(b, -1, a, 1, MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT);
+}
+
+typedef struct SparseProductContext {
+    const MatrixKernels *kernels;
+    SparseMatrix *sparse;
+    Matrix *dense;
+    Matrix *out;
+} SparseProductContext;
+
+// Row i of the result is the combination of the rows of b picked by the
+// entries of row i of a.
+void _sparse_times_dense_rows(int begin, int end, void *context) {
+    SparseProductContext *c = context;
+    SparseMatrix *a = c->sparse;
+
+    for (int i = begin; i < end; i++) {
+        double *row = _sparse_dense_row(c->out, i);
+
+        if (c->out->cols == 1) {
+            double sum = 0;
+
+            for (long p = a->pointers[i]; p < a->pointers[i + 1]; p++) {
+                sum += a->values[p] * _sparse_dense_row(c->dense, a->indices[p])[0];
+            }
+
+            row[0] = sum;
+            continue;
+        }
+
+        for (long p = a->pointers[i]; p < a->pointers[i + 1]; p++) {
+            c->kernels->axpy(row, a->values[p], _sparse_dense_row(c->dense, a->indices[p]), c->out->cols);
+        }
+    }
+}
+
+MatrixResult sparse_matrix_multiply_dense(SparseMatrix *a, Matrix *b) {
+    if (a == NULL || b == NULL) return _sparse_dense_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (a->cols != b->rows) return _sparse_dense_result(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY, NULL);
+    if (b->element_type != MATRIX_FLOAT64) return _sparse_dense_result(MATRIX_ELEMENT_TYPES_MUST_MATCH, NULL);
+
+    MatrixResultCode code = MATRIX_SUCCESS_CODE;
+    SparseMatrix *temporary;
+    SparseMatrix *csr = _sparse_as_csr(a, &temporary, &code);
+
+    if (csr == NULL) return _sparse_dense_result(code, NULL);
+
+    MatrixResult result = new_matrix(a->rows, b->cols);
+
+    if (result.success) {
+        SparseProductContext context = { simd_kernels(), csr, b, result.value };
+        thread_pool_parallel_for(0, a->rows, _sparse_grain(csr, b->cols), _sparse_times_dense_rows, &context);
+    }
+
+    if (temporary != NULL) delete_sparse_matrix(temporary);
+
+    return result;
+}
+
+// Row i of the result is the combination of the rows of b picked by the
+// nonzero elements of row i of a.
+void _dense_times_sparse_rows(int begin, int end, void *context) {
+    SparseProductContext *c = context;
+    SparseMatrix *b = c->sparse;
+
+    for (int i = begin; i < end; i++) {
+        double *a_row = _sparse_dense_row(c->dense, i);
+        double *row = _sparse_dense_row(c->out, i);
+
+        for (int k = 0; k < c->dense->cols; k++) {
+            if (a_row[k] == 0) continue;
+
+            for (long p = b->pointers[k]; p < b->pointers[k + 1]; p++) {
+                row[b->indices[p]] += a_row[k] * b->values[p];
+            }
+        }
+    }
+}
+
+MatrixResult dense_matrix_multiply_sparse(Matrix *a, SparseMatrix *b) {
+    if (a == NULL || b == NULL) return _sparse_dense_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (a->cols != b->rows) return _sparse_dense_result(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY, NULL);
+    if (a->element_type != MATRIX_FLOAT64) return _sparse_dense_result(MATRIX_ELEMENT_TYPES_MUST_MATCH, NULL);
+
+    MatrixResultCode code = MATRIX_SUCCESS_CODE;
+    SparseMatrix *temporary;
+    SparseMatrix *csr = _sparse_as_csr(b, &temporary, &code);
+
+    if (csr == NULL) return _sparse_dense_result(code, NULL);
+
+    MatrixResult result = new_matrix(a->rows, b->cols);
+
+    if (result.success) {
+        SparseProductContext context = { simd_kernels(), csr, a, result.value };
+        long work = a->cols + csr->nonzeros;
+        thread_pool_parallel_for(0, a->rows, thread_pool_grain(work, SPARSE_PARALLEL_MIN_WORK), _dense_times_sparse_rows, &context);
+    }
+
+    if (temporary != NULL) delete_sparse_matrix(temporary);
+
+    return result;
+}
+
+// Per-thread scratch of Gustavson's algorithm, each cols entries long:
+// the last row that touched a column, its running sum, and the columns
+// touched by the current row.
+typedef struct SparseGemmContext {
+    SparseMatrix *a;
+    SparseMatrix *b;
+    SparseMatrix *out;
+    int *markers;
+    double *sums;
+    int *columns;
+    int fill;
+} SparseGemmContext;
+
+void _sparse_gemm_rows(int begin, int end, void *context) {
+    SparseGemmContext *c = context;
+    SparseMatrix *a = c->a, *b = c->b, *out = c->out;
+    size_t offset = (size_t) thread_pool_thread_index() * b->cols;
+    int *markers = c->markers + offset;
+    double *sums = c->sums + offset;
+    int *columns = c->columns + offset;
+
+    for (int i = begin; i < end; i++) {
+        long count = 0;
+
+        for (long p = a->pointers[i]; p < a->pointers[i + 1]; p++) {
+            int k = a->indices[p];
+
+            for (long q = b->pointers[k]; q < b->pointers[k + 1]; q++) {
+                int j = b->indices[q];
+
+                if (markers[j] != i) {
+                    markers[j] = i;
+                    columns[count++] = j;
+                    sums[j] = 0;
+                }
+
+                if (c->fill) sums[j] += a->values[p] * b->values[q];
+            }
+        }
+
+        if (!c->fill) {
+            out->pointers[i + 1] = count;
+            continue;
+        }
+
+        qsort(columns, count, sizeof(int), _sparse_compare_ints);
+
+        long r = out->pointers[i];
+
+        for (long t = 0; t < count; t++) {
+            out->indices[r + t] = columns[t];
+            out->values[r + t] = sums[columns[t]];
+        }
+    }
+}
+
+SparseMatrixResult sparse_matrix_multiply(SparseMatrix *a, SparseMatrix *b) {
+    if (a == NULL || b == NULL) return _sparse_result(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL, NULL);
+    if (a->cols != b->rows) return _sparse_result(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY, NULL);
+
+    MatrixResultCode code = MATRIX_SUCCESS_CODE;
+    SparseMatrix *a_temporary, *b_temporary = NULL;
+    SparseMatrix *a_csr = _sparse_as_csr(a, &a_temporary, &code);
+    SparseMatrix *b_csr = a_csr == NULL ? NULL : _sparse_as_csr(b, &b_temporary, &code);
+    SparseMatrixResult result = _sparse_result(code, NULL);
+
+    size_t scratch = (size_t) thread_pool_size() * b->cols;
+    MatrixAllocator *allocator = matrix_current_allocator();
+    int *markers = matrix_allocate_scratch(allocator, scratch * sizeof(int));
+    double *sums = matrix_allocate_scratch(allocator, scratch * sizeof(double));
+    int *columns = matrix_allocate_scratch(allocator, scratch * sizeof(int));
+
+    if (b_csr != NULL && (markers == NULL || sums == NULL || columns == NULL)) {
+        result = _sparse_result(MATRIX_INTERNAL_ERROR, NULL);
+    } else if (b_csr != NULL) {
+        result = new_sparse_matrix(a->rows, b->cols, SPARSE_MATRIX_CSR, 0);
+    }
+
+    if (result.success) {
+        SparseMatrix *out = result.value;
+        SparseGemmContext context = { a_csr, b_csr, out, markers, sums, columns, 0 };
+        long per_entry = b_csr->nonzeros / b->rows + 1;
+        int grain = _sparse_grain(a_csr, per_entry);
+
+        memset(markers, 0xff, scratch * sizeof(int));
+        thread_pool_parallel_for(0, a->rows, grain, _sparse_gemm_rows, &context);
+
+        out->nonzeros = _sparse_prefix_sum(out->pointers, a->rows);
+
+        int *indices = realloc(out->indices, (out->nonzeros > 0 ? out->nonzeros : 1) * sizeof(int));
+        if (indices != NULL) out->indices = indices;
+
+        double *values = realloc(out->values, (out->nonzeros > 0 ? out->nonzeros : 1) * sizeof(double));
+        if (values != NULL) out->values = values;
+
+        if (indices == NULL || values == NULL) {
+            delete_sparse_matrix(out);
+            result = _sparse_result(MATRIX_INTERNAL_ERROR, NULL);
+        } else {
+            context.fill = 1;
+            memset(markers, 0xff, scratch * sizeof(int));
+            thread_pool_parallel_for(0, a->rows, grain, _sparse_gemm_rows, &context);
+        }
+    }
+
+    matrix_release(allocator, columns, scratch * sizeof(int));
+    matrix_release(allocator, sums, scratch * sizeof(double));
+    matrix_release(allocator, markers, scratch * sizeof(int));
+
+    if (a_temporary != NULL) delete_sparse_matrix(a_temporary);
+    if (b_temporary != NULL) delete_sparse_matrix(b_temporary);
+
+    return result;
+}
@@ -0,0 +1,88 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include "matrix.h"
+
+// Inputs with at most this fraction of nonzero elements are worth keeping
+// in compressed form.
+#define SPARSE_MATRIX_DENSITY_THRESHOLD 0.05
+
+typedef enum SparseMatrixFormat {
+    SPARSE_MATRIX_CSR,
+    SPARSE_MATRIX_CSC
+} SparseMatrixFormat;
+
+// Compressed sparse rows (or columns): the entries of row i (column i for
+// CSC) are values[pointers[i] .. pointers[i + 1]), at the columns (rows)
+// given by indices, sorted and without repetition. Indices are 0-based.
+// Values are float64, and so must be the dense operands mixed with them.
+typedef struct SparseMatrix {
+    int rows;
+    int cols;
+    SparseMatrixFormat format;
+    long nonzeros;
+    long *pointers;
+    int *indices;
+    double *values;
+} SparseMatrix;
+
+typedef struct SparseMatrixResult {
+    int success;
+    MatrixResultCode code;
+    SparseMatrix *value;
+} SparseMatrixResult;
+
+// Allocates room for the given number of entries; pointers are zeroed.
+SparseMatrixResult new_sparse_matrix(int rows, int cols, SparseMatrixFormat format, long nonzeros);
+
+// Builds a CSR matrix from unordered 0-based (row, col, value) triplets;
+// repeated positions are added together.
+SparseMatrixResult new_sparse_matrix_from_triplets(
+    int rows, int cols, long count,
+    const int *row_indices, const int *col_indices, const double *values
+);
+
+SparseMatrixResult sparse_matrix_from_dense(Matrix *m, SparseMatrixFormat format);
+
+MatrixResult sparse_matrix_to_dense(SparseMatrix *s);
+
+// Copies s into the given format (CSR <-> CSC is a transpose of the index
+// structure).
+SparseMatrixResult sparse_matrix_convert(SparseMatrix *s, SparseMatrixFormat format);
+
+// Fraction of elements of m that are not zero.
+double matrix_density(Matrix *m);
+
+// 1-based, like matrix_get.
+MatrixNumericResult sparse_matrix_get(SparseMatrix *s, int row, int col);
+
+// Sparse results keep every position present in an operand, so entries
+// that cancel out are stored as explicit zeros. Operands may be in either
+// format; results are CSR.
+SparseMatrixResult sparse_matrix_sum(SparseMatrix *a, SparseMatrix *b);
+
+SparseMatrixResult sparse_matrix_subtract(SparseMatrix *a, SparseMatrix *b);
+
+// a + b
+MatrixResult sparse_matrix_sum_dense(SparseMatrix *a, Matrix *b);
+
+// a - b
+MatrixResult sparse_matrix_subtract_dense(SparseMatrix *a, Matrix *b);
+
+// a - b
+MatrixResult dense_matrix_subtract_sparse(Matrix *a, SparseMatrix *b);
+
+// Sparse times dense (SpMM; a single column b is a sparse matrix-vector
+// product), in parallel over the rows of a.
+MatrixResult sparse_matrix_multiply_dense(SparseMatrix *a, Matrix *b);
+
+MatrixResult dense_matrix_multiply_sparse(Matrix *a, SparseMatrix *b);
+
+// Sparse times sparse by Gustavson's row-by-row algorithm: a symbolic pass
+// sizes every row of the result, a numeric pass fills them, both in
+// parallel over the rows of a.
+SparseMatrixResult sparse_matrix_multiply(SparseMatrix *a, SparseMatrix *b);
+
+void delete_sparse_matrix(SparseMatrix *s);
+
+#endif // SPARSE_MATRIX_H
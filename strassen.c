@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+#include "strassen.h"
+#include "gemm.h"
+#include "matrix.h"
+#include "simd.h"
+#include "thread-pool.h"
+
+#define STRASSEN_DOUBLES_PER_ALIGNMENT (MATRIX_ALIGNMENT / sizeof(double))
+
+// Against the packed gemm one level of recursion only starts to pay off
+// for products of about this order.
+#define STRASSEN_DEFAULT_CROSSOVER 2048
+
+int strassen_requested_crossover = 0;
+
+int _strassen_min(int a, int b) {
+    return a < b ? a : b;
+}
+
+int _strassen_padded(int cols) {
+    return (cols + STRASSEN_DOUBLES_PER_ALIGNMENT - 1) / STRASSEN_DOUBLES_PER_ALIGNMENT * STRASSEN_DOUBLES_PER_ALIGNMENT;
+}
+
+int _strassen_splits(int m, int n, int k, int crossover) {
+    return _strassen_min(m, _strassen_min(n, k)) >= (crossover < 2 ? 2 : crossover);
+}
+
+// Doubles of workspace needed below one level: X (m/2 x max(k/2, n/2)) and
+// Y (k/2 x n/2) for this level, plus whatever the next level needs. The
+// seven half-size products run one after the other, so they share it.
+size_t _strassen_workspace_size(int m, int n, int k, int crossover) {
+    size_t size = 0;
+
+    while (_strassen_splits(m, n, k, crossover)) {
+        m /= 2;
+        n /= 2;
+        k /= 2;
+        size += (size_t) m * _strassen_padded(k > n ? k : n) + (size_t) k * _strassen_padded(n);
+    }
+
+    return size;
+}
+
+typedef struct StrassenCombineContext {
+    const MatrixKernels *kernels;
+    int subtract;
+    int cols;
+    double *dst;
+    int ldd;
+    const double *a;
+    int lda;
+    const double *b;
+    int ldb;
+} StrassenCombineContext;
+
+void _strassen_combine_rows(int begin, int end, void *context) {
+    StrassenCombineContext *c = context;
+
+    for (int i = begin; i < end; i++) {
+        double *dst = c->dst + (size_t) i * c->ldd;
+        const double *a = c->a + (size_t) i * c->lda;
+        const double *b = c->b + (size_t) i * c->ldb;
+
+        if (c->subtract) {
+            c->kernels->subtract(dst, a, b, c->cols);
+        } else {
+            c->kernels->add(dst, a, b, c->cols);
+        }
+    }
+}
+
+// dst = a + b, or a - b when subtract is set, over a rows x cols block.
+void _strassen_combine(
+    int subtract, int rows, int cols,
+    double *dst, int ldd,
+    const double *a, int lda,
+    const double *b, int ldb
+) {
+    StrassenCombineContext context = { simd_kernels(), subtract, cols, dst, ldd, a, lda, b, ldb };
+
+    thread_pool_parallel_for(0, rows, thread_pool_grain(cols, 1 << 16), _strassen_combine_rows, &context);
+}
+
+// C = A * B on the classical kernel.
+int _strassen_leaf(int m, int n, int k, const double *a, int lda, const double *b, int ldb, double *c, int ldc) {
+    for (int i = 0; i < m; i++) {
+        memset(c + (size_t) i * ldc, 0, n * sizeof(double));
+    }
+
+    return gemm(m, n, k, 1, a, lda, b, ldb, c, ldc);
+}
+
+int _strassen_multiply(
+    int m, int n, int k,
+    const double *a, int lda,
+    const double *b, int ldb,
+    double *c, int ldc,
+    double *workspace, int crossover
+) {
+    if (!_strassen_splits(m, n, k, crossover)) {
+        return _strassen_leaf(m, n, k, a, lda, b, ldb, c, ldc);
+    }
+
+    int hm = m / 2, hn = n / 2, hk = k / 2;
+
+    const double *a11 = a, *a12 = a + hk;
+    const double *a21 = a + (size_t) hm * lda, *a22 = a21 + hk;
+    const double *b11 = b, *b12 = b + hn;
+    const double *b21 = b + (size_t) hk * ldb, *b22 = b21 + hn;
+    double *c11 = c, *c12 = c + hn;
+    double *c21 = c + (size_t) hm * ldc, *c22 = c21 + hn;
+
+    int ldx = _strassen_padded(hk > hn ? hk : hn), ldy = _strassen_padded(hn);
+    double *x = workspace;
+    double *y = x + (size_t) hm * ldx;
+    double *next = y + (size_t) hk * ldy;
+
+    // Schedule with two temporaries from Boyer, Dumas, Pernet and Zhou,
+    // "Memory efficient scheduling of Strassen-Winograd's matrix
+    // multiplication algorithm"; the quadrants of C hold the other
+    // intermediate products.
+    _strassen_combine(1, hm, hk, x, ldx, a11, lda, a21, lda);            // S3 = A11 - A21
+    _strassen_combine(1, hk, hn, y, ldy, b22, ldb, b12, ldb);            // T3 = B22 - B12
+    if (!_strassen_multiply(hm, hn, hk, x, ldx, y, ldy, c21, ldc, next, crossover)) return 0;  // P7 = S3 T3
+
+    _strassen_combine(0, hm, hk, x, ldx, a21, lda, a22, lda);            // S1 = A21 + A22
+    _strassen_combine(1, hk, hn, y, ldy, b12, ldb, b11, ldb);            // T1 = B12 - B11
+    if (!_strassen_multiply(hm, hn, hk, x, ldx, y, ldy, c22, ldc, next, crossover)) return 0;  // P5 = S1 T1
+
+    _strassen_combine(1, hm, hk, x, ldx, x, ldx, a11, lda);              // S2 = S1 - A11
+    _strassen_combine(1, hk, hn, y, ldy, b22, ldb, y, ldy);              // T2 = B22 - T1
+    if (!_strassen_multiply(hm, hn, hk, x, ldx, y, ldy, c12, ldc, next, crossover)) return 0;  // P6 = S2 T2
+
+    _strassen_combine(1, hm, hk, x, ldx, a12, lda, x, ldx);              // S4 = A12 - S2
+    if (!_strassen_multiply(hm, hn, hk, x, ldx, b22, ldb, c11, ldc, next, crossover)) return 0; // P3 = S4 B22
+
+    if (!_strassen_multiply(hm, hn, hk, a11, lda, b11, ldb, x, ldx, next, crossover)) return 0; // P1 = A11 B11
+
+    _strassen_combine(0, hm, hn, c12, ldc, x, ldx, c12, ldc);            // U2 = P1 + P6
+    _strassen_combine(0, hm, hn, c21, ldc, c12, ldc, c21, ldc);          // U3 = U2 + P7
+    _strassen_combine(0, hm, hn, c12, ldc, c12, ldc, c22, ldc);          // U4 = U2 + P5
+    _strassen_combine(0, hm, hn, c22, ldc, c21, ldc, c22, ldc);          // C22 = U3 + P5
+    _strassen_combine(0, hm, hn, c12, ldc, c12, ldc, c11, ldc);          // C12 = U4 + P3
+
+    _strassen_combine(1, hk, hn, y, ldy, y, ldy, b21, ldb);              // T4 = T2 - B21
+    if (!_strassen_multiply(hm, hn, hk, a22, lda, y, ldy, c11, ldc, next, crossover)) return 0; // P4 = A22 T4
+    _strassen_combine(1, hm, hn, c21, ldc, c21, ldc, c11, ldc);          // C21 = U3 - P4
+
+    if (!_strassen_multiply(hm, hn, hk, a12, lda, b21, ldb, c11, ldc, next, crossover)) return 0; // P2 = A12 B21
+    _strassen_combine(0, hm, hn, c11, ldc, x, ldx, c11, ldc);            // C11 = P1 + P2
+
+    // Peel odd dimensions: the even part is done, so add the last column
+    // of A times the last row of B to it, then fill the last column and
+    // the last row of C classically.
+    int em = hm * 2, en = hn * 2, ek = hk * 2;
+
+    if (ek < k && !gemm(em, en, 1, 1, a + ek, lda, b + (size_t) ek * ldb, ldb, c, ldc)) return 0;
+    if (en < n && !_strassen_leaf(em, 1, k, a, lda, b + en, ldb, c + en, ldc)) return 0;
+    if (em < m && !_strassen_leaf(1, n, k, a + (size_t) em * lda, lda, b, ldb, c + (size_t) em * ldc, ldc)) return 0;
+
+    return 1;
+}
+
+int _strassen_run(
+    int m, int n, int k,
+    const double *a, int lda,
+    const double *b, int ldb,
+    double *c, int ldc,
+    int crossover
+) {
+    size_t size = _strassen_workspace_size(m, n, k, crossover) * sizeof(double);
+    MatrixAllocator *allocator = matrix_current_allocator();
+    void *workspace = size > 0 ? matrix_allocate_scratch(allocator, size) : NULL;
+
+    if (size > 0 && workspace == NULL) return 0;
+
+    int done = _strassen_multiply(m, n, k, a, lda, b, ldb, c, ldc, workspace, crossover);
+
+    matrix_release(allocator, workspace, size);
+
+    return done;
+}
+
+int strassen_crossover() {
+    const char *configured = getenv("MATRIX_STRASSEN_CROSSOVER");
+
+    if (strassen_requested_crossover > 0) return strassen_requested_crossover;
+    if (configured != NULL && atoi(configured) > 0) return atoi(configured);
+
+    return STRASSEN_DEFAULT_CROSSOVER;
+}
+
+void strassen_set_crossover(int crossover) {
+    strassen_requested_crossover = crossover > 0 ? crossover : 0;
+}
+
+int strassen_levels(int m, int n, int k) {
+    int crossover = strassen_crossover();
+    int levels = 0;
+
+    while (_strassen_splits(m, n, k, crossover)) {
+        m /= 2;
+        n /= 2;
+        k /= 2;
+        levels++;
+    }
+
+    return levels;
+}
+
+int strassen_gemm(
+    int m, int n, int k,
+    const double *a, int lda,
+    const double *b, int ldb,
+    double *c, int ldc
+) {
+    if (m <= 0 || n <= 0) return 1;
+
+    return _strassen_run(m, n, k, a, lda, b, ldb, c, ldc, strassen_crossover());
+}
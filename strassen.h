@@ -0,0 +1,35 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+// Row-major C = A * B by Strassen-Winograd (7 half-size products and 15
+// additions per level), recursing while every dimension is at least the
+// crossover and finishing with gemm. Odd dimensions are peeled off and
+// fixed up with gemm. All temporaries come from one workspace allocated
+// up front. Returns 0 if the workspace could not be allocated.
+//
+// Error: with l levels of recursion above leaves of order n0, the result
+// satisfies (Higham, Accuracy and Stability of Numerical Algorithms, 23.2)
+//     max|C - fl(C)| <= (18^l (n0^2 + 6 n0) - 6 n) u max|A| max|B|
+// to first order, where u = 2^-53 and n is the inner dimension. This is a
+// normwise bound: small entries of C can lose more relative accuracy than
+// with classical GEMM, whose error is bounded entry by entry by
+// n u (|A| |B|).
+int strassen_gemm(
+    int m, int n, int k,
+    const double *a, int lda,
+    const double *b, int ldb,
+    double *c, int ldc
+);
+
+// Smallest dimension at which strassen_gemm still splits: the one set by
+// strassen_set_crossover, else MATRIX_STRASSEN_CROSSOVER when set, else a
+// fixed default of 2048.
+int strassen_crossover();
+
+// Overrides the crossover; 0 restores the default.
+void strassen_set_crossover(int crossover);
+
+// Number of recursion levels strassen_gemm uses for an m x k by k x n product.
+int strassen_levels(int m, int n, int k);
+
+#endif // STRASSEN_H
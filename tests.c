@@ -1,6 +1,24 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "matrix.h"
+#include "matrix-batch.h"
+#include "matrix-cache.h"
+#include "matrix-fixed.h"
+#include "matrix-format.h"
+#include "matrix-io.h"
+#include "matrix-expression.h"
+#include "matrix-ooc.h"
+#include "matrix-server.h"
+#include "matrix-stats.h"
+#include "simd.h"
+#include "sparse-matrix.h"
+#include "strassen.h"
+#include "thread-pool.h"
 #include <assert.h>
+#include <unistd.h>
 
 void test_new_matrix() {
     Matrix *m = new_matrix(3, 3).value;
@@ -11,6 +29,29 @@ void test_new_matrix() {
     delete_matrix(m);
 }
 
+void test_new_matrix_storage() {
+    int sizes[2][2] = { {3, 5}, {600, 300} };
+
+    for (int s = 0; s < 2; s++) {
+        Matrix *m = new_matrix(sizes[s][0], sizes[s][1]).value;
+
+        assert(0 == (uintptr_t) m->values % MATRIX_ALIGNMENT);
+        assert(m->stride >= m->cols);
+        assert(0 == m->stride * sizeof(double) % MATRIX_ALIGNMENT);
+
+        for (int i = 1; i <= m->rows; i++) {
+            for (int j = 1; j <= m->cols; j++) {
+                assert(0 == matrix_get(m, i, j).value);
+            }
+        }
+
+        matrix_set(m, m->rows, m->cols, 7);
+        assert(7 == matrix_get(m, m->rows, m->cols).value);
+
+        delete_matrix(m);
+    }
+}
+
 void test_matrix_get_and_set() {
     Matrix *m = new_matrix(2, 2).value;
 
@@ -85,6 +126,61 @@ void test_transpose_matrix() {
     delete_matrix(expected);
 }
 
+void test_transpose_matrix_blocked() {
+    Matrix *m = new_matrix(83, 45).value;
+
+    for (int i = 1; i <= 83; i++) {
+        for (int j = 1; j <= 45; j++) {
+            matrix_set(m, i, j, i * 100 + j);
+        }
+    }
+
+    Matrix *t = matrix_transpose(m).value;
+
+    assert(45 == t->rows);
+    assert(83 == t->cols);
+
+    for (int i = 1; i <= 83; i++) {
+        for (int j = 1; j <= 45; j++) {
+            assert(matrix_get(m, i, j).value == matrix_get(t, j, i).value);
+        }
+    }
+
+    delete_matrix(m);
+    delete_matrix(t);
+}
+
+void test_transpose_matrix_in_place() {
+    int shapes[][2] = { { 70, 70 }, { 5, 5 }, { 13, 29 }, { 100, 67 }, { 1, 40 }, { 40, 1 } };
+
+    for (int s = 0; s < 6; s++) {
+        int rows = shapes[s][0], cols = shapes[s][1];
+        Matrix *m = new_matrix(rows, cols).value;
+
+        for (int i = 1; i <= rows; i++) {
+            for (int j = 1; j <= cols; j++) {
+                matrix_set(m, i, j, i * 1000 + j);
+            }
+        }
+
+        Matrix *expected = matrix_transpose(m).value;
+
+        assert(1 == matrix_transpose_in_place(m).success);
+        assert(cols == m->rows);
+        assert(rows == m->cols);
+        assert(1 == matrix_equals(expected, m));
+
+        for (int i = 0; i < m->rows; i++) {
+            for (int j = m->cols; j < m->stride; j++) {
+                assert(0 == m->values[(size_t) i * m->stride + j]);
+            }
+        }
+
+        delete_matrix(expected);
+        delete_matrix(m);
+    }
+}
+
 void test_matrix_sum() {
     double a_values[3][2] = { 
         {1, 2}, 
@@ -147,6 +243,84 @@ void test_matrix_subtract() {
     delete_matrix(expected);
 }
 
+void test_matrix_destination_passing() {
+    double a_values[2][3] = {
+        {1, 2, 3},
+        {4, 5, 6}
+    };
+    double b_values[2][3] = {
+        {6, 5, 4},
+        {3, 2, 1}
+    };
+    Matrix *a = new_matrix_with_values(2, 3, a_values).value;
+    Matrix *b = new_matrix_with_values(2, 3, b_values).value;
+    Matrix *dst = new_matrix(2, 3).value;
+    Matrix *wrong = new_matrix(3, 3).value;
+
+    MatrixResult result = matrix_sum_into(dst, a, b);
+    assert(1 == result.success);
+    assert(dst == result.value);
+    assert(7 == matrix_get(dst, 2, 3).value);
+
+    assert(MATRIX_INVALID_DESTINATION_DIMENSIONS == matrix_sum_into(wrong, a, b).code);
+    assert(MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUBTRACT == matrix_subtract_into(dst, a, wrong).code);
+
+    matrix_subtract_into(dst, a, b);
+    assert(-5 == matrix_get(dst, 1, 1).value);
+
+    Matrix *t = new_matrix(3, 2).value;
+    assert(1 == matrix_transpose_into(t, a).success);
+    assert(6 == matrix_get(t, 3, 2).value);
+
+    Matrix *product = new_matrix(2, 2).value;
+    matrix_set(product, 1, 1, 99);
+    assert(1 == matrix_multiply_into(product, a, t).success);
+    assert(14 == matrix_get(product, 1, 1).value);
+    assert(77 == matrix_get(product, 2, 2).value);
+    assert(MATRIX_DESTINATION_OVERLAPS_ARGUMENTS == matrix_multiply_into(a, a, wrong).code);
+
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(dst);
+    delete_matrix(wrong);
+    delete_matrix(t);
+    delete_matrix(product);
+}
+
+void test_matrix_in_place_operations() {
+    double a_values[2][2] = {
+        {1, 2},
+        {3, 4}
+    };
+    double b_values[2][2] = {
+        {10, 20},
+        {30, 40}
+    };
+    double expected_values[2][2] = {
+        {7, 14},
+        {21, 28}
+    };
+    Matrix *a = new_matrix_with_values(2, 2, a_values).value;
+    Matrix *b = new_matrix_with_values(2, 2, b_values).value;
+    Matrix *expected = new_matrix_with_values(2, 2, expected_values).value;
+
+    assert(1 == matrix_add_in_place(a, b).success);
+    assert(11 == matrix_get(a, 1, 1).value);
+
+    assert(1 == matrix_subtract_in_place(a, b).success);
+    assert(1 == matrix_get(a, 1, 1).value);
+
+    assert(1 == matrix_scale(a, 2).success);
+    assert(8 == matrix_get(a, 2, 2).value);
+
+    assert(1 == matrix_axpy(a, 0.5, b).success);
+    assert(1 == matrix_equals(expected, a));
+
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(expected);
+}
+
 void test_matrix_multiply_1() {
     double a_values[2][3] = { 
         {1, 2, 3}, 
@@ -202,6 +376,1396 @@ void test_matrix_multiply_2() {
     delete_matrix(result);
 }
 
+void test_matrix_multiply_blocked() {
+    int m = 131, k = 290, n = 103;
+
+    Matrix *a = new_matrix(m, k).value;
+    Matrix *b = new_matrix(k, n).value;
+
+    for (int i = 1; i <= m; i++) {
+        for (int j = 1; j <= k; j++) {
+            matrix_set(a, i, j, (i * 7 + j * 3) % 11 - 5);
+        }
+    }
+
+    for (int i = 1; i <= k; i++) {
+        for (int j = 1; j <= n; j++) {
+            matrix_set(b, i, j, (i * 5 + j * 13) % 9 - 4);
+        }
+    }
+
+    Matrix *result = matrix_multiply(a, b).value;
+
+    assert(m == result->rows);
+    assert(n == result->cols);
+
+    for (int i = 1; i <= m; i++) {
+        for (int j = 1; j <= n; j++) {
+            double expected = 0;
+
+            for (int p = 1; p <= k; p++) {
+                expected += matrix_get(a, i, p).value * matrix_get(b, p, j).value;
+            }
+
+            assert(expected == matrix_get(result, i, j).value);
+        }
+    }
+
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(result);
+}
+
+void test_strassen_multiply_matches_classical() {
+    int m = 203, k = 157, n = 181;
+    Matrix *a = new_matrix(m, k).value;
+    Matrix *b = new_matrix(k, n).value;
+
+    for (int i = 1; i <= m; i++) {
+        for (int j = 1; j <= k; j++) {
+            matrix_set(a, i, j, (i * 7 + j * 3) % 11 - 5);
+        }
+    }
+
+    for (int i = 1; i <= k; i++) {
+        for (int j = 1; j <= n; j++) {
+            matrix_set(b, i, j, (i * 5 + j * 13) % 9 - 4);
+        }
+    }
+
+    Matrix *classical = matrix_multiply(a, b).value;
+
+    strassen_set_crossover(16);
+    matrix_set_multiply_mode(MATRIX_MULTIPLY_STRASSEN);
+
+    assert(4 == strassen_levels(m, n, k));
+
+    // Small integers: every intermediate value is exact, so is the result.
+    Matrix *fast = matrix_multiply(a, b).value;
+
+    assert(1 == matrix_equals(classical, fast));
+
+    // Values in [-1, 1]: the difference stays within the Strassen-Winograd
+    // bound documented in strassen.h plus the classical k u bound.
+    srand(7);
+
+    for (int i = 1; i <= m; i++) {
+        for (int j = 1; j <= k; j++) {
+            matrix_set(a, i, j, rand() / (double) RAND_MAX * 2 - 1);
+        }
+    }
+
+    for (int i = 1; i <= k; i++) {
+        for (int j = 1; j <= n; j++) {
+            matrix_set(b, i, j, rand() / (double) RAND_MAX * 2 - 1);
+        }
+    }
+
+    assert(1 == matrix_multiply_into(fast, a, b).success);
+
+    matrix_set_multiply_mode(MATRIX_MULTIPLY_CLASSICAL);
+    matrix_multiply_into(classical, a, b);
+    strassen_set_crossover(0);
+
+    int leaf = k / 16 + 1;
+    double u = ldexp(1, -53);
+    double bound = (pow(18, 4) * (leaf * leaf + 6 * leaf) - 6 * k) * u + k * u;
+    double largest = 0;
+
+    for (int i = 1; i <= m; i++) {
+        for (int j = 1; j <= n; j++) {
+            double difference = fabs(matrix_get(classical, i, j).value - matrix_get(fast, i, j).value);
+
+            assert(difference <= bound);
+            if (difference > largest) largest = difference;
+        }
+    }
+
+    assert(largest > 0);
+
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(classical);
+    delete_matrix(fast);
+}
+
+void test_simd_kernels_agree_with_scalar() {
+    const char *names[] = { "sse2", "avx2", "avx512" };
+    const MatrixKernels *scalar = simd_kernels_named("scalar");
+
+    double a[37], b[37], expected[37], actual[37];
+
+    for (int i = 0; i < 37; i++) {
+        a[i] = i * 1.5 - 7;
+        b[i] = 3 - i * 0.25;
+    }
+
+    for (int n = 0; n < 3; n++) {
+        const MatrixKernels *kernels = simd_kernels_named(names[n]);
+
+        if (kernels == NULL) continue;
+
+        scalar->add(expected, a, b, 37);
+        kernels->add(actual, a, b, 37);
+        assert(1 == scalar->equals(expected, actual, 37));
+
+        scalar->subtract(expected, a, b, 37);
+        kernels->subtract(actual, a, b, 37);
+        assert(1 == scalar->equals(expected, actual, 37));
+
+        scalar->scale(expected, a, -0.5, 37);
+        kernels->scale(actual, a, -0.5, 37);
+        assert(1 == scalar->equals(expected, actual, 37));
+
+        scalar->axpy(expected, 3, b, 37);
+        kernels->axpy(actual, 3, b, 37);
+        assert(1 == scalar->equals(expected, actual, 37));
+
+        actual[36] += 1;
+        assert(0 == kernels->equals(expected, actual, 37));
+        assert(1 == kernels->equals(expected, actual, 36));
+
+        int block = kernels->transpose_block;
+        double tile[64], transposed[64];
+
+        for (int i = 0; i < 64; i++) tile[i] = i;
+
+        kernels->transpose(tile, block, transposed, block);
+
+        for (int i = 0; i < block; i++) {
+            for (int j = 0; j < block; j++) {
+                assert(tile[i * block + j] == transposed[j * block + i]);
+            }
+        }
+
+        int mr = kernels->gemm_mr, nr = kernels->gemm_nr, k = 5;
+        double packed_a[SIMD_GEMM_MAX_MR * 5], packed_b[SIMD_GEMM_MAX_NR * 5];
+        double c[SIMD_GEMM_MAX_MR * SIMD_GEMM_MAX_NR] = { 0 };
+
+        for (int i = 0; i < mr * k; i++) packed_a[i] = i % 7 - 3;
+        for (int i = 0; i < nr * k; i++) packed_b[i] = i % 5 - 2;
+
+        kernels->gemm_kernel(k, packed_a, packed_b, c, nr, 2);
+
+        for (int i = 0; i < mr; i++) {
+            for (int j = 0; j < nr; j++) {
+                double dot = 0;
+
+                for (int p = 0; p < k; p++) {
+                    dot += packed_a[p * mr + i] * packed_b[p * nr + j];
+                }
+
+                assert(2 * dot == c[i * nr + j]);
+            }
+        }
+    }
+}
+
+void _mark_visited(int begin, int end, void *context) {
+    int *visited = context;
+
+    for (int i = begin; i < end; i++) {
+        visited[i]++;
+    }
+}
+
+void test_thread_pool_parallel_for() {
+    int visited[1000] = { 0 };
+
+    thread_pool_parallel_for(3, 1000, 7, _mark_visited, visited);
+
+    for (int i = 0; i < 1000; i++) {
+        assert((i < 3 ? 0 : 1) == visited[i]);
+    }
+
+    thread_pool_parallel_for(10, 10, 1, _mark_visited, visited);
+    assert(0 == visited[10] - 1);
+    assert(thread_pool_size() >= 1);
+}
+
+void test_binary_matrix_file_round_trip() {
+    double values[3][2] = {
+        {1.5, -2},
+        {3, 0.1},
+        {-4e10, 5}
+    };
+    Matrix *m = new_matrix_with_values(3, 2, values).value;
+    Matrix loaded;
+
+    write_matrix_to_file(m, "test-round-trip.matb");
+    assert(1 == read_matrix_from_file(&loaded, "test-round-trip.matb"));
+    unlink("test-round-trip.matb");
+
+    assert(NULL != loaded.mapping);
+    assert(0 == (uintptr_t) loaded.values % MATRIX_ALIGNMENT);
+    assert(1 == matrix_equals(m, &loaded));
+
+    matrix_set(&loaded, 1, 1, 42);
+    assert(42 == matrix_get(&loaded, 1, 1).value);
+
+    delete_matrix(m);
+}
+
+// Small integers, so that every operation on them is exact: element
+// (i, j) is (i * seed + j * 7) % modulus - modulus / 2. With a sparsity
+// above 1, only the elements where (i * seed + j * 11) % sparsity is 0 are
+// set and the rest stay zero.
+Matrix* test_operand(int rows, int cols, int seed, int modulus, int sparsity) {
+    Matrix *m = new_matrix(rows, cols).value;
+
+    for (int i = 1; i <= rows; i++) {
+        for (int j = 1; j <= cols; j++) {
+            if ((i * seed + j * 11) % sparsity == 0) matrix_set(m, i, j, (i * seed + j * 7) % modulus - modulus / 2);
+        }
+    }
+
+    return m;
+}
+
+void test_binary_matrix_file_errors() {
+    Matrix *m = test_operand(3, 2, 3, 19, 1);
+    MatrixFileHeader header;
+    Matrix loaded;
+
+    write_matrix_to_file(m, "test-corrupt.matb");
+
+    // A data offset that wraps around when the data size is added to it.
+    FILE *file = fopen("test-corrupt.matb", "r+b");
+    assert(1 == fread(&header, sizeof(header), 1, file));
+    header.data_offset = (uint64_t) 0 - 4 * MATRIX_ALIGNMENT;
+    rewind(file);
+    assert(1 == fwrite(&header, sizeof(header), 1, file));
+    fclose(file);
+
+    assert(0 == read_matrix_from_file(&loaded, "test-corrupt.matb"));
+    assert(0 == convert_matrix_file("test-corrupt.matb", "test-corrupt.mat"));
+    unlink("test-corrupt.matb");
+
+    // An endianness byte that names neither byte order.
+    uint8_t endianness_values[] = { 0, 7 };
+
+    for (int e = 0; e < 2; e++) {
+        write_matrix_to_file(m, "test-corrupt.matb");
+
+        file = fopen("test-corrupt.matb", "r+b");
+        assert(1 == fread(&header, sizeof(header), 1, file));
+        header.endianness = endianness_values[e];
+        rewind(file);
+        assert(1 == fwrite(&header, sizeof(header), 1, file));
+        fclose(file);
+
+        assert(0 == read_matrix_from_file(&loaded, "test-corrupt.matb"));
+        assert(0 == convert_matrix_file("test-corrupt.matb", "test-corrupt.mat"));
+        unlink("test-corrupt.matb");
+    }
+
+    write_matrix_to_file(m, "test-corrupt.mat");
+    assert(0 == convert_matrix_file("test-corrupt.mat", "missing-directory/test-corrupt.matb"));
+    unlink("test-corrupt.mat");
+
+    delete_matrix(m);
+}
+
+void test_typed_matrix_arithmetic_matches_float64() {
+    MatrixElementType types[] = { MATRIX_FLOAT32, MATRIX_INT32, MATRIX_INT64 };
+    Matrix *a = test_operand(37, 70, 3, 19, 1);
+    Matrix *b = test_operand(37, 70, 5, 19, 1);
+    Matrix *c = test_operand(70, 41, 2, 19, 1);
+    Matrix *expected_sum = matrix_sum(a, b).value;
+    Matrix *expected_subtract = matrix_subtract(a, b).value;
+    Matrix *expected_product = matrix_multiply(a, c).value;
+    Matrix *expected_transpose = matrix_transpose(a).value;
+
+    for (int t = 0; t < 3; t++) {
+        Matrix *typed_a = matrix_convert(a, types[t]).value;
+        Matrix *typed_b = matrix_convert(b, types[t]).value;
+        Matrix *typed_c = matrix_convert(c, types[t]).value;
+        Matrix *results[] = {
+            matrix_sum(typed_a, typed_b).value,
+            matrix_subtract(typed_a, typed_b).value,
+            matrix_multiply(typed_a, typed_c).value,
+            matrix_transpose(typed_a).value
+        };
+        Matrix *expected[] = { expected_sum, expected_subtract, expected_product, expected_transpose };
+
+        assert(0 == (uintptr_t) typed_a->data % MATRIX_ALIGNMENT);
+        assert(0 == typed_a->stride * matrix_element_size(types[t]) % MATRIX_ALIGNMENT);
+
+        for (int r = 0; r < 4; r++) {
+            Matrix *widened = matrix_convert(results[r], MATRIX_FLOAT64).value;
+
+            assert(types[t] == results[r]->element_type);
+            assert(1 == matrix_equals(expected[r], widened));
+
+            delete_matrix(widened);
+            delete_matrix(results[r]);
+        }
+
+        assert(MATRIX_ELEMENT_TYPES_MUST_MATCH == matrix_sum(typed_a, b).code);
+        assert(MATRIX_ELEMENT_TYPES_MUST_MATCH == matrix_multiply(a, typed_c).code);
+        assert(MATRIX_UNSUPPORTED_ELEMENT_TYPE == matrix_scale(typed_a, 2).code);
+
+        delete_matrix(typed_a);
+        delete_matrix(typed_b);
+        delete_matrix(typed_c);
+    }
+
+    Matrix *int32 = new_typed_matrix(1, 2, MATRIX_INT32).value;
+
+    assert(3 == matrix_set(int32, 1, 1, 2.6).value);
+    assert(-10 == matrix_set(int32, 1, 2, -10).value);
+    assert(3 == matrix_get(int32, 1, 1).value);
+
+    Matrix *huge = new_matrix(1, 1).value;
+
+    matrix_set(huge, 1, 1, 3e9);
+    assert(MATRIX_INTEGER_OVERFLOW == matrix_convert(huge, MATRIX_INT32).code);
+
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(c);
+    delete_matrix(expected_sum);
+    delete_matrix(expected_subtract);
+    delete_matrix(expected_product);
+    delete_matrix(expected_transpose);
+    delete_matrix(int32);
+    delete_matrix(huge);
+}
+
+void test_integer_determinant_bareiss() {
+    double values[4][4] = {
+        {2, -1, 0, 3},
+        {0, 0, 4, 1},
+        {-3, 5, 1, 0},
+        {1, 2, -2, 6}
+    };
+    Matrix *m = new_matrix_with_values(4, 4, values).value;
+    Matrix *int32 = matrix_convert(m, MATRIX_INT32).value;
+
+    assert(-55 == matrix_determinant_bareiss(int32).value);
+    assert(-55 == round(matrix_determinant_lu_decomposition(int32).value));
+    assert(MATRIX_UNSUPPORTED_ELEMENT_TYPE == matrix_determinant_bareiss(m).code);
+
+    // The Vandermonde determinant on 1..n is 1! 2! ... (n - 1)!: exact for
+    // n = 8, far past int64 for n = 15.
+    Matrix *vandermonde = new_typed_matrix(8, 8, MATRIX_INT64).value;
+    int64_t expected = 1;
+
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0, power = 1; j < 8; j++, power *= i + 1) {
+            vandermonde->int64_values[(size_t) i * vandermonde->stride + j] = power;
+        }
+        for (int j = 0; j < i; j++) expected *= i - j;
+    }
+
+    MatrixIntegerResult det = matrix_determinant_bareiss(vandermonde);
+
+    assert(1 == det.success);
+    assert(expected == det.value);
+
+    Matrix *large = new_typed_matrix(15, 15, MATRIX_INT64).value;
+
+    for (int i = 0; i < 15; i++) {
+        int64_t power = 1;
+        for (int j = 0; j < 15; j++, power *= i + 1) {
+            large->int64_values[(size_t) i * large->stride + j] = power;
+        }
+    }
+
+    assert(MATRIX_INTEGER_OVERFLOW == matrix_determinant_bareiss(large).code);
+
+    Matrix *singular = new_typed_matrix(3, 3, MATRIX_INT32).value;
+
+    matrix_set(singular, 1, 2, 1);
+    matrix_set(singular, 2, 3, 1);
+    assert(1 == matrix_determinant_bareiss(singular).success);
+    assert(0 == matrix_determinant_bareiss(singular).value);
+
+    delete_matrix(m);
+    delete_matrix(int32);
+    delete_matrix(vandermonde);
+    delete_matrix(large);
+    delete_matrix(singular);
+}
+
+void test_typed_matrix_file_round_trip() {
+    MatrixElementType types[] = { MATRIX_FLOAT32, MATRIX_INT32, MATRIX_INT64 };
+    Matrix *m = test_operand(5, 9, 4, 19, 1);
+
+    for (int t = 0; t < 3; t++) {
+        Matrix *typed = matrix_convert(m, types[t]).value;
+        Matrix binary, text;
+
+        write_matrix_to_file(typed, "test-round-trip.matb");
+        assert(1 == read_matrix_from_file(&binary, "test-round-trip.matb"));
+        unlink("test-round-trip.matb");
+
+        assert(types[t] == binary.element_type);
+        assert(1 == matrix_equals(typed, &binary));
+
+        write_matrix_to_file(typed, "test-round-trip.mat");
+        assert(1 == read_typed_matrix_from_file(&text, "test-round-trip.mat", types[t]));
+        unlink("test-round-trip.mat");
+
+        assert(1 == matrix_equals(typed, &text));
+
+        delete_matrix(typed);
+    }
+
+    Matrix *big = new_typed_matrix(1, 1, MATRIX_INT64).value;
+    Matrix loaded;
+
+    big->int64_values[0] = INT64_MAX - 1;
+    write_matrix_to_file(big, "test-round-trip.mat");
+    assert(1 == read_typed_matrix_from_file(&loaded, "test-round-trip.mat", MATRIX_INT64));
+    assert(INT64_MAX - 1 == loaded.int64_values[0]);
+    assert(0 == read_typed_matrix_from_file(&loaded, "test-round-trip.mat", MATRIX_INT32));
+    unlink("test-round-trip.mat");
+
+    delete_matrix(m);
+    delete_matrix(big);
+}
+
+int test_close(double expected, double actual) {
+    return fabs(expected - actual) <= 1e-9 * (1 + fabs(expected));
+}
+
+void test_matrix_batch_matches_single_matrices() {
+    int count = 1003;
+
+    for (int n = 1; n <= 5; n++) {
+        MatrixBatch *a = new_matrix_batch(count, n, n).value;
+        MatrixBatch *b = new_matrix_batch(count, n, n + 1).value;
+
+        for (int k = 0; k < count; k++) {
+            Matrix *x = test_operand(n, n, k + 2, 19, 1);
+            Matrix *y = test_operand(n, n + 1, k + 5, 19, 1);
+
+            // Make the matrices diagonally dominant, so none is singular.
+            for (int i = 1; i <= n; i++) matrix_set(x, i, i, matrix_get(x, i, i).value + 10 * n);
+
+            assert(MATRIX_SUCCESS_CODE == matrix_batch_set(a, k, x));
+            assert(MATRIX_SUCCESS_CODE == matrix_batch_set(b, k, y));
+
+            delete_matrix(x);
+            delete_matrix(y);
+        }
+
+        MatrixBatch *product = matrix_batch_multiply(a, b).value;
+        MatrixBatch *transposed = matrix_batch_transpose(b).value;
+        MatrixBatch *determinants = matrix_batch_determinant(a).value;
+        MatrixBatch *inverses = matrix_batch_inverse(a).value;
+
+        for (int k = 0; k < count; k += 97) {
+            Matrix *x = matrix_batch_get(a, k).value;
+            Matrix *y = matrix_batch_get(b, k).value;
+            Matrix *expected_product = matrix_multiply(x, y).value;
+            Matrix *expected_transpose = matrix_transpose(y).value;
+            Matrix *expected_inverse = matrix_inverse(x).value;
+            Matrix *actual_product = matrix_batch_get(product, k).value;
+            Matrix *actual_transpose = matrix_batch_get(transposed, k).value;
+
+            assert(1 == matrix_equals(expected_product, actual_product));
+            assert(1 == matrix_equals(expected_transpose, actual_transpose));
+            assert(test_close(matrix_determinant_lu_decomposition(x).value, matrix_batch_lanes(determinants, 0, 0)[k]));
+
+            for (int i = 0; i < n; i++) {
+                for (int j = 0; j < n; j++) {
+                    assert(test_close(matrix_get(expected_inverse, i + 1, j + 1).value, matrix_batch_lanes(inverses, i, j)[k]));
+                }
+            }
+
+            delete_matrix(x);
+            delete_matrix(y);
+            delete_matrix(expected_product);
+            delete_matrix(expected_transpose);
+            delete_matrix(expected_inverse);
+            delete_matrix(actual_product);
+            delete_matrix(actual_transpose);
+        }
+
+        assert(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY == matrix_batch_multiply(b, a).code);
+        assert(MATRIX_SHOULD_BE_SQUARE_TO_CALC_DETERMINANT == matrix_batch_determinant(b).code);
+
+        delete_matrix_batch(a);
+        delete_matrix_batch(b);
+        delete_matrix_batch(product);
+        delete_matrix_batch(transposed);
+        delete_matrix_batch(determinants);
+        delete_matrix_batch(inverses);
+    }
+
+    for (int n = 2; n <= 5; n++) {
+        MatrixBatch *singular = new_matrix_batch(3, n, n).value;
+        MatrixBatch *inverses = matrix_batch_inverse(singular).value;
+        MatrixBatch *determinants = matrix_batch_determinant(singular).value;
+
+        assert(isnan(matrix_batch_lanes(inverses, n - 1, 0)[2]));
+        assert(0 == matrix_batch_lanes(determinants, 0, 0)[1]);
+
+        delete_matrix_batch(singular);
+        delete_matrix_batch(inverses);
+        delete_matrix_batch(determinants);
+    }
+
+    // The work matrices of these would not fit on a thread's stack.
+    int n = 1100;
+    MatrixBatch *large = new_matrix_batch(2, n, n).value;
+
+    for (int i = 0; i < n; i++) {
+        matrix_batch_lanes(large, i, i)[0] = 1;
+        matrix_batch_lanes(large, i, i)[1] = 1;
+    }
+
+    matrix_batch_lanes(large, 0, 0)[0] = 2;
+    matrix_batch_lanes(large, 0, n - 1)[0] = 3;
+    matrix_batch_lanes(large, n - 1, 0)[1] = 4;
+
+    MatrixBatch *inverses = matrix_batch_inverse(large).value;
+    MatrixBatch *determinants = matrix_batch_determinant(large).value;
+
+    assert(inverses != NULL && determinants != NULL);
+    assert(test_close(2, matrix_batch_lanes(determinants, 0, 0)[0]));
+    assert(test_close(1, matrix_batch_lanes(determinants, 0, 0)[1]));
+    assert(test_close(0.5, matrix_batch_lanes(inverses, 0, 0)[0]));
+    assert(test_close(-1.5, matrix_batch_lanes(inverses, 0, n - 1)[0]));
+    assert(test_close(-4, matrix_batch_lanes(inverses, n - 1, 0)[1]));
+    assert(test_close(1, matrix_batch_lanes(inverses, n - 1, n - 1)[1]));
+
+    delete_matrix_batch(large);
+    delete_matrix_batch(inverses);
+    delete_matrix_batch(determinants);
+}
+
+void test_matrix_allocators() {
+    Matrix *a = test_operand(40, 30, 3, 19, 1);
+    Matrix *b = test_operand(30, 50, 7, 19, 1);
+    Matrix *expected = matrix_multiply(a, b).value;
+    MatrixAllocator *arena = new_matrix_arena(1 << 16);
+    MatrixAllocator *pool = new_matrix_pool(1 << 24);
+
+    assert(matrix_heap_allocator() == matrix_use_allocator(arena));
+
+    Matrix *product = matrix_multiply(a, b).value;
+    Matrix *copy = matrix_copy(product);
+
+    assert(arena == product->allocator);
+    assert(1 == matrix_equals(expected, copy));
+
+    // Scratch given back in LIFO order is reused at once.
+    void *scratch = matrix_allocate_scratch(arena, 1000);
+    matrix_release(arena, scratch, 1000);
+    assert(scratch == matrix_allocate(arena, 1000));
+
+    double *first = product->values;
+    delete_matrix(product);
+    delete_matrix(copy);
+    matrix_arena_reset(arena);
+
+    Matrix *after_reset = new_matrix(40, 50).value;
+    assert(first == after_reset->values);
+    assert(0 == matrix_get(after_reset, 40, 50).value);
+    delete_matrix(after_reset);
+
+    assert(arena == matrix_use_allocator(pool));
+
+    product = matrix_multiply(a, b).value;
+    double *recycled = product->values;
+    matrix_set(product, 1, 1, 42);
+    delete_matrix(product);
+
+    product = matrix_multiply(a, b).value;
+    assert(recycled == product->values);
+    assert(1 == matrix_equals(expected, product));
+    delete_matrix(product);
+
+    assert(pool == matrix_use_allocator(NULL));
+    assert(matrix_heap_allocator() == matrix_current_allocator());
+
+    delete_matrix_allocator(arena);
+    delete_matrix_allocator(pool);
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(expected);
+}
+
+void test_fixed_size_kernels_match_generic() {
+    for (int n = MATRIX_FIXED_MIN; n <= MATRIX_FIXED_MAX; n++) {
+        Matrix *x = test_operand(n, n, n + 2, 19, 1);
+        Matrix *y = test_operand(n, n, n + 5, 19, 1);
+
+        for (int i = 1; i <= n; i++) matrix_set(x, i, i, matrix_get(x, i, i).value + 10 * n);
+
+        Matrix *product = matrix_multiply(x, y).value;
+        Matrix *transposed = matrix_transpose(y).value;
+        Matrix *inverse = matrix_inverse(x).value;
+        MatrixLU *lu = matrix_lu_factor(x).value;
+        Matrix *expected_inverse = matrix_lu_inverse(lu).value;
+
+        for (int i = 1; i <= n; i++) {
+            for (int j = 1; j <= n; j++) {
+                double sum = 0;
+                for (int p = 1; p <= n; p++) sum += matrix_get(x, i, p).value * matrix_get(y, p, j).value;
+
+                assert(sum == matrix_get(product, i, j).value);
+                assert(matrix_get(y, j, i).value == matrix_get(transposed, i, j).value);
+                assert(test_close(matrix_get(expected_inverse, i, j).value, matrix_get(inverse, i, j).value));
+            }
+        }
+
+        // Same pivots and operations as the generic factorization, so the
+        // same bits.
+        assert(matrix_lu_determinant(lu).value == matrix_determinant_lu_decomposition(x).value);
+
+        delete_matrix(x);
+        delete_matrix(y);
+        delete_matrix(product);
+        delete_matrix(transposed);
+        delete_matrix(inverse);
+        delete_matrix(expected_inverse);
+        delete_matrix_lu(lu);
+    }
+
+    Matrix3 m = { { { 0, 2, 1 }, { 1, 1, 0 }, { 3, 0, 1 } } }, inverse, identity;
+
+    assert(1 == matrix3_inverse(&inverse, &m));
+    matrix3_multiply(&identity, &m, &inverse);
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) assert(test_close(i == j, identity.values[i][j]));
+    }
+
+    assert(test_close(-5, matrix3_determinant(&m)));
+    matrix3_transpose(&m, &m);
+    assert(3 == m.values[0][2]);
+
+    Matrix4 singular = { { { 1, 2, 3, 4 }, { 2, 4, 6, 8 } } };
+    Matrix *singular_matrix = new_matrix(4, 4).value;
+
+    assert(0 == matrix4_inverse(&singular, &singular));
+    assert(0 == matrix4_determinant(&singular));
+    assert(MATRIX_IS_SINGULAR == matrix_inverse(singular_matrix).code);
+    assert(0 == matrix_determinant_lu_decomposition(singular_matrix).value);
+
+    delete_matrix(singular_matrix);
+}
+
+void test_matrix_batch_file_round_trip() {
+    MatrixBatch *batch = new_matrix_batch(3, 2, 3).value;
+
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < 3; j++) matrix_batch_lanes(batch, i, j)[k] = k * 10 + i * 3 + j - 4.5;
+        }
+    }
+
+    MatrixBatch *loaded;
+
+    assert(1 == write_matrix_batch_to_file(batch, "test-round-trip.batch"));
+    assert(1 == read_matrix_batch_from_file(&loaded, "test-round-trip.batch"));
+    unlink("test-round-trip.batch");
+
+    assert(3 == loaded->count && 2 == loaded->rows && 3 == loaded->cols);
+
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 3; j++) {
+            assert(0 == memcmp(matrix_batch_lanes(batch, i, j), matrix_batch_lanes(loaded, i, j), 3 * sizeof(double)));
+        }
+    }
+
+    delete_matrix_batch(batch);
+    delete_matrix_batch(loaded);
+}
+
+void test_sparse_matrix_conversions() {
+    Matrix *m = test_operand(60, 45, 5, 7, 9);
+    SparseMatrix *csr = sparse_matrix_from_dense(m, SPARSE_MATRIX_CSR).value;
+    SparseMatrix *csc = sparse_matrix_from_dense(m, SPARSE_MATRIX_CSC).value;
+
+    assert(csr->nonzeros == csc->nonzeros);
+    assert(csr->nonzeros < 60 * 45 / 5);
+
+    for (int i = 1; i <= 60; i++) {
+        for (int j = 1; j <= 45; j++) {
+            assert(matrix_get(m, i, j).value == sparse_matrix_get(csr, i, j).value);
+            assert(matrix_get(m, i, j).value == sparse_matrix_get(csc, i, j).value);
+        }
+    }
+
+    Matrix *from_csc = sparse_matrix_to_dense(csc).value;
+
+    assert(1 == matrix_equals(m, from_csc));
+
+    int rows[] = { 2, 0, 2, 1 };
+    int cols[] = { 1, 3, 1, 0 };
+    double values[] = { 1.5, -2, 2.5, 7 };
+    SparseMatrix *triplets = new_sparse_matrix_from_triplets(3, 4, 4, rows, cols, values).value;
+
+    assert(3 == triplets->nonzeros);
+    assert(4 == sparse_matrix_get(triplets, 3, 2).value);
+    assert(-2 == sparse_matrix_get(triplets, 1, 4).value);
+    assert(7 == sparse_matrix_get(triplets, 2, 1).value);
+    assert(0 == sparse_matrix_get(triplets, 3, 3).value);
+    assert(MATRIX_INDEX_ARGUMENT_OUT_OF_BOUNDS == sparse_matrix_get(triplets, 4, 1).code);
+
+    write_sparse_matrix_to_file(triplets, "test-round-trip.coo");
+
+    SparseMatrix *loaded;
+
+    assert(1 == read_sparse_matrix_from_file(&loaded, "test-round-trip.coo"));
+    unlink("test-round-trip.coo");
+
+    assert(3 == loaded->nonzeros);
+    assert(4 == sparse_matrix_get(loaded, 3, 2).value);
+
+    delete_matrix(m);
+    delete_matrix(from_csc);
+    delete_sparse_matrix(csr);
+    delete_sparse_matrix(csc);
+    delete_sparse_matrix(triplets);
+    delete_sparse_matrix(loaded);
+}
+
+void test_sparse_matrix_arithmetic_matches_dense() {
+    Matrix *a = test_operand(60, 45, 5, 7, 9);
+    Matrix *b = test_operand(60, 45, 4, 7, 9);
+    Matrix *c = test_operand(45, 50, 2, 7, 9);
+    SparseMatrix *sa = sparse_matrix_from_dense(a, SPARSE_MATRIX_CSR).value;
+    SparseMatrix *sb = sparse_matrix_from_dense(b, SPARSE_MATRIX_CSC).value;
+    SparseMatrix *sc = sparse_matrix_from_dense(c, SPARSE_MATRIX_CSR).value;
+
+    Matrix *sum = matrix_sum(a, b).value;
+    Matrix *difference = matrix_subtract(a, b).value;
+    Matrix *product = matrix_multiply(a, c).value;
+
+    SparseMatrix *sparse_sum = sparse_matrix_sum(sa, sb).value;
+    SparseMatrix *sparse_difference = sparse_matrix_subtract(sa, sb).value;
+    SparseMatrix *sparse_product = sparse_matrix_multiply(sa, sc).value;
+    Matrix *results[] = {
+        sparse_matrix_to_dense(sparse_sum).value,
+        sparse_matrix_to_dense(sparse_difference).value,
+        sparse_matrix_to_dense(sparse_product).value,
+        sparse_matrix_sum_dense(sa, b).value,
+        sparse_matrix_subtract_dense(sa, b).value,
+        dense_matrix_subtract_sparse(a, sb).value,
+        sparse_matrix_multiply_dense(sa, c).value,
+        dense_matrix_multiply_sparse(a, sc).value
+    };
+    Matrix *expected[] = { sum, difference, product, sum, difference, difference, product, product };
+
+    for (int r = 0; r < 8; r++) {
+        assert(1 == matrix_equals(expected[r], results[r]));
+        delete_matrix(results[r]);
+    }
+
+    assert(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY == sparse_matrix_multiply(sa, sb).code);
+    assert(MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM == sparse_matrix_sum(sa, sc).code);
+
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(c);
+    delete_matrix(sum);
+    delete_matrix(difference);
+    delete_matrix(product);
+    delete_sparse_matrix(sa);
+    delete_sparse_matrix(sb);
+    delete_sparse_matrix(sc);
+    delete_sparse_matrix(sparse_sum);
+    delete_sparse_matrix(sparse_difference);
+    delete_sparse_matrix(sparse_product);
+}
+
+void test_parse_matrix_number_matches_strtod() {
+    const char *numbers[] = {
+        "0", "-0", "12", "-3.25", "0.1", "1e22", "1e23", "123456789012345678901",
+        "2.2250738585072014e-308", "4.9e-324", "9007199254740993", "0.000001",
+        "-1.7976931348623157e308", "3.14159265358979323846", "+7.5", ".5", "5."
+    };
+
+    for (int i = 0; i < (int) (sizeof(numbers) / sizeof(numbers[0])); i++) {
+        double parsed;
+        const char *end = parse_matrix_number(numbers[i], &parsed);
+
+        assert(NULL != end && '\0' == *end);
+        assert(strtod(numbers[i], NULL) == parsed);
+    }
+
+    double parsed;
+    assert(NULL != parse_matrix_number("nan", &parsed) && isnan(parsed));
+    assert(NULL != parse_matrix_number("-inf", &parsed) && -INFINITY == parsed);
+    assert(NULL != parse_matrix_number("inf", &parsed) && INFINITY == parsed);
+
+    double unused;
+    assert(NULL == parse_matrix_number("-", &unused));
+    assert(NULL == parse_matrix_number(".", &unused));
+    assert(NULL == parse_matrix_number("x1", &unused));
+}
+
+void test_read_wide_text_matrix() {
+    int cols = 700;
+    FILE *file = fopen("test-wide.mat", "w");
+
+    fprintf(file, "2\n%d\n", cols);
+
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < cols; j++) {
+            fprintf(file, "%s%d.125e1", j > 0 ? ", " : "", i * cols + j);
+        }
+        fprintf(file, "\r\n");
+    }
+
+    fclose(file);
+
+    Matrix m;
+    assert(1 == read_matrix_from_file(&m, "test-wide.mat"));
+    unlink("test-wide.mat");
+
+    assert(2 == m.rows);
+    assert(cols == m.cols);
+
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < cols; j++) {
+            assert((i * cols + j) * 10 + 1.25 == matrix_get(&m, i + 1, j + 1).value);
+        }
+    }
+}
+
+void test_format_double_round_trips() {
+    const char *expected[][2] = {
+        { "0.1", "0.1" }, { "-0", "-0" }, { "123.45", "123.45" }, { "100", "100" },
+        { "1e21", "1e21" }, { "2.5e-7", "2.5e-7" }, { "0.001", "0.001" },
+        { "5e-324", "5e-324" }, { "1.7976931348623157e308", "1.7976931348623157e308" },
+        { "0.3333333333333333", "0.3333333333333333" }, { "-9007199254740992", "-9007199254740992" }
+    };
+    char text[MATRIX_TEXT_ELEMENT_MAX_LENGTH];
+
+    for (int i = 0; i < (int) (sizeof(expected) / sizeof(expected[0])); i++) {
+        int length = format_double_shortest(text, strtod(expected[i][0], NULL));
+        assert(length == (int) strlen(expected[i][1]) && 0 == memcmp(text, expected[i][1], length));
+    }
+
+    uint64_t state = 88172645463325252ULL;
+
+    for (int i = 0; i < 200000; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        double value, parsed;
+        memcpy(&value, &state, sizeof(value));
+
+        if (!isfinite(value)) continue;
+
+        text[format_double_shortest(text, value)] = '\0';
+        parse_matrix_number(text, &parsed);
+        assert(0 == memcmp(&value, &parsed, sizeof(value)));
+    }
+
+    format_double_fixed(text, 2.675, 2);
+    assert(0 == strcmp("2.67", text));
+    format_double_fixed(text, -3, 2);
+    assert(0 == strcmp("-3.00", text));
+
+    Matrix *m = new_matrix(2, 2).value;
+    Matrix loaded;
+
+    matrix_set(m, 1, 1, 1.0 / 3);
+    matrix_set(m, 1, 2, -2e-300);
+    matrix_set(m, 2, 1, 12345678.875);
+    matrix_set(m, 2, 2, 7);
+
+    write_matrix_to_file(m, "test-precision.mat");
+    assert(1 == read_matrix_from_file(&loaded, "test-precision.mat"));
+    assert(1 == matrix_equals(m, &loaded));
+
+    matrix_set_output_precision(2);
+    write_matrix_to_file(m, "test-precision.mat");
+    matrix_set_output_precision(MATRIX_OUTPUT_SHORTEST);
+
+    assert(1 == read_matrix_from_file(&loaded, "test-precision.mat"));
+    assert(0.33 == matrix_get(&loaded, 1, 1).value);
+    assert(0 == matrix_get(&loaded, 1, 2).value);
+    assert(12345678.88 == matrix_get(&loaded, 2, 1).value);
+    // Non-finite results, such as the inverse of a singular matrix in a
+    // batch, read back as written, also with a fixed precision.
+    matrix_set(m, 1, 1, NAN);
+    matrix_set(m, 1, 2, INFINITY);
+    matrix_set(m, 2, 1, -INFINITY);
+
+    for (int precision = MATRIX_OUTPUT_SHORTEST; precision <= 3; precision += 4) {
+        matrix_set_output_precision(precision);
+        assert(1 == write_matrix_to_file(m, "test-precision.mat"));
+        assert(1 == read_matrix_from_file(&loaded, "test-precision.mat"));
+        assert(isnan(matrix_get(&loaded, 1, 1).value));
+        assert(INFINITY == matrix_get(&loaded, 1, 2).value);
+        assert(-INFINITY == matrix_get(&loaded, 2, 1).value);
+    }
+
+    matrix_set_output_precision(MATRIX_OUTPUT_SHORTEST);
+    unlink("test-precision.mat");
+
+    MatrixBatch *singular = new_matrix_batch(2, 5, 5).value;
+    MatrixBatch *inverses = matrix_batch_inverse(singular).value;
+    MatrixBatch *batch_loaded;
+
+    assert(1 == write_matrix_batch_to_file(inverses, "test-precision.batch"));
+    assert(1 == read_matrix_batch_from_file(&batch_loaded, "test-precision.batch"));
+    unlink("test-precision.batch");
+    assert(isnan(matrix_batch_lanes(batch_loaded, 4, 4)[1]));
+
+    delete_matrix_batch(singular);
+    delete_matrix_batch(inverses);
+    delete_matrix_batch(batch_loaded);
+    delete_matrix(m);
+}
+
+// Large enough to take the parallel paths in both directions.
+void test_parallel_text_matrix_round_trip() {
+    int n = 450;
+    Matrix *m = new_matrix(n, n).value;
+    Matrix *integers = new_typed_matrix(n, n, MATRIX_INT64).value;
+
+    for (int i = 1; i <= n; i++) {
+        for (int j = 1; j <= n; j++) {
+            matrix_set(m, i, j, (i * 401 + j) % 1000 - 500.75);
+            matrix_set(integers, i, j, (i * 401 + j) % 1000 * 1000003LL);
+        }
+    }
+
+    write_matrix_to_file(m, "test-parallel.mat");
+
+    Matrix loaded;
+    assert(1 == read_matrix_from_file(&loaded, "test-parallel.mat"));
+    assert(1 == matrix_equals(m, &loaded));
+
+    // The streaming reader sees the same file.
+    MatrixTextReader *reader = open_matrix_text_reader("test-parallel.mat");
+    double row[450];
+    for (int i = 1; i <= n; i++) {
+        assert(1 == read_matrix_text_row(reader, row));
+        for (int j = 1; j <= n; j++) assert(matrix_get(m, i, j).value == row[j - 1]);
+    }
+    assert(1 == finish_matrix_text_reader(reader));
+    close_matrix_text_reader(reader);
+
+    write_matrix_to_file(integers, "test-parallel.mat");
+
+    Matrix loaded_integers;
+    assert(1 == read_typed_matrix_from_file(&loaded_integers, "test-parallel.mat", MATRIX_INT64));
+    assert(1 == matrix_equals(integers, &loaded_integers));
+
+    // Anything but blank lines after the last row fails the load, as it does
+    // in the streaming reader.
+    FILE *file = fopen("test-parallel.mat", "a");
+    fprintf(file, "1,2,x\n");
+    fclose(file);
+    assert(0 == read_typed_matrix_from_file(&loaded_integers, "test-parallel.mat", MATRIX_INT64));
+
+    unlink("test-parallel.mat");
+    delete_matrix(m);
+    delete_matrix(integers);
+}
+
+void test_matrix_cache() {
+    setenv("MATRIX_CACHE_DIR", "test-cache", 1);
+    setenv("MATRIX_CACHE_SIZE", "1", 1);
+
+    Matrix *m = new_matrix(2, 2).value;
+    char key[MATRIX_CACHE_KEY_LENGTH + 1], same_key[MATRIX_CACHE_KEY_LENGTH + 1];
+    Matrix cached;
+
+    matrix_set(m, 1, 1, 1.5);
+    matrix_set(m, 2, 2, -2);
+    write_matrix_to_file(m, "test-cache.mat");
+
+    assert(1 == matrix_cache_enabled());
+    assert(1 == matrix_cache_file_key("test-cache.mat", key));
+    assert(MATRIX_CACHE_KEY_LENGTH == strlen(key));
+    assert(1 == matrix_cache_file_key("test-cache.mat", same_key));
+    assert(0 == strcmp(key, same_key));
+
+    // Any change to the contents changes the key.
+    matrix_set(m, 1, 2, 1e-300);
+    write_matrix_to_file(m, "test-cache.mat");
+    assert(1 == matrix_cache_file_key("test-cache.mat", same_key));
+    assert(0 != strcmp(key, same_key));
+
+    assert(0 == matrix_cache_load("entry", &cached));
+    matrix_cache_store("entry", m);
+    assert(1 == matrix_cache_load("entry", &cached));
+    assert(1 == matrix_equals(m, &cached));
+
+    // An entry over the 1 MiB the cache may hold is evicted at once, taking
+    // the older ones with it.
+    Matrix *large = new_matrix(400, 400).value;
+    matrix_cache_store("large", large);
+    assert(0 == matrix_cache_load("large", &cached));
+    assert(0 == matrix_cache_load("entry", &cached));
+
+    matrix_cache_set_enabled(0);
+    assert(0 == matrix_cache_file_key("test-cache.mat", key));
+    matrix_cache_set_enabled(1);
+
+    system("rm -rf test-cache");
+    unlink("test-cache.mat");
+    unsetenv("MATRIX_CACHE_SIZE");
+    delete_matrix(m);
+    delete_matrix(large);
+}
+
+void test_matrix_stats_report() {
+    Matrix *a = test_operand(3, 4, 3, 19, 1);
+    Matrix *b = test_operand(4, 5, 5, 19, 1);
+    char report[4096];
+
+    // Nothing is counted while stats are off.
+    delete_matrix(matrix_multiply(a, b).value);
+
+    matrix_stats_set_enabled(1);
+    double begin = matrix_stats_now();
+    Matrix *product = matrix_multiply(a, b).value;
+    Matrix *sum = matrix_sum(product, product).value;
+    matrix_stats_add_phase(MATRIX_STATS_COMPUTE, begin, 0);
+    matrix_stats_add_phase(MATRIX_STATS_WRITE, matrix_stats_now(), 1234);
+    delete_matrix(product);
+    delete_matrix(sum);
+    matrix_stats_set_enabled(0);
+
+    FILE *file = tmpfile();
+    matrix_stats_report(file, 1);
+    rewind(file);
+    size_t length = fread(report, 1, sizeof(report) - 1, file);
+    report[length] = '\0';
+    fclose(file);
+
+    // 2 * 3 * 5 * 4 FLOPs, and the 12 + 20 + 15 elements of A, B and the
+    // product read or written once.
+    assert(NULL != strstr(report, "\"multiply\": {\"calls\": 1, \"flops\": 120, \"bytes\": 376}"));
+    assert(NULL != strstr(report, "\"add\": {\"calls\": 1, \"flops\": 15, \"bytes\": 360}"));
+    assert(NULL != strstr(report, "\"write\": {\"seconds\": "));
+    assert(NULL != strstr(report, "\"bytes\": 1234}"));
+    assert(NULL == strstr(report, "\"transpose\""));
+
+    // The two results and whatever scratch the kernels took, all given back.
+    unsigned long long allocations, releases;
+    assert(2 == sscanf(strstr(report, "\"allocations\""), "\"allocations\": {\"count\": %llu, \"bytes\": %*u, \"releases\": %llu",
+        &allocations, &releases));
+    assert(allocations >= 2 && allocations == releases);
+
+    delete_matrix(a);
+    delete_matrix(b);
+}
+
+int test_files_equal(const char *x_filename, const char *y_filename) {
+    FILE *x = fopen(x_filename, "rb"), *y = fopen(y_filename, "rb");
+    int x_byte, y_byte;
+
+    do {
+        x_byte = fgetc(x);
+        y_byte = fgetc(y);
+    } while (x_byte == y_byte && x_byte != EOF);
+
+    fclose(x);
+    fclose(y);
+
+    return x_byte == y_byte;
+}
+
+void test_streaming_sum_and_subtract() {
+    Matrix *a = test_operand(23, 17, 3, 19, 1);
+    Matrix *b = test_operand(23, 17, 5, 19, 1);
+    Matrix *c = test_operand(17, 23, 2, 19, 1);
+    Matrix *expected_sum = matrix_sum(a, b).value;
+    Matrix *expected_subtract = matrix_subtract(a, b).value;
+    Matrix *streamed = malloc(sizeof(Matrix));
+
+    write_matrix_to_file(a, "test-stream-a.mat");
+    write_matrix_to_file(b, "test-stream-b.matb");
+    write_matrix_to_file(c, "test-stream-c.mat");
+
+    assert(1 == stream_matrix_sum_files("test-stream-a.mat", "test-stream-b.matb", "test-stream-result.mat"));
+    assert(1 == read_matrix_from_file(streamed, "test-stream-result.mat"));
+    assert(1 == matrix_equals(expected_sum, streamed));
+    delete_matrix(streamed);
+
+    streamed = malloc(sizeof(Matrix));
+    assert(1 == stream_matrix_subtract_files("test-stream-a.mat", "test-stream-b.matb", "test-stream-result.matb"));
+    assert(1 == read_matrix_from_file(streamed, "test-stream-result.matb"));
+    assert(1 == matrix_equals(expected_subtract, streamed));
+    delete_matrix(streamed);
+
+    // Binary inputs keep their element type.
+    Matrix *a32 = matrix_convert(a, MATRIX_INT32).value;
+    Matrix *b32 = matrix_convert(b, MATRIX_INT32).value;
+    write_matrix_to_file(a32, "test-stream-a32.matb");
+    write_matrix_to_file(b32, "test-stream-b32.matb");
+
+    Matrix *expected_sum32 = matrix_sum(a32, b32).value;
+
+    streamed = malloc(sizeof(Matrix));
+    assert(1 == stream_matrix_sum_files("test-stream-a32.matb", "test-stream-b32.matb", "test-stream-result.matb"));
+    assert(1 == read_matrix_from_file(streamed, "test-stream-result.matb"));
+    assert(MATRIX_INT32 == streamed->element_type);
+    assert(1 == matrix_equals(expected_sum32, streamed));
+    delete_matrix(streamed);
+
+    // Rows are padded as write_matrix_to_file pads them, so the files match.
+    write_matrix_to_file(expected_sum32, "test-stream-expected.matb");
+    assert(1 == test_files_equal("test-stream-result.matb", "test-stream-expected.matb"));
+    delete_matrix(expected_sum32);
+
+    // Failures leave no output behind.
+    unlink("test-stream-result.mat");
+    assert(0 == stream_matrix_sum_files("test-stream-a.mat", "test-stream-c.mat", "test-stream-result.mat"));
+    assert(0 == stream_matrix_subtract_files("test-stream-a.mat", "test-stream-a32.matb", "test-stream-result.mat"));
+    assert(0 != access("test-stream-result.mat", F_OK));
+
+    // The output may be one of the inputs, which a failure leaves as it was.
+    write_matrix_to_file(a, "test-stream-in-place.mat");
+    assert(0 == stream_matrix_sum_files("test-stream-in-place.mat", "test-stream-c.mat", "test-stream-in-place.mat"));
+    streamed = malloc(sizeof(Matrix));
+    assert(1 == read_matrix_from_file(streamed, "test-stream-in-place.mat"));
+    assert(1 == matrix_equals(a, streamed));
+    delete_matrix(streamed);
+
+    assert(1 == stream_matrix_sum_files("test-stream-in-place.mat", "test-stream-b.matb", "test-stream-in-place.mat"));
+    streamed = malloc(sizeof(Matrix));
+    assert(1 == read_matrix_from_file(streamed, "test-stream-in-place.mat"));
+    assert(1 == matrix_equals(expected_sum, streamed));
+    delete_matrix(streamed);
+    unlink("test-stream-in-place.mat");
+
+    const char *files[] = { "test-stream-a.mat", "test-stream-b.matb", "test-stream-c.mat", "test-stream-a32.matb",
+        "test-stream-b32.matb", "test-stream-result.matb", "test-stream-expected.matb" };
+    for (int i = 0; i < (int) (sizeof(files) / sizeof(files[0])); i++) unlink(files[i]);
+
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(c);
+    delete_matrix(a32);
+    delete_matrix(b32);
+    delete_matrix(expected_sum);
+    delete_matrix(expected_subtract);
+}
+
+// Closes a tiled result and reads it back through a .matb file.
+Matrix* test_read_tiled_result(TiledMatrixResult result, size_t memory_limit) {
+    Matrix *m = malloc(sizeof(Matrix));
+
+    assert(1 == result.success);
+    close_tiled_matrix(result.value);
+    assert(1 == convert_from_tiled_matrix_file("test-ooc-result.matt", "test-ooc-result.matb", memory_limit));
+    assert(1 == read_matrix_from_file(m, "test-ooc-result.matb"));
+
+    return m;
+}
+
+void test_out_of_core_operations() {
+    // Room for five 8x8 tiles, so none of the dimensions below is a
+    // multiple of the tile size.
+    size_t limit = 5 * 8 * 8 * sizeof(double);
+    Matrix *a = test_operand(21, 13, 3, 19, 1);
+    Matrix *b = test_operand(21, 13, 5, 19, 1);
+    Matrix *c = test_operand(13, 19, 2, 19, 1);
+    Matrix *s = test_operand(30, 30, 7, 19, 1);
+
+    for (int i = 1; i <= 30; i++) matrix_set(s, i, i, matrix_get(s, i, i).value + 40);
+
+    assert(0 == tile_size_for_memory_limit(100));
+    assert(8 == tile_size_for_memory_limit(limit));
+
+    write_matrix_to_file(a, "test-ooc-a.mat");
+    write_matrix_to_file(b, "test-ooc-b.matb");
+    write_matrix_to_file(c, "test-ooc-c.mat");
+    write_matrix_to_file(s, "test-ooc-s.mat");
+
+    assert(1 == convert_to_tiled_matrix_file("test-ooc-a.mat", "test-ooc-a.matt", 8, limit));
+    assert(1 == convert_to_tiled_matrix_file("test-ooc-b.matb", "test-ooc-b.matt", 8, limit));
+    assert(1 == convert_to_tiled_matrix_file("test-ooc-c.mat", "test-ooc-c.matt", 8, limit));
+
+    TiledMatrix *ta = open_tiled_matrix("test-ooc-a.matt").value;
+    TiledMatrix *tb = open_tiled_matrix("test-ooc-b.matt").value;
+    TiledMatrix *tc = open_tiled_matrix("test-ooc-c.matt").value;
+
+    assert(21 == ta->rows && 13 == ta->cols && 3 == ta->tile_rows && 2 == ta->tile_cols);
+
+    Matrix *expected = matrix_sum(a, b).value;
+    Matrix *actual = test_read_tiled_result(tiled_matrix_sum(ta, tb, "test-ooc-result.matt", limit), limit);
+    assert(1 == matrix_equals(expected, actual));
+    delete_matrix(expected);
+    delete_matrix(actual);
+
+    expected = matrix_subtract(a, b).value;
+    actual = test_read_tiled_result(tiled_matrix_subtract(ta, tb, "test-ooc-result.matt", limit), limit);
+    assert(1 == matrix_equals(expected, actual));
+    delete_matrix(expected);
+    delete_matrix(actual);
+
+    expected = matrix_multiply(a, c).value;
+    actual = test_read_tiled_result(tiled_matrix_multiply(ta, tc, "test-ooc-result.matt", limit), limit);
+    assert(1 == matrix_equals(expected, actual));
+    delete_matrix(expected);
+    delete_matrix(actual);
+
+    expected = matrix_transpose(a).value;
+    actual = test_read_tiled_result(tiled_matrix_transpose(ta, "test-ooc-result.matt", limit), limit);
+    assert(1 == matrix_equals(expected, actual));
+    delete_matrix(expected);
+    delete_matrix(actual);
+
+    assert(0 == tiled_matrix_multiply(ta, tb, "test-ooc-result.matt", limit).success);
+    assert(0 == tiled_matrix_sum(ta, tc, "test-ooc-result.matt", limit).success);
+
+    // The factorization keeps three 30x8 column panels, padded to whole
+    // tiles, in memory.
+    size_t lu_limit = 3 * 32 * 8 * sizeof(double);
+    int pivots[30];
+
+    assert(8 == lu_tile_size_for_memory_limit(lu_limit, 30));
+    assert(0 == lu_tile_size_for_memory_limit(lu_limit / 2, 30));
+    assert(1 == convert_to_tiled_matrix_file("test-ooc-s.mat", "test-ooc-s.matt", 8, lu_limit));
+
+    TiledMatrix *ts = open_tiled_matrix("test-ooc-s.matt").value;
+    MatrixNumericResult det = tiled_matrix_lu_factor(ts, pivots, lu_limit);
+
+    assert(1 == det.success);
+    assert(test_close(matrix_determinant_lu_decomposition(s).value, det.value));
+    close_tiled_matrix(ts);
+
+    // Two equal rows make the matrix singular.
+    for (int j = 1; j <= 30; j++) matrix_set(s, 30, j, matrix_get(s, 1, j).value);
+    write_matrix_to_file(s, "test-ooc-s.mat");
+    assert(1 == convert_to_tiled_matrix_file("test-ooc-s.mat", "test-ooc-s.matt", 8, lu_limit));
+    ts = open_tiled_matrix("test-ooc-s.matt").value;
+    det = tiled_matrix_lu_factor(ts, pivots, lu_limit);
+    assert(1 == det.success);
+    assert(0 == det.value);
+    close_tiled_matrix(ts);
+
+    // Back to text, with a band smaller than a row of tiles.
+    Matrix *round_trip = malloc(sizeof(Matrix));
+    assert(1 == convert_from_tiled_matrix_file("test-ooc-a.matt", "test-ooc-a2.mat", 3 * 21 * sizeof(double)));
+    assert(1 == read_matrix_from_file(round_trip, "test-ooc-a2.mat"));
+    assert(1 == matrix_equals(a, round_trip));
+    delete_matrix(round_trip);
+
+    int rows, cols;
+    assert(1 == read_matrix_file_dimensions("test-ooc-c.matt", &rows, &cols));
+    assert(13 == rows && 19 == cols);
+
+    // Headers whose tiles overflow or do not fit in the file.
+    TiledMatrixFileHeader header;
+    FILE *file = fopen("test-ooc-c.matt", "r+b");
+    assert(1 == fread(&header, sizeof(header), 1, file));
+
+    uint32_t corrupt[][3] = { { 13, 19, 0x7fffffff }, { 0x7fffffff, 0x7fffffff, 8192 }, { 13, 19 * 100, 8 } };
+
+    for (int i = 0; i < 3; i++) {
+        TiledMatrixFileHeader changed = header;
+        changed.rows = corrupt[i][0];
+        changed.cols = corrupt[i][1];
+        changed.tile_size = corrupt[i][2];
+        rewind(file);
+        assert(1 == fwrite(&changed, sizeof(changed), 1, file));
+        fflush(file);
+        assert(MATRIX_TILE_IO_FAILED == open_tiled_matrix("test-ooc-c.matt").code);
+    }
+
+    fclose(file);
+
+    close_tiled_matrix(ta);
+    close_tiled_matrix(tb);
+    close_tiled_matrix(tc);
+
+    const char *files[] = { "test-ooc-a.mat", "test-ooc-a2.mat", "test-ooc-b.matb", "test-ooc-c.mat", "test-ooc-s.mat",
+        "test-ooc-a.matt", "test-ooc-b.matt", "test-ooc-c.matt", "test-ooc-s.matt",
+        "test-ooc-result.matt", "test-ooc-result.matb" };
+    for (int i = 0; i < (int) (sizeof(files) / sizeof(files[0])); i++) unlink(files[i]);
+
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(c);
+    delete_matrix(s);
+}
+
+void test_matrix_server_requests() {
+    MatrixRegistry *registry = new_matrix_registry();
+    char requests[] =
+        "put A\n2\n2\n1,2\n3,4\n"
+        "put B\n2\n2\n5,6\n7,8\n"
+        "multiply C A B\n"
+        "det A\n"
+        "save C test-server.mat\n"
+        "free C\n"
+        "get C\n"
+        "load C test-server.mat\n"
+        "sum A A C\n"
+        "get A\n"
+        "inverse D B\n"
+        "subtract D A\n"
+        "put E\n2\n2\n1,zz\n3,4\n"
+        "get E\n"
+        "list\n"
+        "quit\n"
+        "free A\n";
+    const char *expected =
+        "ok A 2 2\n"
+        "ok B 2 2\n"
+        "ok C 2 2\n"
+        "ok -2\n"
+        "ok\n"
+        "ok\n"
+        "error Unknown matrix 'C'.\n"
+        "ok C 2 2\n"
+        "ok A 2 2\n"
+        "ok\n2\n2\n20,24\n46,54\n"
+        "ok D 2 2\n"
+        "error Usage: subtract RESULT A B\n"
+        "error Invalid matrix.\n"
+        "error Unknown matrix 'E'.\n"
+        "ok 4\n";
+    char *replies = NULL;
+    size_t size = 0;
+    FILE *in = fmemopen(requests, strlen(requests), "r");
+    FILE *out = open_memstream(&replies, &size);
+
+    matrix_server_serve(registry, in, out);
+    fclose(in);
+    fclose(out);
+
+    // Everything up to the list, whose order is the registry's, then one
+    // line per matrix and nothing after quit.
+    assert(0 == strncmp(replies, expected, strlen(expected)));
+    int lines = 0;
+    for (size_t i = strlen(expected); i < size; i++) lines += replies[i] == '\n';
+    assert(4 == lines);
+    assert(NULL != strstr(replies + strlen(expected), "D 2 2\n"));
+
+    // A resident matrix outlives its name while someone holds it.
+    ResidentMatrix *a = matrix_registry_acquire(registry, "A");
+    assert(1 == matrix_registry_remove(registry, "A"));
+    assert(NULL == matrix_registry_acquire(registry, "A"));
+    assert(20 == matrix_get(a->matrix, 1, 1).value);
+    matrix_registry_release(registry, a);
+    assert(0 == matrix_registry_remove(registry, "A"));
+
+    // Dimensions that are not numbers leave the rows that follow with no
+    // way to be told from requests, so the connection is closed.
+    char unframed[] = "put F\n2\nx\n1,2\n3,4\nlist\n";
+
+    free(replies);
+    in = fmemopen(unframed, strlen(unframed), "r");
+    out = open_memstream(&replies, &size);
+    matrix_server_serve(registry, in, out);
+    fclose(in);
+    fclose(out);
+    assert(0 == strcmp("error Invalid matrix dimensions.\n", replies));
+
+    unlink("test-server.mat");
+    free(replies);
+    delete_matrix_registry(registry);
+}
+
 void test_determinant_2x2_laplace() {
     double values[2][2] = { 
         {3, 2}, 
@@ -378,16 +1942,246 @@ void test_determinant_6x6_lu_decomposition() {
     delete_matrix(m);
 }
 
+void test_determinant_laplace_matches_lu() {
+    int n = 12;
+    Matrix *m = new_matrix(n, n).value;
+
+    for (int i = 1; i <= n; i++) {
+        for (int j = 1; j <= n; j++) {
+            matrix_set(m, i, j, (i * 7 + j * j * 3) % 5 - 2 + (i == j ? 6 : 0));
+        }
+    }
+
+    MatrixNumericResult laplace = matrix_determinant_laplace(m);
+    MatrixNumericResult lu = matrix_determinant_lu_decomposition(m);
+
+    assert(1 == laplace.success);
+    assert(laplace.value == (long long) laplace.value);
+    assert(fabs(laplace.value - lu.value) <= 1e-9 * fabs(laplace.value));
+
+    delete_matrix(m);
+}
+
+void test_lu_factorization_reuse() {
+    double values[3][3] = {
+        {2, 1, 1},
+        {4, -6, 0},
+        {-2, 7, 2}
+    };
+    double b_values[3][2] = {
+        {5, 1},
+        {-2, 0},
+        {9, 0}
+    };
+    Matrix *m = new_matrix_with_values(3, 3, values).value;
+    Matrix *b = new_matrix_with_values(3, 2, b_values).value;
+
+    MatrixLUResult lu = matrix_lu_factor(m);
+    assert(1 == lu.success);
+
+    MatrixNumericResult det = matrix_lu_determinant(lu.value);
+    assert(fabs(det.value + 16) < 1e-12);
+
+    Matrix *x = matrix_lu_solve(lu.value, b).value;
+    Matrix *check = matrix_multiply(m, x).value;
+
+    for (int i = 1; i <= 3; i++) {
+        for (int j = 1; j <= 2; j++) {
+            assert(fabs(matrix_get(check, i, j).value - matrix_get(b, i, j).value) < 1e-12);
+        }
+    }
+
+    Matrix *inverse = matrix_lu_inverse(lu.value).value;
+    Matrix *identity = matrix_multiply(m, inverse).value;
+
+    for (int i = 1; i <= 3; i++) {
+        for (int j = 1; j <= 3; j++) {
+            assert(fabs(matrix_get(identity, i, j).value - (i == j ? 1 : 0)) < 1e-12);
+        }
+    }
+
+    Matrix *wrong = new_matrix(2, 2).value;
+    assert(MATRIX_INVALID_DIMENSIONS_TO_SOLVE == matrix_lu_solve(lu.value, wrong).code);
+
+    delete_matrix_lu(lu.value);
+    delete_matrix(m);
+    delete_matrix(b);
+    delete_matrix(x);
+    delete_matrix(check);
+    delete_matrix(inverse);
+    delete_matrix(identity);
+    delete_matrix(wrong);
+}
+
+void test_lu_factorization_of_singular_matrix() {
+    double values[3][3] = {
+        {1, 2, 3},
+        {2, 4, 6},
+        {0, 0, 0}
+    };
+    Matrix *m = new_matrix_with_values(3, 3, values).value;
+
+    MatrixLUResult lu = matrix_lu_factor(m);
+    assert(1 == lu.success);
+    assert(0 == matrix_lu_determinant(lu.value).value);
+    assert(MATRIX_IS_SINGULAR == matrix_lu_inverse(lu.value).code);
+    assert(MATRIX_IS_SINGULAR == matrix_inverse(m).code);
+
+    delete_matrix_lu(lu.value);
+    delete_matrix(m);
+}
+
+void test_matrix_expression_evaluation() {
+    Matrix *a = test_operand(37, 45, 3, 13, 1);
+    Matrix *b = test_operand(45, 29, 5, 13, 1);
+    Matrix *c = test_operand(37, 29, 11, 13, 1);
+    Matrix *d = test_operand(37, 29, 2, 13, 1);
+
+    MatrixExpression *e = parse_matrix_expression("A*B + C - 2*(D - -C) + (A*B)*0.5");
+
+    assert(e != NULL);
+    assert(1 == matrix_expression_bind(e, "A", a));
+    assert(1 == matrix_expression_bind(e, "B", b));
+    assert(1 == matrix_expression_bind(e, "C", c));
+    assert(1 == matrix_expression_bind(e, "D", d));
+    assert(0 == matrix_expression_bind(e, "E", a));
+
+    Matrix *result = matrix_expression_evaluate(e).value;
+    Matrix *product = matrix_multiply(a, b).value;
+
+    assert(37 == result->rows);
+    assert(29 == result->cols);
+
+    for (int i = 1; i <= 37; i++) {
+        for (int j = 1; j <= 29; j++) {
+            double expected = 1.5 * matrix_get(product, i, j).value
+                - matrix_get(c, i, j).value - 2 * matrix_get(d, i, j).value;
+
+            assert(expected == matrix_get(result, i, j).value);
+        }
+    }
+
+    Matrix *f = test_operand(29, 8, 17, 13, 1);
+    Matrix *difference = matrix_subtract(c, d).value;
+    Matrix *expected = matrix_multiply(difference, f).value;
+    MatrixExpression *nested = parse_matrix_expression("(C - D) * F");
+
+    matrix_expression_bind(nested, "C", c);
+    matrix_expression_bind(nested, "D", d);
+    matrix_expression_bind(nested, "F", f);
+
+    Matrix *materialized = matrix_expression_evaluate(nested).value;
+
+    assert(1 == matrix_equals(expected, materialized));
+
+    delete_matrix_expression(nested);
+    delete_matrix(f);
+    delete_matrix(difference);
+    delete_matrix(expected);
+    delete_matrix(materialized);
+
+    nested = parse_matrix_expression("-(A*B - C)");
+
+    matrix_expression_bind(nested, "A", a);
+    matrix_expression_bind(nested, "B", b);
+    matrix_expression_bind(nested, "C", c);
+
+    assert(1 == matrix_expression_evaluate_into(result, nested).success);
+
+    for (int i = 1; i <= 37; i++) {
+        for (int j = 1; j <= 29; j++) {
+            assert(matrix_get(c, i, j).value - matrix_get(product, i, j).value == matrix_get(result, i, j).value);
+        }
+    }
+
+    delete_matrix_expression(e);
+    delete_matrix_expression(nested);
+    delete_matrix(a);
+    delete_matrix(b);
+    delete_matrix(c);
+    delete_matrix(d);
+    delete_matrix(result);
+    delete_matrix(product);
+}
+
+void test_matrix_expression_errors() {
+    Matrix *a = test_operand(3, 4, 3, 13, 1);
+    Matrix *b = test_operand(3, 4, 5, 13, 1);
+
+    assert(NULL == parse_matrix_expression("A +"));
+    assert(NULL == parse_matrix_expression("(A * B"));
+    assert(NULL == parse_matrix_expression("A B"));
+
+    MatrixExpression *e = parse_matrix_expression("A * B");
+
+    assert(MATRIX_ARGUMENTS_MUST_NOT_BE_NULL == matrix_expression_evaluate(e).code);
+
+    matrix_expression_bind(e, "A", a);
+    matrix_expression_bind(e, "B", b);
+
+    assert(MATRIX_INVALID_DIMENSIONS_TO_MULTIPLY == matrix_expression_evaluate(e).code);
+    assert(MATRIX_DESTINATION_OVERLAPS_ARGUMENTS != matrix_expression_evaluate_into(a, e).code);
+
+    delete_matrix_expression(e);
+
+    e = parse_matrix_expression("(A - B) * (B + 1)");
+    matrix_expression_bind(e, "A", a);
+    matrix_expression_bind(e, "B", b);
+
+    assert(MATRIX_DIMENSIONS_MUST_BE_EQUALS_TO_SUM == matrix_expression_evaluate(e).code);
+
+    delete_matrix_expression(e);
+
+    e = parse_matrix_expression("A + B");
+    matrix_expression_bind(e, "A", a);
+    matrix_expression_bind(e, "B", b);
+
+    assert(MATRIX_DESTINATION_OVERLAPS_ARGUMENTS == matrix_expression_evaluate_into(a, e).code);
+
+    delete_matrix_expression(e);
+    delete_matrix(a);
+    delete_matrix(b);
+}
+
 int main() {
     test_new_matrix();
+    test_new_matrix_storage();
     test_matrix_get_and_set();
     test_new_matrix_with_values();
     test_new_identity_matrix();
     test_transpose_matrix();
+    test_transpose_matrix_blocked();
+    test_transpose_matrix_in_place();
     test_matrix_sum();
     test_matrix_subtract();
+    test_matrix_destination_passing();
+    test_matrix_in_place_operations();
     test_matrix_multiply_1();
     test_matrix_multiply_2();
+    test_matrix_multiply_blocked();
+    test_strassen_multiply_matches_classical();
+    test_simd_kernels_agree_with_scalar();
+    test_thread_pool_parallel_for();
+    test_binary_matrix_file_round_trip();
+    test_binary_matrix_file_errors();
+    test_typed_matrix_arithmetic_matches_float64();
+    test_integer_determinant_bareiss();
+    test_typed_matrix_file_round_trip();
+    test_matrix_batch_matches_single_matrices();
+    test_matrix_batch_file_round_trip();
+    test_fixed_size_kernels_match_generic();
+    test_matrix_allocators();
+    test_sparse_matrix_conversions();
+    test_sparse_matrix_arithmetic_matches_dense();
+    test_parse_matrix_number_matches_strtod();
+    test_read_wide_text_matrix();
+    test_parallel_text_matrix_round_trip();
+    test_format_double_round_trips();
+    test_matrix_server_requests();
+    test_matrix_cache();
+    test_out_of_core_operations();
+    test_streaming_sum_and_subtract();
+    test_matrix_stats_report();
     test_determinant_2x2_laplace();
     test_determinant_2x2_lu_decomposition();
     test_determinant_3x3_laplace();
@@ -398,6 +2192,11 @@ int main() {
     test_determinant_5x5_lu_decomposition();
     test_determinant_6x6_laplace();
     test_determinant_6x6_lu_decomposition();
+    test_determinant_laplace_matches_lu();
+    test_lu_factorization_reuse();
+    test_lu_factorization_of_singular_matrix();
+    test_matrix_expression_evaluation();
+    test_matrix_expression_errors();
 
     printf("All tests passed successfully.");
 }
@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "thread-pool.h"
+
+#define THREAD_POOL_MAX_THREADS 256
+
+typedef struct ThreadPoolJob {
+    ThreadPoolTask task;
+    void *context;
+    int begin;
+    int end;
+    int grain;
+    int chunks;
+    int next_chunk;
+    int finished_chunks;
+} ThreadPoolJob;
+
+typedef struct ThreadPool {
+    int size;
+    pthread_t workers[THREAD_POOL_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    pthread_mutex_t caller_lock;
+    ThreadPoolJob job;
+    unsigned long generation;
+} ThreadPool;
+
+ThreadPool thread_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .job_ready = PTHREAD_COND_INITIALIZER,
+    .job_done = PTHREAD_COND_INITIALIZER,
+    .caller_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+pthread_once_t thread_pool_started = PTHREAD_ONCE_INIT;
+int thread_pool_requested_size = 0;
+__thread int thread_pool_inside_task = 0;
+__thread int thread_pool_worker_index = 0;
+
+// Claims and runs chunks of the current job until none are left.
+// Must be called with thread_pool.lock held; returns with it held.
+void _run_chunks(ThreadPoolJob *job) {
+    while (job->next_chunk < job->chunks) {
+        int chunk = job->next_chunk++;
+        int begin = job->begin + chunk * job->grain;
+        int end = begin + job->grain < job->end ? begin + job->grain : job->end;
+
+        pthread_mutex_unlock(&thread_pool.lock);
+        thread_pool_inside_task = 1;
+        job->task(begin, end, job->context);
+        thread_pool_inside_task = 0;
+        pthread_mutex_lock(&thread_pool.lock);
+
+        if (++job->finished_chunks == job->chunks) {
+            pthread_cond_broadcast(&thread_pool.job_done);
+        }
+    }
+}
+
+void* _worker_main(void *index) {
+    unsigned long seen_generation = 0;
+
+    thread_pool_worker_index = (int) (long) index;
+
+    pthread_mutex_lock(&thread_pool.lock);
+
+    for (;;) {
+        while (thread_pool.generation == seen_generation) {
+            pthread_cond_wait(&thread_pool.job_ready, &thread_pool.lock);
+        }
+
+        seen_generation = thread_pool.generation;
+        _run_chunks(&thread_pool.job);
+    }
+
+    return NULL;
+}
+
+int _default_size() {
+    char *env = getenv("MATRIX_THREADS");
+
+    if (env != NULL && atoi(env) > 0) return atoi(env);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int) cpus : 1;
+}
+
+void _start_pool() {
+    int size = thread_pool_requested_size > 0 ? thread_pool_requested_size : _default_size();
+
+    if (size > THREAD_POOL_MAX_THREADS) size = THREAD_POOL_MAX_THREADS;
+
+    thread_pool.size = 1;
+
+    for (int i = 1; i < size; i++) {
+        if (pthread_create(&thread_pool.workers[i], NULL, _worker_main, (void*) (long) i) != 0) break;
+        pthread_detach(thread_pool.workers[i]);
+        thread_pool.size++;
+    }
+}
+
+void thread_pool_set_size(int threads) {
+    thread_pool_requested_size = threads;
+}
+
+int thread_pool_size() {
+    pthread_once(&thread_pool_started, _start_pool);
+    return thread_pool.size;
+}
+
+int thread_pool_thread_index() {
+    return thread_pool_worker_index;
+}
+
+int thread_pool_grain(long work_per_item, long min_work) {
+    if (work_per_item <= 0) return 1;
+
+    long grain = (min_work + work_per_item - 1) / work_per_item;
+    return grain < 1 ? 1 : grain > 0x7fffffff ? 0x7fffffff : (int) grain;
+}
+
+void thread_pool_parallel_for(int begin, int end, int grain, ThreadPoolTask task, void *context) {
+    if (end <= begin) return;
+    if (grain < 1) grain = 1;
+
+    int chunks = (int) (((long) end - begin + grain - 1) / grain);
+
+    if (chunks <= 1 || thread_pool_inside_task || thread_pool_size() <= 1 ||
+        pthread_mutex_trylock(&thread_pool.caller_lock) != 0) {
+        task(begin, end, context);
+        return;
+    }
+
+    // Never split into more chunks than needed to keep every thread busy a
+    // few times over; larger chunks mean less time under the lock.
+    if (chunks > thread_pool.size * 4) {
+        grain = (int) (((long) end - begin + thread_pool.size * 4 - 1) / (thread_pool.size * 4));
+        chunks = (int) (((long) end - begin + grain - 1) / grain);
+    }
+
+    pthread_mutex_lock(&thread_pool.lock);
+
+    thread_pool.job = (ThreadPoolJob) { task, context, begin, end, grain, chunks, 0, 0 };
+    thread_pool.generation++;
+    pthread_cond_broadcast(&thread_pool.job_ready);
+
+    _run_chunks(&thread_pool.job);
+
+    while (thread_pool.job.finished_chunks < thread_pool.job.chunks) {
+        pthread_cond_wait(&thread_pool.job_done, &thread_pool.lock);
+    }
+
+    pthread_mutex_unlock(&thread_pool.lock);
+    pthread_mutex_unlock(&thread_pool.caller_lock);
+}
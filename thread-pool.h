@@ -0,0 +1,28 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+typedef void (*ThreadPoolTask)(int begin, int end, void *context);
+
+// Sets the number of threads (including the caller) the pool will use.
+// Takes effect only before the pool starts; 0 restores the default, which
+// is MATRIX_THREADS from the environment or the number of online CPUs.
+void thread_pool_set_size(int threads);
+
+int thread_pool_size();
+
+// Runs task over [begin, end) split into chunks of at least grain items,
+// on the pool workers and the calling thread, and returns once all chunks
+// are done. Ranges that fit in one chunk, and calls made from inside a
+// task or while the pool is busy with another caller, run inline.
+void thread_pool_parallel_for(int begin, int end, int grain, ThreadPoolTask task, void *context);
+
+// Index of the calling thread within the pool: 0 for threads outside the
+// pool, 1 to thread_pool_size() - 1 for workers. Tasks use it to pick
+// per-thread scratch buffers.
+int thread_pool_thread_index();
+
+// Number of items per chunk so that each chunk does at least min_work units
+// of work when every item costs work_per_item.
+int thread_pool_grain(long work_per_item, long min_work);
+
+#endif // THREAD_POOL_H
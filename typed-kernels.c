@@ -0,0 +1,142 @@
+#include <math.h>
+#include <string.h>
+#include "typed-kernels.h"
+#include "simd.h"
+
+// Columns of C and rows of B per block: a block of B (256 KiB at most)
+// stays in cache while every row of A in the range goes over it, and the
+// slice of a row of C being accumulated stays in L1.
+#define TYPED_MULTIPLY_COLUMNS 512
+#define TYPED_MULTIPLY_DEPTH 128
+
+#pragma GCC push_options
+#pragma GCC optimize ("tree-vectorize", "vect-cost-model=dynamic")
+
+// type is the element type; wide is the type arithmetic is carried out in
+// (the unsigned counterpart for integers, so that overflow wraps instead
+// of being undefined).
+#define DEFINE_TYPED_KERNELS(name, type, wide, min, max)                                        \
+    MATRIX_VECTORIZE_CLONES                                                                     \
+    void _typed_add_##name(void *dst, const void *a, const void *b, int n) {                    \
+        type *restrict d = dst;                                                                 \
+        const type *restrict x = a, *restrict y = b;                                            \
+        for (int i = 0; i < n; i++) d[i] = (type) ((wide) x[i] + (wide) y[i]);                  \
+    }                                                                                           \
+                                                                                                \
+    MATRIX_VECTORIZE_CLONES                                                                     \
+    void _typed_subtract_##name(void *dst, const void *a, const void *b, int n) {               \
+        type *restrict d = dst;                                                                 \
+        const type *restrict x = a, *restrict y = b;                                            \
+        for (int i = 0; i < n; i++) d[i] = (type) ((wide) x[i] - (wide) y[i]);                  \
+    }                                                                                           \
+                                                                                                \
+    int _typed_equals_##name(const void *a, const void *b, int n) {                             \
+        const type *x = a, *y = b;                                                              \
+        for (int i = 0; i < n; i++) {                                                           \
+            if (x[i] != y[i]) return 0;                                                         \
+        }                                                                                       \
+        return 1;                                                                               \
+    }                                                                                           \
+                                                                                                \
+    MATRIX_VECTORIZE_CLONES                                                                     \
+    void _typed_multiply_rows_##name(                                                           \
+        int begin, int end, int n, int k,                                                       \
+        const void *a, int lda, const void *b, int ldb, void *c, int ldc                        \
+    ) {                                                                                         \
+        for (int i = begin; i < end; i++) {                                                     \
+            memset((type*) c + (size_t) i * ldc, 0, n * sizeof(type));                          \
+        }                                                                                       \
+                                                                                                \
+        for (int j0 = 0; j0 < n; j0 += TYPED_MULTIPLY_COLUMNS) {                                \
+            int width = n - j0 < TYPED_MULTIPLY_COLUMNS ? n - j0 : TYPED_MULTIPLY_COLUMNS;      \
+                                                                                                \
+            for (int p0 = 0; p0 < k; p0 += TYPED_MULTIPLY_DEPTH) {                              \
+                int depth = k - p0 < TYPED_MULTIPLY_DEPTH ? k - p0 : TYPED_MULTIPLY_DEPTH;      \
+                                                                                                \
+                for (int i = begin; i < end; i++) {                                             \
+                    const type *a_row = (const type*) a + (size_t) i * lda + p0;                \
+                    type *restrict c_row = (type*) c + (size_t) i * ldc + j0;                   \
+                                                                                                \
+                    for (int p = 0; p < depth; p++) {                                           \
+                        wide factor = (wide) a_row[p];                                          \
+                        const type *restrict b_row =                                            \
+                            (const type*) b + (size_t) (p0 + p) * ldb + j0;                     \
+                                                                                                \
+                        for (int j = 0; j < width; j++) {                                       \
+                            c_row[j] = (type) ((wide) c_row[j] + factor * (wide) b_row[j]);     \
+                        }                                                                       \
+                    }                                                                           \
+                }                                                                               \
+            }                                                                                   \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    void _typed_transpose_##name(                                                               \
+        const void *src, int src_stride, void *dst, int dst_stride, int rows, int cols          \
+    ) {                                                                                         \
+        const type *s = src;                                                                    \
+        type *d = dst;                                                                          \
+        for (int i = 0; i < rows; i++) {                                                        \
+            for (int j = 0; j < cols; j++) {                                                    \
+                d[(size_t) j * dst_stride + i] = s[(size_t) i * src_stride + j];                \
+            }                                                                                   \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    double _typed_get_##name(const void *values, size_t index) {                                \
+        return (double) ((const type*) values)[index];                                          \
+    }                                                                                           \
+                                                                                                \
+    int64_t _typed_get_integer_##name(const void *values, size_t index) {                       \
+        return (int64_t) ((const type*) values)[index];                                         \
+    }                                                                                           \
+                                                                                                \
+    int _typed_set_integer_##name(void *values, size_t index, int64_t value) {                  \
+        if ((double) value < (double) (min) || (double) value > (double) (max)) return 0;       \
+        ((type*) values)[index] = (type) value;                                                 \
+        return 1;                                                                               \
+    }
+
+DEFINE_TYPED_KERNELS(float64, double, double, -INFINITY, INFINITY)
+DEFINE_TYPED_KERNELS(float32, float, float, -INFINITY, INFINITY)
+DEFINE_TYPED_KERNELS(int32, int32_t, uint32_t, INT32_MIN, INT32_MAX)
+DEFINE_TYPED_KERNELS(int64, int64_t, uint64_t, INT64_MIN, INT64_MAX)
+
+#pragma GCC pop_options
+
+void _typed_set_float64(void *values, size_t index, double value) {
+    ((double*) values)[index] = value;
+}
+
+void _typed_set_float32(void *values, size_t index, double value) {
+    ((float*) values)[index] = (float) value;
+}
+
+// Integer elements take the nearest integer, saturating at the limits.
+void _typed_set_int32(void *values, size_t index, double value) {
+    value = nearbyint(value);
+    ((int32_t*) values)[index] = value <= INT32_MIN ? INT32_MIN : value >= INT32_MAX ? INT32_MAX : (int32_t) value;
+}
+
+void _typed_set_int64(void *values, size_t index, double value) {
+    value = nearbyint(value);
+    ((int64_t*) values)[index] = value <= -0x1p63 ? INT64_MIN : value >= 0x1p63 ? INT64_MAX : (int64_t) value;
+}
+
+#define TYPED_KERNELS_ENTRY(type_tag, name, type, is_integer) {                                 \
+    type_tag, sizeof(type), is_integer,                                                         \
+    _typed_add_##name, _typed_subtract_##name, _typed_equals_##name,                            \
+    _typed_multiply_rows_##name, _typed_transpose_##name,                                       \
+    _typed_get_##name, _typed_set_##name, _typed_get_integer_##name, _typed_set_integer_##name  \
+}
+
+const TypedKernels TYPED_KERNELS[] = {
+    TYPED_KERNELS_ENTRY(MATRIX_FLOAT64, float64, double, 0),
+    TYPED_KERNELS_ENTRY(MATRIX_FLOAT32, float32, float, 0),
+    TYPED_KERNELS_ENTRY(MATRIX_INT32, int32, int32_t, 1),
+    TYPED_KERNELS_ENTRY(MATRIX_INT64, int64, int64_t, 1)
+};
+
+const TypedKernels* typed_kernels(MatrixElementType type) {
+    return &TYPED_KERNELS[type];
+}
@@ -0,0 +1,39 @@
+#ifndef TYPED_KERNELS_H
+#define TYPED_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "matrix.h"
+
+// Kernels for one element type, generated from a single macro. float64
+// matrices keep using the hand-written SIMD kernels of simd.h for their
+// arithmetic; this table still serves them for element access. Integer
+// arithmetic wraps around on overflow, as with unsigned C types.
+typedef struct TypedKernels {
+    MatrixElementType type;
+    size_t size;
+    int is_integer;
+
+    void (*add)(void *dst, const void *a, const void *b, int n);
+    void (*subtract)(void *dst, const void *a, const void *b, int n);
+    int (*equals)(const void *a, const void *b, int n);
+
+    // Rows [begin, end) of C = A * B, where A has k columns and C has n.
+    void (*multiply_rows)(
+        int begin, int end, int n, int k,
+        const void *a, int lda, const void *b, int ldb, void *c, int ldc
+    );
+
+    // Transposes a rows x cols tile.
+    void (*transpose)(const void *src, int src_stride, void *dst, int dst_stride, int rows, int cols);
+
+    double (*get)(const void *values, size_t index);
+    void (*set)(void *values, size_t index, double value);
+    int64_t (*get_integer)(const void *values, size_t index);
+    // Returns 0 if the value does not fit the element type.
+    int (*set_integer)(void *values, size_t index, int64_t value);
+} TypedKernels;
+
+const TypedKernels* typed_kernels(MatrixElementType type);
+
+#endif // TYPED_KERNELS_H